@@ -0,0 +1,320 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "common_generated.h"
+#include "flatbuffers/util.h"
+#include "fplbase/atlas_packer.h"
+#include "texture_atlas_generated.h"
+
+// The stdlib build of fplbase leaves the STB implementations to the
+// application.
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+using fplbase::AtlasPacker;
+using mathfu::vec2i;
+
+static const int kDefaultPageSize = 1024;
+static const int kDefaultPadding = 2;
+static const int kBytesPerPixel = 4;
+
+struct AtlasPipelineArgs {
+  AtlasPipelineArgs()
+      : page_size(kDefaultPageSize), padding(kDefaultPadding), bleed(false) {}
+  std::vector<std::string> images;  /// The loose image files to pack.
+  std::string output_file;          /// The output fplatlas file.
+  std::string texture_path;  /// Prefix of page textures named in the atlas.
+  int page_size;             /// Width and height of each page, in pixels.
+  int padding;               /// Empty pixels around every image.
+  bool bleed;                /// Extend image edges into the padding.
+};
+
+// A loose image, and where it ended up.
+struct AtlasImage {
+  AtlasImage() : pixels(nullptr), page(0) {}
+  std::string name;
+  uint8_t* pixels;
+  vec2i size;
+  vec2i position;
+  int page;
+};
+
+static bool ParseAtlasPipelineArgs(int argc, char** argv,
+                                   AtlasPipelineArgs* args) {
+  bool valid_args = true;
+
+  // Last parameter is used as the output file.
+  if (argc > 1) {
+    args->output_file = std::string(argv[argc - 1]);
+  } else {
+    valid_args = false;
+  }
+
+  // Parse switches.
+  for (int i = 1; i < argc - 1; ++i) {
+    const std::string arg = argv[i];
+
+    // -s switch
+    if (arg == "-s" || arg == "--page-size") {
+      if (i < argc - 2) {
+        ++i;
+        args->page_size = atoi(argv[i]);
+        if (args->page_size <= 0) valid_args = false;
+      } else {
+        valid_args = false;
+      }
+
+      // -p switch
+    } else if (arg == "-p" || arg == "--padding") {
+      if (i < argc - 2) {
+        ++i;
+        args->padding = atoi(argv[i]);
+        if (args->padding < 0) valid_args = false;
+      } else {
+        valid_args = false;
+      }
+
+      // -b switch
+    } else if (arg == "-b" || arg == "--bleed") {
+      args->bleed = true;
+
+      // -t switch
+    } else if (arg == "-t" || arg == "--texture-path") {
+      if (i < argc - 2) {
+        ++i;
+        args->texture_path = std::string(argv[i]);
+      } else {
+        valid_args = false;
+      }
+
+      // all other (non-empty) arguments are images
+    } else if (arg != "" && arg[0] == '-') {
+      printf("Unknown parameter: %s\n", arg.c_str());
+      valid_args = false;
+    } else if (arg != "") {
+      args->images.push_back(arg);
+    }
+
+    if (!valid_args) break;
+  }
+
+  if (args->images.empty()) valid_args = false;
+
+  // Print usage.
+  if (!valid_args) {
+    printf(
+        "Usage: atlas_pipeline [options] IMAGE... OUTPUT_FILE\n"
+        "\n"
+        "Pipeline to pack loose images into a texture atlas. Writes the\n"
+        "fplatlas file OUTPUT_FILE, and its pages as PNG files next to it,\n"
+        "named after OUTPUT_FILE with the page number appended. Subtextures\n"
+        "are named after their image file, without directory or extension.\n"
+        "Images that don't fit on one page spill onto more pages.\n"
+        "\n"
+        "Options:\n"
+        "  -s, --page-size PIXELS     Page width and height (default %d).\n"
+        "  -p, --padding PIXELS       Space around every image (default %d).\n"
+        "  -b, --bleed                Extend image edges into the padding,\n"
+        "                             so filtering doesn't pick up the\n"
+        "                             transparent space between images.\n"
+        "  -t, --texture-path PATH    Directory of the pages, as passed to\n"
+        "                             AssetManager::LoadTexture().\n",
+        kDefaultPageSize, kDefaultPadding);
+  }
+
+  return valid_args;
+}
+
+// Returns the file name without its directory and extension.
+static std::string BaseName(const std::string& filename) {
+  const size_t slash = filename.find_last_of("/\\");
+  std::string name =
+      slash == std::string::npos ? filename : filename.substr(slash + 1);
+  const size_t dot = name.find_last_of('.');
+  return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// Returns the file name without its extension.
+static std::string RemoveExtension(const std::string& filename) {
+  const size_t dot = filename.find_last_of('.');
+  const size_t slash = filename.find_last_of("/\\");
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return filename;
+  }
+  return filename.substr(0, dot);
+}
+
+// Copies `image` into `page` at its position. With `bleed`, the padding
+// around it is filled with the nearest edge pixel of the image.
+static void BlitImage(const AtlasImage& image, int page_size, int padding,
+                      bool bleed, uint8_t* page) {
+  const int border = bleed ? padding : 0;
+  for (int y = -border; y < image.size.y() + border; ++y) {
+    const int src_y = std::min(std::max(y, 0), image.size.y() - 1);
+    for (int x = -border; x < image.size.x() + border; ++x) {
+      const int src_x = std::min(std::max(x, 0), image.size.x() - 1);
+      const uint8_t* src =
+          image.pixels + (src_y * image.size.x() + src_x) * kBytesPerPixel;
+      uint8_t* dest =
+          page + ((image.position.y() + y) * page_size + image.position.x() +
+                  x) * kBytesPerPixel;
+      memcpy(dest, src, kBytesPerPixel);
+    }
+  }
+}
+
+bool WriteFlatBufferBuilder(const flatbuffers::FlatBufferBuilder& fbb,
+                            const std::string& filename) {
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (file) {
+    fwrite(fbb.GetBufferPointer(), 1, fbb.GetSize(), file);
+    fclose(file);
+    return true;
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  // Parse the command line arguments.
+  AtlasPipelineArgs args;
+  if (!ParseAtlasPipelineArgs(argc, argv, &args)) {
+    return 1;
+  }
+
+  // Load all images as RGBA.
+  std::vector<AtlasImage> images(args.images.size());
+  std::set<std::string> names;
+  int result = 0;
+  for (size_t i = 0; i < images.size() && result == 0; ++i) {
+    AtlasImage& image = images[i];
+    image.name = BaseName(args.images[i]);
+    if (!names.insert(image.name).second) {
+      printf("Two images are named %s.\n", image.name.c_str());
+      result = 1;
+      break;
+    }
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    image.pixels = stbi_load(args.images[i].c_str(), &width, &height,
+                             &channels, kBytesPerPixel);
+    if (!image.pixels) {
+      printf("Unable to load image: %s\n%s\n", args.images[i].c_str(),
+             stbi_failure_reason());
+      result = 1;
+      break;
+    }
+    image.size = vec2i(width, height);
+  }
+
+  // Place the biggest images first, onto the first page with room for them.
+  std::vector<size_t> order(images.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&images](size_t a, size_t b) {
+    const vec2i& sa = images[a].size;
+    const vec2i& sb = images[b].size;
+    return std::max(sa.x(), sa.y()) > std::max(sb.x(), sb.y());
+  });
+  const vec2i page_size(args.page_size, args.page_size);
+  std::vector<AtlasPacker> packers;
+  for (size_t i = 0; i < order.size() && result == 0; ++i) {
+    AtlasImage& image = images[order[i]];
+    size_t page = 0;
+    while (page < packers.size() &&
+           !packers[page].Insert(image.size, &image.position)) {
+      ++page;
+    }
+    if (page == packers.size()) {
+      packers.push_back(AtlasPacker(page_size, args.padding));
+      if (!packers.back().Insert(image.size, &image.position)) {
+        printf("%s (%dx%d) doesn't fit on a %dx%d page.\n",
+               image.name.c_str(), image.size.x(), image.size.y(),
+               args.page_size, args.page_size);
+        result = 1;
+      }
+    }
+    image.page = static_cast<int>(page);
+  }
+
+  // Draw and save the pages.
+  std::vector<std::string> page_names;
+  const std::string page_base = RemoveExtension(args.output_file);
+  for (size_t page = 0; page < packers.size() && result == 0; ++page) {
+    std::vector<uint8_t> pixels(
+        static_cast<size_t>(args.page_size) * args.page_size * kBytesPerPixel,
+        0);
+    for (auto it = images.begin(); it != images.end(); ++it) {
+      if (it->page != static_cast<int>(page)) continue;
+      BlitImage(*it, args.page_size, args.padding, args.bleed, pixels.data());
+    }
+    const std::string page_file =
+        page_base + "_" + flatbuffers::NumToString(page) + ".png";
+    if (!stbi_write_png(page_file.c_str(), args.page_size, args.page_size,
+                        kBytesPerPixel, pixels.data(),
+                        args.page_size * kBytesPerPixel)) {
+      printf("Could not write %s.\n", page_file.c_str());
+      result = 1;
+    }
+    page_names.push_back(args.texture_path + BaseName(page_file) + ".png");
+    printf("%s: %.0f%% occupied.\n", page_file.c_str(),
+           packers[page].Occupancy() * 100.0f);
+  }
+
+  if (result == 0) {
+    // Create the FlatBuffer for the TextureAtlas, with the entries in the
+    // order the images were given.
+    flatbuffers::FlatBufferBuilder fbb;
+    std::vector<flatbuffers::Offset<atlasdef::TextureAtlasEntry>> entries;
+    const float scale = 1.0f / args.page_size;
+    for (auto it = images.begin(); it != images.end(); ++it) {
+      const fplbase::Vec2 location(it->position.x() * scale,
+                                   it->position.y() * scale);
+      const fplbase::Vec2 size(it->size.x() * scale, it->size.y() * scale);
+      entries.push_back(atlasdef::CreateTextureAtlasEntry(
+          fbb, fbb.CreateString(it->name), &location, &size,
+          static_cast<uint16_t>(it->page)));
+    }
+    std::vector<flatbuffers::Offset<flatbuffers::String>> pages;
+    for (auto it = page_names.begin(); it != page_names.end(); ++it) {
+      pages.push_back(fbb.CreateString(*it));
+    }
+    auto atlas_fb = atlasdef::CreateTextureAtlas(
+        fbb, fbb.CreateString(page_names[0]), fbb.CreateVector(entries),
+        fbb.CreateVector(pages));
+    atlasdef::FinishTextureAtlasBuffer(fbb, atlas_fb);
+
+    // Save the TextureAtlas FlatBuffer to disk.
+    if (!WriteFlatBufferBuilder(fbb, args.output_file)) {
+      printf("Could not open %s for writing.\n", args.output_file.c_str());
+      result = 1;
+    }
+  }
+
+  for (auto it = images.begin(); it != images.end(); ++it) {
+    if (it->pixels) stbi_image_free(it->pixels);
+  }
+  return result;
+}
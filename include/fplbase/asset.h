@@ -16,11 +16,24 @@
 #define FPLBASE_ASSET_H
 
 #include <assert.h>
+#include <stddef.h>
 
 namespace fplbase {
 
 class AssetManager;
 
+/// @struct AssetMemoryUsage
+/// @brief Estimated memory held by an asset, in bytes.
+struct AssetMemoryUsage {
+  AssetMemoryUsage() : cpu_bytes(0), gpu_bytes(0) {}
+
+  /// @brief Sum of CPU and GPU bytes.
+  size_t total() const { return cpu_bytes + gpu_bytes; }
+
+  size_t cpu_bytes;
+  size_t gpu_bytes;
+};
+
 /// @class Asset
 /// @brief Base class of all assets that _may_ be managed by Assetmanager.
 class Asset {
@@ -30,12 +43,17 @@ class Asset {
 
   /// @brief indicate there is an additional owner of this asset.
   /// By default, when you call any of the UnLoad*() functions in the
-  /// AssetManager, that will directly delete the asset since they all start
-  /// out with a single reference count. Call this function to indicate
+  /// AssetManager, that will directly delete the asset (or keep it as unused,
+  /// see AssetManager::set_memory_budget()) since they all start out with a
+  /// single reference count. Call this function to indicate
   /// multiple owners will call Unload*() independently, and only have the
   /// asset deleted by the last one.
   void IncreaseRefCount() { refcount_++; }
 
+  /// @brief Estimate the memory this asset holds, not counting other assets
+  /// it refers to. Used by AssetManager to keep within its memory budget.
+  virtual AssetMemoryUsage MemoryUsage() const { return AssetMemoryUsage(); }
+
  private:
   // This is private, since only the AssetManager can delete assets.
   friend class AssetManager;
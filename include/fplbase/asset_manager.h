@@ -15,16 +15,28 @@
 #ifndef FPLBASE_ASSET_MANAGER_H
 #define FPLBASE_ASSET_MANAGER_H
 
+#include <list>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "fplbase/config.h"  // Must come first.
 
+#include "fplbase/asset_telemetry.h"
 #include "fplbase/async_loader.h"
+#include "fplbase/file_watcher.h"
 #include "fplbase/fpl_common.h"
 #include "fplbase/renderer.h"
+#include "fplbase/shader_permutations.h"
 #include "fplbase/texture_atlas.h"
 
+namespace matdef {
+struct Material;
+}
+
 namespace fplbase {
 
 /// @file
@@ -37,9 +49,45 @@ class FileAsset : public AsyncAsset {
   virtual void Load();
   virtual void Finalize();
  public:
+  virtual AssetMemoryUsage MemoryUsage() const {
+    AssetMemoryUsage usage;
+    usage.cpu_bytes = contents.size();
+    return usage;
+  }
+
   std::string contents;
 };
 
+/// @brief The kinds of asset an AssetManager holds.
+enum AssetType {
+  kAssetTypeShader,
+  kAssetTypeTexture,
+  kAssetTypeMaterial,
+  kAssetTypeMesh,
+  kAssetTypeTextureAtlas,
+  kAssetTypeFile,
+  kAssetTypeShaderPermutations,
+  kAssetTypeCount
+};
+
+/// @struct AssetMemoryStats
+/// @brief Memory held by a group of assets.
+struct AssetMemoryStats {
+  AssetMemoryStats() : count(0), unused_count(0), unused_bytes(0) {}
+
+  /// @brief Number of assets held, including unused ones.
+  size_t count;
+  /// @brief Estimated memory of all assets held.
+  AssetMemoryUsage usage;
+  /// @brief Number of unused assets, which are kept after being unloaded
+  /// until the memory budget requires deleting them.
+  size_t unused_count;
+  /// @brief Estimated memory of the unused assets, CPU and GPU together.
+  size_t unused_bytes;
+};
+
+class AssetReload;
+
 /// @class AssetManager
 /// @brief Central place to own game assets loaded from disk.
 ///
@@ -57,12 +105,7 @@ class AssetManager {
   AssetManager(Renderer &renderer);
 
   /// @brief AssetManager destructor that purges all assets.
-  ~AssetManager() {
-    // Stop loading before clearing assets, since any pending assets need to be
-    // valid when loader calls Finalize().
-    loader_.Stop();
-    ClearAllAssets();
-  }
+  ~AssetManager();
 
   /// @brief Returns a previously loaded shader object.
   ///
@@ -130,6 +173,29 @@ class AssetManager {
   /// @param filename The name of the shader to unload.
   void UnloadShader(const char *filename);
 
+  /// @brief Returns previously loaded shader permutations.
+  ///
+  /// @param filename The name of the shader file.
+  /// @return Returns the permutations, or nullptr if not previously loaded.
+  ShaderPermutations *FindShaderPermutations(const char *filename);
+
+  /// @brief Load all variants of a shader built by shader_pipeline.
+  ///
+  /// Only reads the file: each variant is compiled when first used, or when
+  /// prewarmed. Also works for files without features, which have a single
+  /// variant.
+  /// @param filename Name of the shader file to load.
+  /// @return Returns nullptr if the file can't be loaded.
+  ShaderPermutations *LoadShaderPermutations(const char *filename);
+
+  /// @brief Deletes previously loaded shader permutations, and all the
+  /// variants compiled from them.
+  ///
+  /// If its reference count was >1, it will be decreased instead of unloaded.
+  ///
+  /// @param filename The name of the shader file to unload.
+  void UnloadShaderPermutations(const char *filename);
+
   /// @brief Returns a previously created texture.
   ///
   /// @param filename The name of the texture.
@@ -164,6 +230,9 @@ class AssetManager {
   /// Call this repeatedly until it returns true, which signals all textures
   /// will have loaded, and turned into OpenGL textures.
   /// Textures with a 0 id will have failed to load.
+  /// Each call also compiles one shader variant queued with
+  /// ShaderPermutations::Prewarm(), and doesn't return true until all of them
+  /// have compiled.
   ///
   /// @return Returns true when all textures have been loaded.
   bool TryFinalize();
@@ -299,11 +368,130 @@ class AssetManager {
   /// on low RAM devices.
   void SetTextureScale(const mathfu::vec2 &scale) { texture_scale_ = scale; }
 
+  /// @brief Timings, sizes and cache hits of every Load*() call.
+  ///
+  /// Use AssetLoadTelemetry::SaveCsv() or AssetLoadTelemetry::SaveJson() after
+  /// startup to find the slowest assets.
+  AssetLoadTelemetry &load_telemetry() { return load_telemetry_; }
+
+  /// @brief Keep unloaded assets cached while memory allows.
+  ///
+  /// When an Unload*() call drops an asset's reference count to zero, the
+  /// asset is kept as unused, and a later Load*() of it reuses it. Unused
+  /// assets are deleted, least recently unloaded first, while the estimated
+  /// memory of all assets held is over `bytes`. The default of 0 deletes
+  /// assets as soon as they are unloaded.
+  ///
+  /// Find*() still returns unused assets, but they may be deleted by any
+  /// Unload*() call.
+  void set_memory_budget(size_t bytes);
+
+  /// @brief The memory budget set with set_memory_budget().
+  size_t memory_budget() const { return memory_budget_; }
+
+  /// @brief Estimated memory held by assets of one type.
+  AssetMemoryStats MemoryStats(AssetType type) const;
+
+  /// @brief Estimated memory held by all assets.
+  AssetMemoryStats TotalMemoryStats() const;
+
+  /// @brief Delete unused assets until within the memory budget.
+  ///
+  /// Called by set_memory_budget(). Unload*() does the same, with an estimate
+  /// of the memory held that is only added up again after assets were
+  /// loaded. Call it after loading assets to make room for them straight
+  /// away.
+  void EnforceMemoryBudget();
+
+  /// @brief Delete all unused assets, whatever the memory budget.
+  void PurgeUnusedAssets();
+
+  /// @brief Reload assets when their files change on disk.
+  ///
+  /// While enabled, the files of shaders (including the files they
+  /// \#include), textures, materials and file assets loaded from then on are
+  /// watched. When any of them change, the asset is loaded again on the
+  /// loader thread, and TryFinalize() swaps the result into the existing
+  /// object, so pointers to it stay valid. If the new version fails to load,
+  /// the old one is kept. Meshes and texture atlases aren't reloaded.
+  ///
+  /// Meant for iterating on assets in development builds. Enable it before
+  /// loading anything, and keep calling TryFinalize() every frame.
+  ///
+  /// @param enable Whether to watch files. Disabling stops watching all files.
+  void EnableHotReload(bool enable);
+
+  /// @brief Whether EnableHotReload() is on.
+  bool hot_reload_enabled() const { return file_watcher_ != nullptr; }
+
+  /// @brief Queue loads of all watched assets whose files changed.
+  ///
+  /// Called by TryFinalize() while hot reload is enabled. Starts the loader
+  /// thread if StartLoadingTextures() hasn't yet.
+  ///
+  /// @return Returns the number of assets queued for reloading.
+  int ReloadChangedAssets();
+
  private:
    Shader *LoadShaderHelper(const char *basename, const char * const *defines,
                             bool should_reload);
   FPL_DISALLOW_COPY_AND_ASSIGN(AssetManager);
 
+  struct UnusedAsset {
+    AssetType type;
+    std::string name;
+    Asset *asset;
+  };
+
+  // What to load again when any of `files` change.
+  struct HotReloadInfo {
+    HotReloadInfo() : type(kAssetTypeCount), from_glsl(false) {}
+    HotReloadInfo(AssetType type, const std::string &name)
+        : type(type), name(name), from_glsl(false) {
+      files.insert(name);
+    }
+
+    AssetType type;
+    std::string name;
+    // For shaders loaded from .glslv and .glslf files, rather than from a
+    // shader_pipeline file.
+    bool from_glsl;
+    std::vector<std::string> defines;
+    std::set<std::string> files;
+  };
+
+  // Drop a reference to `asset`. Returns true if it was the last one.
+  bool Release(Asset *asset);
+  // Make `asset` used again if it was unused.
+  template <typename T>
+  T *Reuse(T *asset);
+  void MarkUnused(AssetType type, const char *name, Asset *asset);
+  void RemoveUnused(const Asset *asset);
+  // Delete an asset that has no references left. Returns the estimated
+  // memory freed.
+  size_t DeleteAsset(AssetType type, const std::string &name, Asset *asset);
+  // Delete unused assets while memory_total_ is over the budget.
+  void EvictUnused();
+  // Set the blend mode and textures of `mat` from `matdef`, taking a
+  // reference to each texture and dropping those to its previous textures.
+  void SetUpMaterial(const matdef::Material *matdef, Material *mat);
+  // Drop a reference to each of `textures`, deleting those left unreferenced.
+  // Returns the estimated memory freed.
+  size_t ReleaseTextures(const std::vector<Texture *> &textures);
+  template <typename T>
+  void AddMemoryStats(const std::map<std::string, T *> &asset_map,
+                      AssetMemoryStats *stats) const;
+  // Like Renderer::RecompileShader, but keeps the shader's reference count.
+  bool RecompileShader(Shader *shader, const std::string &vs_source,
+                       const std::string &ps_source);
+  // Start watching the files of `asset`, if hot reload is enabled.
+  void WatchAsset(const Asset *asset, const HotReloadInfo &info);
+  // Stop watching `asset` and drop its queued reloads, before deleting it.
+  void CancelReloads(const Asset *asset);
+  // Called by AssetReload::Finalize(). Deletes `reload`.
+  void FinishReload(AssetReload *reload);
+  bool ApplyReload(AssetReload *reload);
+
   // This implements the mechanism for each asset to be both loadable
   // sync or async.
   // It gets passed a blank asset that we take ownership of, and the map it
@@ -331,8 +519,31 @@ class AssetManager {
   std::map<std::string, Material *> material_map_;
   std::map<std::string, Mesh *> mesh_map_;
   std::map<std::string, FileAsset *> file_map_;
+  std::map<std::string, ShaderPermutations *> shader_permutations_map_;
+  // Declared before loader_, since its thread records into this.
+  AssetLoadTelemetry load_telemetry_;
   AsyncLoader loader_;
   mathfu::vec2 texture_scale_;
+  // Assets whose reference count has dropped to zero, least recently
+  // unloaded first.
+  std::list<UnusedAsset> unused_assets_;
+  std::unordered_map<const Asset *, std::list<UnusedAsset>::iterator>
+      unused_index_;
+  size_t memory_budget_;
+  // Estimated memory of all assets, kept up to date as assets are deleted so
+  // that each Unload*() doesn't add up every asset again. Only valid while
+  // memory_total_valid_; loading changes how much memory assets take.
+  size_t memory_total_;
+  bool memory_total_valid_;
+  bool loader_started_;
+  // Set while hot reload is enabled.
+  std::unique_ptr<FileWatcher> file_watcher_;
+  std::unordered_map<const Asset *, HotReloadInfo> hot_reload_assets_;
+  // Reloads queued on loader_ but not finalized yet.
+  std::vector<AssetReload *> pending_reloads_;
+
+  friend class AssetReload;
+  friend class ScopedAssetLoad;
 };
 
 /// @}
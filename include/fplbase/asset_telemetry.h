@@ -0,0 +1,218 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_ASSET_TELEMETRY_H
+#define FPLBASE_ASSET_TELEMETRY_H
+
+#include <stdint.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "fplbase/fpl_common.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_asset_manager
+/// @{
+
+/// @brief The parts of an asset load that are timed separately.
+enum AssetLoadPhase {
+  kAssetLoadPhaseRead,    ///< @brief Reading files, through LoadFile().
+  kAssetLoadPhaseDecode,  ///< @brief Unpacking and parsing the file data.
+  kAssetLoadPhaseUpload,  ///< @brief Creating GL objects from decoded data.
+  kAssetLoadPhaseCount
+};
+
+/// @brief Names of the phases, as used in the CSV and JSON exports.
+const char *const *AssetLoadPhaseNames();
+
+/// @struct AssetLoadRecord
+/// @brief Timings and sizes of a single asset load.
+struct AssetLoadRecord {
+  /// @brief The kind of asset, such as "texture" or "mesh".
+  const char *kind;
+  /// @brief The file name the asset was loaded with.
+  std::string name;
+  /// @brief Seconds from the start of the telemetry to the load being
+  /// requested, and to it finishing. `end` is negative while in progress.
+  double start;
+  double end;
+  /// @brief Seconds spent in each phase, on whichever thread did the work.
+  double phase_seconds[kAssetLoadPhaseCount];
+  /// @brief Bytes read from files, and bytes of decoded data staged in CPU
+  /// memory before upload.
+  size_t bytes_read;
+  size_t bytes_decoded;
+  bool async;
+  bool failed;
+
+  /// @brief Seconds spent in all phases. Time spent waiting in the async
+  /// queue is not included.
+  double TotalSeconds() const;
+};
+
+/// @struct AssetCacheCounts
+/// @brief How many Load*() calls found an already loaded asset.
+struct AssetCacheCounts {
+  AssetCacheCounts() : hits(0), misses(0) {}
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/// @class AssetLoadTelemetry
+/// @brief Per-asset load timings, sizes and cache-hit counts.
+///
+/// The AssetManager owns one of these, and records each load in it. Loads may
+/// be recorded from any thread.
+class AssetLoadTelemetry {
+ public:
+  AssetLoadTelemetry();
+  ~AssetLoadTelemetry();
+
+  /// @brief Start recording the load of an asset.
+  /// @return Returns the record id, or -1 if disabled.
+  int BeginAsset(const char *kind, const std::string &name, bool async);
+
+  /// @brief Add time spent in `phase` to a record.
+  void AddPhaseTime(int record, AssetLoadPhase phase, double seconds);
+
+  /// @brief Add bytes read and decoded to a record. Decoded bytes count as
+  /// staging memory until EndAsset().
+  void AddBytes(int record, size_t bytes_read, size_t bytes_decoded);
+
+  /// @brief Finish a record, releasing its staging memory.
+  void EndAsset(int record, bool succeeded);
+
+  /// @brief Count a Load*() call that found, or didn't find, the asset
+  /// already loaded.
+  void CountLookup(const char *kind, bool hit);
+
+  /// @brief Decoded bytes of loads that haven't finished yet.
+  size_t staging_bytes() const;
+
+  /// @brief The most staging_bytes() has been since the last Clear().
+  size_t peak_staging_bytes() const;
+
+  /// @brief Copy of all records, in the order the loads were requested.
+  std::vector<AssetLoadRecord> Records() const;
+
+  /// @brief The slowest `fraction` of records by TotalSeconds(), slowest
+  /// first. At least one record is returned if there are any.
+  std::vector<AssetLoadRecord> SlowestRecords(double fraction) const;
+
+  /// @brief Cache counts for one kind of asset, or for all if `kind` is null.
+  AssetCacheCounts CacheCounts(const char *kind) const;
+
+  /// @brief All records as CSV, one line per asset, with a header line.
+  /// Times are in milliseconds.
+  std::string ToCsv() const;
+
+  /// @brief All records, cache counts and peak staging memory as JSON.
+  /// Times are in milliseconds.
+  std::string ToJson() const;
+
+  /// @brief Save ToCsv() to a file.
+  bool SaveCsv(const char *filename) const;
+
+  /// @brief Save ToJson() to a file.
+  bool SaveJson(const char *filename) const;
+
+  /// @brief Remove all records and counts. Loads still in progress are no
+  /// longer recorded.
+  void Clear();
+
+  /// @brief Turn recording on or off. On by default.
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  // Returns the record for `id`, or null. Must hold mutex_.
+  AssetLoadRecord *Find(int id);
+  double Now() const;
+
+  // Guards everything below. An SDL_mutex or a std::mutex, depending on the
+  // backend.
+  void *mutex_;
+  Clock::time_point epoch_;
+  std::vector<AssetLoadRecord> records_;
+  // Id of records_[0]. Ids before it belong to records removed by Clear().
+  int first_id_;
+  std::map<std::string, AssetCacheCounts> cache_counts_;
+  size_t staging_bytes_;
+  size_t peak_staging_bytes_;
+  bool enabled_;
+
+  friend class TelemetryLock;
+  FPL_DISALLOW_COPY_AND_ASSIGN(AssetLoadTelemetry);
+};
+
+/// @class AssetLoadScope
+/// @brief Makes a record current on this thread, so work done by code that
+/// doesn't know about the asset, like LoadFile(), is added to it.
+///
+/// Scopes nest, so a mesh load that loads its materials records each
+/// separately.
+class AssetLoadScope {
+ public:
+  /// @param telemetry May be null, in which case nothing is recorded.
+  AssetLoadScope(AssetLoadTelemetry *telemetry, int record);
+  ~AssetLoadScope();
+
+ private:
+  AssetLoadTelemetry *previous_telemetry_;
+  int previous_record_;
+};
+
+/// @class AssetLoadPhaseTimer
+/// @brief Adds the time until Stop() or destruction to the current record.
+///
+/// Time spent in timers nested inside this one, including those of other
+/// assets loaded meanwhile, is left out, so no time is counted twice.
+class AssetLoadPhaseTimer {
+ public:
+  explicit AssetLoadPhaseTimer(AssetLoadPhase phase);
+  ~AssetLoadPhaseTimer() { Stop(); }
+
+  /// @brief Stop timing early. Nested timers must be stopped first.
+  void Stop();
+
+ private:
+  AssetLoadPhaseTimer(const AssetLoadPhaseTimer &);
+  AssetLoadPhaseTimer &operator=(const AssetLoadPhaseTimer &);
+
+  AssetLoadTelemetry *telemetry_;
+  int record_;
+  AssetLoadPhase phase_;
+  bool running_;
+  // The timer this one is nested in, and the time spent in timers nested in
+  // this one.
+  AssetLoadPhaseTimer *parent_;
+  double nested_seconds_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/// @brief Add bytes to the record current on this thread, if any.
+void AssetLoadAddBytes(size_t bytes_read, size_t bytes_decoded);
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_ASSET_TELEMETRY_H
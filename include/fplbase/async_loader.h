@@ -40,6 +40,7 @@ typedef void *Mutex;
 typedef void *Semaphore;
 
 class AsyncLoader;
+class AssetLoadTelemetry;
 
 /// @class AsyncResource
 /// @brief Any resource that can be loaded asynchronously should inherit from
@@ -50,13 +51,17 @@ class AsyncAsset : public Asset {
   typedef std::function<void()> AssetFinalizedCallback;
 
   /// @brief Default constructor for an empty AsyncAsset.
-  AsyncAsset() : data_(nullptr) {}
+  AsyncAsset() : data_(nullptr), load_telemetry_(nullptr), load_record_(-1) {}
 
   /// @brief Construct an AsyncAsset with a given file name.
   /// @param[in] filename A C-string corresponding to the name of the asset
   /// file.
   explicit AsyncAsset(const char *filename)
-      : filename_(filename), data_(nullptr), finalize_callbacks_(0) {}
+      : filename_(filename),
+        data_(nullptr),
+        finalize_callbacks_(0),
+        load_telemetry_(nullptr),
+        load_record_(-1) {}
 
   /// @brief AsyncAsset destructor.
   virtual ~AsyncAsset() {}
@@ -112,6 +117,15 @@ class AsyncAsset : public Asset {
     finalize_callbacks_.push_back(callback);
   }
 
+  /// @brief Sets where Load() and Finalize() record their timings.
+  ///
+  /// @param telemetry The telemetry to record to, or nullptr for none.
+  /// @param record The record returned by AssetLoadTelemetry::BeginAsset().
+  void set_load_telemetry(AssetLoadTelemetry *telemetry, int record) {
+    load_telemetry_ = telemetry;
+    load_record_ = record;
+  }
+
  protected:
   /// @brief Calls app callbacks when an asset is ready to be used.
   ///
@@ -130,6 +144,10 @@ class AsyncAsset : public Asset {
 
   std::vector<AssetFinalizedCallback> finalize_callbacks_;
 
+  // Telemetry for this asset's load, if any.
+  AssetLoadTelemetry *load_telemetry_;
+  int load_record_;
+
   friend class AsyncLoader;
 };
 
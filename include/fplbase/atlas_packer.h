@@ -0,0 +1,103 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPLBASE_ATLAS_PACKER_H
+#define FPLBASE_ATLAS_PACKER_H
+
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "mathfu/glsl_mappings.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_texture_atlas
+/// @{
+
+/// @class AtlasPacker
+/// @brief Places rectangles on a fixed size texture page.
+///
+/// Uses the MaxRects algorithm: it keeps the list of maximal free rectangles
+/// of the page, and puts every new rectangle in the free one that leaves the
+/// shortest leftover side (best short side fit). Rectangles are never
+/// rotated, so texture coordinates stay axis aligned.
+///
+/// Each rectangle is surrounded by `padding` pixels that nothing else is
+/// placed in, so that filtering and mip maps don't sample neighbours. The
+/// page border counts as a neighbour too.
+class AtlasPacker {
+ public:
+  /// @brief Create an empty page.
+  ///
+  /// @param page_size The page dimensions in pixels.
+  /// @param padding Empty pixels around every rectangle.
+  AtlasPacker(const mathfu::vec2i &page_size, int padding);
+
+  /// @brief Remove all rectangles.
+  void Reset();
+
+  /// @brief Find room for a rectangle and reserve it.
+  ///
+  /// @param size The rectangle dimensions in pixels, without padding.
+  /// @param position Set to the top left corner of the rectangle, inside its
+  ///        padding.
+  /// @return Returns false if there is no room left on the page for it.
+  bool Insert(const mathfu::vec2i &size, mathfu::vec2i *position);
+
+  /// @brief Whether a rectangle could be inserted, without inserting it.
+  bool Fits(const mathfu::vec2i &size) const;
+
+  /// @brief The fraction of the page covered by rectangles and padding.
+  float Occupancy() const;
+
+  /// @brief The page dimensions in pixels.
+  const mathfu::vec2i &page_size() const { return page_size_; }
+
+  /// @brief Empty pixels around every rectangle.
+  int padding() const { return padding_; }
+
+ private:
+  // A rectangle in pixels, with (x, y) its top left corner.
+  struct Rect {
+    Rect() : x(0), y(0), w(0), h(0) {}
+    Rect(int x, int y, int w, int h) : x(x), y(y), w(w), h(h) {}
+    bool Contains(const Rect &r) const {
+      return r.x >= x && r.y >= y && r.x + r.w <= x + w && r.y + r.h <= y + h;
+    }
+    int x, y, w, h;
+  };
+
+  // Returns the index in free_rects_ of the best place for a rectangle of
+  // the padded size, or -1 if there is none.
+  int FindPosition(int w, int h) const;
+  // Carves `used` out of every free rectangle that it overlaps.
+  void SplitFreeRects(const Rect &used);
+  // Removes free rectangles that are contained in another one.
+  void PruneFreeRects();
+
+  mathfu::vec2i page_size_;
+  int padding_;
+  // Maximal rectangles of free space. They may overlap each other.
+  std::vector<Rect> free_rects_;
+  // Pixels covered by inserted rectangles, including their padding.
+  size_t used_area_;
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_ATLAS_PACKER_H
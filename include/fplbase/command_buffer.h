@@ -0,0 +1,319 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_COMMAND_BUFFER_H
+#define FPLBASE_COMMAND_BUFFER_H
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "fplbase/async_loader.h"
+#include "fplbase/fpl_common.h"
+#include "fplbase/renderer.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_renderer
+/// @{
+
+/// @brief The commands that can be recorded into a CommandBuffer.
+enum CommandType {
+  kCommandSetModelViewProjection,
+  kCommandSetModel,
+  kCommandSetColor,
+  kCommandSetLightPos,
+  kCommandSetCameraPos,
+  kCommandSetBoneTransforms,
+  kCommandSetBlendMode,
+  kCommandSetCulling,
+  kCommandDepthTest,
+  kCommandSetViewport,
+  kCommandClearFrameBuffer,
+  kCommandClearDepthBuffer,
+  kCommandSetShader,
+  kCommandSetUniform,
+  kCommandSetTexture,
+  kCommandSetMaterial,
+  kCommandRenderMesh,
+  kCommandCount
+};
+
+/// @class CommandBackend
+/// @brief Receives the commands of a CommandBuffer as it is executed.
+///
+/// RendererCommandBackend submits them to OpenGL; RecordingCommandBackend
+/// just logs them, so command streams can be tested without a GPU.
+class CommandBackend {
+ public:
+  virtual ~CommandBackend() {}
+  virtual void SetModelViewProjection(const mathfu::mat4 &mvp) = 0;
+  virtual void SetModel(const mathfu::mat4 &model) = 0;
+  virtual void SetColor(const mathfu::vec4 &color) = 0;
+  virtual void SetLightPos(const mathfu::vec3 &light_pos) = 0;
+  virtual void SetCameraPos(const mathfu::vec3 &camera_pos) = 0;
+  /// `bone_transforms` is only valid during the call, so backends that hold
+  /// on to it must copy it.
+  virtual void SetBoneTransforms(const mathfu::AffineTransform *bone_transforms,
+                                 int num_bones) = 0;
+  virtual void SetBlendMode(BlendMode blend_mode, float amount) = 0;
+  virtual void SetCulling(CullingMode mode) = 0;
+  virtual void DepthTest(bool on) = 0;
+  virtual void SetViewport(const mathfu::vec4i &viewport) = 0;
+  virtual void ClearFrameBuffer(const mathfu::vec4 &color) = 0;
+  virtual void ClearDepthBuffer() = 0;
+  virtual void SetShader(Shader *shader) = 0;
+  virtual void SetUniform(Shader *shader, UniformHandle uniform,
+                          const float *value, size_t num_components) = 0;
+  virtual void SetTexture(Texture *texture, size_t unit) = 0;
+  virtual void SetMaterial(Material *material) = 0;
+  virtual void RenderMesh(Mesh *mesh, bool ignore_material,
+                          size_t instances) = 0;
+};
+
+/// @class CommandBuffer
+/// @brief A recorded list of render state changes and draws.
+///
+/// Any thread can record into a CommandBuffer, since recording doesn't touch
+/// OpenGL. The commands are later executed, in order, on the thread that owns
+/// the GL context: get a buffer with CommandQueue::AcquireCommandBuffer(),
+/// record into it and CommandQueue::Submit() it, then have the render thread
+/// call CommandQueue::ExecutePending() with a RendererCommandBackend. This
+/// lets the simulation of one frame overlap with the GL submission of the
+/// previous one.
+///
+/// Commands are packed into a single arena that is kept across Clear(), so
+/// once a buffer has reached its steady state size, recording a frame does
+/// not allocate. Values (matrices, colors, bone transforms, uniforms) are
+/// copied into the buffer, but assets (shaders, meshes, textures, materials)
+/// are recorded by pointer, and must stay alive until the buffer has been
+/// executed.
+class CommandBuffer {
+ public:
+  CommandBuffer()
+      : num_commands_(0), bones_(nullptr), num_bones_(0), bone_capacity_(0) {}
+  ~CommandBuffer();
+
+  /// @brief Record Renderer::set_model_view_projection().
+  void SetModelViewProjection(const mathfu::mat4 &mvp);
+  /// @brief Record Renderer::set_model().
+  void SetModel(const mathfu::mat4 &model);
+  /// @brief Record Renderer::set_color().
+  void SetColor(const mathfu::vec4 &color);
+  /// @brief Record Renderer::set_light_pos().
+  void SetLightPos(const mathfu::vec3 &light_pos);
+  /// @brief Record Renderer::set_camera_pos().
+  void SetCameraPos(const mathfu::vec3 &camera_pos);
+  /// @brief Record Renderer::SetBoneTransforms(). The transforms are copied.
+  void SetBoneTransforms(const mathfu::AffineTransform *bone_transforms,
+                         int num_bones);
+  /// @brief Record Renderer::SetBlendMode().
+  void SetBlendMode(BlendMode blend_mode, float amount = 0.5f);
+  /// @brief Record Renderer::SetCulling().
+  void SetCulling(CullingMode mode);
+  /// @brief Record Renderer::DepthTest().
+  void DepthTest(bool on);
+  /// @brief Record a glViewport() call, as (x, y, width, height).
+  void SetViewport(const mathfu::vec4i &viewport);
+  /// @brief Record Renderer::ClearFrameBuffer().
+  void ClearFrameBuffer(const mathfu::vec4 &color);
+  /// @brief Record Renderer::ClearDepthBuffer().
+  void ClearDepthBuffer();
+  /// @brief Record Shader::Set(), which also uploads the standard uniforms
+  ///        as set by the commands recorded before it.
+  void SetShader(Shader *shader);
+  /// @brief Record Shader::SetUniform() with 1, 2, 3, 4 or 16 floats.
+  void SetUniform(Shader *shader, UniformHandle uniform, const float *value,
+                  size_t num_components);
+  /// @brief Record Texture::Set().
+  void SetTexture(Texture *texture, size_t unit);
+  /// @brief Record Material::Set().
+  void SetMaterial(Material *material);
+  /// @brief Record Mesh::Render().
+  void RenderMesh(Mesh *mesh, bool ignore_material = false,
+                  size_t instances = 1);
+
+  /// @brief Send every recorded command, in order, to `backend`.
+  void Execute(CommandBackend *backend) const;
+
+  /// @brief Remove all commands, keeping the arena for reuse.
+  void Clear();
+
+  /// @brief The number of recorded commands.
+  size_t num_commands() const { return num_commands_; }
+
+  /// @brief The number of bytes of the arena in use.
+  size_t size_in_bytes() const { return arena_.size(); }
+
+ private:
+  // Reserve room for a command and return its payload.
+  uint8_t *Append(CommandType type, size_t payload_size);
+  void AppendFloats(CommandType type, const float *values, size_t count);
+  void AppendPointer(CommandType type, const void *pointer);
+
+  std::vector<uint8_t> arena_;
+  size_t num_commands_;
+
+  // Bone transforms of all SetBoneTransforms() commands, kept apart from the
+  // arena as they need to be 16 byte aligned. A raw array, rather than a
+  // vector, for the same reason as Mesh::default_bone_transform_inverses_.
+  mathfu::AffineTransform *bones_;
+  size_t num_bones_;
+  size_t bone_capacity_;
+
+  FPL_DISALLOW_COPY_AND_ASSIGN(CommandBuffer);
+};
+
+/// @class RendererCommandBackend
+/// @brief Executes commands with a Renderer and RenderContext.
+class RendererCommandBackend : public CommandBackend {
+ public:
+  RendererCommandBackend(Renderer *renderer, RenderContext *render_context)
+      : renderer_(renderer),
+        render_context_(render_context),
+        bones_(nullptr),
+        bone_capacity_(0) {}
+  ~RendererCommandBackend();
+
+  virtual void SetModelViewProjection(const mathfu::mat4 &mvp);
+  virtual void SetModel(const mathfu::mat4 &model);
+  virtual void SetColor(const mathfu::vec4 &color);
+  virtual void SetLightPos(const mathfu::vec3 &light_pos);
+  virtual void SetCameraPos(const mathfu::vec3 &camera_pos);
+  virtual void SetBoneTransforms(const mathfu::AffineTransform *bone_transforms,
+                                 int num_bones);
+  virtual void SetBlendMode(BlendMode blend_mode, float amount);
+  virtual void SetCulling(CullingMode mode);
+  virtual void DepthTest(bool on);
+  virtual void SetViewport(const mathfu::vec4i &viewport);
+  virtual void ClearFrameBuffer(const mathfu::vec4 &color);
+  virtual void ClearDepthBuffer();
+  virtual void SetShader(Shader *shader);
+  virtual void SetUniform(Shader *shader, UniformHandle uniform,
+                          const float *value, size_t num_components);
+  virtual void SetTexture(Texture *texture, size_t unit);
+  virtual void SetMaterial(Material *material);
+  virtual void RenderMesh(Mesh *mesh, bool ignore_material, size_t instances);
+
+ private:
+  Renderer *renderer_;
+  RenderContext *render_context_;
+
+  // Copy of the last bone transforms, which the render context points to.
+  mathfu::AffineTransform *bones_;
+  size_t bone_capacity_;
+
+  FPL_DISALLOW_COPY_AND_ASSIGN(RendererCommandBackend);
+};
+
+/// @class RecordingCommandBackend
+/// @brief Logs commands as text instead of rendering them.
+///
+/// Assets are logged by the order in which they were first seen (e.g.
+/// `mesh0`, `shader1`) rather than by address, so logs are deterministic and
+/// can be compared against expected output in tests.
+class RecordingCommandBackend : public CommandBackend {
+ public:
+  virtual void SetModelViewProjection(const mathfu::mat4 &mvp);
+  virtual void SetModel(const mathfu::mat4 &model);
+  virtual void SetColor(const mathfu::vec4 &color);
+  virtual void SetLightPos(const mathfu::vec3 &light_pos);
+  virtual void SetCameraPos(const mathfu::vec3 &camera_pos);
+  virtual void SetBoneTransforms(const mathfu::AffineTransform *bone_transforms,
+                                 int num_bones);
+  virtual void SetBlendMode(BlendMode blend_mode, float amount);
+  virtual void SetCulling(CullingMode mode);
+  virtual void DepthTest(bool on);
+  virtual void SetViewport(const mathfu::vec4i &viewport);
+  virtual void ClearFrameBuffer(const mathfu::vec4 &color);
+  virtual void ClearDepthBuffer();
+  virtual void SetShader(Shader *shader);
+  virtual void SetUniform(Shader *shader, UniformHandle uniform,
+                          const float *value, size_t num_components);
+  virtual void SetTexture(Texture *texture, size_t unit);
+  virtual void SetMaterial(Material *material);
+  virtual void RenderMesh(Mesh *mesh, bool ignore_material, size_t instances);
+
+  /// @brief One line per executed command.
+  const std::vector<std::string> &log() const { return log_; }
+  /// @brief Forget the logged commands and the names given to assets.
+  void Clear() {
+    log_.clear();
+    names_.clear();
+  }
+
+ private:
+  std::string Name(const char *kind, const void *asset);
+  void Log(const std::string &name, const float *values, size_t count);
+
+  std::vector<std::string> log_;
+  std::vector<const void *> names_;
+};
+
+/// @class CommandQueue
+/// @brief Hands recorded CommandBuffers from recording threads to the render
+///        thread.
+///
+/// Recording threads call AcquireCommandBuffer(), record, then Submit(). The
+/// render thread calls ExecutePending() once per frame, which executes every
+/// submitted buffer in submission order, then recycles them.
+class CommandQueue {
+ public:
+  CommandQueue();
+  ~CommandQueue();
+
+  /// @brief Get an empty buffer to record into, reusing executed ones.
+  CommandBuffer *AcquireCommandBuffer();
+
+  /// @brief Queue a recorded buffer for execution.
+  void Submit(CommandBuffer *commands);
+
+  /// @brief Execute and recycle all submitted buffers.
+  ///
+  /// @param backend Where to send the commands.
+  /// @param wait If true and nothing has been submitted, block until a
+  ///        buffer is submitted.
+  /// @return Returns the number of buffers executed.
+  size_t ExecutePending(CommandBackend *backend, bool wait);
+
+ private:
+  void Lock(const std::function<void()> &body);
+
+  // Every buffer created by AcquireCommandBuffer(), for deletion.
+  std::vector<CommandBuffer *> all_;
+  std::vector<CommandBuffer *> free_;
+  std::vector<CommandBuffer *> submitted_;
+
+#ifdef FPL_BASE_BACKEND_SDL
+  // Protects free_ and submitted_.
+  Mutex mutex_;
+  // Signalled once for every submitted buffer.
+  Semaphore submitted_semaphore_;
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  std::mutex mutex_;
+  std::condition_variable submitted_condition_;
+#endif
+
+  FPL_DISALLOW_COPY_AND_ASSIGN(CommandQueue);
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_COMMAND_BUFFER_H
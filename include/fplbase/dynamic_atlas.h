@@ -0,0 +1,175 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPLBASE_DYNAMIC_ATLAS_H
+#define FPLBASE_DYNAMIC_ATLAS_H
+
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "fplbase/texture.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_texture_atlas
+/// @{
+
+/// @class DynamicAtlas
+/// @brief One texture shared by many small images created at runtime.
+///
+/// Glyphs, avatars and the like are inserted under a key chosen by the
+/// caller, and drawn from the atlas texture using the bounds they were given.
+/// Space is handed out in shelves: rows as tall as the images put in them,
+/// filled from left to right. When the texture is full, the least recently
+/// used images are evicted to make room.
+///
+/// Pixels are copied into a CPU side copy of the texture, and only sent to
+/// GL by Flush(), which uploads every changed band of rows with one
+/// Texture::UpdateTexture() call. Call it once per frame, after inserting
+/// and before drawing. Images used (inserted or found) since the last
+/// Flush() are never evicted, so the bounds of everything drawn in a batch
+/// stay valid until it has been drawn.
+class DynamicAtlas {
+ public:
+  /// @brief Identifies an image in the atlas, e.g. a glyph index or a hash.
+  typedef uint64_t Key;
+
+  /// @brief Create an empty atlas. No GL texture is created until the first
+  /// Upload().
+  ///
+  /// @param size The texture dimensions in pixels. The width times the bytes
+  ///        per pixel must be a multiple of 4.
+  /// @param format The texture format. Must be uncompressed.
+  /// @param padding Empty pixels around every image.
+  DynamicAtlas(const mathfu::vec2i &size, TextureFormat format,
+               int padding = 1);
+  ~DynamicAtlas();
+
+  /// @brief Look up an image, and mark it as used.
+  ///
+  /// @param key The key the image was inserted with.
+  /// @return The image bounds in normalized texture coordinates, in the
+  ///         form (u, v, width, height), or nullptr if the image isn't in
+  ///         the atlas (anymore).
+  const mathfu::vec4 *Find(Key key);
+
+  /// @brief Add an image, replacing any image with the same key.
+  ///
+  /// @param key Identifies the image in later calls.
+  /// @param size The image dimensions in pixels.
+  /// @param pixels Tightly packed rows of pixels in the atlas format.
+  /// @return The image bounds in normalized texture coordinates, or nullptr
+  ///         if it doesn't fit, even after evicting every image that has not
+  ///         been used since the last Flush().
+  const mathfu::vec4 *Insert(Key key, const mathfu::vec2i &size,
+                             const void *pixels);
+
+  /// @brief Remove an image, freeing its space.
+  void Remove(Key key);
+
+  /// @brief Remove all images.
+  void Clear();
+
+  /// @brief Upload the pixels changed since the last call, and start a new
+  /// frame for the purpose of eviction. Same as Upload() then AdvanceFrame().
+  void Flush() {
+    Upload();
+    AdvanceFrame();
+  }
+
+  /// @brief Upload the pixels changed since the last call to the texture,
+  /// creating it the first time.
+  void Upload();
+
+  /// @brief Allow the images used so far to be evicted.
+  void AdvanceFrame() { ++frame_; }
+
+  /// @brief The atlas texture, or nullptr before the first Upload().
+  Texture *texture() { return texture_.get(); }
+  /// @brief The atlas texture, or nullptr before the first Upload().
+  const Texture *texture() const { return texture_.get(); }
+
+  /// @brief The texture dimensions in pixels.
+  const mathfu::vec2i &size() const { return size_; }
+  /// @brief The texture format.
+  TextureFormat format() const { return format_; }
+  /// @brief The number of images in the atlas.
+  size_t num_entries() const { return entries_.size(); }
+  /// @brief The number of images evicted to make room, since construction.
+  size_t num_evictions() const { return num_evictions_; }
+  /// @brief Whether there are pixels waiting for Upload().
+  bool has_pending_upload() const { return dirty_rows_ != 0; }
+  /// @brief The CPU side copy of the texture, as tightly packed rows.
+  const std::vector<uint8_t> &pixels() const { return pixels_; }
+
+ private:
+  // A horizontal band of the texture that holds images of similar height.
+  struct Shelf {
+    Shelf(int y, int height) : y(y), height(height), end(0) {}
+    int y;
+    int height;
+    // Everything from here to the right edge is free.
+    int end;
+    // Free (x, width) spans left of `end`, sorted by x.
+    std::vector<std::pair<int, int>> free_spans;
+  };
+
+  struct Entry {
+    // Slot in the texture, including padding.
+    int x, y, w, h;
+    size_t shelf;
+    mathfu::vec4 bounds;
+    uint32_t last_used_frame;
+    // Position in lru_, most recently used first.
+    std::list<Key>::iterator lru;
+  };
+
+  // Reserves a slot of padded size w * h. Returns false if there is no room.
+  bool Allocate(int w, int h, int *x, int *y, size_t *shelf);
+  // Returns the slot of an entry to its shelf.
+  void Free(const Entry &entry);
+  // Removes the least recently used entry, unless it was used this frame.
+  bool EvictOne();
+  void Touch(Entry *entry);
+  void MarkDirty(int y, int h);
+
+  mathfu::vec2i size_;
+  TextureFormat format_;
+  int padding_;
+  int bytes_per_pixel_;
+  // CPU copy of the texture contents, uploaded by Flush().
+  std::vector<uint8_t> pixels_;
+  // Rows of pixels_ that changed since the last Flush().
+  std::vector<bool> row_dirty_;
+  size_t dirty_rows_;
+  std::vector<Shelf> shelves_;
+  std::unordered_map<Key, Entry> entries_;
+  std::list<Key> lru_;
+  uint32_t frame_;
+  size_t num_evictions_;
+  std::unique_ptr<Texture> texture_;
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_DYNAMIC_ATLAS_H
@@ -0,0 +1,98 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_FILE_WATCHER_H
+#define FPLBASE_FILE_WATCHER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "fplbase/fpl_common.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_asset_manager
+/// @{
+
+/// @class FileWatcher
+/// @brief Reports files on disk that have been written since the last check.
+///
+/// On Linux this uses inotify on the directories holding the watched files,
+/// so it also sees editors that save by writing a new file and renaming it
+/// over the old one. Elsewhere it compares modification times on every Poll().
+/// Files that only exist inside an archive (e.g. an Android APK) can't be
+/// watched.
+class FileWatcher {
+ public:
+  FileWatcher();
+  ~FileWatcher();
+
+  /// @brief Start watching a file.
+  ///
+  /// @param filename The file, as passed to LoadFile(). Poll() reports it
+  ///        with exactly this name.
+  /// @return Returns false if the file can't be watched.
+  bool Watch(const std::string &filename);
+
+  /// @brief Stop watching a file.
+  void Unwatch(const std::string &filename);
+
+  /// @brief Stop watching all files.
+  void UnwatchAll();
+
+  /// @brief Whether Watch() has been called for `filename`.
+  bool IsWatching(const std::string &filename) const {
+    return files_.find(filename) != files_.end();
+  }
+
+  /// @brief Find watched files that changed since the last call.
+  ///
+  /// Doesn't block.
+  ///
+  /// @param changed Set to the names of the files that changed, each once.
+  void Poll(std::vector<std::string> *changed);
+
+ private:
+  FPL_DISALLOW_COPY_AND_ASSIGN(FileWatcher);
+
+  // What a file looked like when last polled. Only used without inotify.
+  struct FileStamp {
+    FileStamp() : modification_ns(-1), size(-1) {}
+    bool operator!=(const FileStamp &other) const {
+      return modification_ns != other.modification_ns || size != other.size;
+    }
+    // Nanoseconds since the epoch, where the platform records them.
+    long long modification_ns;
+    long long size;
+  };
+
+  // Watched files, with how they looked when last polled.
+  std::map<std::string, FileStamp> files_;
+#if defined(__linux__) && !defined(__ANDROID__)
+  // The inotify instance, and one watch per directory holding watched files.
+  int inotify_fd_;
+  std::map<std::string, int> directory_watches_;
+  std::map<int, std::string> watch_directories_;
+#endif
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_FILE_WATCHER_H
@@ -0,0 +1,189 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_FRAME_STATS_H
+#define FPLBASE_FRAME_STATS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "fplbase/config.h"  // Must come first.
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_utilities
+/// @{
+
+/// @brief The parts of a frame that FrameStats times separately.
+enum FramePhase {
+  /// Everything on the CPU between the end of one buffer swap and the start
+  /// of the next, including kFramePhaseFinalize.
+  kFramePhaseCpu,
+  /// AssetManager::TryFinalize(), which uploads loaded assets to the GPU.
+  kFramePhaseFinalize,
+  /// Renderer::AdvanceFrame() waiting for the buffer swap.
+  kFramePhaseSwap,
+  /// The whole frame, from one swap to the next.
+  kFramePhaseTotal,
+  kFramePhaseCount
+};
+
+/// @class FrameTimeHistogram
+/// @brief Fixed size histogram of durations, with percentiles.
+///
+/// Durations are counted in microseconds, in buckets whose width grows with
+/// their value (as in HdrHistogram), so every percentile is accurate to
+/// within about 6% from a microsecond up to over an hour. Recording a value
+/// is a few integer operations and never allocates.
+class FrameTimeHistogram {
+ public:
+  /// @brief Values below this are counted exactly.
+  static const int kLinearBuckets = 16;
+  /// @brief Number of buckets each power of two above that is divided into.
+  static const int kSubBuckets = 16;
+  static const int kNumBuckets = kLinearBuckets + 28 * kSubBuckets;
+
+  FrameTimeHistogram() { Clear(); }
+
+  /// @brief Count one duration.
+  void Record(double seconds);
+
+  /// @brief Forget all recorded durations.
+  void Clear();
+
+  /// @brief Get the duration below which `percentile`% of durations fall.
+  ///
+  /// @param percentile Between 0 and 100, e.g. 99 for the 99th percentile.
+  /// @return Returns the duration in seconds, or 0 if nothing was recorded.
+  double Percentile(double percentile) const;
+
+  /// @brief Number of durations recorded.
+  uint64_t count() const { return count_; }
+  /// @brief Shortest duration recorded, in seconds.
+  double min() const { return count_ ? min_ : 0.0; }
+  /// @brief Longest duration recorded, in seconds.
+  double max() const { return max_; }
+  /// @brief Average duration, in seconds.
+  double mean() const { return count_ ? total_ / count_ : 0.0; }
+
+  /// @brief Get the bucket a duration in microseconds is counted in.
+  static int BucketIndex(uint64_t microseconds);
+  /// @brief Get the smallest duration in microseconds counted in a bucket.
+  static uint64_t BucketStart(int index);
+
+ private:
+  uint32_t buckets_[kNumBuckets];
+  uint64_t count_;
+  double total_;
+  double min_;
+  double max_;
+};
+
+/// @class FrameStats
+/// @brief Keeps the time taken by each phase of recent frames, and
+///        histograms of all frames.
+///
+/// The Renderer owns one, which Renderer::AdvanceFrame() and
+/// AssetManager::TryFinalize() feed; get it with Renderer::frame_stats().
+/// In-game overlays can read the most recent frames with CopyRecentFrames()
+/// from any thread without locking, and Summary() formats the histograms for
+/// logging at exit.
+class FrameStats {
+ public:
+  /// @brief Number of frames kept for CopyRecentFrames().
+  static const int kRingSize = 256;
+
+  /// @brief The time spent in each phase of one frame.
+  struct Frame {
+    /// @brief Index of the frame, counting from 0 when timing started.
+    uint32_t index;
+    /// @brief Duration of each FramePhase, in seconds.
+    float seconds[kFramePhaseCount];
+  };
+
+  FrameStats();
+
+  /// @brief Start timing `phase` of the current frame.
+  void BeginPhase(FramePhase phase);
+
+  /// @brief Stop timing `phase` and add the time since BeginPhase() to it.
+  ///
+  /// A phase may be timed several times in one frame; the times add up.
+  void EndPhase(FramePhase phase);
+
+  /// @brief Add time to a phase of the current frame directly.
+  void AddPhaseTime(FramePhase phase, double seconds);
+
+  /// @brief Finish the current frame: record its phases and start the next.
+  ///
+  /// kFramePhaseTotal is set to the time since the previous EndFrame(). The
+  /// first call only starts the clock.
+  void EndFrame();
+
+  /// @brief Copy the most recent frames, oldest first.
+  ///
+  /// Safe to call from any thread while frames are being recorded. Frames
+  /// that are overwritten while being copied are skipped.
+  ///
+  /// @param frames Where to copy to.
+  /// @param max_frames The size of `frames`; at most kRingSize are copied.
+  /// @return Returns the number of frames copied.
+  int CopyRecentFrames(Frame *frames, int max_frames) const;
+
+  /// @brief Histogram of one phase over all frames since Reset().
+  ///
+  /// Only safe to read on the thread calling EndFrame().
+  const FrameTimeHistogram &histogram(FramePhase phase) const {
+    return histograms_[phase];
+  }
+
+  /// @brief Number of frames recorded since Reset().
+  uint32_t num_frames() const { return num_frames_.load(); }
+
+  /// @brief Forget all frames, e.g. after loading a level.
+  void Reset();
+
+  /// @brief Format p50/p95/p99/max of every phase, in milliseconds, one line
+  ///        per phase.
+  std::string Summary() const;
+
+  /// @brief Write Summary() to the log.
+  void LogSummary() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  // One ring entry. `sequence` is odd while `frame` is being written, so
+  // readers can detect torn copies.
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    Frame frame;
+  };
+
+  Slot ring_[kRingSize];
+  std::atomic<uint32_t> num_frames_;
+  FrameTimeHistogram histograms_[kFramePhaseCount];
+  double current_[kFramePhaseCount];
+  Clock::time_point phase_start_[kFramePhaseCount];
+  Clock::time_point frame_start_;
+  bool frame_started_;
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_FRAME_STATS_H
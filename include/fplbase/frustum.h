@@ -0,0 +1,225 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_FRUSTUM_H
+#define FPLBASE_FRUSTUM_H
+
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "mathfu/glsl_mappings.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_frustum
+/// @{
+
+class Mesh;
+
+/// @brief Bit set in a visibility mask when an object is inside the left eye
+///        frustum, i.e. the first frustum passed to CullBoundingBoxes().
+static const uint8_t kFrustumVisibleLeftEye = 1 << 0;
+/// @brief Bit set in a visibility mask when an object is inside the right eye
+///        frustum, i.e. the second frustum passed to CullBoundingBoxes().
+static const uint8_t kFrustumVisibleRightEye = 1 << 1;
+/// @brief Visibility mask for objects visible to both eyes.
+static const uint8_t kFrustumVisibleBothEyes =
+    kFrustumVisibleLeftEye | kFrustumVisibleRightEye;
+
+/// @brief The maximum number of frustums CullBoundingBoxes() can test
+///        against in one pass, limited by the bits in a visibility mask.
+static const size_t kMaxCullingFrustums = 8;
+
+/// @class Frustum
+/// @brief The six clip planes of a camera, in world space.
+///
+/// Planes are stored as `(a, b, c, d)` such that a point `p` is on the inside
+/// when `a * p.x + b * p.y + c * p.z + d >= 0`.
+class Frustum {
+ public:
+  enum Plane {
+    kLeft,
+    kRight,
+    kBottom,
+    kTop,
+    kNear,
+    kFar,
+    kNumPlanes
+  };
+
+  /// @brief Extract the planes from a view projection matrix.
+  ///
+  /// Pass the same matrix used for `set_model_view_projection()` minus the
+  /// model transform, so that the planes are in world space.
+  ///
+  /// @param view_projection The combined view and OpenGL-style projection
+  ///        matrix of the camera.
+  explicit Frustum(const mathfu::mat4 &view_projection);
+
+  /// @brief Test a single axis-aligned box against the frustum.
+  ///
+  /// Prefer CullBoundingBoxes() when testing many boxes.
+  ///
+  /// @param min_position The minimum corner of the box.
+  /// @param max_position The maximum corner of the box.
+  /// @return Returns false if the box is entirely outside one of the planes.
+  bool IntersectsAabb(const mathfu::vec3 &min_position,
+                      const mathfu::vec3 &max_position) const;
+
+  /// @brief Get one of the six planes.
+  ///
+  /// @param plane The plane to get.
+  /// @return Returns the normalized plane as `(a, b, c, d)`.
+  mathfu::vec4 plane(Plane plane) const {
+    return mathfu::vec4(a_[plane], b_[plane], c_[plane], d_[plane]);
+  }
+
+ private:
+  friend class FrustumCuller;
+
+  // Planes in SoA layout so they can be broadcast into SIMD registers.
+  float a_[kNumPlanes];
+  float b_[kNumPlanes];
+  float c_[kNumPlanes];
+  float d_[kNumPlanes];
+};
+
+/// @class AabbBatch
+/// @brief World-space axis-aligned bounding boxes, stored as SoA for culling.
+///
+/// Boxes are stored as center and half-extent arrays, so that a batch of four
+/// boxes can be loaded into SIMD registers with one load per component.
+class AabbBatch {
+ public:
+  AabbBatch() : count_(0) {}
+
+  /// @brief Remove all boxes, keeping the allocated memory for the next frame.
+  void Clear();
+
+  /// @brief Preallocate room for `count` boxes.
+  void Reserve(size_t count);
+
+  /// @brief Append a world-space box.
+  ///
+  /// @param min_position The minimum corner of the box.
+  /// @param max_position The maximum corner of the box.
+  /// @return Returns the index of the box in the batch.
+  size_t Add(const mathfu::vec3 &min_position,
+             const mathfu::vec3 &max_position);
+
+  /// @brief Append the world-space box enclosing a transformed local box.
+  ///
+  /// @param min_position The minimum corner of the box in local space.
+  /// @param max_position The maximum corner of the box in local space.
+  /// @param world The affine transform from local space to world space.
+  /// @return Returns the index of the box in the batch.
+  size_t Add(const mathfu::vec3 &min_position,
+             const mathfu::vec3 &max_position, const mathfu::mat4 &world);
+
+  /// @brief Append the world-space box enclosing a mesh.
+  ///
+  /// @param mesh The mesh whose `min_position()` and `max_position()` bound
+  ///        its vertices.
+  /// @param world The affine transform from mesh space to world space.
+  /// @return Returns the index of the box in the batch.
+  size_t Add(const Mesh &mesh, const mathfu::mat4 &world);
+
+  /// @brief The number of boxes in the batch.
+  size_t size() const { return count_; }
+
+ private:
+  friend class FrustumCuller;
+
+  // Arrays are padded to a multiple of four boxes, so they are usually
+  // longer than count_.
+  size_t count_;
+  std::vector<float> center_x_, center_y_, center_z_;
+  std::vector<float> extent_x_, extent_y_, extent_z_;
+};
+
+/// @class ObbBatch
+/// @brief World-space oriented bounding boxes, stored as SoA for culling.
+///
+/// Each box is stored as its center plus its three half-axes. This is tighter
+/// than an AabbBatch for rotated objects, at twice the memory per box.
+class ObbBatch {
+ public:
+  ObbBatch() : count_(0) {}
+
+  /// @brief Remove all boxes, keeping the allocated memory for the next frame.
+  void Clear();
+
+  /// @brief Preallocate room for `count` boxes.
+  void Reserve(size_t count);
+
+  /// @brief Append a transformed local box.
+  ///
+  /// @param min_position The minimum corner of the box in local space.
+  /// @param max_position The maximum corner of the box in local space.
+  /// @param world The affine transform from local space to world space.
+  /// @return Returns the index of the box in the batch.
+  size_t Add(const mathfu::vec3 &min_position,
+             const mathfu::vec3 &max_position, const mathfu::mat4 &world);
+
+  /// @brief Append the oriented box of a mesh.
+  ///
+  /// @param mesh The mesh whose `min_position()` and `max_position()` bound
+  ///        its vertices.
+  /// @param world The affine transform from mesh space to world space.
+  /// @return Returns the index of the box in the batch.
+  size_t Add(const Mesh &mesh, const mathfu::mat4 &world);
+
+  /// @brief The number of boxes in the batch.
+  size_t size() const { return count_; }
+
+ private:
+  friend class FrustumCuller;
+
+  // Arrays are padded to a multiple of four boxes, so they are usually
+  // longer than count_.
+  size_t count_;
+  std::vector<float> center_x_, center_y_, center_z_;
+  // The three half-axes, each scaled by the box's half-extent along it.
+  std::vector<float> axis_x_[3], axis_y_[3], axis_z_[3];
+};
+
+/// @brief Test every box in a batch against one or more frustums.
+///
+/// Boxes are processed four at a time with SSE or NEON where available, and
+/// large batches are split across threads with ParallelFor(). All frustums
+/// are tested in the same pass over the batch, so stereo rendering can cull
+/// for both eyes at the cost of reading the boxes once; pass the left eye
+/// frustum first to get masks compatible with Mesh::RenderStereo().
+///
+/// @param frustums Array of frustums to test against.
+/// @param num_frustums Length of `frustums`, at most kMaxCullingFrustums.
+/// @param batch The boxes to test.
+/// @param visibility Output array of length `batch.size()`. Bit `i` of
+///        element `j` is set if box `j` intersects `frustums[i]`.
+void CullBoundingBoxes(const Frustum *frustums, size_t num_frustums,
+                       const AabbBatch &batch, uint8_t *visibility);
+
+/// @brief Test every box in a batch against one or more frustums.
+///
+/// @see CullBoundingBoxes(const Frustum *, size_t, const AabbBatch &,
+///      uint8_t *)
+void CullBoundingBoxes(const Frustum *frustums, size_t num_frustums,
+                       const ObbBatch &batch, uint8_t *visibility);
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_FRUSTUM_H
@@ -61,7 +61,9 @@
 #ifdef _WIN32
 #define GLBASEEXTS                                             \
   GLEXT(PFNGLACTIVETEXTUREARBPROC, glActiveTexture)            \
-  GLEXT(PFNGLCOMPRESSEDTEXIMAGE2DPROC, glCompressedTexImage2D)
+  GLEXT(PFNGLCOMPRESSEDTEXIMAGE2DPROC, glCompressedTexImage2D) \
+  GLEXT(PFNGLTEXIMAGE3DPROC, glTexImage3D)                     \
+  GLEXT(PFNGLCOMPRESSEDTEXIMAGE3DPROC, glCompressedTexImage3D)
 #else   // !defined(_WIN32)
 #define GLBASEEXTS
 #endif  // !defined(_WIN32)
@@ -86,6 +88,7 @@
       GLEXT(PFNGLDELETEBUFFERSARBPROC, glDeleteBuffers)                       \
       GLEXT(PFNGLGETBUFFERSUBDATAARBPROC, glGetBufferSubData)                 \
       GLEXT(PFNGLVERTEXATTRIBPOINTERARBPROC, glVertexAttribPointer)           \
+      GLEXT(PFNGLVERTEXATTRIB1FPROC, glVertexAttrib1f)                        \
       GLEXT(PFNGLENABLEVERTEXATTRIBARRAYARBPROC, glEnableVertexAttribArray)   \
       GLEXT(PFNGLDISABLEVERTEXATTRIBARRAYARBPROC, glDisableVertexAttribArray) \
       GLEXT(PFNGLCREATEPROGRAMPROC, glCreateProgram)                          \
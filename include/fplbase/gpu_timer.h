@@ -0,0 +1,211 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_GPU_TIMER_H
+#define FPLBASE_GPU_TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_renderer
+/// @{
+
+/// @class GpuTimerBackend
+/// @brief The GPU timestamp queries GpuTimer is built on.
+///
+/// GlGpuTimerBackend implements these with OpenGL; tests substitute a mock.
+class GpuTimerBackend {
+ public:
+  virtual ~GpuTimerBackend() {}
+
+  /// @brief True if timestamps can be queried at all.
+  virtual bool Supported() const = 0;
+  /// @brief Create `count` query objects.
+  virtual void CreateQueries(size_t count, unsigned int *queries) = 0;
+  /// @brief Delete query objects made by CreateQueries().
+  virtual void DeleteQueries(size_t count, const unsigned int *queries) = 0;
+  /// @brief Have `query` record the GPU time once all preceding commands
+  ///        have completed.
+  virtual void QueryTimestamp(unsigned int query) = 0;
+  /// @brief True if the result of `query` can be read without waiting.
+  virtual bool ResultAvailable(unsigned int query) = 0;
+  /// @brief The recorded time, in nanoseconds.
+  virtual uint64_t Result(unsigned int query) = 0;
+  /// @brief True if something (e.g. a change of GPU clock) made timings
+  ///        unreliable since the last call.
+  virtual bool Disjoint() { return false; }
+};
+
+/// @class GlGpuTimerBackend
+/// @brief GpuTimerBackend using GL_TIMESTAMP queries.
+///
+/// Needs OpenGL 3.3, GL_ARB_timer_query or GL_EXT_disjoint_timer_query.
+/// Without them, Supported() is false and GpuTimer does nothing.
+class GlGpuTimerBackend : public GpuTimerBackend {
+ public:
+  GlGpuTimerBackend();
+
+  /// @brief Look up the query functions. Call with a current GL context.
+  void Initialize();
+
+  virtual bool Supported() const { return supported_; }
+  virtual void CreateQueries(size_t count, unsigned int *queries);
+  virtual void DeleteQueries(size_t count, const unsigned int *queries);
+  virtual void QueryTimestamp(unsigned int query);
+  virtual bool ResultAvailable(unsigned int query);
+  virtual uint64_t Result(unsigned int query);
+  virtual bool Disjoint();
+
+ private:
+  bool supported_;
+  // True for GL_EXT_disjoint_timer_query, which reports disjoint events.
+  bool check_disjoint_;
+  // Entry points, which differ between GL and GLES, so they are looked up
+  // at runtime.
+  void *gen_queries_;
+  void *delete_queries_;
+  void *query_counter_;
+  void *get_query_object_uiv_;
+  void *get_query_object_ui64v_;
+};
+
+/// @class GpuTimer
+/// @brief Measures how long named scopes of rendering take on the GPU.
+///
+/// Each scope places a timestamp query before and after its commands. The
+/// queries of a frame are only read back kFramesInFlight - 1 frames later,
+/// when the GPU has long finished them, so timing never stalls the CPU.
+/// Frames whose results still aren't ready when their queries are needed
+/// again are dropped.
+///
+/// The Renderer owns one, advanced by Renderer::AdvanceFrame(). Results go to
+/// results(), and to the profiler as "gpu:<scope>" counters in
+/// microseconds, next to the CPU zones.
+class GpuTimer {
+ public:
+  /// @brief Number of frames whose queries can be outstanding.
+  static const int kFramesInFlight = 3;
+  /// @brief Scopes beyond this many in one frame are not timed.
+  static const int kMaxScopesPerFrame = 64;
+
+  /// @brief The time one scope took on the GPU.
+  struct ScopeTiming {
+    /// @brief The name given to BeginScope() or BeginPass().
+    const char *name;
+    /// @brief Number of enclosing scopes.
+    int depth;
+    /// @brief GPU time from the start to the end of the scope.
+    double seconds;
+  };
+
+  /// @param backend Issues the queries. Not owned.
+  explicit GpuTimer(GpuTimerBackend *backend);
+  ~GpuTimer();
+
+  /// @brief Start timing a scope. Scopes nest.
+  ///
+  /// @param name Must outlive the results, e.g. a string literal.
+  void BeginScope(const char *name);
+
+  /// @brief Stop timing the most recently begun scope.
+  void EndScope();
+
+  /// @brief Start timing a top level pass, ending the previous pass.
+  ///
+  /// For passes that have a start but no natural end, such as
+  /// RenderTarget::SetAsRenderTarget(). The last pass of a frame ends in
+  /// AdvanceFrame().
+  void BeginPass(const char *name);
+
+  /// @brief End the current pass, if any.
+  void EndPass();
+
+  /// @brief Finish the frame's queries, and collect any finished results.
+  void AdvanceFrame();
+
+  /// @brief Delete all queries. Call before destroying the GL context.
+  void Reset();
+
+  /// @brief The timings of the most recent frame whose results are in, in
+  ///        the order the scopes began.
+  const std::vector<ScopeTiming> &results() const { return results_; }
+
+  /// @brief Number of frames advanced so far.
+  uint32_t frame() const { return frame_; }
+  /// @brief The frame results() belongs to.
+  uint32_t results_frame() const { return results_frame_; }
+  /// @brief Number of frames whose results could not be used.
+  uint32_t dropped_frames() const { return dropped_frames_; }
+
+  /// @brief Turn timing on or off. On by default, where supported.
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+
+ private:
+  struct Scope {
+    const char *name;
+    int depth;
+    int begin_query;
+    int end_query;  // -1 while the scope is open.
+  };
+
+  struct Frame {
+    Frame() : frame(0), pending(false), queries_used(0) {}
+    uint32_t frame;
+    // True if this frame has queries that haven't been read.
+    bool pending;
+    std::vector<Scope> scopes;
+    std::vector<unsigned int> queries;
+    size_t queries_used;
+  };
+
+  bool Active() const;
+  int Timestamp();
+  // Read the results of `frame` if ready. With `force`, drop them if not.
+  bool Collect(Frame *frame, bool force);
+
+  GpuTimerBackend *backend_;
+  Frame frames_[kFramesInFlight];
+  std::vector<size_t> open_scopes_;
+  bool pass_open_;
+  uint32_t frame_;
+  std::vector<ScopeTiming> results_;
+  uint32_t results_frame_;
+  uint32_t dropped_frames_;
+  bool enabled_;
+};
+
+/// @class GpuTimerScope
+/// @brief Times the GPU commands issued during its lifetime.
+class GpuTimerScope {
+ public:
+  GpuTimerScope(GpuTimer *timer, const char *name) : timer_(timer) {
+    timer_->BeginScope(name);
+  }
+  ~GpuTimerScope() { timer_->EndScope(); }
+
+ private:
+  GpuTimer *timer_;
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_GPU_TIMER_H
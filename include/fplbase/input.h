@@ -19,6 +19,7 @@
 #include <map>
 #include <queue>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "fplbase/config.h"  // Must come first.
@@ -72,13 +73,13 @@ typedef int AndroidInputDeviceId;
 /// Allows you to know if a button went up/down this frame.
 class Button {
  public:
-  Button() : is_down_(false) { AdvanceFrame(); }
+  Button() : state_(0) {}
   /// @brief Advances the current state of the button by one frame.
   ///
   /// Important, because it tells the system where frame boundaries occur, so
   /// that went_down() and went_up() can be updated correctly.
   /// Normally called automatically by FPLBase.
-  void AdvanceFrame() { went_down_ = went_up_ = false; }
+  void AdvanceFrame() { state_ &= kIsDown; }
 
   /// @brief Updates the current state of the button.
   ///
@@ -87,18 +88,23 @@ class Button {
   void Update(bool down);
 
   /// @brief Returns true if the button is currently pressed.
-  bool is_down() const { return is_down_; }
+  bool is_down() const { return (state_ & kIsDown) != 0; }
 
   /// @brief Returns true if the button has been pressed since last update.
-  bool went_down() const { return went_down_; }
+  bool went_down() const { return (state_ & kWentDown) != 0; }
 
   /// @brief Returns true if the button has been released since last update.
-  bool went_up() const { return went_up_; }
+  bool went_up() const { return (state_ & kWentUp) != 0; }
 
  private:
-  bool is_down_;
-  bool went_down_;
-  bool went_up_;
+  friend class ButtonTable;
+  friend class InputSystem;
+
+  enum { kIsDown = 1 << 0, kWentDown = 1 << 1, kWentUp = 1 << 2 };
+
+  // A mask of the flags above, so that a table of buttons can be advanced to
+  // the next frame with a single pass of bitwise ands.
+  uint8_t state_;
 };
 
 // This enum extends the FPL keycodes, which are normally positive values.
@@ -123,6 +129,63 @@ enum {
   K_PAD_B
 };
 
+/// @class ButtonTable
+/// @brief Maps button IDs (FPL keycodes and the values above) to Buttons.
+///
+/// Pointer and pad buttons, ASCII keycodes and keycodes derived from
+/// scancodes are stored in a dense array indexed directly by the ID. Any other
+/// ID goes in a small hash table. References returned by GetButton() stay
+/// valid until Clear() is called.
+class ButtonTable {
+ public:
+  /// @brief Number of negative IDs, from K_PAD_UP up to -1.
+  static const int kNumNegativeButtons = -K_PAD_UP;
+  /// @brief Number of keycodes that are plain characters.
+  static const int kNumCharacterKeys = 128;
+  /// @brief Number of keycodes made with FPL_SCANCODE_TO_KEYCODE().
+  static const int kNumScancodeKeys = 512;
+  /// @brief Number of buttons stored in the dense array.
+  static const int kNumDenseButtons =
+      kNumNegativeButtons + kNumCharacterKeys + kNumScancodeKeys;
+
+  /// @brief Get the Button for an ID, creating it in the released state if
+  ///        this is the first request for it.
+  Button &GetButton(int button) {
+    const int index = DenseIndex(button);
+    return index >= 0 ? dense_[index] : sparse_[button];
+  }
+
+  /// @brief Clear the went_down() and went_up() state of every button.
+  void AdvanceFrame();
+
+  /// @brief Set every button back to the released state.
+  void Clear();
+
+  /// @brief Call `function` with the ID of every button that went up or down
+  ///        this frame.
+  void ForEachChangedButton(
+      const std::function<void(int, const Button &)> &function) const;
+
+  /// @brief Get the index of a button ID in the dense array, or -1 if the
+  ///        button is stored in the hash table.
+  static int DenseIndex(int button) {
+    if (button < 0) {
+      return button >= -kNumNegativeButtons ? button + kNumNegativeButtons
+                                            : -1;
+    }
+    if (button < kNumCharacterKeys) return kNumNegativeButtons + button;
+    const int scancode = button & ~FPLK_SCANCODE_MASK;
+    if ((button & FPLK_SCANCODE_MASK) && scancode < kNumScancodeKeys) {
+      return kNumNegativeButtons + kNumCharacterKeys + scancode;
+    }
+    return -1;
+  }
+
+ private:
+  Button dense_[kNumDenseButtons];
+  std::unordered_map<int, Button> sparse_;
+};
+
 /// @class InputPointer
 /// @brief Stores information about the current and recent state of a pointer.
 ///
@@ -549,6 +612,10 @@ struct TextInputEvent {
                  int32_t length);
 };
 
+class InputPlayer;
+class InputRecorder;
+struct InputFrame;
+
 /// @class InputSystem
 /// @brief Use to handle time, touch/mouse/keyboard/etc input, and lifecyle
 ///        events.
@@ -776,6 +843,28 @@ class InputSystem {
   /// @brief Sets if the application is currently minimized.
   void set_minimized(bool b) { minimized_ = b; }
 
+  /// @brief Record the outcome of every AdvanceFrame() into `recorder`.
+  ///
+  /// @param recorder The recorder to append to, or nullptr to stop recording.
+  ///        Not owned by the InputSystem.
+  void set_input_recorder(InputRecorder *recorder) {
+    input_recorder_ = recorder;
+  }
+  /// @brief The recorder set with set_input_recorder(), if any.
+  InputRecorder *input_recorder() const { return input_recorder_; }
+
+  /// @brief Replace live events and time with a recording.
+  ///
+  /// While `player` has frames left, AdvanceFrame() ignores platform events
+  /// and the real clock, and instead applies the next recorded frame. Once it
+  /// runs out, live input resumes.
+  ///
+  /// @param player The recording to play, or nullptr to stop replaying. Not
+  ///        owned by the InputSystem.
+  void set_input_player(InputPlayer *player) { input_player_ = player; }
+  /// @brief The player set with set_input_player(), if any.
+  InputPlayer *input_player() const { return input_player_; }
+
   /// @brief Gets if exit has been requested by the system.
   bool exit_requested() { return exit_requested_; }
   /// @brief Sets if exit has been requested.
@@ -792,6 +881,10 @@ class InputSystem {
   // The event specific part of AdvanceFrame().
   void UpdateEvents(mathfu::vec2i *window_size);
 
+  // Record and replay the outcome of UpdateEvents().
+  void CaptureInputFrame(const mathfu::vec2i &window_size, InputFrame *frame);
+  void ApplyInputFrame(const InputFrame &frame, mathfu::vec2i *window_size);
+
   bool exit_requested_;
   bool minimized_;
   std::vector<InputPointer> pointers_;
@@ -802,7 +895,7 @@ class InputSystem {
   void RemovePointer(size_t i);
   mathfu::vec2 ConvertHatToVector(uint32_t hat_enum) const;
   std::vector<AppEventCallback> app_event_callbacks_;
-  std::map<int, Button> button_map_;
+  ButtonTable button_table_;
   std::map<JoystickId, Joystick> joystick_map_;
 
 #if ANDROID_GAMEPAD
@@ -844,6 +937,13 @@ class InputSystem {
   // A flag indicating a text input status.
   bool record_text_input_;
 
+  // True if ResetInputState() was called since the last recorded frame.
+  bool input_reset_;
+
+  // Where to record input to, and where to replay it from, if anywhere.
+  InputRecorder *input_recorder_;
+  InputPlayer *input_player_;
+
   // True if most recent pointer events are coming from a touch screen,
   // false if coming from a mouse or similar.
   bool touch_device_;
@@ -0,0 +1,153 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_INPUT_RECORDING_H
+#define FPLBASE_INPUT_RECORDING_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "fplbase/input.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_input
+/// @{
+
+/// @class InputFrame
+/// @brief The InputSystem state that one call to AdvanceFrame() produced.
+///
+/// This is what is recorded and replayed: the outcome of the frame's events
+/// rather than the platform events themselves, so that a recording made with
+/// one backend can be replayed with any other, including on machines with no
+/// window or input devices. Joystick and text input are not recorded.
+struct InputFrame {
+  /// @brief A button that went up or down during the frame.
+  struct ButtonState {
+    ButtonState() : id(0), is_down(false), went_down(false), went_up(false) {}
+    int id;
+    bool is_down;
+    bool went_down;
+    bool went_up;
+  };
+
+  InputFrame()
+      : delta_time(0.0),
+        mousewheel_delta(mathfu::kZeros2i),
+        window_size(mathfu::kZeros2i),
+        exit_requested(false),
+        minimized(false),
+        touch_device(false),
+        input_reset(false) {}
+
+  /// @brief Seconds since the previous frame.
+  double delta_time;
+  /// @brief Every button with went_down() or went_up() set.
+  std::vector<ButtonState> buttons;
+  /// @brief All InputSystem::kMaxSimultanuousPointers pointers.
+  std::vector<InputPointer> pointers;
+  mathfu::vec2i mousewheel_delta;
+  mathfu::vec2i window_size;
+  bool exit_requested;
+  bool minimized;
+  bool touch_device;
+  /// @brief True if every button was released before applying `buttons`,
+  ///        e.g. when an Android app came back to the foreground.
+  bool input_reset;
+};
+
+/// @class InputRecorder
+/// @brief Encodes InputFrames into a compact binary stream.
+///
+/// Attach to an InputSystem with InputSystem::set_input_recorder() to capture
+/// a session, then Save() it. Pointers are only written when they changed
+/// since the previous frame, so an idle frame costs under 32 bytes.
+class InputRecorder {
+ public:
+  InputRecorder();
+
+  /// @brief Append a frame to the stream.
+  void AddFrame(const InputFrame &frame);
+
+  /// @brief Forget all recorded frames.
+  void Clear();
+
+  /// @brief Write the stream to a file.
+  bool Save(const char *filename) const;
+
+  /// @brief The encoded stream.
+  const std::string &data() const { return data_; }
+
+  /// @brief The number of frames recorded.
+  int num_frames() const { return num_frames_; }
+
+ private:
+  std::string data_;
+  int num_frames_;
+  // Pointers as of the last recorded frame.
+  std::vector<InputPointer> pointers_;
+};
+
+/// @class InputPlayer
+/// @brief Decodes a stream written by InputRecorder, one frame at a time.
+///
+/// Attach to an InputSystem with InputSystem::set_input_player() to replace
+/// live input and time with the recording.
+class InputPlayer {
+ public:
+  InputPlayer();
+
+  /// @brief Load a stream saved by InputRecorder::Save().
+  bool Load(const char *filename);
+
+  /// @brief Use a stream held in memory, e.g. InputRecorder::data().
+  bool Set(const std::string &data);
+
+  /// @brief Decode the next frame.
+  ///
+  /// @return Returns false once all frames have been played, or if the
+  ///         stream is corrupt.
+  bool NextFrame(InputFrame *frame);
+
+  /// @brief Start playing again from the first frame.
+  void Rewind();
+
+  /// @brief True once every frame has been played.
+  bool finished() const { return position_ >= data_.size(); }
+
+  /// @brief If greater than zero, every frame advances time by this many
+  ///        seconds instead of by the recorded delta time.
+  ///
+  /// A fixed timestep makes simulation results independent of the frame
+  /// times of the machine the recording was made on.
+  void set_fixed_timestep(double seconds) { fixed_timestep_ = seconds; }
+  double fixed_timestep() const { return fixed_timestep_; }
+
+ private:
+  std::string data_;
+  size_t position_;
+  double fixed_timestep_;
+  // Pointers as of the last decoded frame.
+  std::vector<InputPointer> pointers_;
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_INPUT_RECORDING_H
@@ -27,6 +27,7 @@ namespace fplbase {
 /// @addtogroup fplbase_material
 /// @{
 
+class RenderContext;
 class Renderer;
 class Texture;
 
@@ -55,10 +56,14 @@ enum BlendMode {
 class Material : public Asset {
  public:
   /// @brief Default constructor for Material.
-  Material() : blend_mode_(kBlendModeOff) {}
+  Material() : blend_mode_(kBlendModeOff), texture_layer_(0) {}
 
   /// @brief Set the renderer for this Material.
   /// @param[in] renderer The renderer to set for this Material.
+  /// @param[in] render_context The context the blend mode and textures are
+  /// set in.
+  void Set(Renderer &renderer, RenderContext *render_context);
+  /// @overload void Set(Renderer &renderer)
   void Set(Renderer &renderer);
 
   /// @brief Get all Textures from this Material.
@@ -85,12 +90,25 @@ class Material : public Asset {
     blend_mode_ = blend_mode;
   }
 
+  /// @brief Get the layer of the texture arrays this Material samples.
+  /// @return Returns the index of the layer, 0 if the textures aren't arrays.
+  int texture_layer() const { return texture_layer_; }
+
+  /// @brief Set the layer of the texture arrays this Material samples.
+  ///
+  /// Materials that differ only in their layer share their textures, so
+  /// drawing them one after the other doesn't rebind any.
+  /// @param[in] texture_layer The index of the layer, passed to shaders as
+  /// the `aTextureLayer` attribute.
+  void set_texture_layer(int texture_layer) { texture_layer_ = texture_layer; }
+
   /// @brief Delete all Textures in this Material.
   void DeleteTextures();
 
  private:
   std::vector<Texture *> textures_;
   BlendMode blend_mode_;
+  int texture_layer_;
 };
 
 /// @}
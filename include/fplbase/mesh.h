@@ -20,6 +20,7 @@
 #include "fplbase/config.h"  // Must come first.
 #include "fplbase/asset.h"
 
+#include "fplbase/frustum.h"
 #include "fplbase/material.h"
 #include "fplbase/shader.h"
 #include "mathfu/constants.h"
@@ -59,6 +60,9 @@ class Mesh : public Asset {
   };
 
   /// @brief Initialize a Mesh by creating one VBO, and no IBO's.
+  ///
+  /// With a `count` of 0, no VBO is created, so the mesh can be used for its
+  /// bones alone without a GL context.
   Mesh(const void *vertex_data, int count, int vertex_size,
        const Attribute *format, mathfu::vec3 *max_position = nullptr,
        mathfu::vec3 *min_position = nullptr);
@@ -112,6 +116,28 @@ class Mesh : public Asset {
   void GatherShaderTransforms(const mathfu::AffineTransform *bone_transforms,
                               mathfu::AffineTransform *shader_transforms) const;
 
+  /// @brief One skinned instance to process with the batched version of
+  ///        GatherShaderTransforms().
+  struct SkinnedInstance {
+    /// The mesh whose bones are animated.
+    const Mesh *mesh;
+    /// Input bone transforms, in object space. Length mesh->num_bones().
+    const mathfu::AffineTransform *bone_transforms;
+    /// Output shader transforms. Length mesh->num_shader_bones().
+    mathfu::AffineTransform *shader_transforms;
+  };
+
+  /// @brief Convert bone transforms for many skinned instances at once.
+  ///
+  /// Equivalent to calling GatherShaderTransforms() on every instance, but
+  /// large batches are split across threads with ParallelFor(). Instances may
+  /// share a mesh, but must not share output arrays.
+  ///
+  /// @param instances Array of instances to process.
+  /// @param num_instances Length of `instances`.
+  static void GatherShaderTransforms(const SkinnedInstance *instances,
+                                     size_t num_instances);
+
   /// @brief Render the mesh.
   ///
   /// Call to have the mesh render itself. Uniforms must have been set before
@@ -121,10 +147,22 @@ class Mesh : public Asset {
   /// @param renderer The renderer object to be used.
   /// @param ignore_material Whether to ignore the meshes defined material.
   /// @param instances The number of instances to be rendered.
+  /// @param render_context The context materials are set in.
+  void Render(Renderer &renderer, bool ignore_material, size_t instances,
+              RenderContext *render_context);
+  /// @overload void Render(Renderer &renderer, bool ignore_material,
+  ///                       size_t instances)
   void Render(Renderer &renderer, bool ignore_material = false,
               size_t instances = 1);
 
   /// @brief Render the mesh, itself, into stereoscopic viewports.
+  ///
+  /// When both eyes are visible, the renderer supports OpenGL ES 3.0 and the
+  /// shader supports instanced stereo (see Shader::SupportsInstancedStereo()),
+  /// both eyes are drawn with a single instanced draw call per surface, and
+  /// the shader's uniforms are uploaded once. Otherwise each eye is drawn
+  /// with its own viewport and uniforms.
+  ///
   /// @param renderer The renderer object to be used.
   /// @param shader The shader object to be used.
   /// @param viewport An array with two elements (left and right parameters) for
@@ -135,10 +173,29 @@ class Mesh : public Asset {
   /// parameters) for camera position.
   /// @param ignore_material Whether to ignore the meshes defined material.
   /// @param instances The number of instances to be rendered.
+  /// @param visible_eyes Bitmask of the eyes to render into, as computed for
+  /// this mesh by CullBoundingBoxes() with the left and right eye frustums.
+  /// Eyes that can't see the mesh are skipped entirely.
   void RenderStereo(Renderer &renderer, const Shader *shader,
                     const mathfu::vec4i *viewport, const mathfu::mat4 *mvp,
                     const mathfu::vec3 *camera_position,
-                    bool ignore_material = false, size_t instances = 1);
+                    bool ignore_material = false, size_t instances = 1,
+                    uint8_t visible_eyes = kFrustumVisibleBothEyes);
+
+  /// @brief Compute the shared viewport and per-eye uniforms of instanced
+  /// stereo rendering.
+  ///
+  /// @param viewport An array with two elements (left and right parameters)
+  /// for the viewport.
+  /// @param span Set to the viewport spanning both eyes.
+  /// @param viewport_transform Set to two scale (xy) and offset (zw) pairs,
+  /// mapping each eye's clip space into `span`.
+  /// @param viewport_bounds Set to the window rectangle of each eye, min (xy)
+  /// and max (zw), for shaders to discard pixels outside of.
+  static void ComputeStereoViewports(const mathfu::vec4i *viewport,
+                                     mathfu::vec4i *span,
+                                     mathfu::vec4 *viewport_transform,
+                                     mathfu::vec4 *viewport_bounds);
 
   /// @brief Get the material associated with the IBO at the given index.
   ///
@@ -158,7 +215,8 @@ class Mesh : public Asset {
   ///
   /// Renders primitives using vertex and index data directly in local memory.
   /// This is a convenient alternative to creating a Mesh instance for small
-  /// amounts of data, or dynamic data.
+  /// amounts of data, or dynamic data. The data is copied into the
+  /// Renderer's streaming buffers, so it can be freed after this returns.
   ///
   /// @param primitive The type of primitive to render the data as.
   /// @param index_count The total number of indices.
@@ -175,7 +233,8 @@ class Mesh : public Asset {
   ///
   /// Renders primitives using vertex data directly in local memory. This is a
   /// convenient alternative to creating a Mesh instance for small amounts of
-  /// data, or dynamic data.
+  /// data, or dynamic data. The data is copied into the Renderer's streaming
+  /// buffers, so it can be freed after this returns.
   ///
   /// @param primitive The type of primitive to render the data as.
   /// @param vertex_count The total number of vertices.
@@ -302,6 +361,7 @@ class Mesh : public Asset {
     kAttributeColor,
     kAttributeBoneIndices,
     kAttributeBoneWeights,
+    kAttributeTextureLayer,  // Constant, set by Renderer::SetTextureLayer().
   };
 
   /// @brief Compute the byte size for a vertex from given attributes.
@@ -348,6 +408,10 @@ class Mesh : public Asset {
   /// @return Returns the total number of indices across all IBOs.
   size_t CalculateTotalNumberOfIndices() const;
 
+  /// @brief Size of the vertex and index buffers, and of the bone data.
+  /// Materials are not included.
+  virtual AssetMemoryUsage MemoryUsage() const;
+
   MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
 
  private:
@@ -367,6 +431,11 @@ class Mesh : public Asset {
                             int vertex_size, const char *buffer);
   static void UnSetAttributes(const Attribute *attributes);
   void DrawElement(Renderer &renderer, int32_t count, int32_t instances);
+  void RenderInstancedStereo(Renderer &renderer, const Shader *shader,
+                             const mathfu::vec4i *viewport,
+                             const mathfu::mat4 *mvp,
+                             const mathfu::vec3 *camera_position,
+                             bool ignore_material, size_t instances);
 
   struct Indices {
     int count;
@@ -0,0 +1,66 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_PARALLEL_FOR_H
+#define FPLBASE_PARALLEL_FOR_H
+
+#include <stddef.h>
+#include <functional>
+
+#include "fplbase/config.h"  // Must come first.
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_utilities
+/// @{
+
+/// @brief Function called by ParallelFor() on each sub-range [begin, end).
+typedef std::function<void(size_t begin, size_t end)> ParallelForBody;
+
+/// @brief Split the range [0, count) over several threads and wait for them.
+///
+/// The range is divided into at most ParallelForThreadCount() contiguous
+/// sub-ranges, each at least `min_range` long, and `body` is called once per
+/// sub-range. The calling thread processes the first sub-range itself, so
+/// small ranges never pay for a thread. Sub-ranges never overlap, so `body`
+/// may freely write to per-index output.
+///
+/// The other sub-ranges run on worker threads that are started the first
+/// time they are needed and kept for the lifetime of the program, so a call
+/// costs a lock and a wakeup per thread rather than starting threads. That
+/// is still a few microseconds, so keep `min_range` well above the work that
+/// takes. ParallelFor() may be called from several threads at once, and
+/// from inside `body`.
+///
+/// @param count The number of items to process.
+/// @param min_range The smallest sub-range worth handing to a thread.
+/// @param body The function to call on each sub-range.
+void ParallelFor(size_t count, size_t min_range, const ParallelForBody &body);
+
+/// @brief The maximum number of threads ParallelFor() will use.
+///
+/// @return Defaults to the number of CPU cores.
+size_t ParallelForThreadCount();
+
+/// @brief Override the maximum number of threads ParallelFor() will use.
+///
+/// @param count Pass 1 to run everything on the calling thread, or 0 to go
+///        back to using one thread per CPU core.
+void SetParallelForThreadCount(size_t count);
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_PARALLEL_FOR_H
@@ -0,0 +1,234 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPLBASE_PIXEL_BUFFER_POOL_H
+#define FPLBASE_PIXEL_BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+#include "fplbase/fpl_common.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_texture
+/// @{
+
+/// @class PixelBufferBackend
+/// @brief The GL buffer operations PixelBufferPool is built on.
+///
+/// GlPixelBufferBackend implements these with OpenGL; tests substitute a
+/// mock.
+class PixelBufferBackend {
+ public:
+  virtual ~PixelBufferBackend() {}
+
+  /// @brief True if pixel buffer objects can be mapped at all.
+  virtual bool Supported() const = 0;
+  /// @brief Create a buffer with `size` bytes of storage. 0 on failure.
+  virtual unsigned int CreateBuffer(size_t size) = 0;
+  /// @brief Delete a buffer made by CreateBuffer(). It is not mapped.
+  virtual void DeleteBuffer(unsigned int buffer) = 0;
+  /// @brief Map all `size` bytes of `buffer` for writing, discarding its
+  ///        old contents. nullptr on failure.
+  virtual void *Map(unsigned int buffer, size_t size) = 0;
+  /// @brief Unmap `buffer`. False if its contents were lost while mapped.
+  virtual bool Unmap(unsigned int buffer) = 0;
+  /// @brief Bind `buffer` as the pixel unpack buffer, or unbind with 0.
+  virtual void Bind(unsigned int buffer) = 0;
+};
+
+/// @class GlPixelBufferBackend
+/// @brief PixelBufferBackend using GL_PIXEL_UNPACK_BUFFER.
+///
+/// Needs OpenGL (ES) 3.0. Without it, Supported() is false and textures are
+/// uploaded from client memory as before.
+class GlPixelBufferBackend : public PixelBufferBackend {
+ public:
+  GlPixelBufferBackend();
+
+  /// @brief Look up the mapping functions. Call with a current GL context.
+  ///
+  /// @param gl3 True if the context is OpenGL (ES) 3.0 or better.
+  void Initialize(bool gl3);
+
+  virtual bool Supported() const { return supported_; }
+  virtual unsigned int CreateBuffer(size_t size);
+  virtual void DeleteBuffer(unsigned int buffer);
+  virtual void *Map(unsigned int buffer, size_t size);
+  virtual bool Unmap(unsigned int buffer);
+  virtual void Bind(unsigned int buffer);
+
+ private:
+  bool supported_;
+  // Entry points that GL 2 headers lack, so they are looked up at runtime.
+  void *map_buffer_range_;
+  void *unmap_buffer_;
+};
+
+/// @class PixelBufferPool
+/// @brief Mapped pixel buffer objects that texture data is staged in.
+///
+/// Idle buffers are kept mapped, so any thread can Acquire() one and write
+/// pixels into it, e.g. the loader thread right after decoding. The GL thread
+/// then only has to unmap it and issue the upload from it, which the driver
+/// can do without copying the pixels or waiting for the GPU.
+///
+/// Mapping and creating buffers has to happen on the GL thread, so a request
+/// that no idle buffer fits fails, and the caller uploads from client memory
+/// instead. The pool remembers the size it wanted, and AdvanceFrame() creates
+/// a buffer for it, within max_bytes(). Buffers an upload was issued from
+/// are mapped again once kFramesInFlight frames have passed, so the GPU is
+/// done with them. Buffers that go unused for kIdleFrames are deleted, so
+/// the pool shrinks again after a burst of loading.
+///
+/// The Renderer owns one, advanced with the streaming buffers. Texture::Load()
+/// stages textures that need no conversion in it, and
+/// Texture::UpdateTexture() streams through it.
+class PixelBufferPool {
+ public:
+  /// @brief Frames before a buffer an upload was issued from is reused.
+  static const int kFramesInFlight = 3;
+  /// @brief Frames an idle buffer is kept for.
+  static const uint32_t kIdleFrames = 300;
+  /// @brief Buffers are a power of two in size, and at least this big.
+  static const size_t kMinBufferSize = 64 * 1024;
+
+  /// @brief A mapped buffer handed out by Acquire().
+  struct Staging {
+    Staging() : buffer(0), data(nullptr), size(0) {}
+    /// @brief The GL buffer, or 0 if none was acquired.
+    unsigned int buffer;
+    /// @brief Where to write the pixels.
+    uint8_t *data;
+    /// @brief The number of bytes `data` has room for.
+    size_t size;
+  };
+
+  /// @param backend Creates and maps the buffers. Not owned.
+  /// @param max_bytes The most memory all buffers together may take.
+  PixelBufferPool(PixelBufferBackend *backend, size_t max_bytes);
+  ~PixelBufferPool();
+
+  /// @brief True if the backend supports pixel buffer objects.
+  bool Supported() const { return backend_->Supported(); }
+
+  /// @brief Take an idle buffer with room for `size` bytes. Thread-safe.
+  ///
+  /// @return Returns false, leaving `staging` empty, if there is none. The
+  ///         next AdvanceFrame() then tries to create one.
+  bool Acquire(size_t size, Staging *staging);
+
+  /// @brief Give back a buffer that no upload was issued from. Thread-safe.
+  ///
+  /// Empties `staging`. Does nothing if it is already empty.
+  void Release(Staging *staging);
+
+  /// @brief Unmap the buffer and bind it as the pixel unpack buffer, so that
+  ///        texture uploads read from it. GL thread only.
+  ///
+  /// Pointers passed to glTexImage2D() and friends are then offsets into the
+  /// buffer. Always follow with EndTransfer().
+  ///
+  /// @return Returns false if the contents were lost while the buffer was
+  ///         mapped; it is then not bound.
+  bool BeginTransfer(const Staging &staging);
+
+  /// @brief Unbind the buffer, and reuse it once the GPU is done with it.
+  ///        GL thread only.
+  ///
+  /// Empties `staging`.
+  void EndTransfer(Staging *staging);
+
+  /// @brief Map buffers that are free again, and create the ones requests
+  ///        failed for since the last call. GL thread only.
+  ///
+  /// Called by Renderer::AdvanceStreamingBuffers() once per frame.
+  void AdvanceFrame();
+
+  /// @brief Delete all buffers. Call before destroying the GL context.
+  ///
+  /// Release() or EndTransfer() every acquired buffer first. One still
+  /// acquired may be being written to, so it is kept, and deleted when
+  /// Release() or EndTransfer() gives it back. Uploads from it fail.
+  void Reset();
+
+  /// @brief Change the most memory all buffers together may take.
+  ///
+  /// Doesn't delete buffers already over the limit until they are idle.
+  void set_max_bytes(size_t max_bytes);
+  size_t max_bytes() const { return max_bytes_; }
+
+  /// @brief The size of all buffers, in bytes.
+  size_t total_bytes() const;
+
+  /// @brief The number of buffers, in any state, including ones still
+  ///        acquired over a Reset().
+  size_t num_buffers() const;
+
+  /// @brief The number of buffers mapped and waiting for Acquire().
+  size_t num_idle() const;
+
+  /// @brief The size of buffer Acquire() would want for `size` bytes.
+  static size_t BufferSize(size_t size);
+
+ private:
+  enum State {
+    kIdle,      // Mapped, waiting for Acquire().
+    kAcquired,  // Mapped, being written by its owner.
+    kInFlight,  // Unmapped, an upload may still read it.
+    kOrphaned,  // Acquired over a Reset(), deleted once given back.
+  };
+
+  struct Buffer {
+    unsigned int id;
+    size_t size;
+    uint8_t *data;
+    State state;
+    // The frame the buffer was last acquired or uploaded from.
+    uint32_t last_use;
+  };
+
+  // Returns the index of the buffer with `id`, or -1. Hold the lock.
+  int Find(unsigned int id) const;
+  // Deletes buffers_[index], unmapping it first if needed. Hold the lock.
+  void Delete(size_t index);
+  // Deletes idle buffers, least recently used first, until `size` more
+  // bytes fit. Hold the lock.
+  bool MakeRoom(size_t size);
+
+  PixelBufferBackend *backend_;
+  size_t max_bytes_;
+  size_t total_bytes_;
+  uint32_t frame_;
+  std::vector<Buffer> buffers_;
+  // Buffer sizes that Acquire() found nothing for.
+  std::vector<size_t> wanted_;
+  // Guards everything above. An SDL_mutex or a std::mutex, depending on the
+  // backend.
+  void *mutex_;
+
+  friend class PixelBufferPoolLock;
+  // The GL buffers are owned by this object.
+  FPL_DISALLOW_COPY_AND_ASSIGN(PixelBufferPool);
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_PIXEL_BUFFER_POOL_H
@@ -15,12 +15,98 @@
 #ifndef FPLBASE_PREPROCESSOR_H
 #define FPLBASE_PREPROCESSOR_H
 
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fplbase/fpl_common.h"
 #include "fplbase/utilities.h"
 
 namespace fplbase {
+
+/// @class Preprocessor
+/// @brief Expands \#include, and evaluates \#define, \#ifdef and \#ifndef.
+///
+/// Each file is split into directives and runs of text, and kept in a cache.
+/// Files are read with LoadFile() on every call, so changes, and any custom
+/// LoadFileFunction, are always seen, but are only split again when their
+/// contents differ from the cached ones. The output is built by appending,
+/// in a single pass over the files.
+///
+/// Identifiers given to Process() and ones \#defined without a value are
+/// evaluated here: by \#ifdef and \#ifndef, and as `defined(X)` in \#if and
+/// \#elif, which becomes `1`. Their \#define lines are removed. Defines
+/// given to Process() with a value, e.g. "NUM_LIGHTS 4", are also written out
+/// after any \#version line. \#defines with a value or arguments, \#if, and
+/// conditionals on identifiers the GLSL compiler predefines (starting with
+/// `GL_` or `__`) are left for the GLSL compiler. Each file is included at
+/// most once per call.
+///
+/// It is safe to call Process() from several threads at once.
+class Preprocessor {
+ public:
+  Preprocessor();
+  ~Preprocessor();
+
+  /// @brief The Preprocessor used by LoadFileWithDirectives().
+  static Preprocessor &Shared();
+
+  /// @brief Load a file, and process its directives.
+  ///
+  /// @param[in] filename The file to load, with LoadFile().
+  /// @param[in] defines A nullptr-terminated array of identifiers to treat as
+  /// \#defined, each optionally followed by a space and a value, or nullptr.
+  /// @param[out] dest Set to the processed file.
+  /// @param[out] error_message Set to the reason if this returns false.
+  /// @param[out] sources If not nullptr, set to `filename` followed by the
+  /// files it \#includes, in the order they were first included. The index of
+  /// each is its source string number in \#line directives.
+  /// @return Returns false if a file can't be loaded, or a directive is
+  /// malformed or unmatched.
+  bool Process(const char *filename, const char *const *defines,
+               std::string *dest, std::string *error_message,
+               std::vector<std::string> *sources = nullptr);
+
+  /// @brief Emit \#line directives, so shader compile errors can be mapped
+  /// back to the file and line they came from.
+  ///
+  /// Around every included file, a `#line LINE SOURCE` directive is emitted,
+  /// where SOURCE is the index of the file in Process()'s `sources`, and
+  /// removed directive lines are left blank rather than deleted. Off by
+  /// default.
+  void set_line_directives(bool enable) { line_directives_ = enable; }
+
+  /// @brief Whether \#line directives are emitted.
+  bool line_directives() const { return line_directives_; }
+
+  /// @brief Forget all cached files.
+  void ClearCache();
+
+  /// @brief Number of files in the cache.
+  size_t cache_size() const;
+
+ private:
+  FPL_DISALLOW_COPY_AND_ASSIGN(Preprocessor);
+  friend class PreprocessorCacheLock;
+
+  struct ParsedFile;
+  struct State;
+
+  std::shared_ptr<const ParsedFile> LoadParsed(const std::string &filename,
+                                               std::string *error_message);
+  bool ProcessFile(const std::string &filename, State *state);
+
+  bool line_directives_;
+  // Guards cache_. An SDL_mutex or a std::mutex, depending on the backend.
+  void *cache_mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const ParsedFile>> cache_;
+};
+
 /// @brief Load a file like `LoadFile()`, but scan for directives.
 ///
-/// The only supported directives is \#include.
+/// Uses Preprocessor::Shared(); see Preprocessor for the supported directives.
 /// @param[in] filename A UTF-8 C-string representing the file to load.
 /// @param[out] dest A pointer to a `std::string` to capture the preprocessed
 /// version of the file.
@@ -38,14 +124,31 @@ bool LoadFileWithDirectives(const char *filename, std::string *dest,
 /// @param[out] dest A pointer to a `std::string` to capture the preprocessed
 /// version of the file.
 /// @param[in] defines A nullptr-terminated array of identifiers which will be
-/// prefixed with \#define at the start of the file.
-/// before loading the file.
+/// treated as \#defined by \#ifdef and \#ifndef.
+/// @param[out] error_message A pointer to a `std::string` that captures an
+/// error message (if the function returned `false`, indicating failure).
+/// @return If this function returns false, `error_message` indicates which
+/// directive caused the problem and why.
+bool LoadFileWithDirectives(const char *filename, std::string *dest,
+                            const char * const *defines,
+                            std::string *error_message);
+
+/// @brief Overloaded LoadFileWithDirectives to also find every file read.
+///
+/// @param[in] filename A UTF-8 C-string representing the file to load.
+/// @param[out] dest A pointer to a `std::string` to capture the preprocessed
+/// version of the file.
+/// @param[in] defines A nullptr-terminated array of identifiers which will be
+/// treated as \#defined by \#ifdef and \#ifndef, or nullptr.
+/// @param[out] files Set to `filename` and every file it \#includes, directly
+/// or not. Useful for reloading the file when any of them change.
 /// @param[out] error_message A pointer to a `std::string` that captures an
 /// error message (if the function returned `false`, indicating failure).
 /// @return If this function returns false, `error_message` indicates which
 /// directive caused the problem and why.
 bool LoadFileWithDirectives(const char *filename, std::string *dest,
                             const char * const *defines,
+                            std::set<std::string> *files,
                             std::string *error_message);
 }
 
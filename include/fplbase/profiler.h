@@ -0,0 +1,181 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_PROFILER_H
+#define FPLBASE_PROFILER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+/// @brief Set to 0 to compile out the FPLBASE_PROFILE_* macros and the
+///        instrumentation inside FPLBase.
+#ifndef FPLBASE_ENABLE_PROFILER
+#define FPLBASE_ENABLE_PROFILER 1
+#endif
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_profiler
+/// @{
+
+/// @brief The kinds of event the profiler records.
+enum ProfileEventType {
+  kProfileZoneBegin,
+  kProfileZoneEnd,
+  kProfileCounter,
+  kProfileAsyncBegin,
+  kProfileAsyncEnd,
+};
+
+/// @brief One recorded event.
+struct ProfileEvent {
+  /// @brief Nanoseconds since the profiler was first used.
+  uint64_t time;
+  /// @brief Zone, counter or span name. Always a string that lives forever:
+  ///        a literal, or the result of ProfileInternName().
+  const char *name;
+  /// @brief The counter value, or the cookie of an async span.
+  int64_t value;
+  ProfileEventType type;
+};
+
+/// @brief The events recorded by one thread.
+struct ProfileThreadEvents {
+  /// @brief Small number identifying the thread, in order of first use.
+  ///
+  /// A thread that has exited passes its index, and its buffer, on to a
+  /// later thread once its events have been cleared by ProfilerClear().
+  int thread_index;
+  /// @brief Name set with ProfileSetThreadName(), or empty.
+  std::string thread_name;
+  /// @brief Events in the order they were recorded.
+  std::vector<ProfileEvent> events;
+};
+
+/// @brief Turn recording on or off. Off by default.
+///
+/// While off, every profiling call returns after checking a flag.
+void ProfilerEnable(bool enable);
+
+/// @brief True if events are being recorded.
+bool ProfilerEnabled();
+
+/// @brief Record the start of a zone on the calling thread.
+///
+/// Zones nest, and must end on the thread they began on.
+///
+/// @param name The zone's name, which must outlive the profiler, e.g. a
+///        string literal.
+void ProfileBegin(const char *name);
+
+/// @brief Record the end of the most recently begun zone on this thread.
+void ProfileEnd();
+
+/// @brief Record the current value of a counter, shown as a graph.
+void ProfileCounter(const char *name, int64_t value);
+
+/// @brief Record the start of a span that may end on another thread.
+///
+/// @param name The span's name.
+/// @param cookie Identifies the span among those with the same name.
+void ProfileAsyncBegin(const char *name, int32_t cookie);
+
+/// @brief Record the end of a span begun with ProfileAsyncBegin().
+void ProfileAsyncEnd(const char *name, int32_t cookie);
+
+/// @brief Make an async span cookie from the address of the object the span
+///        is about.
+inline int32_t ProfileCookie(const void *object) {
+  const uint64_t address = reinterpret_cast<uintptr_t>(object);
+  return static_cast<int32_t>(address ^ (address >> 32));
+}
+
+/// @brief Name the calling thread in exported traces.
+void ProfileSetThreadName(const char *name);
+
+/// @brief Get a copy of `name` that lives as long as the program, for
+///        names that aren't literals, e.g. asset file names.
+///
+/// Takes a lock, so avoid calling this every frame.
+const char *ProfileInternName(const std::string &name);
+
+/// @brief Copy the events recorded so far, one entry per thread.
+///
+/// Safe to call while other threads are recording; events recorded during
+/// the call may or may not be included.
+void ProfilerCollect(std::vector<ProfileThreadEvents> *threads);
+
+/// @brief Forget all events recorded so far.
+void ProfilerClear();
+
+/// @brief Number of events dropped because a thread's buffer was full.
+uint64_t ProfilerDroppedEvents();
+
+/// @brief Format events as Chrome trace event JSON.
+///
+/// Load the result in chrome://tracing or https://ui.perfetto.dev.
+std::string ProfilerChromeTraceJson(
+    const std::vector<ProfileThreadEvents> &threads);
+
+/// @brief Collect all events and save them as Chrome trace event JSON.
+///
+/// @return Returns false if the file could not be written.
+bool ProfilerSaveChromeTrace(const char *filename);
+
+/// @class ProfileZone
+/// @brief Records a zone for the lifetime of the object.
+///
+/// Normally used through FPLBASE_PROFILE_ZONE().
+class ProfileZone {
+ public:
+  explicit ProfileZone(const char *name) { ProfileBegin(name); }
+  ~ProfileZone() { ProfileEnd(); }
+
+ private:
+  ProfileZone(const ProfileZone &);
+  ProfileZone &operator=(const ProfileZone &);
+};
+
+/// @}
+}  // namespace fplbase
+
+#define FPLBASE_PROFILE_CONCAT_INTERNAL(a, b) a##b
+#define FPLBASE_PROFILE_CONCAT(a, b) FPLBASE_PROFILE_CONCAT_INTERNAL(a, b)
+
+#if FPLBASE_ENABLE_PROFILER
+/// @brief Record a zone from here to the end of the enclosing scope.
+#define FPLBASE_PROFILE_ZONE(name)                                    \
+  fplbase::ProfileZone FPLBASE_PROFILE_CONCAT(fplbase_profile_zone_, \
+                                              __LINE__)(name)
+/// @brief Record the value of a counter.
+#define FPLBASE_PROFILE_COUNTER(name, value) \
+  fplbase::ProfileCounter(name, value)
+/// @brief Record the start of an async span.
+#define FPLBASE_PROFILE_ASYNC_BEGIN(name, cookie) \
+  fplbase::ProfileAsyncBegin(name, cookie)
+/// @brief Record the end of an async span.
+#define FPLBASE_PROFILE_ASYNC_END(name, cookie) \
+  fplbase::ProfileAsyncEnd(name, cookie)
+#else
+#define FPLBASE_PROFILE_ZONE(name) (void)(name)
+#define FPLBASE_PROFILE_COUNTER(name, value) ((void)(name), (void)(value))
+#define FPLBASE_PROFILE_ASYNC_BEGIN(name, cookie) ((void)(name), (void)(cookie))
+#define FPLBASE_PROFILE_ASYNC_END(name, cookie) ((void)(name), (void)(cookie))
+#endif  // FPLBASE_ENABLE_PROFILER
+
+#endif  // FPLBASE_PROFILER_H
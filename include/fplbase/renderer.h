@@ -17,9 +17,13 @@
 
 #include "fplbase/config.h"  // Must come first.
 
+#include "fplbase/frame_stats.h"
+#include "fplbase/gpu_timer.h"
 #include "fplbase/material.h"
 #include "fplbase/mesh.h"
+#include "fplbase/pixel_buffer_pool.h"
 #include "fplbase/shader.h"
+#include "fplbase/streaming_buffer.h"
 #include "fplbase/texture.h"
 #include "fplbase/version.h"
 #include "mathfu/glsl_mappings.h"
@@ -247,7 +251,9 @@ class Renderer {
   /// @param shader The old shader to replace with the recompiled shader.
   /// @param vs_source The source code of the vertex shader.
   /// @param ps_source The source code of the fragment shader.
-  void RecompileShader(const char *vs_source, const char *ps_source,
+  /// @return Returns false if the new shader failed to compile or link, in
+  /// which case `shader` is left as it was, and last_error() says why.
+  bool RecompileShader(const char *vs_source, const char *ps_source,
                        Shader *shader);
 
   /// @brief Begin rendering commands.
@@ -325,6 +331,29 @@ class Renderer {
   /// @overload void ScissorOff()
   void ScissorOff() { ScissorOff(default_render_context_); }
 
+  /// @brief Bind a texture to a texture unit, unless it already is.
+  ///
+  /// Materials sharing a texture, such as the layers of one texture array,
+  /// then draw one after the other without rebinding it.
+  ///
+  /// @param unit The texture unit, below kMaxTexturesPerShader.
+  /// @param target The target, e.g. GL_TEXTURE_2D.
+  /// @param texture The texture to bind.
+  void BindTexture(size_t unit, TextureTarget target, TextureHandle texture);
+
+  /// @brief Forget which textures are bound, after binding them without
+  /// BindTexture(), e.g. with direct OpenGL calls.
+  void InvalidateTextureBindings();
+
+  /// @brief Select the layer of a texture array the next draws sample.
+  ///
+  /// Sets the `aTextureLayer` vertex attribute, which shaders read as a
+  /// float, to the same value for every vertex. Only used with OpenGL (ES)
+  /// 3.0, the first version with texture arrays.
+  ///
+  /// @param layer The index of the layer.
+  void SetTextureLayer(int layer);
+
   /// @brief Set bone transforms in vertex shader uniforms.
   ///
   /// Allows vertex shader to skin each vertex to the bone position.
@@ -568,14 +597,54 @@ class Renderer {
   /// see: https://www.opengl.org/wiki/NPOT_Texture
   bool SupportsTextureNpot() const;
 
+  /// @brief Recycle the transient vertex and index buffers, and the pixel
+  /// buffers textures are staged in.
+  ///
+  /// Called by AdvanceFrame(). When the window isn't owned by the renderer,
+  /// call this once per frame after swapping buffers instead.
+  void AdvanceStreamingBuffers();
+
+  /// @brief Buffer for vertices that are only drawn this frame.
+  /// @return Returns the buffer used by Mesh::RenderArray().
+  StreamingBuffer &streaming_vertices() { return streaming_vertices_; }
+
+  /// @brief Buffer for indices that are only drawn this frame.
+  /// @return Returns the buffer used by Mesh::RenderArray().
+  StreamingBuffer &streaming_indices() { return streaming_indices_; }
+
+  /// @brief Pixel buffers that texture uploads are staged in.
+  ///
+  /// Only used with OpenGL (ES) 3.0; see PixelBufferPool::Supported().
+  PixelBufferPool &pixel_buffer_pool() { return pixel_buffer_pool_; }
+
+  /// @brief Timing of recent frames, split into phases.
+  ///
+  /// AdvanceFrame() times the swap and ends each frame. When the window isn't
+  /// owned by the renderer, call FrameStats::EndFrame() once per frame
+  /// instead.
+  FrameStats &frame_stats() { return frame_stats_; }
+  /// @brief Timing of recent frames, split into phases.
+  const FrameStats &frame_stats() const { return frame_stats_; }
+
+  /// @brief GPU time spent in each render pass.
+  ///
+  /// Render targets, the screen and the HMD eyes each begin a pass. Results
+  /// arrive a few frames late, once the GPU has finished them. AdvanceFrame()
+  /// advances the timer; when the window isn't owned by the renderer, call
+  /// GpuTimer::AdvanceFrame() once per frame after swapping buffers instead.
+  GpuTimer &gpu_timer() { return gpu_timer_; }
+
+  /// @brief The render context used by the overloads that don't take one.
+  RenderContext *default_render_context() const {
+    return default_render_context_;
+  }
+
  private:
   ShaderHandle CompileShader(bool is_vertex_shader, ShaderHandle program,
                              const char *source);
   Shader *CompileAndLinkShaderHelper(const char *vs_source,
                                      const char *ps_source, Shader *shader);
 
-  RenderContext *default_render_context() { return default_render_context_; }
-
   // Initialize OpenGL parameters like uniform limits, supported texture formats
   // etc.
   bool InitializeRenderingState();
@@ -603,6 +672,31 @@ class Renderer {
 
   int max_vertex_uniform_components_;
 
+  // The active texture unit and the texture bound to each unit, kept by
+  // BindTexture(). A unit of kMaxTexturesPerShader and a texture of 0 are
+  // unknown, since nothing binds texture 0 through it.
+  size_t active_texture_unit_;
+  TextureHandle bound_textures_[kMaxTexturesPerShader];
+  // The value of the aTextureLayer attribute, or -1 if unknown.
+  int texture_layer_;
+
+  // Transient geometry drawn by Mesh::RenderArray() and friends. The
+  // backends must be declared before the buffers, which use them.
+  GlStreamingBufferBackend streaming_vertex_backend_;
+  GlStreamingBufferBackend streaming_index_backend_;
+  StreamingBuffer streaming_vertices_;
+  StreamingBuffer streaming_indices_;
+
+  FrameStats frame_stats_;
+
+  // Must be declared before gpu_timer_, which uses it.
+  GlGpuTimerBackend gpu_timer_backend_;
+  GpuTimer gpu_timer_;
+
+  // Must be declared before pixel_buffer_pool_, which uses it.
+  GlPixelBufferBackend pixel_buffer_backend_;
+  PixelBufferPool pixel_buffer_pool_;
+
   // Current version of the library.
   const FplBaseVersion *version_;
 
@@ -22,6 +22,7 @@
 
 namespace fplbase {
 class Renderer;
+class RenderContext;
 
 /// @file
 /// @addtogroup fplbase_shader
@@ -52,7 +53,11 @@ class Shader : public Asset {
         uniform_light_pos_(-1),
         uniform_camera_pos_(-1),
         uniform_time_(-1),
-        uniform_bone_transforms_(-1) {}
+        uniform_bone_transforms_(-1),
+        uniform_stereo_model_view_projection_(-1),
+        uniform_stereo_camera_pos_(-1),
+        uniform_stereo_viewport_transform_(-1),
+        uniform_stereo_viewport_(-1) {}
 
   ~Shader();
 
@@ -63,6 +68,9 @@ class Shader : public Asset {
   /// Renderer, if this shader refers to them.
   ///
   /// @param renderer The renderer that has the standard uniforms set.
+  /// @param render_context The context whose uniform values are used.
+  void Set(const Renderer &renderer, RenderContext *render_context) const;
+  /// @overload void Set(const Renderer &renderer) const
   void Set(const Renderer &renderer) const;
 
   /// @brief Find a non-standard uniform by name.
@@ -137,6 +145,65 @@ class Shader : public Asset {
     return true;
   }
 
+  /// @brief Whether this shader can render both eyes in one instanced draw.
+  ///
+  /// Shaders opt into instanced stereo by declaring these uniforms:
+  ///
+  ///     uniform mat4 stereo_model_view_projection[2];
+  ///     uniform vec4 stereo_viewport_transform[2];
+  ///     uniform vec4 stereo_viewport[2];
+  ///     uniform vec3 stereo_camera_pos[2];  // Optional.
+  ///
+  /// Each instance is then drawn twice, and the vertex shader selects the eye
+  /// with `gl_InstanceID % 2` (the original instance is `gl_InstanceID / 2`).
+  /// Both eyes share one viewport spanning the two eye viewports, so the
+  /// vertex shader must move its output into the eye's part of it:
+  ///
+  ///     flat out int vEye;
+  ///     ...
+  ///     vEye = gl_InstanceID % 2;
+  ///     vec4 pos = stereo_model_view_projection[vEye] * aPosition;
+  ///     vec4 vt = stereo_viewport_transform[vEye];
+  ///     pos.xy = pos.xy * vt.xy + vt.zw * pos.w;
+  ///     gl_Position = pos;
+  ///
+  /// GL only clips against the shared viewport, so triangles that cross the
+  /// edge of an eye's frustum would spill into the other eye. The fragment
+  /// shader discards those pixels, using the window rectangle of each eye
+  /// (min in xy, max in zw):
+  ///
+  ///     flat in int vEye;
+  ///     ...
+  ///     vec4 vp = stereo_viewport[vEye];
+  ///     if (any(lessThan(gl_FragCoord.xy, vp.xy)) ||
+  ///         any(greaterThanEqual(gl_FragCoord.xy, vp.zw))) discard;
+  ///
+  /// Shaders without `stereo_viewport` don't clip, so are drawn one eye at a
+  /// time instead.
+  ///
+  /// @return Returns true if the stereo uniforms are present.
+  bool SupportsInstancedStereo() const {
+    return uniform_stereo_model_view_projection_ >= 0 &&
+           uniform_stereo_viewport_transform_ >= 0 &&
+           uniform_stereo_viewport_ >= 0;
+  }
+
+  /// @brief Set the per-eye uniforms used by instanced stereo rendering.
+  ///
+  /// Call this after Set(). Does nothing for shaders that don't support
+  /// instanced stereo.
+  ///
+  /// @param mvp Array of two Model View Projection matrices, left eye first.
+  /// @param camera_position Array of two camera positions.
+  /// @param viewport_transform Array of two scale (xy) and offset (zw)
+  ///        pairs, mapping each eye's clip space into the shared viewport.
+  /// @param viewport Array of two window rectangles, min (xy) and max (zw),
+  ///        outside of which each eye's pixels are discarded.
+  void SetStereoUniforms(const mathfu::mat4 *mvp,
+                         const mathfu::vec3 *camera_position,
+                         const mathfu::vec4 *viewport_transform,
+                         const mathfu::vec4 *viewport) const;
+
   void InitializeUniforms();
 
   ShaderHandle program() const { return program_; }
@@ -151,6 +218,10 @@ class Shader : public Asset {
   UniformHandle uniform_camera_pos_;
   UniformHandle uniform_time_;
   UniformHandle uniform_bone_transforms_;
+  UniformHandle uniform_stereo_model_view_projection_;
+  UniformHandle uniform_stereo_camera_pos_;
+  UniformHandle uniform_stereo_viewport_transform_;
+  UniformHandle uniform_stereo_viewport_;
 };
 
 /// @}
@@ -0,0 +1,149 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPLBASE_SHADER_PERMUTATIONS_H
+#define FPLBASE_SHADER_PERMUTATIONS_H
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "fplbase/asset.h"
+#include "fplbase/fpl_common.h"
+
+namespace fplbase {
+
+class Renderer;
+class Shader;
+
+/// @file
+/// @addtogroup fplbase_shader
+/// @{
+
+/// @brief The most features a shader can declare, giving 2^8 variants.
+static const int kMaxShaderFeatures = 8;
+
+/// @brief Find the feature keywords a shader declares.
+///
+/// Features are declared on lines of the form
+/// `#pragma fpl_features SHADOWS FOG`, which GLSL compilers ignore.
+/// shader_pipeline builds a variant of the shader for every combination of
+/// them, each with those features \#defined.
+///
+/// @param source The shader source, with \#includes already expanded.
+/// @param features Each keyword not already in it is appended, in order.
+void FindShaderFeatures(const char *source, std::vector<std::string> *features);
+
+/// @class ShaderPermutations
+/// @brief All variants of a shader built by shader_pipeline.
+///
+/// Variants are selected by a bitmask of features, where bit i stands for
+/// feature(i), so finding one is an array lookup. Each variant is compiled the
+/// first time it is asked for, or ahead of time with Prewarm(), which spreads
+/// the compiles over calls to AssetManager::TryFinalize().
+///
+/// Load these with AssetManager::LoadShaderPermutations().
+class ShaderPermutations : public Asset {
+ public:
+  explicit ShaderPermutations(Renderer &renderer);
+  ~ShaderPermutations();
+
+  /// @brief Take the contents of a .fplshader file.
+  ///
+  /// @param shader_file The file contents. Swapped out of the string.
+  /// @return Returns false if it isn't a valid shader file.
+  bool Init(std::string *shader_file);
+
+  /// @brief Number of features declared by the shader.
+  int num_features() const { return static_cast<int>(features_.size()); }
+
+  /// @brief The keyword of feature `i`, which is bit `i` in feature masks.
+  const std::string &feature(int i) const { return features_[i]; }
+
+  /// @brief The bit for a feature keyword, or 0 if the shader doesn't
+  /// declare it.
+  uint32_t FeatureBit(const char *feature) const;
+
+  /// @brief The mask for a nullptr-terminated array of feature keywords.
+  ///
+  /// Keywords the shader doesn't declare are ignored. Look masks up once, and
+  /// keep them around, rather than calling this every frame.
+  uint32_t FeatureMask(const char *const *features) const;
+
+  /// @brief Number of variants, which is `1 << num_features()`.
+  uint32_t num_variants() const {
+    return static_cast<uint32_t>(variants_.size());
+  }
+
+  /// @brief Get the variant with exactly the features in `feature_mask`.
+  ///
+  /// Compiles it if this is the first time it's used.
+  ///
+  /// @return Returns nullptr if the variant failed to compile, with the error
+  /// in Renderer::last_error().
+  Shader *Variant(uint32_t feature_mask);
+
+  /// @brief Queue a variant to be compiled before it is first used.
+  void Prewarm(uint32_t feature_mask);
+
+  /// @brief Queue all variants to be compiled before they are first used.
+  void PrewarmAll();
+
+  /// @brief Compile the next variant queued by Prewarm().
+  ///
+  /// Called by AssetManager::TryFinalize().
+  ///
+  /// @return Returns false if nothing was queued.
+  bool CompileNextPrewarm();
+
+  /// @brief Whether any variants queued by Prewarm() are still to compile.
+  bool prewarm_pending() const { return !prewarm_queue_.empty(); }
+
+  /// @brief Number of variants compiled so far.
+  int num_compiled() const { return num_compiled_; }
+
+  /// @brief The size of the shader file, which holds every variant's source.
+  virtual AssetMemoryUsage MemoryUsage() const {
+    AssetMemoryUsage usage;
+    usage.cpu_bytes = shader_file_.size();
+    return usage;
+  }
+
+ private:
+  FPL_DISALLOW_COPY_AND_ASSIGN(ShaderPermutations);
+
+  enum VariantState {
+    kVariantNotCompiled,
+    kVariantCompiled,
+    kVariantFailed,
+  };
+
+  Renderer &renderer_;
+  std::string shader_file_;
+  std::vector<std::string> features_;
+  // Indexed by feature mask.
+  std::vector<Shader *> variants_;
+  std::vector<VariantState> states_;
+  std::deque<uint32_t> prewarm_queue_;
+  int num_compiled_;
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_SHADER_PERMUTATIONS_H
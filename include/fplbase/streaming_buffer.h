@@ -0,0 +1,147 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_STREAMING_BUFFER_H
+#define FPLBASE_STREAMING_BUFFER_H
+
+#include <stddef.h>
+
+#include "fplbase/config.h"  // Must come first.
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_mesh
+/// @{
+
+class StreamingBufferBackend;
+
+/// @class StreamingBuffer
+/// @brief GPU buffer for vertex or index data that lives one frame.
+///
+/// Transient geometry (e.g. UI quads) is appended to the buffer with
+/// glBufferSubData, and drawn from there rather than from client memory.
+/// The buffer is orphaned at the start of every frame it was written in, and
+/// whenever a write doesn't fit: the driver hands out fresh storage, while
+/// draws already issued keep using the old one, so writing never waits for
+/// the GPU. A write larger than the whole buffer grows it.
+///
+/// Each Write() is its own glBufferSubData, since immediate mode callers
+/// draw right after writing.
+///
+/// The Renderer owns one StreamingBuffer for vertices and one for indices,
+/// which Mesh::RenderArray() and the quad helpers use.
+class StreamingBuffer {
+ public:
+  enum Type {
+    kVertexBuffer,
+    kIndexBuffer,
+  };
+
+  /// @brief Offsets returned by Write() are aligned to this, which satisfies
+  /// the alignment requirements of all vertex attribute and index types.
+  static const size_t kAlignment = 16;
+
+  /// @brief Describe the buffer. No GL objects are created until first use.
+  ///
+  /// @param backend Creates and fills the GL buffer. Not owned.
+  /// @param capacity The initial size of the buffer, in bytes. Grows if a
+  ///        single write is larger than this.
+  StreamingBuffer(StreamingBufferBackend *backend, size_t capacity);
+  ~StreamingBuffer();
+
+  /// @brief Append data to the buffer, and leave it bound.
+  ///
+  /// @param data The data to upload.
+  /// @param size The size of `data` in bytes.
+  /// @param offset Set to the byte offset of the data in handle().
+  /// @return Returns false if there is nothing to write, or no buffer.
+  bool Write(const void *data, size_t size, size_t *offset);
+
+  /// @brief Orphan the buffer if this frame wrote to it.
+  ///
+  /// Called by Renderer::AdvanceStreamingBuffers() once per frame.
+  void AdvanceFrame();
+
+  /// @brief Delete the GL buffer, e.g. before the GL context goes away.
+  ///
+  /// It is recreated on the next Write().
+  void Reset();
+
+  /// @brief The GL buffer that Write() goes to, or 0 before the first.
+  unsigned int handle() const { return buffer_; }
+
+  /// @brief The current size of the buffer, in bytes.
+  size_t capacity() const { return capacity_; }
+
+  /// @brief The number of bytes written since the last AdvanceFrame().
+  size_t bytes_this_frame() const { return bytes_this_frame_; }
+
+ private:
+  // Disallow copies, as the GL buffer is owned by this object.
+  StreamingBuffer(const StreamingBuffer &);
+  StreamingBuffer &operator=(const StreamingBuffer &);
+
+  StreamingBufferBackend *backend_;
+  size_t capacity_;
+  unsigned int buffer_;
+  size_t offset_;
+  size_t bytes_this_frame_;
+};
+
+/// @class StreamingBufferBackend
+/// @brief The GL buffer operations StreamingBuffer is built on.
+///
+/// GlStreamingBufferBackend implements these with OpenGL; tests substitute a
+/// mock.
+class StreamingBufferBackend {
+ public:
+  virtual ~StreamingBufferBackend() {}
+
+  /// @brief Create a buffer without storage. 0 on failure.
+  virtual unsigned int CreateBuffer() = 0;
+  /// @brief Delete a buffer made by CreateBuffer().
+  virtual void DeleteBuffer(unsigned int buffer) = 0;
+  /// @brief Bind `buffer`, or unbind with 0.
+  virtual void Bind(unsigned int buffer) = 0;
+  /// @brief Give the bound buffer fresh storage of `size` bytes, orphaning
+  ///        the old.
+  virtual void Allocate(size_t size) = 0;
+  /// @brief Copy `size` bytes of `data` to `offset` in the bound buffer.
+  virtual void Upload(size_t offset, const void *data, size_t size) = 0;
+};
+
+/// @class GlStreamingBufferBackend
+/// @brief StreamingBufferBackend for GL_ARRAY_BUFFER or
+/// GL_ELEMENT_ARRAY_BUFFER.
+class GlStreamingBufferBackend : public StreamingBufferBackend {
+ public:
+  /// @param type Whether the buffers hold vertices or indices.
+  explicit GlStreamingBufferBackend(StreamingBuffer::Type type)
+      : type_(type) {}
+
+  virtual unsigned int CreateBuffer();
+  virtual void DeleteBuffer(unsigned int buffer);
+  virtual void Bind(unsigned int buffer);
+  virtual void Allocate(size_t size);
+  virtual void Upload(size_t offset, const void *data, size_t size);
+
+ private:
+  StreamingBuffer::Type type_;
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_STREAMING_BUFFER_H
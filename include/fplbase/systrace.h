@@ -18,10 +18,18 @@
 /// @file fplbase/systrace.h
 /// @brief Functions for creating systrace log events, for Android.
 ///
-/// To enable, \#define FPLBASE_ENABLE_SYSTRACE 1.
+/// Every event is also recorded by the portable profiler in
+/// fplbase/profiler.h, on all platforms. To also write events to the Android
+/// kernel trace, \#define FPLBASE_ENABLE_SYSTRACE 1.
 /// @addtogroup fplbase_systrace
 /// @{
 
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fplbase/profiler.h"
+
 #if FPLBASE_ENABLE_SYSTRACE
 #ifndef __ANDROID__
 #error Systrace is only suppported for Android Builds
@@ -30,19 +38,25 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 #endif  // FPLBASE_ENABLE_SYSTRACE
 
 #define MAX_SYSTRACE_LEN 256
-int trace_marker = -1;
+
+/// @brief The file descriptor of the kernel trace marker, or -1.
+inline int &SystraceMarker() {
+  static int trace_marker = -1;
+  return trace_marker;
+}
 
 /// @brief Initializes the settings for systrace.
 ///
 /// This needs to be called before any other systrace call.
-void SystraceInit() {
+inline void SystraceInit() {
 #if FPLBASE_ENABLE_SYSTRACE
-  trace_marker = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY);
+  SystraceMarker() = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY);
   // Check that it didn't fail:
-  assert(trace_marker == -1);
+  assert(SystraceMarker() != -1);
 #endif
 }
 
@@ -52,19 +66,20 @@ void SystraceInit() {
 ///
 /// @param name The name of the block, which will appear in the trace.
 inline void SystraceBegin(const char *name) {
-  (void)name;
+  fplbase::ProfileBegin(name);
 #if FPLBASE_ENABLE_SYSTRACE
   char buf[MAX_SYSTRACE_LEN];
   int len = snprintf(buf, MAX_SYSTRACE_LEN, "B|%d|%s", getpid(), name);
-  write(trace_marker, buf, len);
+  write(SystraceMarker(), buf, len);
 #endif
 }
 
 /// @brief Ends the most recently begun block.
 inline void SystraceEnd() {
+  fplbase::ProfileEnd();
 #if FPLBASE_ENABLE_SYSTRACE
   char c = 'E';
-  write(trace_marker, &c, 1);
+  write(SystraceMarker(), &c, 1);
 #endif
 }
 
@@ -75,13 +90,12 @@ inline void SystraceEnd() {
 /// @param name The name that will be logged.
 /// @param value The value to be logged with the given name.
 inline void SystraceCounter(const char *name, const int value) {
-  (void)name;
-  (void)value;
+  fplbase::ProfileCounter(name, value);
 #if FPLBASE_ENABLE_SYSTRACE
   char buf[MAX_SYSTRACE_LEN];
   int len =
       snprintf(buf, MAX_SYSTRACE_LEN, "C|%d|%s|%i", getpid(), name, value);
-  write(trace_marker, buf, len);
+  write(SystraceMarker(), buf, len);
 #endif
 }
 
@@ -92,13 +106,12 @@ inline void SystraceCounter(const char *name, const int value) {
 /// @param name The name of the block, which will appear in the trace.
 /// @param cookie Part of the unique identifier to note the block.
 inline void SystraceAsyncBegin(const char *name, const int32_t cookie) {
-  (void)name;
-  (void)cookie;
+  fplbase::ProfileAsyncBegin(name, cookie);
 #if FPLBASE_ENABLE_SYSTRACE
   char buf[MAX_SYSTRACE_LEN];
   int len =
       snprintf(buf, MAX_SYSTRACE_LEN, "S|%d|%s|%i", getpid(), name, cookie);
-  write(trace_marker, buf, len);
+  write(SystraceMarker(), buf, len);
 #endif
 }
 
@@ -109,13 +122,12 @@ inline void SystraceAsyncBegin(const char *name, const int32_t cookie) {
 /// @param cookie The unique identifier of the block, which needs to match the
 ///               one used to begin the block.
 inline void SystraceAsyncEnd(const char *name, const int32_t cookie) {
-  (void)name;
-  (void)cookie;
+  fplbase::ProfileAsyncEnd(name, cookie);
 #if FPLBASE_ENABLE_SYSTRACE
   char buf[MAX_SYSTRACE_LEN];
   int len =
       snprintf(buf, MAX_SYSTRACE_LEN, "F|%d|%s|%i", getpid(), name, cookie);
-  write(trace_marker, buf, len);
+  write(SystraceMarker(), buf, len);
 #endif
 }
 
@@ -20,6 +20,7 @@
 #include "fplbase/config.h"  // Must come first.
 
 #include "fplbase/async_loader.h"
+#include "fplbase/pixel_buffer_pool.h"
 #include "mathfu/constants.h"
 #include "mathfu/glsl_mappings.h"
 
@@ -49,8 +50,13 @@ enum TextureFlags {
   kTextureFlagsNone = 0,
   kTextureFlagsClampToEdge = 1 << 0,  // If not set, use repeating texcoords.
   kTextureFlagsUseMipMaps = 1 << 1,   // Uses (or generates) mipmaps.
-  kTextureFlagsIsCubeMap = 1 << 2,    // Data represents a 1x6 cubemap.
+  kTextureFlagsIsCubeMap = 1 << 2,    // A 1x6 strip or a KTX cubemap.
   kTextureFlagsLoadAsync = 1 << 3,    // Load texture asynchronously.
+  kTextureFlagsParallelDecode = 1 << 4,  // Decode on several threads.
+  kTextureFlagsIsArray = 1 << 5,         // Layers stacked, or a KTX array.
+  // Average 1/2^n scales in place, instead of resampling. Faster, but the
+  // image is still decoded at full size first, so peak memory is unchanged.
+  kTextureFlagsBoxDownscale = 1 << 6,
 };
 
 inline TextureFlags operator|(TextureFlags a, TextureFlags b) {
@@ -85,6 +91,28 @@ inline bool IsCompressed(TextureFormat format) {
   }
 }
 
+/// @brief The number of bits each pixel takes in the format.
+/// Block compressed formats return the most their blocks can take.
+inline int BitsPerPixel(TextureFormat format) {
+  switch (format) {
+    case kFormat8888:
+      return 32;
+    case kFormat888:
+      return 24;
+    case kFormat5551:
+    case kFormat565:
+      return 16;
+    case kFormatLuminance:
+    case kFormatASTC:  // 4x4 blocks.
+    case kFormatKTX:   // Depends on the file, see Texture::MemoryUsage().
+      return 8;
+    case kFormatPKM:
+      return 4;
+    default:
+      return 32;
+  }
+}
+
 /// @brief These typedefs are compatible with OpenGL equivalents, but don't
 /// require this header to depend on OpenGL.
 typedef unsigned int TextureHandle;
@@ -103,13 +131,21 @@ class Texture : public AsyncAsset {
 
   /// @brief Destructor for a Texture.
   /// @note Calls `Delete()`.
-  virtual ~Texture() { Delete(); }
+  virtual ~Texture();
 
   /// @brief Loads and unpacks the Texture from `filename_` into `data_`. It
   /// also sets the original size, if it has not yet been set.
+  ///
+  /// With OpenGL (ES) 3.0, data that CreateTexture() would upload as it is
+  /// is also copied into a buffer of Renderer::pixel_buffer_pool(), so that
+  /// Finalize() only has to issue the upload from there.
   virtual void Load();
 
   /// @brief Create a texture from data in memory.
+  ///
+  /// Replaces the texture if there is one, but only once the new one has
+  /// been created, so the current one is kept if that fails.
+  ///
   /// @param[in] data The Texture data in memory to load from.
   /// @param[in] size A const `mathfu::vec2i` reference to the original
   /// Texture size `x` and `y` components.
@@ -120,6 +156,10 @@ class Texture : public AsyncAsset {
   /// @brief Creates a Texture from `data_` and stores the handle in `id_`.
   virtual void Finalize();
 
+  /// @brief Estimated size of the GL texture, and of `data_` while it is
+  /// waiting to be finalized.
+  virtual AssetMemoryUsage MemoryUsage() const;
+
   /// @brief Set the active Texture and binds `id_` to `GL_TEXTURE_2D`.
   /// @param[in] unit Specifies which texture unit to make active.
   /// @param[in] render_context Pointer to the RenderContext object
@@ -147,15 +187,22 @@ class Texture : public AsyncAsset {
   /// @param[in] texture_format The format of `buffer`.
   /// @param[in] desired The desired TextureFormat. Defaults to `kFormatAuto`.
   /// @param[in] flags Options for the texture.
+  /// @param[in] staged True if a copy of `buffer` is in the bound
+  /// GL_PIXEL_UNPACK_BUFFER, at offset 0, to upload the pixels from. Only
+  /// for data that needs no conversion; `buffer` is still read for headers.
   /// @return Returns the Texture handle. Otherwise, it returns `0`, if not a
   /// power of two in size.
   static TextureHandle CreateTexture(
       const uint8_t *buffer, const mathfu::vec2i &size,
       TextureFormat texture_format, TextureFormat desired = kFormatAuto,
-      TextureFlags flags = kTextureFlagsUseMipMaps);
+      TextureFlags flags = kTextureFlagsUseMipMaps, bool staged = false);
 
   /// @brief Update (part of) the current texture with new pixel data.
   /// For now, must always update at least entire rows.
+  ///
+  /// With OpenGL (ES) 3.0, the pixels go through a buffer of
+  /// Renderer::pixel_buffer_pool(), so the upload doesn't have to wait for
+  /// the GPU to be done with the texture, e.g. for video frames.
   static void UpdateTexture(TextureFormat format, int xoffset, int yoffset,
                             int width, int height, const void *data);
 
@@ -181,13 +228,16 @@ class Texture : public AsyncAsset {
   /// width and height.
   /// @param[out] texture_format The format of the returned buffer, always
   /// either 888 or 8888.
+  /// @param[in] flags With kTextureFlagsParallelDecode, lets libwebp filter
+  /// and scale on a second thread.
   /// @return Returns a RGBA array of the returned dimensions or `nullptr`, if
   /// the format is not understood.
   /// @note You must `free()` on the returned pointer when done.
   static uint8_t *UnpackWebP(const void *webp_buf, size_t size,
                              const mathfu::vec2 &scale,
                              mathfu::vec2i *dimensions,
-                             TextureFormat *texture_format);
+                             TextureFormat *texture_format,
+                             TextureFlags flags = kTextureFlagsNone);
 
   /// @brief Reads a memory buffer containing an ASTC format (.astc) file.
   /// @param[in] astc_buf The ASTC image data.
@@ -239,14 +289,18 @@ class Texture : public AsyncAsset {
   /// @param[out] dimensions A `mathfu::vec2i` pointer the captures the image
   /// width and height.
   /// @param[out] texture_format Pixel format of unpacked image.
+  /// @param[in] flags With kTextureFlagsParallelDecode, large images are
+  /// resized in stripes on several threads. With kTextureFlagsBoxDownscale,
+  /// 1/2^n scales average blocks of pixels instead of resampling.
   /// @return Returns a RGBA array of the returned dimensions or `nullptr`, if
   /// the format is not understood.
   /// @note You must `free()` on the returned pointer when done.
   static uint8_t *UnpackPng(const void *png_buf, size_t size,
                             const mathfu::vec2 &scale,
                             mathfu::vec2i *dimensions,
-                            TextureFormat *texture_format) {
-    return UnpackImage(png_buf, size, scale, dimensions, texture_format);
+                            TextureFormat *texture_format,
+                            TextureFlags flags = kTextureFlagsNone) {
+    return UnpackImage(png_buf, size, scale, dimensions, texture_format, flags);
   }
 
   /// @brief Unpacks a memory buffer containing a Jpeg format file.
@@ -257,20 +311,28 @@ class Texture : public AsyncAsset {
   /// @param[out] dimensions A `mathfu::vec2i` pointer the captures the image
   /// width and height.
   /// @param[out] texture_format Pixel format of unpacked image.
+  /// @param[in] flags With kTextureFlagsParallelDecode, large images are
+  /// resized in stripes on several threads. With kTextureFlagsBoxDownscale,
+  /// 1/2^n scales average blocks of pixels instead of resampling.
   /// @return Returns a RGBA array of the returned dimensions or `nullptr`, if
   /// the format is not understood.
   /// @note You must `free()` on the returned pointer when done.
   static uint8_t *UnpackJpg(const void *jpg_buf, size_t size,
                             const mathfu::vec2 &scale,
                             mathfu::vec2i *dimensions,
-                            TextureFormat *texture_format) {
-    return UnpackImage(jpg_buf, size, scale, dimensions, texture_format);
+                            TextureFormat *texture_format,
+                            TextureFlags flags = kTextureFlagsNone) {
+    return UnpackImage(jpg_buf, size, scale, dimensions, texture_format, flags);
   }
 
   /// @brief Loads the file in filename, and then unpacks the file format
-  /// (supports TGA, WebP, KTX, PKM, ASTC).
+  /// (supports TGA, WebP, KTX, PKM, ASTC, ETC1S).
   /// @note KTX/PKM/ASTC will automatically fall-back on WebP if the file is not
-  /// present or not supported by the GPU.
+  /// present or not supported by the GPU. KTX files of uncompressed 16 bit
+  /// pixels, as written by texture_pipeline, are supported everywhere.
+  /// @note ETC1S is transcoded to `desired` if that is PKM, ASTC, 565 or 888
+  /// and the GPU supports it, else to PKM, ASTC or 565, whichever the GPU
+  /// supports first. It can't be scaled. See TranscodeETC1S().
   /// @note `last_error()` contains more information if `nullptr` is returned.
   ///  You must `free()` the returned pointer when done.
   /// @param[in] filename A C-string corresponding to the name of the file
@@ -281,13 +343,21 @@ class Texture : public AsyncAsset {
   /// width and height.
   /// @param[out] texture_format The format of the returned buffer, always
   /// either 888 or 8888.
+  /// @param[in] flags The flags of the Texture. kTextureFlagsParallelDecode
+  /// changes how the file is unpacked.
+  /// @param[in] desired The format the Texture is converted to on upload.
   /// @return Returns a RGBA array of the returned dimensions or `nullptr`, if
   /// the format is not understood.
+  /// @note While TextureCache::Shared() is open, tga, png, jpg and webp files
+  /// are returned as KTX, already converted to `desired` and with the mips
+  /// `flags` ask for.
   /// @note You must `free()` on the returned pointer when done.
   static uint8_t *LoadAndUnpackTexture(const char *filename,
                                        const mathfu::vec2 &scale,
                                        mathfu::vec2i *dimensions,
-                                       TextureFormat *texture_format);
+                                       TextureFormat *texture_format,
+                                       TextureFlags flags = kTextureFlagsNone,
+                                       TextureFormat desired = kFormatAuto);
 
   /// @brief Utility function to convert 32bit RGBA (8-bits each) to 16bit RGB
   /// in hex 5551 format.
@@ -300,6 +370,26 @@ class Texture : public AsyncAsset {
   static uint16_t *Convert888To565(const uint8_t *buffer,
                                    const mathfu::vec2i &size);
 
+  /// @brief Converts pixels into a KTX file that CreateTexture() uploads as
+  /// is, holding what it would otherwise have made of them: pixels in the
+  /// `desired` format, and with kTextureFlagsUseMipMaps, the whole mip chain
+  /// as 2x2 averages.
+  /// @param[in] buffer The pixels, in rows.
+  /// @param[in] size The size of the image. With kTextureFlagsIsCubeMap, a
+  /// 1x6 strip that becomes a KTX cubemap. With kTextureFlagsIsArray, square
+  /// layers stacked vertically, that become the layers of a KTX array.
+  /// @param[in] texture_format The format of `buffer`, 888 or 8888.
+  /// @param[in] desired The format of the KTX pixels: 565, 5551, 888, 8888,
+  /// kFormatNative or kFormatAuto, which picks the same as CreateTexture().
+  /// @param[in] flags kTextureFlagsUseMipMaps, kTextureFlagsIsCubeMap and
+  /// kTextureFlagsIsArray change the contents. kTextureFlagsParallelDecode
+  /// splits the work over threads.
+  /// @param[out] ktx Set to the contents of the KTX file.
+  /// @return Returns false if the formats or size aren't supported.
+  static bool PackKTX(const uint8_t *buffer, const mathfu::vec2i &size,
+                      TextureFormat texture_format, TextureFormat desired,
+                      TextureFlags flags, std::string *ktx);
+
   /// @brief Set texture target and id directly for textures that have been
   /// created outside of this class.
   /// @param[in] target Texture target to use when binding texture to context.
@@ -328,6 +418,9 @@ class Texture : public AsyncAsset {
   /// @brief returns the texture flags.
   TextureFlags flags() const { return flags_; }
 
+  /// @brief returns the format the texture is converted to on upload.
+  TextureFormat desired_format() const { return desired_; }
+
   /// @brief Get the original size of the Texture.
   /// @return Returns a const `mathfu::vec2` reference to the scale of the
   /// Texture.
@@ -363,13 +456,27 @@ class Texture : public AsyncAsset {
   /// width and height.
   /// @param[out] has_alpha A `bool` pointer that captures whether the Png
   /// image has an alpha.
+  /// @param[in] flags With kTextureFlagsParallelDecode, large images are
+  /// resized in stripes on several threads. With kTextureFlagsBoxDownscale,
+  /// 1/2^n scales average blocks of pixels instead of resampling. The image
+  /// is decoded at full size either way, so peak memory use is the same;
+  /// only the returned image, and the texture made from it, are smaller.
   /// @return Returns a RGBA array of the returned dimensions or `nullptr`, if
   /// the format is not understood.
   /// @note You must `free()` on the returned pointer when done.
   static uint8_t *UnpackImage(const void *img_buf, size_t size,
                               const mathfu::vec2 &scale,
                               mathfu::vec2i *dimensions,
-                              TextureFormat *texture_format);
+                              TextureFormat *texture_format,
+                              TextureFlags flags = kTextureFlagsNone);
+
+  // Copies `data_` into a pixel buffer for Finalize() to upload from, if
+  // CreateTexture() would upload it as it is.
+  void StageData();
+
+  // Reads the sizes of a KTX file's images from its header into
+  // `ktx_data_bytes_` and `ktx_gpu_bytes_`.
+  void CountKTXBytes(const uint8_t *ktx);
 
   TextureHandle id_;
   mathfu::vec2i size_;
@@ -379,6 +486,12 @@ class Texture : public AsyncAsset {
   TextureTarget target_;
   TextureFormat desired_;
   TextureFlags flags_;
+  // For KTX textures, the bytes of image data in the file, and in the texture
+  // created from it, which depend on the format stored in the file.
+  size_t ktx_data_bytes_;
+  size_t ktx_gpu_bytes_;
+  // Holds a copy of `data_` between Load() and Finalize(), if any.
+  PixelBufferPool::Staging staging_;
 };
 
 /// @}
@@ -15,12 +15,15 @@
 #ifndef FPLBASE_TEXTURE_ATLAS_H
 #define FPLBASE_TEXTURE_ATLAS_H
 
+#include <assert.h>
+#include <stdint.h>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "fplbase/config.h"  // Must come first.
 #include "fplbase/asset.h"
+#include "fplbase/texture.h"
 
 namespace fplbase {
 
@@ -29,26 +32,45 @@ namespace fplbase {
 /// @{
 using mathfu::vec4;
 
-class Texture;
+/// @brief Returned by TextureAtlas::GetIndex() for names not in the atlas.
+static const size_t kInvalidSubtextureIndex = static_cast<size_t>(-1);
 
 /// @class TextureAtlas
 /// @brief Texture coordinate dictionary.
 ///
-/// A TextureAtlas supports sprite sheets by containing one texture and a list
-/// of subtexture bounding boxes, which can also be indexed by name using the
-/// index_map. Subtexture bounding boxes are returned in normalized texture
-/// coordinates, and take the form (u, v, width, height).
+/// A TextureAtlas supports sprite sheets by containing one or more textures
+/// (pages) and a list of subtexture bounding boxes, which can also be indexed
+/// by name using the index_map. Subtexture bounding boxes are returned in
+/// normalized texture coordinates, and take the form (u, v, width, height).
+///
+/// Looking a subtexture up by name searches the index_map, so code that draws
+/// the same subtextures every frame should resolve their names once with
+/// GetIndex(), and use bounds() and GetTexture() with the index from then on.
 ///
 /// @warning This is will very likely be refactored.
 class TextureAtlas : public Asset {
  public:
-  TextureAtlas() : atlas_texture_(nullptr) {}
+  TextureAtlas() {}
   ~TextureAtlas() { Delete(); }
 
-  /// @brief Delete the texture associated with this atlas.
+  /// @brief Delete the textures associated with this atlas.
   void Delete() {
-    atlas_texture_->Delete();
-    atlas_texture_ = nullptr;
+    for (auto it = page_textures_.begin(); it != page_textures_.end(); ++it) {
+      if (*it) (*it)->Delete();
+    }
+    page_textures_.clear();
+  }
+
+  /// @brief Size of the subtexture tables. The atlas textures are not
+  /// included.
+  virtual AssetMemoryUsage MemoryUsage() const {
+    AssetMemoryUsage usage;
+    usage.cpu_bytes = subtexture_bounds_.size() * sizeof(vec4) +
+                      subtexture_pages_.size() * sizeof(uint16_t);
+    for (auto it = index_map_.begin(); it != index_map_.end(); ++it) {
+      usage.cpu_bytes += it->first.size() + sizeof(it->second);
+    }
+    return usage;
   }
 
   /// @brief Get the bounds of a subtexture associated with name.
@@ -57,23 +79,63 @@ class TextureAtlas : public Asset {
   /// @returns Bounds of the subtexture or nullptr if the specified name isn't
   /// found.
   const vec4 *GetBounds(const std::string &name) {
+    const size_t index = GetIndex(name);
+    return index != kInvalidSubtextureIndex ? &subtexture_bounds_[index]
+                                            : nullptr;
+  }
+
+  /// @brief Resolve the name of a subtexture to its index.
+  ///
+  /// @param name Name of the subtexture to lookup.
+  /// @returns Index of the subtexture, for use with bounds() and
+  /// GetTexture(), or kInvalidSubtextureIndex if the name isn't found.
+  size_t GetIndex(const std::string &name) const {
     auto index_iter = index_map_.find(name);
-    if (index_iter != index_map_.end()) {
-      return &subtexture_bounds_[index_iter->second];
-    }
-    return nullptr;
+    return index_iter != index_map_.end() ? index_iter->second
+                                          : kInvalidSubtextureIndex;
+  }
+
+  /// @brief Get the bounds of a subtexture by index, from GetIndex().
+  const vec4 &bounds(size_t index) const {
+    assert(index < subtexture_bounds_.size());
+    return subtexture_bounds_[index];
+  }
+
+  /// @brief Get the page that holds a subtexture, by index from GetIndex().
+  size_t page(size_t index) const {
+    return index < subtexture_pages_.size() ? subtexture_pages_[index] : 0;
+  }
+
+  /// @brief Get the texture that holds a subtexture, by index from
+  /// GetIndex().
+  Texture *GetTexture(size_t index) const {
+    const size_t page_index = page(index);
+    return page_index < page_textures_.size() ? page_textures_[page_index]
+                                              : nullptr;
   }
 
   /// @brief Get the texture associated with this atlas.
-  /// @return Pointer to the texture associated with this atlas.
-  const Texture *atlas_texture() const { return atlas_texture_; }
+  /// @return Pointer to the texture of the first page of this atlas.
+  const Texture *atlas_texture() const {
+    return page_textures_.empty() ? nullptr : page_textures_[0];
+  }
   /// @brief Get the texture associated with this atlas.
-  /// @return Pointer to the texture associated with this atlas.
-  Texture *atlas_texture() { return atlas_texture_; }
-  /// @brief Set the texture associated with this atlas.
+  /// @return Pointer to the texture of the first page of this atlas.
+  Texture *atlas_texture() {
+    return page_textures_.empty() ? nullptr : page_textures_[0];
+  }
+  /// @brief Set the texture of the first page of this atlas.
   void set_atlas_texture(Texture *atlas_texture) {
-    atlas_texture_ = atlas_texture;
+    if (page_textures_.empty()) page_textures_.push_back(nullptr);
+    page_textures_[0] = atlas_texture;
+  }
+
+  /// @brief Get the textures of all pages of this atlas.
+  const std::vector<Texture *> &page_textures() const {
+    return page_textures_;
   }
+  /// @brief Get the textures of all pages of this atlas.
+  std::vector<Texture *> &page_textures() { return page_textures_; }
 
   /// @brief Get a vector of the bounds of each subtexture in this atlas.
   ///
@@ -95,6 +157,15 @@ class TextureAtlas : public Asset {
   /// @returns Vector of subtexture bounds.
   std::vector<vec4> &subtexture_bounds() { return subtexture_bounds_; }
 
+  /// @brief Get the page of each subtexture, parallel to
+  /// @ref subtexture_bounds(). May be empty if there is only one page.
+  const std::vector<uint16_t> &subtexture_pages() const {
+    return subtexture_pages_;
+  }
+  /// @brief Get the page of each subtexture, parallel to
+  /// @ref subtexture_bounds(). May be empty if there is only one page.
+  std::vector<uint16_t> &subtexture_pages() { return subtexture_pages_; }
+
   /// @brief Get a map of subtexture names to subtexture offsets.
   ///
   /// Each entry in the map can be used to lookup the subtexture bounds in
@@ -114,10 +185,12 @@ class TextureAtlas : public Asset {
   std::map<std::string, size_t> &index_map() { return index_map_; }
 
  private:
-  // Texture being used by this atlas.
-  Texture *atlas_texture_;
+  // Textures of the pages of this atlas.
+  std::vector<Texture *> page_textures_;
   // List of bounds (offsetx, offsety, sizex, sizey) of each subtexture.
   std::vector<vec4> subtexture_bounds_;
+  // Page of each subtexture, or empty if all are on the first page.
+  std::vector<uint16_t> subtexture_pages_;
   // Map of subtexture names to indices into subtexture_bounds_.
   std::map<std::string, size_t> index_map_;
 };
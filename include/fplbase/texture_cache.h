@@ -0,0 +1,149 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPLBASE_TEXTURE_CACHE_H
+#define FPLBASE_TEXTURE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "fplbase/fpl_common.h"
+#include "fplbase/texture.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_texture
+/// @{
+
+/// @class TextureCache
+/// @brief Keeps decoded and converted textures on disk between runs.
+///
+/// While the shared cache is open, Texture::LoadAndUnpackTexture() looks up
+/// tga, png, jpg and webp files in it by a hash of their contents, the
+/// desired format, the flags that change the result, and the scale. A hit
+/// returns the stored KTX file, which holds the pixels converted and
+/// mip-mapped the way CreateTexture() would have, so the texture costs one
+/// extra read instead of a decode. A miss decodes the file as usual, packs
+/// it with Texture::PackKTX() and stores it.
+///
+/// Entries are files named after their key in one directory. When their
+/// total size goes over the limit, the least recently used ones are deleted.
+/// An index file in the same directory keeps the sizes and the order of use
+/// between runs. It is written by Close(), and every few Store() calls, not
+/// on each one. Entry files the index doesn't list, e.g. ones stored after it
+/// was last written by an app that was then killed, are deleted by Open().
+///
+/// All methods are thread-safe.
+class TextureCache {
+ public:
+  /// @brief Identifies an entry. See MakeKey().
+  typedef uint64_t Key;
+
+  TextureCache();
+  ~TextureCache();
+
+  /// @brief The cache used by Texture::LoadAndUnpackTexture().
+  static TextureCache &Shared();
+
+  /// @brief Start using the entries in `directory`.
+  ///
+  /// @param[in] directory An existing, writable directory, only used by this
+  /// cache, e.g. one returned by SDL_GetPrefPath().
+  /// @param[in] max_bytes The most disk space the entries may take.
+  /// @return Returns false if the index can't be written to `directory`.
+  bool Open(const std::string &directory, size_t max_bytes);
+
+  /// @brief Save the index and stop using the cache. Entries stay on disk.
+  void Close();
+
+  /// @brief Delete all entries.
+  void Clear();
+
+  /// @brief Compute the key of a texture.
+  ///
+  /// @param[in] file The contents of the texture file.
+  /// @param[in] size The size of `file`.
+  /// @param[in] desired The format the texture is converted to.
+  /// @param[in] flags The texture flags. Only the ones that change the
+  /// converted pixels are part of the key.
+  /// @param[in] scale The scale the texture is decoded at.
+  static Key MakeKey(const void *file, size_t size, TextureFormat desired,
+                     TextureFlags flags, const mathfu::vec2 &scale);
+
+  /// @brief Read an entry, and mark it as the most recently used.
+  ///
+  /// @param[in] key The key of the entry.
+  /// @param[out] size Set to the size of the returned buffer.
+  /// @return Returns the contents of the entry, or nullptr if there is none.
+  /// @note You must `free()` the returned pointer when done.
+  uint8_t *Load(Key key, size_t *size);
+
+  /// @brief Add or replace an entry, deleting the least recently used ones
+  /// until all fit.
+  ///
+  /// @return Returns false if the entry is bigger than the cache, or can't be
+  /// written.
+  bool Store(Key key, const std::string &data);
+
+  /// @brief Delete an entry, e.g. one whose contents turned out to be bad.
+  void Remove(Key key);
+
+  /// @brief Returns true between Open() and Close().
+  bool is_open() const;
+
+  /// @brief The size of all entries, in bytes.
+  size_t total_bytes() const;
+
+  /// @brief The number of entries.
+  size_t num_entries() const;
+
+ private:
+  struct Entry {
+    size_t size;
+    uint64_t last_use;
+  };
+
+  std::string EntryPath(Key key) const;
+  void RemoveLocked(Key key);
+  void RemoveOrphansLocked();
+  void SaveIndexLocked();
+
+  // Guards everything below. An SDL_mutex or a std::mutex, depending on the
+  // backend.
+  void *mutex_;
+  std::string directory_;
+  size_t max_bytes_;
+  size_t total_bytes_;
+  uint64_t use_counter_;
+  uint64_t temp_counter_;
+  size_t stores_since_save_;
+  bool open_;
+  bool index_dirty_;
+  std::unordered_map<Key, Entry> entries_;
+
+  friend class TextureCacheLock;
+  FPL_DISALLOW_COPY_AND_ASSIGN(TextureCache);
+};
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_TEXTURE_CACHE_H
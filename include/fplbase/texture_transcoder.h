@@ -0,0 +1,89 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPLBASE_TEXTURE_TRANSCODER_H
+#define FPLBASE_TEXTURE_TRANSCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "fplbase/config.h"  // Must come first.
+
+#include "fplbase/texture.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fplbase {
+
+/// @file
+/// @addtogroup fplbase_texture
+/// @{
+
+/// @brief Size in bytes of the header of an ETC1S (.etc1s) file.
+static const size_t kETC1SHeaderSize = 12;
+
+/// @brief Size in bytes of one 4x4 pixel block of ETC1S data.
+static const size_t kETC1SBlockSize = 8;
+
+/// @brief Compress opaque RGB pixels into an ETC1S (.etc1s) file.
+///
+/// ETC1S is the intermediate format shipped instead of one file per GPU
+/// compression format. Its blocks are ETC1 blocks restricted to a single
+/// base color and intensity table, which makes them valid ETC1 and ETC2
+/// data as they are, and simple enough to transcode into ASTC or plain RGB on
+/// the CPU at load time. See TranscodeETC1S().
+///
+/// The file is a 12 byte header ("E1S1", then the width and height as 32 bit
+/// little endian integers) followed by the blocks in rows, each block 8
+/// bytes in ETC1 bit order.
+///
+/// This is slow compared to transcoding, and meant for asset pipelines.
+///
+/// @param[in] pixels Rows of pixels, tightly packed.
+/// @param[in] size The image dimensions.
+/// @param[in] channels Bytes per pixel, 3 (RGB) or 4 (RGBA, alpha ignored).
+/// @param[out] file Set to the contents of the .etc1s file.
+void EncodeETC1S(const uint8_t *pixels, const mathfu::vec2i &size,
+                 int channels, std::string *file);
+
+/// @brief Transcode an ETC1S file into data that Texture::CreateTexture()
+/// can upload.
+///
+/// Each block is handled on its own, so this is fast enough to run on the
+/// loader thread for every texture:
+/// - kFormatPKM: a PKM file. The blocks are copied as they are.
+/// - kFormatASTC: an ASTC file of 4x4 blocks. The four colors of each block
+///   are fitted with a line that the ASTC weights interpolate, which is a
+///   close approximation.
+/// - kFormat565 and kFormat888: the decoded pixels.
+///
+/// @param[in] file The contents of an .etc1s file.
+/// @param[in] size The size of `file` in bytes.
+/// @param[in] target One of the formats above.
+/// @param[out] dimensions Set to the image dimensions.
+/// @return Returns a buffer in the `target` format, or nullptr if the file
+/// is malformed or the target isn't supported.
+/// @note You must `free()` the returned pointer when done.
+uint8_t *TranscodeETC1S(const void *file, size_t size, TextureFormat target,
+                        mathfu::vec2i *dimensions);
+
+/// @brief Decode one ETC1 block, in differential or individual mode, into
+/// 4x4 RGB pixels in rows.
+void DecodeETC1Block(const uint8_t *block, uint8_t *rgb);
+
+/// @}
+}  // namespace fplbase
+
+#endif  // FPLBASE_TEXTURE_TRANSCODER_H
@@ -25,16 +25,32 @@ FPLBASE_DIR := $(LOCAL_PATH)
 
 FPLBASE_COMMON_SRC_FILES := \
   src/asset_manager.cpp \
+  src/atlas_packer.cpp \
+  src/asset_telemetry.cpp \
+  src/command_buffer.cpp \
+  src/dynamic_atlas.cpp \
+  src/file_watcher.cpp \
+  src/frame_stats.cpp \
+  src/frustum.cpp \
+  src/gpu_timer.cpp \
   src/input.cpp \
+  src/input_recording.cpp \
   src/material.cpp \
   src/mesh.cpp \
+  src/parallel_for.cpp \
+  src/pixel_buffer_pool.cpp \
   src/precompiled.cpp \
   src/preprocessor.cpp \
+  src/profiler.cpp \
   src/renderer.cpp \
   src/renderer_hmd.cpp \
   src/render_target.cpp \
   src/shader.cpp \
+  src/shader_permutations.cpp \
+  src/streaming_buffer.cpp \
   src/texture.cpp \
+  src/texture_cache.cpp \
+  src/texture_transcoder.cpp \
   src/utilities.cpp \
   src/version.cpp \
   $(NDK_ROOT)/sources/android/ndk_helper/gl3stub.c
@@ -18,6 +18,7 @@
 
 #include "common_generated.h"
 #include "fplbase/preprocessor.h"
+#include "fplbase/shader_permutations.h"
 #include "fplbase/utilities.h"
 #include "shader_generated.h"
 
@@ -94,6 +95,11 @@ static bool ParseShaderPipelineArgs(int argc, char** argv,
         "Pipeline to generate fplshader files from individual vertex and \n"
         "fragment shader files.\n"
         "\n"
+        "Features declared in the shaders with\n"
+        "  #pragma fpl_features FEATURE...\n"
+        "get a variant of the shader for every combination of them, each\n"
+        "with those features #defined.\n"
+        "\n"
         "Options:\n"
         "  -vs, --vertex-shader VERTEX_SHADER\n"
         "  -fs, --fragment-shader FRAGMENT_SHADER\n"
@@ -140,17 +146,60 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  std::vector<std::string> features;
+  fplbase::FindShaderFeatures(vsh.c_str(), &features);
+  fplbase::FindShaderFeatures(fsh.c_str(), &features);
+  if (features.size() > static_cast<size_t>(fplbase::kMaxShaderFeatures)) {
+    printf("%d features declared, the most allowed is %d.\n",
+           static_cast<int>(features.size()), fplbase::kMaxShaderFeatures);
+    return 1;
+  }
+
   // Create the FlatBuffer for the Shader.
   flatbuffers::FlatBufferBuilder fbb;
   auto vsh_fb = fbb.CreateString(vsh);
   auto fsh_fb = fbb.CreateString(fsh);
 
+  // Preprocess every combination of features, indexed by feature mask.
+  std::vector<flatbuffers::Offset<shaderdef::ShaderVariant>> variants;
+  const uint32_t num_variants = features.empty() ? 0 : 1u << features.size();
+  for (uint32_t mask = 0; mask < num_variants; ++mask) {
+    std::vector<const char*> variant_defines(args.defines.begin(),
+                                             args.defines.end() - 1);
+    for (size_t i = 0; i < features.size(); ++i) {
+      if (mask & (1u << i)) variant_defines.push_back(features[i].c_str());
+    }
+    variant_defines.push_back(nullptr);
+    std::string variant_vsh;
+    std::string variant_fsh;
+    if (!fplbase::LoadFileWithDirectives(args.vertex_shader.c_str(),
+                                         &variant_vsh, variant_defines.data(),
+                                         &error_message) ||
+        !fplbase::LoadFileWithDirectives(args.fragment_shader.c_str(),
+                                         &variant_fsh, variant_defines.data(),
+                                         &error_message)) {
+      printf("Unable to load variant %u:\n%s\n", mask,
+             error_message.c_str());
+      return 1;
+    }
+    variants.push_back(shaderdef::CreateShaderVariant(
+        fbb, mask, fbb.CreateString(variant_vsh),
+        fbb.CreateString(variant_fsh)));
+  }
+  std::vector<flatbuffers::Offset<flatbuffers::String>> features_vector;
+  for (auto it = features.begin(); it != features.end(); ++it) {
+    features_vector.push_back(fbb.CreateString(*it));
+  }
+  auto features_fb = fbb.CreateVector(features_vector);
+  auto variants_fb = fbb.CreateVector(variants);
+
   std::vector<flatbuffers::Offset<flatbuffers::String>> sources_vector;
   sources_vector.push_back(fbb.CreateString(args.vertex_shader));
   sources_vector.push_back(fbb.CreateString(args.fragment_shader));
   auto sources_fb = fbb.CreateVector(sources_vector);
 
-  auto shader_fb = shaderdef::CreateShader(fbb, vsh_fb, fsh_fb, sources_fb);
+  auto shader_fb = shaderdef::CreateShader(fbb, vsh_fb, fsh_fb, sources_fb,
+                                           features_fb, variants_fb);
   shaderdef::FinishShaderBuffer(fbb, shader_fb);
 
   // Save the Shader FlatBuffer to disk.
@@ -18,6 +18,7 @@
 #include "fplbase/flatbuffer_utils.h"
 #include "fplbase/texture.h"
 #include "fplbase/preprocessor.h"
+#include "fplbase/profiler.h"
 #include "fplbase/utilities.h"
 #include "materials_generated.h"
 #include "mesh_generated.h"
@@ -79,6 +80,109 @@ T FindInMap(const std::map<std::string, T> &map, const char *name) {
   return it != map.end() ? it->second : 0;
 }
 
+// Records a load done on this thread, from construction to destruction.
+class ScopedAssetLoad {
+ public:
+  ScopedAssetLoad(AssetManager *manager, const char *kind, const char *name)
+      : telemetry_(&manager->load_telemetry_),
+        record_(telemetry_->BeginAsset(kind, name, false)),
+        scope_(telemetry_, record_),
+        succeeded_(false) {
+    manager->memory_total_valid_ = false;
+  }
+  ~ScopedAssetLoad() { telemetry_->EndAsset(record_, succeeded_); }
+
+  void Succeeded() { succeeded_ = true; }
+
+ private:
+  AssetLoadTelemetry *telemetry_;
+  int record_;
+  AssetLoadScope scope_;
+  bool succeeded_;
+};
+
+// Loads an asset again on the loader thread, after its files changed. The
+// AssetManager swaps the result into the asset when this is finalized.
+class AssetReload : public AsyncAsset {
+ public:
+  AssetReload(AssetManager *manager, const AssetManager::HotReloadInfo &info,
+              Asset *target)
+      : AsyncAsset(info.name.c_str()),
+        manager_(manager),
+        info_(info),
+        target_(target),
+        pixels_(nullptr),
+        texture_format_(kFormatAuto),
+        texture_flags_(kTextureFlagsNone),
+        texture_desired_format_(kFormatAuto) {
+    if (info.type == kAssetTypeTexture) {
+      texture_scale_ = static_cast<Texture *>(target)->scale();
+      texture_flags_ = static_cast<Texture *>(target)->flags();
+      texture_desired_format_ =
+          static_cast<Texture *>(target)->desired_format();
+    }
+  }
+  virtual ~AssetReload() { free(pixels_); }
+
+  virtual void Load() {
+    switch (info_.type) {
+      case kAssetTypeShader:
+        if (info_.from_glsl) {
+          std::vector<const char *> defines;
+          for (auto it = info_.defines.begin(); it != info_.defines.end();
+               ++it) {
+            defines.push_back(it->c_str());
+          }
+          defines.push_back(nullptr);
+          std::set<std::string> ps_files;
+          if (!LoadFileWithDirectives((filename_ + ".glslv").c_str(),
+                                      &contents_, defines.data(),
+                                      &info_.files, &error_) ||
+              !LoadFileWithDirectives((filename_ + ".glslf").c_str(),
+                                      &ps_contents_, defines.data(),
+                                      &ps_files, &error_)) {
+            return;
+          }
+          info_.files.insert(ps_files.begin(), ps_files.end());
+        } else if (!LoadFile(filename_.c_str(), &contents_)) {
+          return;
+        }
+        break;
+      case kAssetTypeTexture:
+        pixels_ = Texture::LoadAndUnpackTexture(
+            filename_.c_str(), texture_scale_, &texture_size_,
+            &texture_format_, texture_flags_, texture_desired_format_);
+        if (!pixels_) return;
+        break;
+      default:
+        if (!LoadFile(filename_.c_str(), &contents_)) return;
+        break;
+    }
+    // Only signals the load succeeded. data_ doesn't own the memory.
+    data_ = reinterpret_cast<const uint8_t *>(contents_.c_str());
+  }
+
+  virtual void Finalize() { manager_->FinishReload(this); }
+
+ private:
+  AssetManager *manager_;
+  // Files are updated by Load(), in case the \#includes changed.
+  AssetManager::HotReloadInfo info_;
+  // Set to nullptr if the asset is deleted before this is finalized.
+  Asset *target_;
+  std::string contents_;
+  std::string ps_contents_;
+  std::string error_;
+  uint8_t *pixels_;
+  vec2 texture_scale_;
+  vec2i texture_size_;
+  TextureFormat texture_format_;
+  TextureFlags texture_flags_;
+  TextureFormat texture_desired_format_;
+
+  friend class AssetManager;
+};
+
 template <typename T>
 void DestructAssetsInMap(std::map<std::string, T> &map) {
   for (auto it = map.begin(); it != map.end(); ++it) {
@@ -88,11 +192,27 @@ void DestructAssetsInMap(std::map<std::string, T> &map) {
 }
 
 AssetManager::AssetManager(Renderer &renderer)
-    : renderer_(renderer), texture_scale_(mathfu::kOnes2f) {
+    : renderer_(renderer),
+      texture_scale_(mathfu::kOnes2f),
+      memory_budget_(0),
+      memory_total_(0),
+      memory_total_valid_(false),
+      loader_started_(false) {
   // Empty material for default case.
   material_map_[""] = new Material();
 }
 
+AssetManager::~AssetManager() {
+  // Stop loading before clearing assets, since any pending assets need to be
+  // valid when loader calls Finalize().
+  loader_.Stop();
+  ClearAllAssets();
+  // Reloads the loader finished but never finalized.
+  for (auto it = pending_reloads_.begin(); it != pending_reloads_.end(); ++it) {
+    delete *it;
+  }
+}
+
 void AssetManager::ClearAllAssets() {
   DestructAssetsInMap(material_map_);
   DestructAssetsInMap(texture_atlas_map_);
@@ -100,6 +220,29 @@ void AssetManager::ClearAllAssets() {
   DestructAssetsInMap(shader_map_);
   DestructAssetsInMap(texture_map_);
   DestructAssetsInMap(file_map_);
+  DestructAssetsInMap(shader_permutations_map_);
+  unused_assets_.clear();
+  unused_index_.clear();
+  hot_reload_assets_.clear();
+  // Reloads may still be on the loader thread, so are deleted once finalized.
+  for (auto it = pending_reloads_.begin(); it != pending_reloads_.end(); ++it) {
+    (*it)->target_ = nullptr;
+  }
+}
+
+bool AssetManager::Release(Asset *asset) {
+  // Unused assets have no references left to drop.
+  if (!asset || asset->refcount_ == 0) return false;
+  return asset->DecreaseRefCount() == 0;
+}
+
+template <typename T>
+T *AssetManager::Reuse(T *asset) {
+  if (asset->refcount_ == 0) {
+    asset->refcount_ = 1;
+    RemoveUnused(asset);
+  }
+  return asset;
 }
 
 Shader *AssetManager::FindShader(const char *basename) {
@@ -109,25 +252,43 @@ Shader *AssetManager::FindShader(const char *basename) {
 Shader *AssetManager::LoadShaderHelper(const char *basename,
                                        const char * const *defines,
                                        bool should_reload) {
+  FPLBASE_PROFILE_ZONE("AssetManager::LoadShader");
   auto shader = FindShader(basename);
+  if (!should_reload) load_telemetry_.CountLookup("shader", shader != nullptr);
   if (!should_reload && shader)
-    return shader;
+    return Reuse(shader);
+  ScopedAssetLoad load(this, "shader", basename);
+  AssetLoadPhaseTimer decode(kAssetLoadPhaseDecode);
   std::string vs_file, ps_file;
   std::string filename = std::string(basename) + ".glslv";
   std::string error_message;
+  HotReloadInfo reload_info;
+  std::set<std::string> files;
   if (LoadFileWithDirectives(filename.c_str(), &vs_file, defines,
-                             &error_message)) {
+                             &reload_info.files, &error_message)) {
     filename = std::string(basename) + ".glslf";
-    if (LoadFileWithDirectives(filename.c_str(), &ps_file, defines,
+    if (LoadFileWithDirectives(filename.c_str(), &ps_file, defines, &files,
                                &error_message)) {
-      if (should_reload) {
-        renderer_.RecompileShader(vs_file.c_str(), ps_file.c_str(), shader);
+      decode.Stop();
+      AssetLoadPhaseTimer upload(kAssetLoadPhaseUpload);
+      if (should_reload && shader) {
+        if (!RecompileShader(shader, vs_file, ps_file)) shader = nullptr;
       } else {
         shader =
             renderer_.CompileAndLinkShader(vs_file.c_str(), ps_file.c_str());
       }
+      upload.Stop();
       if (shader) {
         shader_map_[basename] = shader;
+        load.Succeeded();
+        reload_info.type = kAssetTypeShader;
+        reload_info.name = basename;
+        reload_info.from_glsl = true;
+        for (auto def = defines; def && *def; ++def) {
+          reload_info.defines.push_back(*def);
+        }
+        reload_info.files.insert(files.begin(), files.end());
+        WatchAsset(shader, reload_info);
       } else {
         LogError(kError, "Shader Error: ");
         LogError(kError, "VS:  -----------------------------------");
@@ -161,21 +322,30 @@ Shader *AssetManager::ReloadShader(const char *basename,
 }
 
 Shader *AssetManager::LoadShaderDef(const char *filename) {
+  FPLBASE_PROFILE_ZONE("AssetManager::LoadShaderDef");
   auto shader = FindShader(filename);
-  if (shader) return shader;
+  load_telemetry_.CountLookup("shader", shader != nullptr);
+  if (shader) return Reuse(shader);
 
+  ScopedAssetLoad load(this, "shader", filename);
   std::string flatbuf;
   if (LoadFile(filename, &flatbuf)) {
+    AssetLoadPhaseTimer decode(kAssetLoadPhaseDecode);
     flatbuffers::Verifier verifier(
         reinterpret_cast<const uint8_t *>(flatbuf.c_str()), flatbuf.length());
     assert(shaderdef::VerifyShaderBuffer(verifier));
     auto shaderdef = shaderdef::GetShader(flatbuf.c_str());
+    decode.Stop();
 
+    AssetLoadPhaseTimer upload(kAssetLoadPhaseUpload);
     shader =
         renderer_.CompileAndLinkShader(shaderdef->vertex_shader()->c_str(),
                                        shaderdef->fragment_shader()->c_str());
+    upload.Stop();
     if (shader) {
       shader_map_[filename] = shader;
+      load.Succeeded();
+      WatchAsset(shader, HotReloadInfo(kAssetTypeShader, filename));
     } else {
       LogError(kError, "Shader Error: ");
       if (shaderdef->original_sources()) {
@@ -201,9 +371,46 @@ Shader *AssetManager::LoadShaderDef(const char *filename) {
 
 void AssetManager::UnloadShader(const char *filename) {
   auto shader = FindShader(filename);
-  if (!shader || shader->DecreaseRefCount()) return;
-  shader_map_.erase(filename);
-  delete shader;
+  if (Release(shader)) MarkUnused(kAssetTypeShader, filename, shader);
+}
+
+ShaderPermutations *AssetManager::FindShaderPermutations(
+    const char *filename) {
+  return FindInMap(shader_permutations_map_, filename);
+}
+
+ShaderPermutations *AssetManager::LoadShaderPermutations(
+    const char *filename) {
+  FPLBASE_PROFILE_ZONE("AssetManager::LoadShaderPermutations");
+  auto permutations = FindShaderPermutations(filename);
+  load_telemetry_.CountLookup("shader", permutations != nullptr);
+  if (permutations) return Reuse(permutations);
+
+  ScopedAssetLoad load(this, "shader", filename);
+  std::string flatbuf;
+  if (LoadFile(filename, &flatbuf)) {
+    AssetLoadPhaseTimer decode(kAssetLoadPhaseDecode);
+    permutations = new ShaderPermutations(renderer_);
+    if (permutations->Init(&flatbuf)) {
+      shader_permutations_map_[filename] = permutations;
+      load.Succeeded();
+      return permutations;
+    }
+    delete permutations;
+    LogError(kError, "Can\'t read shader file: %s", filename);
+    renderer_.set_last_error(std::string("Not a shader file: ") + filename);
+    return nullptr;
+  }
+  LogError(kError, "Can\'t load shader file: %s", filename);
+  renderer_.set_last_error(std::string("Couldn\'t load: ") + filename);
+  return nullptr;
+}
+
+void AssetManager::UnloadShaderPermutations(const char *filename) {
+  auto permutations = FindShaderPermutations(filename);
+  if (Release(permutations)) {
+    MarkUnused(kAssetTypeShaderPermutations, filename, permutations);
+  }
 }
 
 Texture *AssetManager::FindTexture(const char *filename) {
@@ -212,30 +419,121 @@ Texture *AssetManager::FindTexture(const char *filename) {
 
 Texture *AssetManager::LoadTexture(const char *filename, TextureFormat format,
                                    TextureFlags flags) {
+  FPLBASE_PROFILE_ZONE("AssetManager::LoadTexture");
   auto tex = FindTexture(filename);
-  if (tex) return tex;
+  load_telemetry_.CountLookup("texture", tex != nullptr);
+  if (tex) return Reuse(tex);
+  memory_total_valid_ = false;
+  const bool async = (flags & kTextureFlagsLoadAsync) != 0;
   tex = new Texture(filename, format, flags);
-  return LoadOrQueue(tex, texture_map_, (flags & kTextureFlagsLoadAsync) != 0);
+  tex->set_load_telemetry(&load_telemetry_,
+                          load_telemetry_.BeginAsset("texture", filename, async));
+  tex = LoadOrQueue(tex, texture_map_, async);
+  if (tex) WatchAsset(tex, HotReloadInfo(kAssetTypeTexture, filename));
+  return tex;
 }
 
-void AssetManager::StartLoadingTextures() { loader_.StartLoading(); }
+void AssetManager::StartLoadingTextures() {
+  // The loader thread keeps running, so picks up anything queued later.
+  if (loader_started_) return;
+  loader_.StartLoading();
+  loader_started_ = true;
+}
 
-bool AssetManager::TryFinalize() { return loader_.TryFinalize(); }
+bool AssetManager::TryFinalize() {
+  FrameStats &frame_stats = renderer_.frame_stats();
+  frame_stats.BeginPhase(kFramePhaseFinalize);
+  if (file_watcher_) ReloadChangedAssets();
+  bool finalized = loader_.TryFinalize();
+  // Finished loads and reloads change how much memory assets take.
+  memory_total_valid_ = false;
+  // Compile at most one prewarmed shader variant per call, since each can
+  // take a noticeable part of a frame.
+  for (auto it = shader_permutations_map_.begin();
+       it != shader_permutations_map_.end(); ++it) {
+    if (it->second->CompileNextPrewarm()) break;
+  }
+  for (auto it = shader_permutations_map_.begin();
+       it != shader_permutations_map_.end(); ++it) {
+    if (it->second->prewarm_pending()) finalized = false;
+  }
+  frame_stats.EndPhase(kFramePhaseFinalize);
+  return finalized;
+}
 
 void AssetManager::UnloadTexture(const char *filename) {
   auto tex = FindTexture(filename);
-  if (!tex || tex->DecreaseRefCount()) return;
-  texture_map_.erase(filename);
-  delete tex;
+  if (Release(tex)) MarkUnused(kAssetTypeTexture, filename, tex);
 }
 
 Material *AssetManager::FindMaterial(const char *filename) {
   return FindInMap(material_map_, filename);
 }
 
+void AssetManager::SetUpMaterial(const matdef::Material *matdef,
+                                 Material *mat) {
+  mat->set_blend_mode(static_cast<BlendMode>(matdef->blendmode()));
+  mat->set_texture_layer(matdef->texture_layer());
+  // Released only once the new textures are loaded, so those the old and new
+  // textures share aren't deleted and loaded again.
+  std::vector<Texture *> previous_textures;
+  previous_textures.swap(mat->textures());
+  for (size_t i = 0; i < matdef->texture_filenames()->size(); i++) {
+    flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(i);
+    auto format =
+        matdef->desired_format() && i < matdef->desired_format()->size()
+            ? static_cast<TextureFormat>(matdef->desired_format()->Get(index))
+            : kFormatAuto;
+    const char *filename = matdef->texture_filenames()->Get(index)->c_str();
+    // LoadTexture() only hands out a reference for a texture that is new or
+    // unused, but the material needs one of its own either way.
+    const Texture *existing = FindTexture(filename);
+    const bool in_use = existing && existing->refcount_ > 0;
+    auto tex = LoadTexture(
+        filename, format,
+        (matdef->mipmaps() ? kTextureFlagsUseMipMaps : kTextureFlagsNone) |
+            (matdef->is_cubemap() && matdef->is_cubemap()->Get(index)
+                 ? kTextureFlagsIsCubeMap
+                 : kTextureFlagsNone) |
+            (matdef->is_array() && index < matdef->is_array()->size() &&
+                     matdef->is_array()->Get(index)
+                 ? kTextureFlagsIsArray
+                 : kTextureFlagsNone));
+    if (in_use) tex->IncreaseRefCount();
+    mat->textures().push_back(tex);
+
+    auto original_size =
+        matdef->original_size() && index < matdef->original_size()->size()
+            ? LoadVec2i(matdef->original_size()->Get(index))
+            : tex->size();
+    tex->set_original_size(original_size);
+
+    tex->set_scale(texture_scale_);
+  }
+  ReleaseTextures(previous_textures);
+}
+
+size_t AssetManager::ReleaseTextures(const std::vector<Texture *> &textures) {
+  size_t freed = 0;
+  for (auto it = textures.begin(); it != textures.end(); ++it) {
+    Texture *tex = *it;
+    if (Release(tex)) {
+      const std::string filename = tex->filename();
+      freed += DeleteAsset(kAssetTypeTexture, filename, tex);
+    }
+  }
+  return freed;
+}
+
 Material *AssetManager::LoadMaterial(const char *filename) {
+  FPLBASE_PROFILE_ZONE("AssetManager::LoadMaterial");
   auto mat = FindMaterial(filename);
-  if (mat) return mat;
+  load_telemetry_.CountLookup("material", mat != nullptr);
+  if (mat) return Reuse(mat);
+  ScopedAssetLoad load(this, "material", filename);
+  // Covers everything but reading files and loading textures, which are
+  // timed separately.
+  AssetLoadPhaseTimer decode(kAssetLoadPhaseDecode);
   std::string flatbuf;
   if (LoadFile(filename, &flatbuf)) {
     flatbuffers::Verifier verifier(
@@ -243,30 +541,10 @@ Material *AssetManager::LoadMaterial(const char *filename) {
     assert(matdef::VerifyMaterialBuffer(verifier));
     auto matdef = matdef::GetMaterial(flatbuf.c_str());
     mat = new Material();
-    mat->set_blend_mode(static_cast<BlendMode>(matdef->blendmode()));
-    for (size_t i = 0; i < matdef->texture_filenames()->size(); i++) {
-      flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(i);
-      auto format =
-          matdef->desired_format() && i < matdef->desired_format()->size()
-              ? static_cast<TextureFormat>(matdef->desired_format()->Get(index))
-              : kFormatAuto;
-      auto tex = LoadTexture(
-          matdef->texture_filenames()->Get(index)->c_str(), format,
-          (matdef->mipmaps() ? kTextureFlagsUseMipMaps : kTextureFlagsNone) |
-              (matdef->is_cubemap() && matdef->is_cubemap()->Get(index)
-                   ? kTextureFlagsIsCubeMap
-                   : kTextureFlagsNone));
-      mat->textures().push_back(tex);
-
-      auto original_size =
-          matdef->original_size() && index < matdef->original_size()->size()
-              ? LoadVec2i(matdef->original_size()->Get(index))
-              : tex->size();
-      tex->set_original_size(original_size);
-
-      tex->set_scale(texture_scale_);
-    }
+    SetUpMaterial(matdef, mat);
     material_map_[filename] = mat;
+    load.Succeeded();
+    WatchAsset(mat, HotReloadInfo(kAssetTypeMaterial, filename));
     return mat;
   }
   renderer_.set_last_error(std::string("Couldn\'t load: ") + filename);
@@ -275,12 +553,7 @@ Material *AssetManager::LoadMaterial(const char *filename) {
 
 void AssetManager::UnloadMaterial(const char *filename) {
   auto mat = FindMaterial(filename);
-  if (!mat || mat->DecreaseRefCount()) return;
-  mat->DeleteTextures();
-  material_map_.erase(filename);
-  for (auto it = mat->textures().begin(); it != mat->textures().end(); ++it) {
-    texture_map_.erase((*it)->filename());
-  }
+  if (Release(mat)) MarkUnused(kAssetTypeMaterial, filename, mat);
 }
 
 Mesh *AssetManager::FindMesh(const char *filename) {
@@ -295,8 +568,14 @@ void CopyAttribute(const T *attr, uint8_t *&buf) {
 }
 
 Mesh *AssetManager::LoadMesh(const char *filename) {
+  FPLBASE_PROFILE_ZONE("AssetManager::LoadMesh");
   auto mesh = FindMesh(filename);
-  if (mesh) return mesh;
+  load_telemetry_.CountLookup("mesh", mesh != nullptr);
+  if (mesh) return Reuse(mesh);
+  ScopedAssetLoad load(this, "mesh", filename);
+  // Covers everything but reading files, creating buffers and loading
+  // materials, which are timed separately.
+  AssetLoadPhaseTimer decode(kAssetLoadPhaseDecode);
   std::string flatbuf;
   if (LoadFile(filename, &flatbuf)) {
     flatbuffers::Verifier verifier(
@@ -344,7 +623,9 @@ Mesh *AssetManager::LoadMesh(const char *filename) {
     // Create an interleaved buffer. Would be cool to do this without
     // the additional copy, but that's not easy in OpenGL.
     // Could use multiple buffers instead, but likely less efficient.
-    auto buf = new uint8_t[vert_size * meshdef->positions()->Length()];
+    const size_t buf_size = vert_size * meshdef->positions()->Length();
+    auto buf = new uint8_t[buf_size];
+    AssetLoadAddBytes(0, buf_size);
     auto p = buf;
     for (size_t i = 0; i < meshdef->positions()->Length(); i++) {
       flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(i);
@@ -365,10 +646,12 @@ Mesh *AssetManager::LoadMesh(const char *filename) {
                                        : mathfu::kZeros3f;
     vec3 min = meshdef->min_position() ? LoadVec3(meshdef->min_position())
                                        : mathfu::kZeros3f;
+    AssetLoadPhaseTimer upload(kAssetLoadPhaseUpload);
     mesh = new Mesh(buf, static_cast<int>(meshdef->positions()->Length()),
                     static_cast<int>(vert_size), attrs.data(),
                     meshdef->max_position() ? &max : nullptr,
                     meshdef->min_position() ? &min : nullptr);
+    upload.Stop();
     delete[] buf;
     // Load the bone information.
     if (has_skinning) {
@@ -397,11 +680,13 @@ Mesh *AssetManager::LoadMesh(const char *filename) {
         delete mesh;
         return nullptr;
       }  // Error msg already set.
+      AssetLoadPhaseTimer upload_indices(kAssetLoadPhaseUpload);
       mesh->AddIndices(
           reinterpret_cast<const uint16_t *>(surface->indices()->Data()),
           surface->indices()->Length(), mat);
     }
     mesh_map_[filename] = mesh;
+    load.Succeeded();
     return mesh;
   }
   renderer_.set_last_error(std::string("Couldn\'t load: ") + filename);
@@ -410,9 +695,7 @@ Mesh *AssetManager::LoadMesh(const char *filename) {
 
 void AssetManager::UnloadMesh(const char *filename) {
   auto mesh = FindMesh(filename);
-  if (!mesh || mesh->DecreaseRefCount()) return;
-  mesh_map_.erase(filename);
-  delete mesh;
+  if (Release(mesh)) MarkUnused(kAssetTypeMesh, filename, mesh);
 }
 
 TextureAtlas *AssetManager::FindTextureAtlas(const char *filename) {
@@ -422,28 +705,42 @@ TextureAtlas *AssetManager::FindTextureAtlas(const char *filename) {
 TextureAtlas *AssetManager::LoadTextureAtlas(const char *filename,
                                              TextureFormat format,
                                              TextureFlags flags) {
+  FPLBASE_PROFILE_ZONE("AssetManager::LoadTextureAtlas");
   auto atlas = FindTextureAtlas(filename);
-  if (atlas) return atlas;
+  load_telemetry_.CountLookup("texture_atlas", atlas != nullptr);
+  if (atlas) return Reuse(atlas);
+  ScopedAssetLoad load(this, "texture_atlas", filename);
+  AssetLoadPhaseTimer decode(kAssetLoadPhaseDecode);
   std::string flatbuf;
   if (LoadFile(filename, &flatbuf)) {
     flatbuffers::Verifier verifier(
         reinterpret_cast<const uint8_t *>(flatbuf.c_str()), flatbuf.length());
     assert(atlasdef::VerifyTextureAtlasBuffer(verifier));
     auto atlasdef = atlasdef::GetTextureAtlas(flatbuf.c_str());
-    Texture *atlas_texture =
-        LoadTexture(atlasdef->texture_filename()->c_str(), format, flags);
     atlas = new TextureAtlas();
-    atlas->set_atlas_texture(atlas_texture);
+    auto pages = atlasdef->pages();
+    if (pages && pages->Length() > 0) {
+      for (auto it = pages->begin(); it != pages->end(); ++it) {
+        atlas->page_textures().push_back(
+            LoadTexture(it->c_str(), format, flags));
+      }
+    } else {
+      atlas->set_atlas_texture(
+          LoadTexture(atlasdef->texture_filename()->c_str(), format, flags));
+    }
+    const bool paged = atlas->page_textures().size() > 1;
     for (size_t i = 0; i < atlasdef->entries()->Length(); ++i) {
       flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(i);
-      atlas->index_map().insert(std::make_pair(
-          atlasdef->entries()->Get(index)->name()->str(), index));
-      vec2 size = LoadVec2(atlasdef->entries()->Get(index)->size());
-      vec2 location = LoadVec2(atlasdef->entries()->Get(index)->location());
+      auto entry = atlasdef->entries()->Get(index);
+      atlas->index_map().insert(std::make_pair(entry->name()->str(), index));
+      vec2 size = LoadVec2(entry->size());
+      vec2 location = LoadVec2(entry->location());
       atlas->subtexture_bounds().push_back(
           vec4(location.x(), location.y(), size.x(), size.y()));
+      if (paged) atlas->subtexture_pages().push_back(entry->page());
     }
     texture_atlas_map_[filename] = atlas;
+    load.Succeeded();
     return atlas;
   }
   renderer_.set_last_error(std::string("Couldn\'t load: ") + filename);
@@ -452,9 +749,7 @@ TextureAtlas *AssetManager::LoadTextureAtlas(const char *filename,
 
 void AssetManager::UnloadTextureAtlas(const char *filename) {
   auto atlas = FindTextureAtlas(filename);
-  if (!atlas || atlas->DecreaseRefCount()) return;
-  texture_atlas_map_.erase(filename);
-  delete atlas;
+  if (Release(atlas)) MarkUnused(kAssetTypeTextureAtlas, filename, atlas);
 }
 
 FileAsset *AssetManager::FindFileAsset(const char *filename) {
@@ -462,11 +757,16 @@ FileAsset *AssetManager::FindFileAsset(const char *filename) {
 }
 
 FileAsset *AssetManager::LoadFileAsset(const char *filename) {
+  FPLBASE_PROFILE_ZONE("AssetManager::LoadFileAsset");
   auto file = FindFileAsset(filename);
-  if (file) return file;
+  load_telemetry_.CountLookup("file", file != nullptr);
+  if (file) return Reuse(file);
+  ScopedAssetLoad load(this, "file", filename);
   file = new FileAsset();
   if (LoadFile(filename, &file->contents)) {
     file_map_[filename] = file;
+    load.Succeeded();
+    WatchAsset(file, HotReloadInfo(kAssetTypeFile, filename));
     return file;
   }
   delete file;
@@ -475,9 +775,283 @@ FileAsset *AssetManager::LoadFileAsset(const char *filename) {
 
 void AssetManager::UnloadFileAsset(const char *filename) {
   auto file = FindFileAsset(filename);
-  if (!file || file->DecreaseRefCount()) return;
-  file_map_.erase(filename);
-  delete file;
+  if (Release(file)) MarkUnused(kAssetTypeFile, filename, file);
+}
+
+void AssetManager::MarkUnused(AssetType type, const char *name,
+                              Asset *asset) {
+  UnusedAsset unused = {type, name, asset};
+  unused_index_[asset] = unused_assets_.insert(unused_assets_.end(), unused);
+  EvictUnused();
+}
+
+void AssetManager::RemoveUnused(const Asset *asset) {
+  auto it = unused_index_.find(asset);
+  if (it == unused_index_.end()) return;
+  unused_assets_.erase(it->second);
+  unused_index_.erase(it);
+}
+
+size_t AssetManager::DeleteAsset(AssetType type, const std::string &name,
+                                 Asset *asset) {
+  CancelReloads(asset);
+  size_t freed = asset->MemoryUsage().total();
+  memory_total_ -= std::min(memory_total_, freed);
+  switch (type) {
+    case kAssetTypeShader:
+      shader_map_.erase(name);
+      break;
+    case kAssetTypeTexture:
+      texture_map_.erase(name);
+      break;
+    case kAssetTypeMaterial: {
+      material_map_.erase(name);
+      // Materials hold a reference to each of their textures, so take with
+      // them those that nothing else uses.
+      freed += ReleaseTextures(static_cast<Material *>(asset)->textures());
+      break;
+    }
+    case kAssetTypeMesh:
+      mesh_map_.erase(name);
+      break;
+    case kAssetTypeTextureAtlas:
+      texture_atlas_map_.erase(name);
+      break;
+    case kAssetTypeFile:
+      file_map_.erase(name);
+      break;
+    case kAssetTypeShaderPermutations:
+      shader_permutations_map_.erase(name);
+      break;
+    default:
+      assert(false);
+      return 0;
+  }
+  delete asset;
+  return freed;
+}
+
+void AssetManager::set_memory_budget(size_t bytes) {
+  memory_budget_ = bytes;
+  EnforceMemoryBudget();
+}
+
+template <typename T>
+void AssetManager::AddMemoryStats(const std::map<std::string, T *> &asset_map,
+                                  AssetMemoryStats *stats) const {
+  for (auto it = asset_map.begin(); it != asset_map.end(); ++it) {
+    const AssetMemoryUsage usage = it->second->MemoryUsage();
+    stats->count++;
+    stats->usage.cpu_bytes += usage.cpu_bytes;
+    stats->usage.gpu_bytes += usage.gpu_bytes;
+    if (it->second->refcount_ == 0) {
+      stats->unused_count++;
+      stats->unused_bytes += usage.total();
+    }
+  }
+}
+
+AssetMemoryStats AssetManager::MemoryStats(AssetType type) const {
+  AssetMemoryStats stats;
+  switch (type) {
+    case kAssetTypeShader:
+      AddMemoryStats(shader_map_, &stats);
+      break;
+    case kAssetTypeTexture:
+      AddMemoryStats(texture_map_, &stats);
+      break;
+    case kAssetTypeMaterial:
+      AddMemoryStats(material_map_, &stats);
+      break;
+    case kAssetTypeMesh:
+      AddMemoryStats(mesh_map_, &stats);
+      break;
+    case kAssetTypeTextureAtlas:
+      AddMemoryStats(texture_atlas_map_, &stats);
+      break;
+    case kAssetTypeFile:
+      AddMemoryStats(file_map_, &stats);
+      break;
+    case kAssetTypeShaderPermutations:
+      AddMemoryStats(shader_permutations_map_, &stats);
+      break;
+    default:
+      assert(false);
+  }
+  return stats;
+}
+
+AssetMemoryStats AssetManager::TotalMemoryStats() const {
+  AssetMemoryStats total;
+  for (int i = 0; i < kAssetTypeCount; ++i) {
+    const AssetMemoryStats stats = MemoryStats(static_cast<AssetType>(i));
+    total.count += stats.count;
+    total.usage.cpu_bytes += stats.usage.cpu_bytes;
+    total.usage.gpu_bytes += stats.usage.gpu_bytes;
+    total.unused_count += stats.unused_count;
+    total.unused_bytes += stats.unused_bytes;
+  }
+  return total;
+}
+
+void AssetManager::EnforceMemoryBudget() {
+  memory_total_valid_ = false;
+  EvictUnused();
+}
+
+void AssetManager::EvictUnused() {
+  if (unused_assets_.empty()) return;
+  // With no budget, nothing is kept, so there's no need to add up memory.
+  if (memory_budget_ && !memory_total_valid_) {
+    memory_total_ = TotalMemoryStats().usage.total();
+    memory_total_valid_ = true;
+  }
+  while (!unused_assets_.empty() &&
+         (memory_budget_ == 0 || memory_total_ > memory_budget_)) {
+    const UnusedAsset oldest = unused_assets_.front();
+    RemoveUnused(oldest.asset);
+    DeleteAsset(oldest.type, oldest.name, oldest.asset);
+  }
+}
+
+void AssetManager::PurgeUnusedAssets() {
+  while (!unused_assets_.empty()) {
+    const UnusedAsset oldest = unused_assets_.front();
+    RemoveUnused(oldest.asset);
+    DeleteAsset(oldest.type, oldest.name, oldest.asset);
+  }
+}
+
+void AssetManager::EnableHotReload(bool enable) {
+  if (!enable) {
+    file_watcher_.reset();
+    hot_reload_assets_.clear();
+  } else if (!file_watcher_) {
+    file_watcher_.reset(new FileWatcher());
+  }
+}
+
+void AssetManager::WatchAsset(const Asset *asset, const HotReloadInfo &info) {
+  if (!file_watcher_) return;
+  for (auto it = info.files.begin(); it != info.files.end(); ++it) {
+    if (!file_watcher_->Watch(*it)) {
+      LogInfo(kApplication, "Hot reload can't watch %s", it->c_str());
+    }
+  }
+  hot_reload_assets_[asset] = info;
+}
+
+void AssetManager::CancelReloads(const Asset *asset) {
+  hot_reload_assets_.erase(asset);
+  for (auto it = pending_reloads_.begin(); it != pending_reloads_.end(); ++it) {
+    if ((*it)->target_ == asset) (*it)->target_ = nullptr;
+  }
+}
+
+int AssetManager::ReloadChangedAssets() {
+  if (!file_watcher_) return 0;
+  std::vector<std::string> changed;
+  file_watcher_->Poll(&changed);
+  if (changed.empty()) return 0;
+  int queued = 0;
+  for (auto it = hot_reload_assets_.begin(); it != hot_reload_assets_.end();
+       ++it) {
+    const std::set<std::string> &files = it->second.files;
+    for (auto file = changed.begin(); file != changed.end(); ++file) {
+      if (files.find(*file) == files.end()) continue;
+      auto reload =
+          new AssetReload(this, it->second, const_cast<Asset *>(it->first));
+      pending_reloads_.push_back(reload);
+      loader_.QueueJob(reload);
+      queued++;
+      break;
+    }
+  }
+  if (queued) StartLoadingTextures();
+  return queued;
+}
+
+void AssetManager::FinishReload(AssetReload *reload) {
+  pending_reloads_.erase(std::find(pending_reloads_.begin(),
+                                   pending_reloads_.end(), reload));
+  if (reload->target_) {
+    if (ApplyReload(reload)) {
+      LogInfo(kApplication, "Reloaded %s", reload->filename().c_str());
+    } else {
+      LogError(kError, "Can't reload %s: %s",
+               reload->filename().c_str(), reload->error_.c_str());
+    }
+  }
+  delete reload;
+}
+
+bool AssetManager::ApplyReload(AssetReload *reload) {
+  if (!reload->data_) {
+    if (reload->error_.empty()) reload->error_ = "cannot load file";
+    return false;
+  }
+  const std::string &contents = reload->contents_;
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t *>(contents.c_str()), contents.length());
+  switch (reload->info_.type) {
+    case kAssetTypeShader: {
+      auto shader = static_cast<Shader *>(reload->target_);
+      bool ok;
+      if (reload->info_.from_glsl) {
+        ok = RecompileShader(shader, contents, reload->ps_contents_);
+        // Watch any newly \#included files.
+        if (ok) WatchAsset(shader, reload->info_);
+      } else {
+        if (!shaderdef::VerifyShaderBuffer(verifier)) {
+          reload->error_ = "not a shader file";
+          return false;
+        }
+        auto shaderdef = shaderdef::GetShader(contents.c_str());
+        ok = RecompileShader(shader, shaderdef->vertex_shader()->str(),
+                             shaderdef->fragment_shader()->str());
+      }
+      if (!ok) reload->error_ = renderer_.last_error();
+      return ok;
+    }
+    case kAssetTypeTexture: {
+      // The texture keeps its current contents if the new ones fail.
+      auto tex = static_cast<Texture *>(reload->target_);
+      const TextureHandle previous_id = tex->id();
+      tex->LoadFromMemory(reload->pixels_, reload->texture_size_,
+                          reload->texture_format_);
+      if (tex->id() == previous_id) {
+        reload->error_ = "cannot create texture";
+        return false;
+      }
+      return true;
+    }
+    case kAssetTypeMaterial: {
+      if (!matdef::VerifyMaterialBuffer(verifier)) {
+        reload->error_ = "not a material file";
+        return false;
+      }
+      SetUpMaterial(matdef::GetMaterial(contents.c_str()),
+                    static_cast<Material *>(reload->target_));
+      return true;
+    }
+    case kAssetTypeFile:
+      static_cast<FileAsset *>(reload->target_)->contents.swap(
+          reload->contents_);
+      return true;
+    default:
+      assert(false);
+      return false;
+  }
+}
+
+bool AssetManager::RecompileShader(Shader *shader, const std::string &vs_source,
+                                   const std::string &ps_source) {
+  // The shader is constructed anew in place, which resets its refcount.
+  const int refcount = shader->refcount_;
+  const bool ok =
+      renderer_.RecompileShader(vs_source.c_str(), ps_source.c_str(), shader);
+  shader->refcount_ = refcount;
+  return ok;
 }
 
 }  // namespace fplbase
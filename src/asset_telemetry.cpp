@@ -0,0 +1,361 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/asset_telemetry.h"
+#include "fplbase/utilities.h"
+#include "json_utilities.h"
+
+#ifdef FPL_BASE_BACKEND_STDLIB
+#include <mutex>
+#endif
+
+namespace fplbase {
+
+// Holds an AssetLoadTelemetry's mutex for as long as it exists.
+class TelemetryLock {
+ public:
+  explicit TelemetryLock(const AssetLoadTelemetry *telemetry)
+      : mutex_(telemetry->mutex_) {
+#ifdef FPL_BASE_BACKEND_SDL
+    auto err = SDL_LockMutex(static_cast<SDL_mutex *>(mutex_));
+    (void)err;
+    assert(err == 0);
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    static_cast<std::mutex *>(mutex_)->lock();
+#else
+#error Need to define FPL_BASE_BACKEND_XXX
+#endif
+  }
+  ~TelemetryLock() {
+#ifdef FPL_BASE_BACKEND_SDL
+    SDL_UnlockMutex(static_cast<SDL_mutex *>(mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    static_cast<std::mutex *>(mutex_)->unlock();
+#endif
+  }
+
+ private:
+  void *mutex_;
+};
+
+// The record work on this thread is added to, set by AssetLoadScope.
+static thread_local AssetLoadTelemetry *current_telemetry = nullptr;
+static thread_local int current_record = -1;
+// The innermost running AssetLoadPhaseTimer on this thread.
+static thread_local AssetLoadPhaseTimer *current_timer = nullptr;
+
+const char *const *AssetLoadPhaseNames() {
+  static const char *const kNames[] = {"read", "decode", "upload"};
+  static_assert(sizeof(kNames) / sizeof(kNames[0]) == kAssetLoadPhaseCount,
+                "Update kNames when adding phases.");
+  return kNames;
+}
+
+double AssetLoadRecord::TotalSeconds() const {
+  double total = 0;
+  for (int i = 0; i < kAssetLoadPhaseCount; ++i) total += phase_seconds[i];
+  return total;
+}
+
+AssetLoadTelemetry::AssetLoadTelemetry()
+    : epoch_(Clock::now()),
+      first_id_(0),
+      staging_bytes_(0),
+      peak_staging_bytes_(0),
+      enabled_(true) {
+#ifdef FPL_BASE_BACKEND_SDL
+  mutex_ = SDL_CreateMutex();
+  assert(mutex_);
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  mutex_ = new std::mutex();
+#endif
+}
+
+AssetLoadTelemetry::~AssetLoadTelemetry() {
+#ifdef FPL_BASE_BACKEND_SDL
+  SDL_DestroyMutex(static_cast<SDL_mutex *>(mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  delete static_cast<std::mutex *>(mutex_);
+#endif
+}
+
+double AssetLoadTelemetry::Now() const {
+  return std::chrono::duration<double>(Clock::now() - epoch_).count();
+}
+
+AssetLoadRecord *AssetLoadTelemetry::Find(int id) {
+  if (id < first_id_) return nullptr;
+  const size_t index = static_cast<size_t>(id - first_id_);
+  return index < records_.size() ? &records_[index] : nullptr;
+}
+
+int AssetLoadTelemetry::BeginAsset(const char *kind, const std::string &name,
+                                   bool async) {
+  if (!enabled_) return -1;
+  AssetLoadRecord record;
+  record.kind = kind;
+  record.name = name;
+  record.start = Now();
+  record.end = -1;
+  for (int i = 0; i < kAssetLoadPhaseCount; ++i) record.phase_seconds[i] = 0;
+  record.bytes_read = 0;
+  record.bytes_decoded = 0;
+  record.async = async;
+  record.failed = false;
+  TelemetryLock lock(this);
+  records_.push_back(record);
+  return first_id_ + static_cast<int>(records_.size()) - 1;
+}
+
+void AssetLoadTelemetry::AddPhaseTime(int id, AssetLoadPhase phase,
+                                      double seconds) {
+  TelemetryLock lock(this);
+  auto record = Find(id);
+  if (record) record->phase_seconds[phase] += seconds;
+}
+
+void AssetLoadTelemetry::AddBytes(int id, size_t bytes_read,
+                                  size_t bytes_decoded) {
+  TelemetryLock lock(this);
+  auto record = Find(id);
+  if (!record) return;
+  record->bytes_read += bytes_read;
+  record->bytes_decoded += bytes_decoded;
+  if (record->end < 0) {
+    staging_bytes_ += bytes_decoded;
+    peak_staging_bytes_ = std::max(peak_staging_bytes_, staging_bytes_);
+  }
+}
+
+void AssetLoadTelemetry::EndAsset(int id, bool succeeded) {
+  const double now = Now();
+  TelemetryLock lock(this);
+  auto record = Find(id);
+  if (!record || record->end >= 0) return;
+  record->end = now;
+  record->failed = !succeeded;
+  staging_bytes_ -= record->bytes_decoded;
+}
+
+void AssetLoadTelemetry::CountLookup(const char *kind, bool hit) {
+  if (!enabled_) return;
+  TelemetryLock lock(this);
+  auto &counts = cache_counts_[kind];
+  if (hit) {
+    counts.hits++;
+  } else {
+    counts.misses++;
+  }
+}
+
+size_t AssetLoadTelemetry::staging_bytes() const {
+  TelemetryLock lock(this);
+  return staging_bytes_;
+}
+
+size_t AssetLoadTelemetry::peak_staging_bytes() const {
+  TelemetryLock lock(this);
+  return peak_staging_bytes_;
+}
+
+std::vector<AssetLoadRecord> AssetLoadTelemetry::Records() const {
+  TelemetryLock lock(this);
+  return records_;
+}
+
+std::vector<AssetLoadRecord> AssetLoadTelemetry::SlowestRecords(
+    double fraction) const {
+  auto records = Records();
+  const size_t count = std::min(
+      records.size(),
+      std::max<size_t>(1, static_cast<size_t>(ceil(records.size() * fraction))));
+  std::partial_sort(records.begin(), records.begin() + count, records.end(),
+                    [](const AssetLoadRecord &a, const AssetLoadRecord &b) {
+                      return a.TotalSeconds() > b.TotalSeconds();
+                    });
+  records.resize(count);
+  return records;
+}
+
+AssetCacheCounts AssetLoadTelemetry::CacheCounts(const char *kind) const {
+  TelemetryLock lock(this);
+  AssetCacheCounts total;
+  for (auto it = cache_counts_.begin(); it != cache_counts_.end(); ++it) {
+    if (kind && it->first != kind) continue;
+    total.hits += it->second.hits;
+    total.misses += it->second.misses;
+  }
+  return total;
+}
+
+// Append `str` to `csv` as a field, quoted if it needs to be.
+static void AppendCsvField(const std::string &str, std::string *csv) {
+  if (str.find_first_of(",\"\n") == std::string::npos) {
+    csv->append(str);
+    return;
+  }
+  csv->push_back('"');
+  for (auto c = str.begin(); c != str.end(); ++c) {
+    if (*c == '"') csv->push_back('"');
+    csv->push_back(*c);
+  }
+  csv->push_back('"');
+}
+
+std::string AssetLoadTelemetry::ToCsv() const {
+  const auto records = Records();
+  const char *const *phases = AssetLoadPhaseNames();
+  std::string csv = "kind,name,async,failed,start_ms,end_ms";
+  for (int i = 0; i < kAssetLoadPhaseCount; ++i) {
+    csv += std::string(",") + phases[i] + "_ms";
+  }
+  csv += ",total_ms,bytes_read,bytes_decoded\n";
+  char buf[64];
+  for (auto it = records.begin(); it != records.end(); ++it) {
+    csv += it->kind;
+    csv.push_back(',');
+    AppendCsvField(it->name, &csv);
+    snprintf(buf, sizeof(buf), ",%d,%d,%.3f,%.3f", it->async ? 1 : 0,
+             it->failed ? 1 : 0, it->start * 1e3, it->end * 1e3);
+    csv += buf;
+    for (int i = 0; i < kAssetLoadPhaseCount; ++i) {
+      snprintf(buf, sizeof(buf), ",%.3f", it->phase_seconds[i] * 1e3);
+      csv += buf;
+    }
+    snprintf(buf, sizeof(buf), ",%.3f,%llu,%llu\n", it->TotalSeconds() * 1e3,
+             static_cast<unsigned long long>(it->bytes_read),
+             static_cast<unsigned long long>(it->bytes_decoded));
+    csv += buf;
+  }
+  return csv;
+}
+
+std::string AssetLoadTelemetry::ToJson() const {
+  const auto records = Records();
+  const char *const *phases = AssetLoadPhaseNames();
+  char buf[128];
+  std::string json;
+  {
+    TelemetryLock lock(this);
+    snprintf(buf, sizeof(buf), "{\"peak_staging_bytes\":%llu,\"cache\":{",
+             static_cast<unsigned long long>(peak_staging_bytes_));
+    json = buf;
+    for (auto it = cache_counts_.begin(); it != cache_counts_.end(); ++it) {
+      if (it != cache_counts_.begin()) json.push_back(',');
+      AppendJsonString(it->first, &json);
+      snprintf(buf, sizeof(buf), ":{\"hits\":%llu,\"misses\":%llu}",
+               static_cast<unsigned long long>(it->second.hits),
+               static_cast<unsigned long long>(it->second.misses));
+      json += buf;
+    }
+  }
+  json += "},\"assets\":[";
+  for (auto it = records.begin(); it != records.end(); ++it) {
+    json += it == records.begin() ? "\n{\"kind\":" : ",\n{\"kind\":";
+    AppendJsonString(it->kind, &json);
+    json += ",\"name\":";
+    AppendJsonString(it->name, &json);
+    snprintf(buf, sizeof(buf),
+             ",\"async\":%s,\"failed\":%s,\"start_ms\":%.3f,\"end_ms\":%.3f",
+             it->async ? "true" : "false", it->failed ? "true" : "false",
+             it->start * 1e3, it->end * 1e3);
+    json += buf;
+    for (int i = 0; i < kAssetLoadPhaseCount; ++i) {
+      snprintf(buf, sizeof(buf), ",\"%s_ms\":%.3f", phases[i],
+               it->phase_seconds[i] * 1e3);
+      json += buf;
+    }
+    snprintf(buf, sizeof(buf),
+             ",\"total_ms\":%.3f,\"bytes_read\":%llu,\"bytes_decoded\":%llu}",
+             it->TotalSeconds() * 1e3,
+             static_cast<unsigned long long>(it->bytes_read),
+             static_cast<unsigned long long>(it->bytes_decoded));
+    json += buf;
+  }
+  json += "\n]}\n";
+  return json;
+}
+
+bool AssetLoadTelemetry::SaveCsv(const char *filename) const {
+  if (!SaveFile(filename, ToCsv())) {
+    LogError(kApplication, "Couldn't save asset telemetry to %s", filename);
+    return false;
+  }
+  return true;
+}
+
+bool AssetLoadTelemetry::SaveJson(const char *filename) const {
+  if (!SaveFile(filename, ToJson())) {
+    LogError(kApplication, "Couldn't save asset telemetry to %s", filename);
+    return false;
+  }
+  return true;
+}
+
+void AssetLoadTelemetry::Clear() {
+  TelemetryLock lock(this);
+  first_id_ += static_cast<int>(records_.size());
+  records_.clear();
+  cache_counts_.clear();
+  staging_bytes_ = 0;
+  peak_staging_bytes_ = 0;
+}
+
+AssetLoadScope::AssetLoadScope(AssetLoadTelemetry *telemetry, int record)
+    : previous_telemetry_(current_telemetry),
+      previous_record_(current_record) {
+  current_telemetry = telemetry;
+  current_record = record;
+}
+
+AssetLoadScope::~AssetLoadScope() {
+  current_telemetry = previous_telemetry_;
+  current_record = previous_record_;
+}
+
+AssetLoadPhaseTimer::AssetLoadPhaseTimer(AssetLoadPhase phase)
+    : telemetry_(current_record >= 0 ? current_telemetry : nullptr),
+      record_(current_record),
+      phase_(phase),
+      running_(telemetry_ != nullptr || current_timer != nullptr),
+      parent_(current_timer),
+      nested_seconds_(0) {
+  if (!running_) return;
+  current_timer = this;
+  start_ = std::chrono::steady_clock::now();
+}
+
+void AssetLoadPhaseTimer::Stop() {
+  if (!running_) return;
+  running_ = false;
+  assert(current_timer == this);
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_)
+          .count();
+  if (telemetry_) {
+    telemetry_->AddPhaseTime(record_, phase_,
+                             std::max(0.0, seconds - nested_seconds_));
+  }
+  if (parent_) parent_->nested_seconds_ += seconds;
+  current_timer = parent_;
+}
+
+void AssetLoadAddBytes(size_t bytes_read, size_t bytes_decoded) {
+  if (current_telemetry && current_record >= 0) {
+    current_telemetry->AddBytes(current_record, bytes_read, bytes_decoded);
+  }
+}
+
+}  // namespace fplbase
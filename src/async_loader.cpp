@@ -14,6 +14,7 @@
 
 #include "precompiled.h"
 #include "fplbase/async_loader.h"
+#include "fplbase/profiler.h"
 #include "fplbase/utilities.h"
 
 #ifndef FPL_BASE_BACKEND_SDL
@@ -67,11 +68,15 @@ void AsyncLoader::Stop() {
 }
 
 void AsyncLoader::QueueJob(AsyncAsset *res) {
+  if (!BookendAsyncResource::IsBookend(*res)) {
+    FPLBASE_PROFILE_ASYNC_BEGIN("AsyncLoader::Job", ProfileCookie(res));
+  }
   Lock([this, res]() { queue_.push_back(res); });
   SDL_SemPost(static_cast<SDL_semaphore *>(job_semaphore_));
 }
 
 void AsyncLoader::LoaderWorker() {
+  ProfileSetThreadName("FPL Loader Thread");
   for (;;) {
     auto res = LockReturn<AsyncAsset *>(
         [this]() { return queue_.empty() ? nullptr : queue_[0]; });
@@ -83,7 +88,10 @@ void AsyncLoader::LoaderWorker() {
     // StopLoadingWhenComplete(). To start loading again, call StartLoading().
     if (BookendAsyncResource::IsBookend(*res)) break;
     LogInfo(kApplication, "async load: %s", res->filename_.c_str());
-    res->Load();
+    {
+      FPLBASE_PROFILE_ZONE("AsyncAsset::Load");
+      res->Load();
+    }
     Lock([this, res]() {
       queue_.erase(queue_.begin());
       done_.push_back(res);
@@ -109,11 +117,13 @@ void AsyncLoader::StopLoadingWhenComplete() {
 }
 
 bool AsyncLoader::TryFinalize() {
+  FPLBASE_PROFILE_ZONE("AsyncLoader::TryFinalize");
   for (;;) {
     auto res = LockReturn<AsyncAsset *>(
         [this]() { return done_.empty() ? nullptr : done_[0]; });
     if (!res) break;
     res->Finalize();
+    FPLBASE_PROFILE_ASYNC_END("AsyncLoader::Job", ProfileCookie(res));
     Lock([this]() { done_.erase(done_.begin()); });
   }
   return LockReturn<bool>([this]() { return queue_.empty() && done_.empty(); });
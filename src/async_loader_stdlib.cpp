@@ -14,6 +14,7 @@
 
 #include "precompiled.h"
 #include "fplbase/async_loader.h"
+#include "fplbase/profiler.h"
 
 #ifndef FPL_BASE_BACKEND_STDLIB
 #error This version of AsyncLoader is designed for use with the C++ library.
@@ -35,6 +36,9 @@ void AsyncLoader::Stop() {
 }
 
 void AsyncLoader::QueueJob(AsyncAsset *res) {
+  if (res) {
+    FPLBASE_PROFILE_ASYNC_BEGIN("AsyncLoader::Job", ProfileCookie(res));
+  }
   {
     std::unique_lock<std::mutex> lock(mutex_);
     queue_.push_back(res);
@@ -49,6 +53,7 @@ void AsyncLoader::StartLoading() {
 void AsyncLoader::StopLoadingWhenComplete() { QueueJob(nullptr); }
 
 bool AsyncLoader::TryFinalize() {
+  FPLBASE_PROFILE_ZONE("AsyncLoader::TryFinalize");
   for (;;) {
     AsyncAsset *resource = nullptr;
     {
@@ -58,6 +63,7 @@ bool AsyncLoader::TryFinalize() {
 
     if (!resource) break;
     resource->Finalize();
+    FPLBASE_PROFILE_ASYNC_END("AsyncLoader::Job", ProfileCookie(resource));
 
     {
       std::unique_lock<std::mutex> lock(mutex_);
@@ -73,6 +79,7 @@ bool AsyncLoader::TryFinalize() {
 }
 
 void AsyncLoader::LoaderWorker() {
+  ProfileSetThreadName("FPL Loader Thread");
   for (;;) {
     AsyncAsset *resource = nullptr;
     {
@@ -81,7 +88,10 @@ void AsyncLoader::LoaderWorker() {
       resource = queue_[0];
     }
 
-    if (resource) resource->Load();
+    if (resource) {
+      FPLBASE_PROFILE_ZONE("AsyncAsset::Load");
+      resource->Load();
+    }
 
     {
       std::unique_lock<std::mutex> lock(mutex_);
@@ -0,0 +1,132 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "fplbase/atlas_packer.h"
+
+#include <algorithm>
+#include <limits>
+
+using mathfu::vec2i;
+
+namespace fplbase {
+
+AtlasPacker::AtlasPacker(const vec2i &page_size, int padding)
+    : page_size_(page_size), padding_(padding), used_area_(0) {
+  assert(padding >= 0);
+  Reset();
+}
+
+void AtlasPacker::Reset() {
+  free_rects_.clear();
+  free_rects_.push_back(Rect(0, 0, page_size_.x(), page_size_.y()));
+  used_area_ = 0;
+}
+
+int AtlasPacker::FindPosition(int w, int h) const {
+  int best = -1;
+  int best_short_side = std::numeric_limits<int>::max();
+  int best_long_side = std::numeric_limits<int>::max();
+  for (size_t i = 0; i < free_rects_.size(); ++i) {
+    const Rect &free = free_rects_[i];
+    if (free.w < w || free.h < h) continue;
+    const int leftover_w = free.w - w;
+    const int leftover_h = free.h - h;
+    const int short_side = std::min(leftover_w, leftover_h);
+    const int long_side = std::max(leftover_w, leftover_h);
+    if (short_side < best_short_side ||
+        (short_side == best_short_side && long_side < best_long_side)) {
+      best = static_cast<int>(i);
+      best_short_side = short_side;
+      best_long_side = long_side;
+    }
+  }
+  return best;
+}
+
+bool AtlasPacker::Fits(const vec2i &size) const {
+  if (size.x() <= 0 || size.y() <= 0) return false;
+  return FindPosition(size.x() + 2 * padding_, size.y() + 2 * padding_) >= 0;
+}
+
+bool AtlasPacker::Insert(const vec2i &size, vec2i *position) {
+  if (size.x() <= 0 || size.y() <= 0) return false;
+  const int w = size.x() + 2 * padding_;
+  const int h = size.y() + 2 * padding_;
+  const int index = FindPosition(w, h);
+  if (index < 0) return false;
+  const Rect used(free_rects_[index].x, free_rects_[index].y, w, h);
+  SplitFreeRects(used);
+  PruneFreeRects();
+  used_area_ += static_cast<size_t>(w) * h;
+  *position = vec2i(used.x + padding_, used.y + padding_);
+  return true;
+}
+
+void AtlasPacker::SplitFreeRects(const Rect &used) {
+  // Every free rectangle that overlaps `used` is replaced by the (up to four)
+  // maximal rectangles of what is left of it on each side.
+  const size_t count = free_rects_.size();
+  for (size_t i = 0; i < count; ++i) {
+    const Rect free = free_rects_[i];
+    if (used.x >= free.x + free.w || used.x + used.w <= free.x ||
+        used.y >= free.y + free.h || used.y + used.h <= free.y) {
+      continue;
+    }
+    if (used.x > free.x) {
+      free_rects_.push_back(Rect(free.x, free.y, used.x - free.x, free.h));
+    }
+    if (used.x + used.w < free.x + free.w) {
+      free_rects_.push_back(Rect(used.x + used.w, free.y,
+                                 free.x + free.w - (used.x + used.w), free.h));
+    }
+    if (used.y > free.y) {
+      free_rects_.push_back(Rect(free.x, free.y, free.w, used.y - free.y));
+    }
+    if (used.y + used.h < free.y + free.h) {
+      free_rects_.push_back(Rect(free.x, used.y + used.h, free.w,
+                                 free.y + free.h - (used.y + used.h)));
+    }
+    // Mark for removal; PruneFreeRects() drops empty rectangles.
+    free_rects_[i].w = 0;
+  }
+}
+
+void AtlasPacker::PruneFreeRects() {
+  for (size_t i = 0; i < free_rects_.size(); ++i) {
+    if (free_rects_[i].w == 0) continue;
+    for (size_t j = 0; j < free_rects_.size(); ++j) {
+      if (i == j || free_rects_[j].w == 0) continue;
+      // Of two identical rectangles keep the first.
+      if (free_rects_[j].Contains(free_rects_[i]) &&
+          !(free_rects_[i].Contains(free_rects_[j]) && i < j)) {
+        free_rects_[i].w = 0;
+        break;
+      }
+    }
+  }
+  free_rects_.erase(
+      std::remove_if(free_rects_.begin(), free_rects_.end(),
+                     [](const Rect &r) { return r.w == 0 || r.h == 0; }),
+      free_rects_.end());
+}
+
+float AtlasPacker::Occupancy() const {
+  const size_t page_area =
+      static_cast<size_t>(page_size_.x()) * page_size_.y();
+  return page_area ? static_cast<float>(used_area_) / page_area : 0.0f;
+}
+
+}  // namespace fplbase
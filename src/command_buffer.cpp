@@ -0,0 +1,585 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/command_buffer.h"
+#include "fplbase/texture.h"
+
+namespace fplbase {
+namespace {
+
+// Every command is a header followed by its payload. Payloads start, and are
+// padded to, 16 byte boundaries within the arena. The arena itself is only as
+// aligned as the allocator makes it, so payloads are copied in and out with
+// memcpy rather than read in place, and bone transforms, which need 16 byte
+// alignment, are kept outside of it.
+struct CommandHeader {
+  uint32_t type;
+  uint32_t payload_size;
+};
+const size_t kCommandAlignment = 16;
+
+inline size_t AlignCommandSize(size_t size) {
+  return (size + kCommandAlignment - 1) & ~(kCommandAlignment - 1);
+}
+
+// Sequential, alignment-agnostic access to a payload.
+class PayloadWriter {
+ public:
+  explicit PayloadWriter(uint8_t *data) : data_(data) {}
+  template <typename T>
+  void Write(const T &value) {
+    memcpy(data_, &value, sizeof(value));
+    data_ += sizeof(value);
+  }
+  void Write(const float *values, size_t count) {
+    memcpy(data_, values, count * sizeof(float));
+    data_ += count * sizeof(float);
+  }
+
+ private:
+  uint8_t *data_;
+};
+
+class PayloadReader {
+ public:
+  explicit PayloadReader(const uint8_t *data) : data_(data) {}
+  template <typename T>
+  T Read() {
+    T value;
+    memcpy(&value, data_, sizeof(value));
+    data_ += sizeof(value);
+    return value;
+  }
+  void ReadFloats(float *values, size_t count) {
+    memcpy(values, data_, count * sizeof(float));
+    data_ += count * sizeof(float);
+  }
+
+ private:
+  const uint8_t *data_;
+};
+
+}  // namespace
+
+uint8_t *CommandBuffer::Append(CommandType type, size_t payload_size) {
+  const size_t position = arena_.size();
+  arena_.resize(position + AlignCommandSize(sizeof(CommandHeader)) +
+                AlignCommandSize(payload_size));
+  CommandHeader header;
+  header.type = static_cast<uint32_t>(type);
+  header.payload_size = static_cast<uint32_t>(payload_size);
+  memcpy(&arena_[position], &header, sizeof(header));
+  num_commands_++;
+  return &arena_[position + AlignCommandSize(sizeof(CommandHeader))];
+}
+
+void CommandBuffer::AppendFloats(CommandType type, const float *values,
+                                 size_t count) {
+  PayloadWriter(Append(type, count * sizeof(float))).Write(values, count);
+}
+
+void CommandBuffer::AppendPointer(CommandType type, const void *pointer) {
+  PayloadWriter(Append(type, sizeof(pointer))).Write(pointer);
+}
+
+void CommandBuffer::SetModelViewProjection(const mathfu::mat4 &mvp) {
+  AppendFloats(kCommandSetModelViewProjection, &mvp[0], 16);
+}
+
+void CommandBuffer::SetModel(const mathfu::mat4 &model) {
+  AppendFloats(kCommandSetModel, &model[0], 16);
+}
+
+void CommandBuffer::SetColor(const mathfu::vec4 &color) {
+  const float values[] = {color.x(), color.y(), color.z(), color.w()};
+  AppendFloats(kCommandSetColor, values, 4);
+}
+
+void CommandBuffer::SetLightPos(const mathfu::vec3 &light_pos) {
+  const float values[] = {light_pos.x(), light_pos.y(), light_pos.z()};
+  AppendFloats(kCommandSetLightPos, values, 3);
+}
+
+void CommandBuffer::SetCameraPos(const mathfu::vec3 &camera_pos) {
+  const float values[] = {camera_pos.x(), camera_pos.y(), camera_pos.z()};
+  AppendFloats(kCommandSetCameraPos, values, 3);
+}
+
+CommandBuffer::~CommandBuffer() { delete[] bones_; }
+
+void CommandBuffer::SetBoneTransforms(
+    const mathfu::AffineTransform *bone_transforms, int num_bones) {
+  if (num_bones_ + num_bones > bone_capacity_) {
+    const size_t capacity =
+        std::max(num_bones_ + num_bones, 2 * bone_capacity_);
+    mathfu::AffineTransform *bones = new mathfu::AffineTransform[capacity];
+    for (size_t i = 0; i < num_bones_; ++i) bones[i] = bones_[i];
+    delete[] bones_;
+    bones_ = bones;
+    bone_capacity_ = capacity;
+  }
+  // The command records where in bones_ its transforms start, rather than a
+  // pointer, as bones_ may still be reallocated.
+  PayloadWriter out(Append(kCommandSetBoneTransforms, 2 * sizeof(int32_t)));
+  out.Write(static_cast<int32_t>(num_bones_));
+  out.Write(static_cast<int32_t>(num_bones));
+  for (int i = 0; i < num_bones; ++i) {
+    bones_[num_bones_++] = bone_transforms[i];
+  }
+}
+
+void CommandBuffer::SetBlendMode(BlendMode blend_mode, float amount) {
+  PayloadWriter out(
+      Append(kCommandSetBlendMode, sizeof(int32_t) + sizeof(float)));
+  out.Write(static_cast<int32_t>(blend_mode));
+  out.Write(amount);
+}
+
+void CommandBuffer::SetCulling(CullingMode mode) {
+  PayloadWriter(Append(kCommandSetCulling, sizeof(int32_t)))
+      .Write(static_cast<int32_t>(mode));
+}
+
+void CommandBuffer::DepthTest(bool on) {
+  PayloadWriter(Append(kCommandDepthTest, sizeof(int32_t)))
+      .Write(static_cast<int32_t>(on));
+}
+
+void CommandBuffer::SetViewport(const mathfu::vec4i &viewport) {
+  PayloadWriter out(Append(kCommandSetViewport, 4 * sizeof(int32_t)));
+  for (int i = 0; i < 4; ++i) out.Write(static_cast<int32_t>(viewport[i]));
+}
+
+void CommandBuffer::ClearFrameBuffer(const mathfu::vec4 &color) {
+  const float values[] = {color.x(), color.y(), color.z(), color.w()};
+  AppendFloats(kCommandClearFrameBuffer, values, 4);
+}
+
+void CommandBuffer::ClearDepthBuffer() { Append(kCommandClearDepthBuffer, 0); }
+
+void CommandBuffer::SetShader(Shader *shader) {
+  AppendPointer(kCommandSetShader, shader);
+}
+
+void CommandBuffer::SetUniform(Shader *shader, UniformHandle uniform,
+                               const float *value, size_t num_components) {
+  assert(num_components <= 16);
+  PayloadWriter out(Append(kCommandSetUniform,
+                           sizeof(shader) + 2 * sizeof(int32_t) +
+                               num_components * sizeof(float)));
+  out.Write(shader);
+  out.Write(static_cast<int32_t>(uniform));
+  out.Write(static_cast<int32_t>(num_components));
+  out.Write(value, num_components);
+}
+
+void CommandBuffer::SetTexture(Texture *texture, size_t unit) {
+  PayloadWriter out(
+      Append(kCommandSetTexture, sizeof(texture) + sizeof(uint32_t)));
+  out.Write(texture);
+  out.Write(static_cast<uint32_t>(unit));
+}
+
+void CommandBuffer::SetMaterial(Material *material) {
+  AppendPointer(kCommandSetMaterial, material);
+}
+
+void CommandBuffer::RenderMesh(Mesh *mesh, bool ignore_material,
+                               size_t instances) {
+  PayloadWriter out(
+      Append(kCommandRenderMesh, sizeof(mesh) + 2 * sizeof(uint32_t)));
+  out.Write(mesh);
+  out.Write(static_cast<uint32_t>(ignore_material));
+  out.Write(static_cast<uint32_t>(instances));
+}
+
+void CommandBuffer::Clear() {
+  arena_.clear();
+  num_commands_ = 0;
+  num_bones_ = 0;
+}
+
+void CommandBuffer::Execute(CommandBackend *backend) const {
+  size_t position = 0;
+  while (position < arena_.size()) {
+    CommandHeader header;
+    memcpy(&header, &arena_[position], sizeof(header));
+    const uint8_t *payload =
+        &arena_[position + AlignCommandSize(sizeof(CommandHeader))];
+    position += AlignCommandSize(sizeof(CommandHeader)) +
+                AlignCommandSize(header.payload_size);
+    PayloadReader in(payload);
+    float values[16];
+
+    switch (static_cast<CommandType>(header.type)) {
+      case kCommandSetModelViewProjection:
+        in.ReadFloats(values, 16);
+        backend->SetModelViewProjection(mathfu::mat4(values));
+        break;
+      case kCommandSetModel:
+        in.ReadFloats(values, 16);
+        backend->SetModel(mathfu::mat4(values));
+        break;
+      case kCommandSetColor:
+        in.ReadFloats(values, 4);
+        backend->SetColor(mathfu::vec4(values));
+        break;
+      case kCommandSetLightPos:
+        in.ReadFloats(values, 3);
+        backend->SetLightPos(mathfu::vec3(values));
+        break;
+      case kCommandSetCameraPos:
+        in.ReadFloats(values, 3);
+        backend->SetCameraPos(mathfu::vec3(values));
+        break;
+      case kCommandSetBoneTransforms: {
+        const int32_t first_bone = in.Read<int32_t>();
+        backend->SetBoneTransforms(bones_ + first_bone, in.Read<int32_t>());
+        break;
+      }
+      case kCommandSetBlendMode: {
+        const auto blend_mode = static_cast<BlendMode>(in.Read<int32_t>());
+        backend->SetBlendMode(blend_mode, in.Read<float>());
+        break;
+      }
+      case kCommandSetCulling:
+        backend->SetCulling(static_cast<CullingMode>(in.Read<int32_t>()));
+        break;
+      case kCommandDepthTest:
+        backend->DepthTest(in.Read<int32_t>() != 0);
+        break;
+      case kCommandSetViewport: {
+        mathfu::vec4i viewport;
+        for (int i = 0; i < 4; ++i) viewport[i] = in.Read<int32_t>();
+        backend->SetViewport(viewport);
+        break;
+      }
+      case kCommandClearFrameBuffer:
+        in.ReadFloats(values, 4);
+        backend->ClearFrameBuffer(mathfu::vec4(values));
+        break;
+      case kCommandClearDepthBuffer:
+        backend->ClearDepthBuffer();
+        break;
+      case kCommandSetShader:
+        backend->SetShader(in.Read<Shader *>());
+        break;
+      case kCommandSetUniform: {
+        Shader *shader = in.Read<Shader *>();
+        const UniformHandle uniform = in.Read<int32_t>();
+        const size_t num_components = in.Read<int32_t>();
+        in.ReadFloats(values, num_components);
+        backend->SetUniform(shader, uniform, values, num_components);
+        break;
+      }
+      case kCommandSetTexture: {
+        Texture *texture = in.Read<Texture *>();
+        backend->SetTexture(texture, in.Read<uint32_t>());
+        break;
+      }
+      case kCommandSetMaterial:
+        backend->SetMaterial(in.Read<Material *>());
+        break;
+      case kCommandRenderMesh: {
+        Mesh *mesh = in.Read<Mesh *>();
+        const bool ignore_material = in.Read<uint32_t>() != 0;
+        backend->RenderMesh(mesh, ignore_material, in.Read<uint32_t>());
+        break;
+      }
+      case kCommandCount:
+        assert(false);
+        break;
+    }
+  }
+}
+
+void RendererCommandBackend::SetModelViewProjection(const mathfu::mat4 &mvp) {
+  renderer_->set_model_view_projection(mvp, render_context_);
+}
+
+void RendererCommandBackend::SetModel(const mathfu::mat4 &model) {
+  renderer_->set_model(model, render_context_);
+}
+
+void RendererCommandBackend::SetColor(const mathfu::vec4 &color) {
+  renderer_->set_color(color, render_context_);
+}
+
+void RendererCommandBackend::SetLightPos(const mathfu::vec3 &light_pos) {
+  renderer_->set_light_pos(light_pos, render_context_);
+}
+
+void RendererCommandBackend::SetCameraPos(const mathfu::vec3 &camera_pos) {
+  renderer_->set_camera_pos(camera_pos, render_context_);
+}
+
+RendererCommandBackend::~RendererCommandBackend() { delete[] bones_; }
+
+void RendererCommandBackend::SetBoneTransforms(
+    const mathfu::AffineTransform *bone_transforms, int num_bones) {
+  // The render context keeps the pointer until the next draw, so the
+  // transforms must outlive the command buffer, which may be cleared and
+  // recorded into again before then.
+  if (static_cast<size_t>(num_bones) > bone_capacity_) {
+    delete[] bones_;
+    bones_ = new mathfu::AffineTransform[num_bones];
+    bone_capacity_ = num_bones;
+  }
+  for (int i = 0; i < num_bones; ++i) bones_[i] = bone_transforms[i];
+  renderer_->SetBoneTransforms(bones_, num_bones, render_context_);
+}
+
+void RendererCommandBackend::SetBlendMode(BlendMode blend_mode, float amount) {
+  renderer_->SetBlendMode(blend_mode, amount, render_context_);
+}
+
+void RendererCommandBackend::SetCulling(CullingMode mode) {
+  renderer_->SetCulling(mode, render_context_);
+}
+
+void RendererCommandBackend::DepthTest(bool on) {
+  renderer_->DepthTest(on, render_context_);
+}
+
+void RendererCommandBackend::SetViewport(const mathfu::vec4i &viewport) {
+  GL_CALL(glViewport(viewport.x(), viewport.y(), viewport.z(), viewport.w()));
+}
+
+void RendererCommandBackend::ClearFrameBuffer(const mathfu::vec4 &color) {
+  renderer_->ClearFrameBuffer(color, render_context_);
+}
+
+void RendererCommandBackend::ClearDepthBuffer() {
+  renderer_->ClearDepthBuffer(render_context_);
+}
+
+void RendererCommandBackend::SetShader(Shader *shader) {
+  shader->Set(*renderer_, render_context_);
+}
+
+void RendererCommandBackend::SetUniform(Shader *shader, UniformHandle uniform,
+                                        const float *value,
+                                        size_t num_components) {
+  shader->SetUniform(uniform, value, num_components);
+}
+
+void RendererCommandBackend::SetTexture(Texture *texture, size_t unit) {
+  texture->Set(unit, render_context_);
+}
+
+void RendererCommandBackend::SetMaterial(Material *material) {
+  material->Set(*renderer_, render_context_);
+}
+
+void RendererCommandBackend::RenderMesh(Mesh *mesh, bool ignore_material,
+                                        size_t instances) {
+  mesh->Render(*renderer_, ignore_material, instances, render_context_);
+}
+
+std::string RecordingCommandBackend::Name(const char *kind,
+                                          const void *asset) {
+  auto it = std::find(names_.begin(), names_.end(), asset);
+  size_t index = it - names_.begin();
+  if (it == names_.end()) names_.push_back(asset);
+  return std::string(kind) + flatbuffers::NumToString(index);
+}
+
+void RecordingCommandBackend::Log(const std::string &name, const float *values,
+                                  size_t count) {
+  std::string line = name;
+  for (size_t i = 0; i < count; ++i) {
+    char value[32];
+    snprintf(value, sizeof(value), " %g", values[i]);
+    line += value;
+  }
+  log_.push_back(line);
+}
+
+void RecordingCommandBackend::SetModelViewProjection(const mathfu::mat4 &mvp) {
+  Log("SetModelViewProjection", &mvp[0], 16);
+}
+
+void RecordingCommandBackend::SetModel(const mathfu::mat4 &model) {
+  Log("SetModel", &model[0], 16);
+}
+
+void RecordingCommandBackend::SetColor(const mathfu::vec4 &color) {
+  const float values[] = {color.x(), color.y(), color.z(), color.w()};
+  Log("SetColor", values, 4);
+}
+
+void RecordingCommandBackend::SetLightPos(const mathfu::vec3 &light_pos) {
+  const float values[] = {light_pos.x(), light_pos.y(), light_pos.z()};
+  Log("SetLightPos", values, 3);
+}
+
+void RecordingCommandBackend::SetCameraPos(const mathfu::vec3 &camera_pos) {
+  const float values[] = {camera_pos.x(), camera_pos.y(), camera_pos.z()};
+  Log("SetCameraPos", values, 3);
+}
+
+void RecordingCommandBackend::SetBoneTransforms(
+    const mathfu::AffineTransform *bone_transforms, int num_bones) {
+  std::vector<float> values;
+  for (int i = 0; i < num_bones; ++i) {
+    values.insert(values.end(), &bone_transforms[i][0],
+                  &bone_transforms[i][0] + 12);
+  }
+  Log("SetBoneTransforms", values.data(), values.size());
+}
+
+void RecordingCommandBackend::SetBlendMode(BlendMode blend_mode,
+                                           float amount) {
+  const float values[] = {static_cast<float>(blend_mode), amount};
+  Log("SetBlendMode", values, 2);
+}
+
+void RecordingCommandBackend::SetCulling(CullingMode mode) {
+  const float value = static_cast<float>(mode);
+  Log("SetCulling", &value, 1);
+}
+
+void RecordingCommandBackend::DepthTest(bool on) {
+  const float value = on ? 1.0f : 0.0f;
+  Log("DepthTest", &value, 1);
+}
+
+void RecordingCommandBackend::SetViewport(const mathfu::vec4i &viewport) {
+  const float values[] = {
+      static_cast<float>(viewport.x()), static_cast<float>(viewport.y()),
+      static_cast<float>(viewport.z()), static_cast<float>(viewport.w())};
+  Log("SetViewport", values, 4);
+}
+
+void RecordingCommandBackend::ClearFrameBuffer(const mathfu::vec4 &color) {
+  const float values[] = {color.x(), color.y(), color.z(), color.w()};
+  Log("ClearFrameBuffer", values, 4);
+}
+
+void RecordingCommandBackend::ClearDepthBuffer() {
+  Log("ClearDepthBuffer", nullptr, 0);
+}
+
+void RecordingCommandBackend::SetShader(Shader *shader) {
+  Log("SetShader " + Name("shader", shader), nullptr, 0);
+}
+
+void RecordingCommandBackend::SetUniform(Shader *shader, UniformHandle uniform,
+                                         const float *value,
+                                         size_t num_components) {
+  Log("SetUniform " + Name("shader", shader) + " " +
+          flatbuffers::NumToString(uniform),
+      value, num_components);
+}
+
+void RecordingCommandBackend::SetTexture(Texture *texture, size_t unit) {
+  const float value = static_cast<float>(unit);
+  Log("SetTexture " + Name("texture", texture), &value, 1);
+}
+
+void RecordingCommandBackend::SetMaterial(Material *material) {
+  Log("SetMaterial " + Name("material", material), nullptr, 0);
+}
+
+void RecordingCommandBackend::RenderMesh(Mesh *mesh, bool ignore_material,
+                                         size_t instances) {
+  const float values[] = {ignore_material ? 1.0f : 0.0f,
+                          static_cast<float>(instances)};
+  Log("RenderMesh " + Name("mesh", mesh), values, 2);
+}
+
+CommandQueue::CommandQueue() {
+#ifdef FPL_BASE_BACKEND_SDL
+  mutex_ = SDL_CreateMutex();
+  submitted_semaphore_ = SDL_CreateSemaphore(0);
+  assert(mutex_ && submitted_semaphore_);
+#endif
+}
+
+CommandQueue::~CommandQueue() {
+  for (auto it = all_.begin(); it != all_.end(); ++it) delete *it;
+#ifdef FPL_BASE_BACKEND_SDL
+  SDL_DestroyMutex(static_cast<SDL_mutex *>(mutex_));
+  SDL_DestroySemaphore(static_cast<SDL_semaphore *>(submitted_semaphore_));
+#endif
+}
+
+CommandBuffer *CommandQueue::AcquireCommandBuffer() {
+  CommandBuffer *commands = nullptr;
+  Lock([this, &commands]() {
+    if (free_.empty()) {
+      commands = new CommandBuffer();
+      all_.push_back(commands);
+    } else {
+      commands = free_.back();
+      free_.pop_back();
+    }
+  });
+  return commands;
+}
+
+void CommandQueue::Submit(CommandBuffer *commands) {
+  Lock([this, commands]() { submitted_.push_back(commands); });
+#ifdef FPL_BASE_BACKEND_SDL
+  SDL_SemPost(static_cast<SDL_semaphore *>(submitted_semaphore_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  submitted_condition_.notify_one();
+#endif
+}
+
+size_t CommandQueue::ExecutePending(CommandBackend *backend, bool wait) {
+  std::vector<CommandBuffer *> pending;
+#ifdef FPL_BASE_BACKEND_SDL
+  for (;;) {
+    Lock([this, &pending]() { pending.swap(submitted_); });
+    if (!pending.empty() || !wait) break;
+    // The semaphore may count buffers that were already taken by an earlier
+    // call, so check again after waking up.
+    SDL_SemWait(static_cast<SDL_semaphore *>(submitted_semaphore_));
+  }
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (wait) {
+      submitted_condition_.wait(lock, [this]() { return !submitted_.empty(); });
+    }
+    pending.swap(submitted_);
+  }
+#endif
+
+  for (auto it = pending.begin(); it != pending.end(); ++it) {
+    (*it)->Execute(backend);
+    (*it)->Clear();
+  }
+  Lock([this, &pending]() {
+    free_.insert(free_.end(), pending.begin(), pending.end());
+  });
+  return pending.size();
+}
+
+void CommandQueue::Lock(const std::function<void()> &body) {
+#ifdef FPL_BASE_BACKEND_SDL
+  auto err = SDL_LockMutex(static_cast<SDL_mutex *>(mutex_));
+  (void)err;
+  assert(err == 0);
+  body();
+  SDL_UnlockMutex(static_cast<SDL_mutex *>(mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  std::lock_guard<std::mutex> lock(mutex_);
+  body();
+#endif
+}
+
+}  // namespace fplbase
@@ -0,0 +1,259 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "fplbase/dynamic_atlas.h"
+#include "fplbase/profiler.h"
+#include "fplbase/utilities.h"
+
+#include <string.h>
+#include <algorithm>
+
+using mathfu::vec2i;
+using mathfu::vec4;
+
+namespace fplbase {
+
+// Shelves are made taller than the first image put in them by up to this
+// many pixels, so that images of similar height can share them.
+static const int kShelfHeightGranularity = 4;
+
+DynamicAtlas::DynamicAtlas(const vec2i &size, TextureFormat format,
+                           int padding)
+    : size_(size),
+      format_(format),
+      padding_(padding),
+      bytes_per_pixel_(BitsPerPixel(format) / 8),
+      pixels_(static_cast<size_t>(size.x()) * size.y() *
+                  (BitsPerPixel(format) / 8),
+              0),
+      row_dirty_(size.y(), false),
+      dirty_rows_(0),
+      frame_(0),
+      num_evictions_(0) {
+  assert(format == kFormat8888 || format == kFormat888 ||
+         format == kFormat5551 || format == kFormat565 ||
+         format == kFormatLuminance);
+  // Flush() uploads whole rows, which GL reads with 4 byte alignment.
+  assert((size.x() * bytes_per_pixel_) % 4 == 0);
+  assert(padding >= 0);
+}
+
+DynamicAtlas::~DynamicAtlas() {}
+
+const vec4 *DynamicAtlas::Find(Key key) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return nullptr;
+  Touch(&it->second);
+  return &it->second.bounds;
+}
+
+const vec4 *DynamicAtlas::Insert(Key key, const vec2i &size,
+                                 const void *pixels) {
+  FPLBASE_PROFILE_ZONE("DynamicAtlas::Insert");
+  Remove(key);
+  const int w = size.x() + 2 * padding_;
+  const int h = size.y() + 2 * padding_;
+  if (size.x() <= 0 || size.y() <= 0 || w > size_.x() || h > size_.y()) {
+    LogError(kError, "DynamicAtlas: can't fit a %dx%d image in %dx%d",
+             size.x(), size.y(), size_.x(), size_.y());
+    return nullptr;
+  }
+  Entry entry;
+  while (!Allocate(w, h, &entry.x, &entry.y, &entry.shelf)) {
+    if (!EvictOne()) return nullptr;
+  }
+  entry.w = w;
+  entry.h = h;
+
+  // Clear the padding left by earlier images, and copy the new one inside.
+  const size_t pitch = static_cast<size_t>(size_.x()) * bytes_per_pixel_;
+  const size_t slot_bytes = static_cast<size_t>(w) * bytes_per_pixel_;
+  const size_t row_bytes = static_cast<size_t>(size.x()) * bytes_per_pixel_;
+  const uint8_t *src = static_cast<const uint8_t *>(pixels);
+  for (int row = 0; row < h; ++row) {
+    uint8_t *dest = &pixels_[(entry.y + row) * pitch +
+                             static_cast<size_t>(entry.x) * bytes_per_pixel_];
+    const int image_row = row - padding_;
+    if (image_row < 0 || image_row >= size.y()) {
+      memset(dest, 0, slot_bytes);
+      continue;
+    }
+    const size_t pad_bytes = static_cast<size_t>(padding_) * bytes_per_pixel_;
+    memset(dest, 0, pad_bytes);
+    memcpy(dest + pad_bytes, src + image_row * row_bytes, row_bytes);
+    memset(dest + pad_bytes + row_bytes, 0, pad_bytes);
+  }
+  MarkDirty(entry.y, h);
+
+  entry.bounds = vec4(static_cast<float>(entry.x + padding_) / size_.x(),
+                      static_cast<float>(entry.y + padding_) / size_.y(),
+                      static_cast<float>(size.x()) / size_.x(),
+                      static_cast<float>(size.y()) / size_.y());
+  entry.last_used_frame = frame_;
+  lru_.push_front(key);
+  entry.lru = lru_.begin();
+  return &(entries_[key] = entry).bounds;
+}
+
+void DynamicAtlas::Remove(Key key) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return;
+  Free(it->second);
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+void DynamicAtlas::Clear() {
+  entries_.clear();
+  lru_.clear();
+  shelves_.clear();
+}
+
+void DynamicAtlas::Upload() {
+  FPLBASE_PROFILE_ZONE("DynamicAtlas::Upload");
+  if (!texture_) {
+    // The first upload creates the texture with all of pixels_.
+    texture_.reset(new Texture(nullptr, kFormatNative,
+                               kTextureFlagsClampToEdge));
+    texture_->LoadFromMemory(pixels_.data(), size_, format_);
+    std::fill(row_dirty_.begin(), row_dirty_.end(), false);
+    dirty_rows_ = 0;
+  } else if (dirty_rows_) {
+    // Upload each run of changed rows in one call.
+    texture_->Set(0);
+    const size_t pitch = static_cast<size_t>(size_.x()) * bytes_per_pixel_;
+    int y = 0;
+    while (y < size_.y()) {
+      if (!row_dirty_[y]) {
+        ++y;
+        continue;
+      }
+      const int first = y;
+      while (y < size_.y() && row_dirty_[y]) row_dirty_[y++] = false;
+      Texture::UpdateTexture(format_, 0, first, size_.x(), y - first,
+                             &pixels_[first * pitch]);
+    }
+    dirty_rows_ = 0;
+  }
+}
+
+bool DynamicAtlas::Allocate(int w, int h, int *x, int *y, size_t *shelf) {
+  // Use the lowest shelf that is tall enough but not too tall, or any empty
+  // shelf that is tall enough.
+  int best = -1;
+  int best_x = 0;
+  for (size_t i = 0; i < shelves_.size(); ++i) {
+    const Shelf &s = shelves_[i];
+    if (s.height < h) continue;
+    const bool empty = s.end == 0;
+    if (!empty && s.height > h + kShelfHeightGranularity) continue;
+    if (best >= 0 && shelves_[best].height <= s.height) continue;
+    int found_x = -1;
+    for (auto it = s.free_spans.begin(); it != s.free_spans.end(); ++it) {
+      if (it->second >= w) {
+        found_x = it->first;
+        break;
+      }
+    }
+    if (found_x < 0 && s.end + w <= size_.x()) found_x = s.end;
+    if (found_x < 0) continue;
+    best = static_cast<int>(i);
+    best_x = found_x;
+  }
+
+  // Otherwise start a new shelf below the others.
+  if (best < 0) {
+    const int top = shelves_.empty()
+                        ? 0
+                        : shelves_.back().y + shelves_.back().height;
+    if (top + h > size_.y()) return false;
+    const int rounded = (h + kShelfHeightGranularity - 1) /
+                        kShelfHeightGranularity * kShelfHeightGranularity;
+    shelves_.push_back(Shelf(top, std::min(rounded, size_.y() - top)));
+    best = static_cast<int>(shelves_.size() - 1);
+    best_x = 0;
+  }
+
+  // Take the space out of the shelf.
+  Shelf &s = shelves_[best];
+  if (best_x == s.end) {
+    s.end += w;
+  } else {
+    for (auto it = s.free_spans.begin(); it != s.free_spans.end(); ++it) {
+      if (it->first != best_x) continue;
+      it->first += w;
+      it->second -= w;
+      if (it->second == 0) s.free_spans.erase(it);
+      break;
+    }
+  }
+  *x = best_x;
+  *y = s.y;
+  *shelf = static_cast<size_t>(best);
+  return true;
+}
+
+void DynamicAtlas::Free(const Entry &entry) {
+  Shelf &s = shelves_[entry.shelf];
+  auto &spans = s.free_spans;
+  auto it = std::lower_bound(spans.begin(), spans.end(),
+                             std::make_pair(entry.x, entry.w));
+  it = spans.insert(it, std::make_pair(entry.x, entry.w));
+  // Merge with the neighbouring spans.
+  if (it + 1 != spans.end() && it->first + it->second == (it + 1)->first) {
+    it->second += (it + 1)->second;
+    spans.erase(it + 1);
+  }
+  if (it != spans.begin() && (it - 1)->first + (it - 1)->second == it->first) {
+    (it - 1)->second += it->second;
+    it = spans.erase(it) - 1;
+  }
+  // Give space at the end back to the free area right of `end`.
+  if (it->first + it->second == s.end) {
+    s.end = it->first;
+    spans.erase(it);
+  }
+  // Empty shelves at the bottom can be replaced by shelves of any height.
+  while (!shelves_.empty() && shelves_.back().end == 0) shelves_.pop_back();
+}
+
+bool DynamicAtlas::EvictOne() {
+  if (lru_.empty()) return false;
+  auto it = entries_.find(lru_.back());
+  assert(it != entries_.end());
+  if (it->second.last_used_frame == frame_) return false;
+  Free(it->second);
+  entries_.erase(it);
+  lru_.pop_back();
+  ++num_evictions_;
+  return true;
+}
+
+void DynamicAtlas::Touch(Entry *entry) {
+  lru_.splice(lru_.begin(), lru_, entry->lru);
+  entry->last_used_frame = frame_;
+}
+
+void DynamicAtlas::MarkDirty(int y, int h) {
+  for (int row = y; row < y + h; ++row) {
+    if (!row_dirty_[row]) {
+      row_dirty_[row] = true;
+      ++dirty_rows_;
+    }
+  }
+}
+
+}  // namespace fplbase
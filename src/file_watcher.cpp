@@ -0,0 +1,172 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/file_watcher.h"
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define FPLBASE_FILE_WATCHER_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "fplbase/utilities.h"
+
+namespace fplbase {
+
+#ifdef FPLBASE_FILE_WATCHER_INOTIFY
+
+// Splits "dir/name" into "dir/" and "name", so the two join back into exactly
+// the name the file was watched under.
+static std::string DirectoryPrefix(const std::string &filename) {
+  const size_t slash = filename.find_last_of('/');
+  return slash == std::string::npos ? std::string()
+                                    : filename.substr(0, slash + 1);
+}
+
+FileWatcher::FileWatcher()
+    : inotify_fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+  if (inotify_fd_ < 0) {
+    LogError(kApplication, "FileWatcher: inotify unavailable");
+  }
+}
+
+FileWatcher::~FileWatcher() {
+  if (inotify_fd_ >= 0) close(inotify_fd_);
+}
+
+bool FileWatcher::Watch(const std::string &filename) {
+  if (IsWatching(filename)) return true;
+  if (inotify_fd_ < 0) return false;
+  const std::string prefix = DirectoryPrefix(filename);
+  if (directory_watches_.find(prefix) == directory_watches_.end()) {
+    // Watch the directory rather than the file, since saving often replaces
+    // the file, which would end a watch on the file itself.
+    const int watch = inotify_add_watch(
+        inotify_fd_, prefix.empty() ? "." : prefix.c_str(),
+        IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0) return false;
+    directory_watches_[prefix] = watch;
+    watch_directories_[watch] = prefix;
+  }
+  files_[filename] = FileStamp();
+  return true;
+}
+
+void FileWatcher::Unwatch(const std::string &filename) {
+  if (files_.erase(filename) == 0) return;
+  const std::string prefix = DirectoryPrefix(filename);
+  for (auto it = files_.begin(); it != files_.end(); ++it) {
+    if (DirectoryPrefix(it->first) == prefix) return;
+  }
+  auto watch = directory_watches_.find(prefix);
+  if (watch == directory_watches_.end()) return;
+  inotify_rm_watch(inotify_fd_, watch->second);
+  watch_directories_.erase(watch->second);
+  directory_watches_.erase(watch);
+}
+
+void FileWatcher::UnwatchAll() {
+  for (auto it = directory_watches_.begin(); it != directory_watches_.end();
+       ++it) {
+    inotify_rm_watch(inotify_fd_, it->second);
+  }
+  directory_watches_.clear();
+  watch_directories_.clear();
+  files_.clear();
+}
+
+void FileWatcher::Poll(std::vector<std::string> *changed) {
+  changed->clear();
+  if (inotify_fd_ < 0) return;
+  std::set<std::string> seen;
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  for (;;) {
+    const ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+    if (length <= 0) break;  // EAGAIN once there are no more events.
+    for (const char *p = buffer; p < buffer + length;) {
+      auto event = reinterpret_cast<const struct inotify_event *>(p);
+      p += sizeof(struct inotify_event) + event->len;
+      if (!event->len) continue;
+      auto directory = watch_directories_.find(event->wd);
+      if (directory == watch_directories_.end()) continue;
+      const std::string filename = directory->second + event->name;
+      if (IsWatching(filename) && seen.insert(filename).second) {
+        changed->push_back(filename);
+      }
+    }
+  }
+}
+
+#else  // !FPLBASE_FILE_WATCHER_INOTIFY
+
+// Returns false if the file doesn't exist. Sizes are compared as well as
+// times, as some platforms only record times to the second, and a file saved
+// twice within one may well change size.
+static bool GetFileStamp(const std::string &filename,
+                         long long *modification_ns, long long *size) {
+  struct stat info;
+  if (stat(filename.c_str(), &info) != 0) return false;
+  long long nanoseconds = 0;
+#if defined(__APPLE__)
+  nanoseconds = info.st_mtimespec.tv_nsec;
+#elif defined(__ANDROID__) || defined(__linux__)
+  nanoseconds = info.st_mtim.tv_nsec;
+#endif
+  *modification_ns =
+      static_cast<long long>(info.st_mtime) * 1000000000LL + nanoseconds;
+  *size = static_cast<long long>(info.st_size);
+  return true;
+}
+
+FileWatcher::FileWatcher() {}
+
+FileWatcher::~FileWatcher() {}
+
+bool FileWatcher::Watch(const std::string &filename) {
+  if (IsWatching(filename)) return true;
+  FileStamp stamp;
+  if (!GetFileStamp(filename, &stamp.modification_ns, &stamp.size)) {
+    return false;
+  }
+  files_[filename] = stamp;
+  return true;
+}
+
+void FileWatcher::Unwatch(const std::string &filename) {
+  files_.erase(filename);
+}
+
+void FileWatcher::UnwatchAll() { files_.clear(); }
+
+void FileWatcher::Poll(std::vector<std::string> *changed) {
+  changed->clear();
+  for (auto it = files_.begin(); it != files_.end(); ++it) {
+    FileStamp stamp;
+    // A file that is missing is likely being replaced; wait for it to return.
+    if (GetFileStamp(it->first, &stamp.modification_ns, &stamp.size) &&
+        stamp != it->second) {
+      it->second = stamp;
+      changed->push_back(it->first);
+    }
+  }
+}
+
+#endif  // FPLBASE_FILE_WATCHER_INOTIFY
+
+}  // namespace fplbase
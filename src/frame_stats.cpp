@@ -0,0 +1,190 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/frame_stats.h"
+#include "fplbase/utilities.h"
+
+#include <limits>
+
+namespace fplbase {
+
+const int FrameTimeHistogram::kLinearBuckets;
+const int FrameTimeHistogram::kSubBuckets;
+const int FrameTimeHistogram::kNumBuckets;
+const int FrameStats::kRingSize;
+
+// log2(kSubBuckets).
+static const int kSubBucketBits = 4;
+
+static const char *kFramePhaseNames[] = {"cpu", "finalize", "swap", "total"};
+static_assert(sizeof(kFramePhaseNames) / sizeof(kFramePhaseNames[0]) ==
+                  kFramePhaseCount,
+              "Update kFramePhaseNames to match FramePhase.");
+
+int FrameTimeHistogram::BucketIndex(uint64_t microseconds) {
+  if (microseconds < static_cast<uint64_t>(kLinearBuckets)) {
+    return static_cast<int>(microseconds);
+  }
+  // Position of the highest set bit, at least kSubBucketBits here.
+  int exponent = 0;
+  while ((microseconds >> exponent) > 1) exponent++;
+  const int shift = exponent - kSubBucketBits;
+  const int sub_bucket =
+      static_cast<int>(microseconds >> shift) & (kSubBuckets - 1);
+  const int index = kLinearBuckets + shift * kSubBuckets + sub_bucket;
+  return std::min(index, kNumBuckets - 1);
+}
+
+uint64_t FrameTimeHistogram::BucketStart(int index) {
+  if (index < kLinearBuckets) return static_cast<uint64_t>(index);
+  const int shift = (index - kLinearBuckets) / kSubBuckets;
+  const int sub_bucket = (index - kLinearBuckets) % kSubBuckets;
+  return static_cast<uint64_t>(kSubBuckets + sub_bucket) << shift;
+}
+
+void FrameTimeHistogram::Record(double seconds) {
+  seconds = std::max(seconds, 0.0);
+  buckets_[BucketIndex(static_cast<uint64_t>(seconds * 1e6))]++;
+  count_++;
+  total_ += seconds;
+  min_ = std::min(min_, seconds);
+  max_ = std::max(max_, seconds);
+}
+
+void FrameTimeHistogram::Clear() {
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  total_ = 0.0;
+  min_ = std::numeric_limits<double>::max();
+  max_ = 0.0;
+}
+
+double FrameTimeHistogram::Percentile(double percentile) const {
+  if (!count_) return 0.0;
+  // The rank of the value we want, counting from 1.
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(ceil(percentile / 100.0 * count_)));
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      // Report the middle of the bucket, within the range actually seen.
+      const double start = static_cast<double>(BucketStart(i));
+      const double end = i + 1 < kNumBuckets
+                             ? static_cast<double>(BucketStart(i + 1))
+                             : start + 1.0;
+      const double seconds = (start + end - 1.0) * 0.5e-6;
+      return std::min(std::max(seconds, min_), max_);
+    }
+  }
+  return max_;
+}
+
+FrameStats::FrameStats() { Reset(); }
+
+void FrameStats::Reset() {
+  for (int i = 0; i < kRingSize; ++i) ring_[i].sequence.store(0);
+  num_frames_.store(0);
+  for (int i = 0; i < kFramePhaseCount; ++i) {
+    histograms_[i].Clear();
+    current_[i] = 0.0;
+  }
+  frame_started_ = false;
+}
+
+void FrameStats::BeginPhase(FramePhase phase) {
+  phase_start_[phase] = Clock::now();
+}
+
+void FrameStats::EndPhase(FramePhase phase) {
+  const std::chrono::duration<double> elapsed =
+      Clock::now() - phase_start_[phase];
+  current_[phase] += elapsed.count();
+}
+
+void FrameStats::AddPhaseTime(FramePhase phase, double seconds) {
+  current_[phase] += seconds;
+}
+
+void FrameStats::EndFrame() {
+  const Clock::time_point now = Clock::now();
+  if (!frame_started_) {
+    // Nothing to measure the first frame against.
+    frame_started_ = true;
+    frame_start_ = now;
+    for (int i = 0; i < kFramePhaseCount; ++i) current_[i] = 0.0;
+    return;
+  }
+  const std::chrono::duration<double> total = now - frame_start_;
+  frame_start_ = now;
+  current_[kFramePhaseTotal] = total.count();
+
+  const uint32_t index = num_frames_.load(std::memory_order_relaxed);
+  Frame frame;
+  frame.index = index;
+  for (int i = 0; i < kFramePhaseCount; ++i) {
+    histograms_[i].Record(current_[i]);
+    frame.seconds[i] = static_cast<float>(current_[i]);
+    current_[i] = 0.0;
+  }
+
+  Slot &slot = ring_[index % kRingSize];
+  slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.frame = frame;
+  slot.sequence.store(2 * index + 2, std::memory_order_release);
+  num_frames_.store(index + 1, std::memory_order_release);
+}
+
+int FrameStats::CopyRecentFrames(Frame *frames, int max_frames) const {
+  const uint32_t end = num_frames_.load(std::memory_order_acquire);
+  const uint32_t count =
+      std::min(end, static_cast<uint32_t>(std::min(max_frames, kRingSize)));
+  int copied = 0;
+  for (uint32_t index = end - count; index != end; ++index) {
+    const Slot &slot = ring_[index % kRingSize];
+    const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before != 2 * index + 2) continue;
+    frames[copied] = slot.frame;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+    copied++;
+  }
+  return copied;
+}
+
+std::string FrameStats::Summary() const {
+  std::string summary;
+  char line[160];
+  snprintf(line, sizeof(line), "Frame stats over %u frames (ms):\n",
+           static_cast<unsigned int>(num_frames()));
+  summary += line;
+  for (int i = 0; i < kFramePhaseCount; ++i) {
+    const FrameTimeHistogram &h = histograms_[i];
+    snprintf(line, sizeof(line),
+             "  %-8s p50 %7.2f  p95 %7.2f  p99 %7.2f  max %7.2f  mean %7.2f\n",
+             kFramePhaseNames[i], h.Percentile(50) * 1000.0,
+             h.Percentile(95) * 1000.0, h.Percentile(99) * 1000.0,
+             h.max() * 1000.0, h.mean() * 1000.0);
+    summary += line;
+  }
+  return summary;
+}
+
+void FrameStats::LogSummary() const {
+  LogInfo(kApplication, "%s", Summary().c_str());
+}
+
+}  // namespace fplbase
@@ -0,0 +1,356 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/frustum.h"
+#include "fplbase/mesh.h"
+#include "fplbase/parallel_for.h"
+
+#if !defined(MATHFU_COMPILE_WITHOUT_SIMD_SUPPORT)
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FPLBASE_FRUSTUM_SSE
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FPLBASE_FRUSTUM_NEON
+#endif
+#endif  // !defined(MATHFU_COMPILE_WITHOUT_SIMD_SUPPORT)
+
+using mathfu::mat4;
+using mathfu::vec3;
+using mathfu::vec4;
+
+namespace fplbase {
+namespace {
+
+// Number of boxes tested per SIMD iteration.
+const size_t kLanes = 4;
+
+// Batches smaller than this are not worth splitting across threads.
+const size_t kMinBoxesPerThread = 16 * 1024;
+
+// Minimal 4-wide float abstraction, so the culling loops below are written
+// once for SSE, NEON and plain C++.
+#if defined(FPLBASE_FRUSTUM_SSE)
+typedef __m128 Float4;
+inline Float4 Load4(const float *p) { return _mm_loadu_ps(p); }
+inline Float4 Splat4(float f) { return _mm_set1_ps(f); }
+inline Float4 Add4(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Mul4(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Abs4(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+// Returns a 4 bit mask with bit i set if lane i is negative.
+inline unsigned int NegativeMask4(Float4 a) {
+  return static_cast<unsigned int>(
+      _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps())));
+}
+#elif defined(FPLBASE_FRUSTUM_NEON)
+typedef float32x4_t Float4;
+inline Float4 Load4(const float *p) { return vld1q_f32(p); }
+inline Float4 Splat4(float f) { return vdupq_n_f32(f); }
+inline Float4 Add4(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Mul4(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 Abs4(Float4 a) { return vabsq_f32(a); }
+inline unsigned int NegativeMask4(Float4 a) {
+  static const uint32_t kLaneBits[4] = {1, 2, 4, 8};
+  const uint32x4_t bits =
+      vandq_u32(vcltq_f32(a, vdupq_n_f32(0.0f)), vld1q_u32(kLaneBits));
+  const uint32x2_t pairs = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+  return vget_lane_u32(pairs, 0) | vget_lane_u32(pairs, 1);
+}
+#else
+struct Float4 {
+  float v[4];
+};
+inline Float4 Load4(const float *p) {
+  Float4 r = {{p[0], p[1], p[2], p[3]}};
+  return r;
+}
+inline Float4 Splat4(float f) {
+  Float4 r = {{f, f, f, f}};
+  return r;
+}
+inline Float4 Add4(Float4 a, Float4 b) {
+  Float4 r = {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2],
+               a.v[3] + b.v[3]}};
+  return r;
+}
+inline Float4 Mul4(Float4 a, Float4 b) {
+  Float4 r = {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2],
+               a.v[3] * b.v[3]}};
+  return r;
+}
+inline Float4 Abs4(Float4 a) {
+  Float4 r = {{fabsf(a.v[0]), fabsf(a.v[1]), fabsf(a.v[2]), fabsf(a.v[3])}};
+  return r;
+}
+inline unsigned int NegativeMask4(Float4 a) {
+  return (a.v[0] < 0.0f ? 1u : 0u) | (a.v[1] < 0.0f ? 2u : 0u) |
+         (a.v[2] < 0.0f ? 4u : 0u) | (a.v[3] < 0.0f ? 8u : 0u);
+}
+#endif
+
+// Dot product of a broadcast plane normal with four vectors.
+inline Float4 Dot4(float a, float b, float c, Float4 x, Float4 y, Float4 z) {
+  return Add4(Add4(Mul4(Splat4(a), x), Mul4(Splat4(b), y)),
+              Mul4(Splat4(c), z));
+}
+
+// Transform the center of a local box, and return the world-space half-axes
+// scaled by the box half-extents in `axes[0..2]`.
+vec3 TransformBox(const vec3 &min_position, const vec3 &max_position,
+                  const mat4 &world, vec3 *axes) {
+  const vec3 center = (min_position + max_position) * 0.5f;
+  const vec3 extent = (max_position - min_position) * 0.5f;
+  for (int i = 0; i < 3; ++i) {
+    axes[i] = vec3(world(0, i), world(1, i), world(2, i)) * extent[i];
+  }
+  return vec3(world(0, 0) * center.x() + world(0, 1) * center.y() +
+                  world(0, 2) * center.z() + world(0, 3),
+              world(1, 0) * center.x() + world(1, 1) * center.y() +
+                  world(1, 2) * center.z() + world(1, 3),
+              world(2, 0) * center.x() + world(2, 1) * center.y() +
+                  world(2, 2) * center.z() + world(2, 3));
+}
+
+}  // namespace
+
+// Has access to the SoA internals of the batch classes.
+class FrustumCuller {
+ public:
+  // Distance from the box center to the farthest corner in the direction of
+  // plane `p`'s normal. For AABBs this is the dot product of the absolute
+  // normal with the half extents.
+  static Float4 Radius4(const Frustum &f, int p, const AabbBatch &batch,
+                        size_t i) {
+    return Dot4(fabsf(f.a_[p]), fabsf(f.b_[p]), fabsf(f.c_[p]),
+                Load4(&batch.extent_x_[i]), Load4(&batch.extent_y_[i]),
+                Load4(&batch.extent_z_[i]));
+  }
+
+  // For OBBs this is the sum of the absolute projections of the half-axes.
+  static Float4 Radius4(const Frustum &f, int p, const ObbBatch &batch,
+                        size_t i) {
+    Float4 radius = Splat4(0.0f);
+    for (int axis = 0; axis < 3; ++axis) {
+      radius = Add4(radius,
+                    Abs4(Dot4(f.a_[p], f.b_[p], f.c_[p],
+                              Load4(&batch.axis_x_[axis][i]),
+                              Load4(&batch.axis_y_[axis][i]),
+                              Load4(&batch.axis_z_[axis][i]))));
+    }
+    return radius;
+  }
+
+  // Cull the boxes in [begin, end). `begin` must be a multiple of kLanes.
+  // The arrays in the batch are padded, so the last iteration can always read
+  // four lanes; only the valid ones are written to `visibility`.
+  template <typename Batch>
+  static void CullRange(const Frustum *frustums, size_t num_frustums,
+                        const Batch &batch, size_t begin, size_t end,
+                        uint8_t *visibility) {
+    for (size_t i = begin; i < end; i += kLanes) {
+      const Float4 cx = Load4(&batch.center_x_[i]);
+      const Float4 cy = Load4(&batch.center_y_[i]);
+      const Float4 cz = Load4(&batch.center_z_[i]);
+      unsigned int lane_masks[kLanes] = {0, 0, 0, 0};
+      for (size_t f = 0; f < num_frustums; ++f) {
+        const Frustum &frustum = frustums[f];
+        unsigned int outside = 0;
+        for (int p = 0; p < Frustum::kNumPlanes; ++p) {
+          const Float4 dist =
+              Add4(Dot4(frustum.a_[p], frustum.b_[p], frustum.c_[p], cx, cy,
+                        cz),
+                   Splat4(frustum.d_[p]));
+          outside |= NegativeMask4(Add4(dist, Radius4(frustum, p, batch, i)));
+          // Every lane is already culled by this frustum.
+          if (outside == 0xF) break;
+        }
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+          if (!(outside & (1u << lane))) lane_masks[lane] |= 1u << f;
+        }
+      }
+      const size_t lanes = std::min(kLanes, end - i);
+      for (size_t lane = 0; lane < lanes; ++lane) {
+        visibility[i + lane] = static_cast<uint8_t>(lane_masks[lane]);
+      }
+    }
+  }
+
+  template <typename Batch>
+  static void Cull(const Frustum *frustums, size_t num_frustums,
+                   const Batch &batch, uint8_t *visibility) {
+    assert(num_frustums <= kMaxCullingFrustums);
+    const size_t count = batch.size();
+    const size_t num_groups = (count + kLanes - 1) / kLanes;
+    ParallelFor(num_groups, kMinBoxesPerThread / kLanes,
+                [&](size_t begin, size_t end) {
+                  CullRange(frustums, num_frustums, batch, begin * kLanes,
+                            std::min(end * kLanes, count), visibility);
+                });
+  }
+
+  // Keep every array padded to a multiple of kLanes, so that SIMD loads of
+  // the last group stay in bounds. The padding is a degenerate box at the
+  // origin, whose result is never written.
+  static void Grow(std::vector<float> *v, size_t count) {
+    if (v->size() < count + 1) v->resize(v->size() + kLanes, 0.0f);
+  }
+
+  static void Reserve(std::vector<float> *v, size_t count) {
+    v->reserve((count + kLanes - 1) / kLanes * kLanes);
+  }
+};
+
+Frustum::Frustum(const mat4 &m) {
+  // Gribb & Hartmann: each clip plane is the sum or difference of the last
+  // row of the matrix and one of the other rows.
+  for (int p = 0; p < kNumPlanes; ++p) {
+    const int row = p / 2;
+    const float sign = (p & 1) ? -1.0f : 1.0f;
+    vec4 plane(m(3, 0) + sign * m(row, 0), m(3, 1) + sign * m(row, 1),
+               m(3, 2) + sign * m(row, 2), m(3, 3) + sign * m(row, 3));
+    const float length = plane.xyz().Length();
+    if (length > 0.0f) plane /= length;
+    a_[p] = plane.x();
+    b_[p] = plane.y();
+    c_[p] = plane.z();
+    d_[p] = plane.w();
+  }
+}
+
+bool Frustum::IntersectsAabb(const vec3 &min_position,
+                             const vec3 &max_position) const {
+  const vec3 center = (min_position + max_position) * 0.5f;
+  const vec3 extent = (max_position - min_position) * 0.5f;
+  for (int p = 0; p < kNumPlanes; ++p) {
+    const float dist =
+        a_[p] * center.x() + b_[p] * center.y() + c_[p] * center.z() + d_[p];
+    const float radius = fabsf(a_[p]) * extent.x() +
+                         fabsf(b_[p]) * extent.y() + fabsf(c_[p]) * extent.z();
+    if (dist + radius < 0.0f) return false;
+  }
+  return true;
+}
+
+void AabbBatch::Clear() {
+  count_ = 0;
+  center_x_.clear();
+  center_y_.clear();
+  center_z_.clear();
+  extent_x_.clear();
+  extent_y_.clear();
+  extent_z_.clear();
+}
+
+void AabbBatch::Reserve(size_t count) {
+  FrustumCuller::Reserve(&center_x_, count);
+  FrustumCuller::Reserve(&center_y_, count);
+  FrustumCuller::Reserve(&center_z_, count);
+  FrustumCuller::Reserve(&extent_x_, count);
+  FrustumCuller::Reserve(&extent_y_, count);
+  FrustumCuller::Reserve(&extent_z_, count);
+}
+
+size_t AabbBatch::Add(const vec3 &min_position, const vec3 &max_position) {
+  const size_t index = count_++;
+  const vec3 center = (min_position + max_position) * 0.5f;
+  const vec3 extent = (max_position - min_position) * 0.5f;
+  std::vector<float> *arrays[] = {&center_x_, &center_y_, &center_z_,
+                                  &extent_x_, &extent_y_, &extent_z_};
+  const float values[] = {center.x(), center.y(), center.z(),
+                          extent.x(), extent.y(), extent.z()};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    FrustumCuller::Grow(arrays[i], index);
+    (*arrays[i])[index] = values[i];
+  }
+  return index;
+}
+
+size_t AabbBatch::Add(const vec3 &min_position, const vec3 &max_position,
+                      const mat4 &world) {
+  // The enclosing AABB of an OBB has half-extents equal to the sum of the
+  // absolute half-axes.
+  vec3 axes[3];
+  const vec3 center = TransformBox(min_position, max_position, world, axes);
+  const vec3 extent =
+      vec3(fabsf(axes[0].x()) + fabsf(axes[1].x()) + fabsf(axes[2].x()),
+           fabsf(axes[0].y()) + fabsf(axes[1].y()) + fabsf(axes[2].y()),
+           fabsf(axes[0].z()) + fabsf(axes[1].z()) + fabsf(axes[2].z()));
+  return Add(center - extent, center + extent);
+}
+
+size_t AabbBatch::Add(const Mesh &mesh, const mat4 &world) {
+  return Add(mesh.min_position(), mesh.max_position(), world);
+}
+
+void ObbBatch::Clear() {
+  count_ = 0;
+  center_x_.clear();
+  center_y_.clear();
+  center_z_.clear();
+  for (int axis = 0; axis < 3; ++axis) {
+    axis_x_[axis].clear();
+    axis_y_[axis].clear();
+    axis_z_[axis].clear();
+  }
+}
+
+void ObbBatch::Reserve(size_t count) {
+  FrustumCuller::Reserve(&center_x_, count);
+  FrustumCuller::Reserve(&center_y_, count);
+  FrustumCuller::Reserve(&center_z_, count);
+  for (int axis = 0; axis < 3; ++axis) {
+    FrustumCuller::Reserve(&axis_x_[axis], count);
+    FrustumCuller::Reserve(&axis_y_[axis], count);
+    FrustumCuller::Reserve(&axis_z_[axis], count);
+  }
+}
+
+size_t ObbBatch::Add(const vec3 &min_position, const vec3 &max_position,
+                     const mat4 &world) {
+  const size_t index = count_++;
+  vec3 axes[3];
+  const vec3 center = TransformBox(min_position, max_position, world, axes);
+  std::vector<float> *centers[] = {&center_x_, &center_y_, &center_z_};
+  for (int i = 0; i < 3; ++i) {
+    FrustumCuller::Grow(centers[i], index);
+    (*centers[i])[index] = center[i];
+  }
+  for (int axis = 0; axis < 3; ++axis) {
+    std::vector<float> *components[] = {&axis_x_[axis], &axis_y_[axis],
+                                        &axis_z_[axis]};
+    for (int i = 0; i < 3; ++i) {
+      FrustumCuller::Grow(components[i], index);
+      (*components[i])[index] = axes[axis][i];
+    }
+  }
+  return index;
+}
+
+size_t ObbBatch::Add(const Mesh &mesh, const mat4 &world) {
+  return Add(mesh.min_position(), mesh.max_position(), world);
+}
+
+void CullBoundingBoxes(const Frustum *frustums, size_t num_frustums,
+                       const AabbBatch &batch, uint8_t *visibility) {
+  FrustumCuller::Cull(frustums, num_frustums, batch, visibility);
+}
+
+void CullBoundingBoxes(const Frustum *frustums, size_t num_frustums,
+                       const ObbBatch &batch, uint8_t *visibility) {
+  FrustumCuller::Cull(frustums, num_frustums, batch, visibility);
+}
+
+}  // namespace fplbase
@@ -0,0 +1,273 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/gpu_timer.h"
+#include "fplbase/profiler.h"
+#include "fplbase/utilities.h"
+
+#include <limits>
+
+namespace fplbase {
+
+const int GpuTimer::kFramesInFlight;
+const int GpuTimer::kMaxScopesPerFrame;
+
+// Queries are created in blocks of this many.
+static const size_t kQueryBlockSize = 16;
+
+// Marks a scope in GpuTimer::open_scopes_ that isn't being timed.
+static const size_t kUntimedScope = std::numeric_limits<size_t>::max();
+
+// Timer query enums, which older GL headers lack. The EXT values are the same.
+static const GLenum kGlTimestamp = 0x8E28;
+static const GLenum kGlQueryResult = 0x8866;
+static const GLenum kGlQueryResultAvailable = 0x8867;
+static const GLenum kGlGpuDisjoint = 0x8FBB;
+
+#if defined(_WIN32)
+#define FPLBASE_GL_APIENTRY __stdcall
+#else
+#define FPLBASE_GL_APIENTRY
+#endif
+typedef void(FPLBASE_GL_APIENTRY *GenQueriesFunc)(GLsizei, GLuint *);
+typedef void(FPLBASE_GL_APIENTRY *DeleteQueriesFunc)(GLsizei, const GLuint *);
+typedef void(FPLBASE_GL_APIENTRY *QueryCounterFunc)(GLuint, GLenum);
+typedef void(FPLBASE_GL_APIENTRY *GetQueryObjectuivFunc)(GLuint, GLenum,
+                                                         GLuint *);
+typedef void(FPLBASE_GL_APIENTRY *GetQueryObjectui64vFunc)(GLuint, GLenum,
+                                                           uint64_t *);
+
+static void *GetGlFunction(const char *name) {
+#ifdef FPL_BASE_BACKEND_SDL
+  return SDL_GL_GetProcAddress(name);
+#else
+  (void)name;
+  return nullptr;
+#endif
+}
+
+static bool HasGlExtension(const char *extension) {
+  auto extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+  if (!extensions) return false;
+  auto position = strstr(extensions, extension);
+  return position && position[strlen(extension)] <= ' ';
+}
+
+GlGpuTimerBackend::GlGpuTimerBackend()
+    : supported_(false),
+      check_disjoint_(false),
+      gen_queries_(nullptr),
+      delete_queries_(nullptr),
+      query_counter_(nullptr),
+      get_query_object_uiv_(nullptr),
+      get_query_object_ui64v_(nullptr) {}
+
+void GlGpuTimerBackend::Initialize() {
+  const char *suffix = nullptr;
+#ifdef PLATFORM_MOBILE
+  if (HasGlExtension("GL_EXT_disjoint_timer_query")) {
+    suffix = "EXT";
+    check_disjoint_ = true;
+  }
+#else
+  int major = 0, minor = 0;
+  auto version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+  if (version) sscanf(version, "%d.%d", &major, &minor);
+  if (major * 10 + minor >= 33 || HasGlExtension("GL_ARB_timer_query")) {
+    suffix = "";
+  }
+#endif
+  if (!suffix) return;
+
+  auto lookup = [suffix](const char *name) {
+    return GetGlFunction((std::string(name) + suffix).c_str());
+  };
+  gen_queries_ = lookup("glGenQueries");
+  delete_queries_ = lookup("glDeleteQueries");
+  query_counter_ = lookup("glQueryCounter");
+  get_query_object_uiv_ = lookup("glGetQueryObjectuiv");
+  get_query_object_ui64v_ = lookup("glGetQueryObjectui64v");
+  supported_ = gen_queries_ && delete_queries_ && query_counter_ &&
+               get_query_object_uiv_ && get_query_object_ui64v_;
+  if (supported_ && check_disjoint_) Disjoint();  // Clear the flag.
+}
+
+void GlGpuTimerBackend::CreateQueries(size_t count, unsigned int *queries) {
+  GL_CALL(reinterpret_cast<GenQueriesFunc>(gen_queries_)(
+      static_cast<GLsizei>(count), queries));
+}
+
+void GlGpuTimerBackend::DeleteQueries(size_t count,
+                                      const unsigned int *queries) {
+  GL_CALL(reinterpret_cast<DeleteQueriesFunc>(delete_queries_)(
+      static_cast<GLsizei>(count), queries));
+}
+
+void GlGpuTimerBackend::QueryTimestamp(unsigned int query) {
+  GL_CALL(reinterpret_cast<QueryCounterFunc>(query_counter_)(query,
+                                                             kGlTimestamp));
+}
+
+bool GlGpuTimerBackend::ResultAvailable(unsigned int query) {
+  GLuint available = 0;
+  GL_CALL(reinterpret_cast<GetQueryObjectuivFunc>(get_query_object_uiv_)(
+      query, kGlQueryResultAvailable, &available));
+  return available != 0;
+}
+
+uint64_t GlGpuTimerBackend::Result(unsigned int query) {
+  uint64_t result = 0;
+  GL_CALL(reinterpret_cast<GetQueryObjectui64vFunc>(get_query_object_ui64v_)(
+      query, kGlQueryResult, &result));
+  return result;
+}
+
+bool GlGpuTimerBackend::Disjoint() {
+  if (!check_disjoint_) return false;
+  GLint disjoint = 0;
+  GL_CALL(glGetIntegerv(kGlGpuDisjoint, &disjoint));
+  return disjoint != 0;
+}
+
+GpuTimer::GpuTimer(GpuTimerBackend *backend)
+    : backend_(backend),
+      pass_open_(false),
+      frame_(0),
+      results_frame_(0),
+      dropped_frames_(0),
+      enabled_(true) {}
+
+GpuTimer::~GpuTimer() { Reset(); }
+
+bool GpuTimer::Active() const { return enabled_ && backend_->Supported(); }
+
+int GpuTimer::Timestamp() {
+  Frame &frame = frames_[frame_ % kFramesInFlight];
+  if (frame.queries_used == frame.queries.size()) {
+    frame.queries.resize(frame.queries.size() + kQueryBlockSize);
+    backend_->CreateQueries(kQueryBlockSize,
+                            &frame.queries[frame.queries_used]);
+  }
+  backend_->QueryTimestamp(frame.queries[frame.queries_used]);
+  return static_cast<int>(frame.queries_used++);
+}
+
+void GpuTimer::BeginScope(const char *name) {
+  Frame &frame = frames_[frame_ % kFramesInFlight];
+  if (!Active() || frame.scopes.size() >= kMaxScopesPerFrame) {
+    open_scopes_.push_back(kUntimedScope);
+    return;
+  }
+  Scope scope;
+  scope.name = name;
+  scope.depth = static_cast<int>(open_scopes_.size());
+  scope.begin_query = Timestamp();
+  scope.end_query = -1;
+  open_scopes_.push_back(frame.scopes.size());
+  frame.scopes.push_back(scope);
+}
+
+void GpuTimer::EndScope() {
+  if (open_scopes_.empty()) return;
+  const size_t index = open_scopes_.back();
+  open_scopes_.pop_back();
+  if (index == kUntimedScope) return;
+  frames_[frame_ % kFramesInFlight].scopes[index].end_query = Timestamp();
+}
+
+void GpuTimer::BeginPass(const char *name) {
+  EndPass();
+  BeginScope(name);
+  pass_open_ = true;
+}
+
+void GpuTimer::EndPass() {
+  if (!pass_open_) return;
+  EndScope();
+  pass_open_ = false;
+}
+
+void GpuTimer::AdvanceFrame() {
+  EndPass();
+  while (!open_scopes_.empty()) EndScope();
+  Frame &current = frames_[frame_ % kFramesInFlight];
+  current.frame = frame_;
+  current.pending = current.queries_used > 0;
+
+  // Collect from the oldest frame to the newest, so results() ends up with
+  // the newest that is ready.
+  for (int i = 1; i <= kFramesInFlight; ++i) {
+    Frame &frame = frames_[(frame_ + i) % kFramesInFlight];
+    if (frame.pending) Collect(&frame, false);
+  }
+
+  // Make room for the next frame, dropping its old results if the GPU still
+  // hasn't got to them.
+  frame_++;
+  Frame &next = frames_[frame_ % kFramesInFlight];
+  if (next.pending) Collect(&next, true);
+  next.scopes.clear();
+  next.queries_used = 0;
+}
+
+bool GpuTimer::Collect(Frame *frame, bool force) {
+  // Queries complete in order, so the last one being ready means they all
+  // are.
+  if (!backend_->ResultAvailable(frame->queries[frame->queries_used - 1])) {
+    if (force) {
+      frame->pending = false;
+      dropped_frames_++;
+    }
+    return false;
+  }
+  frame->pending = false;
+  if (backend_->Disjoint()) {
+    dropped_frames_++;
+    return false;
+  }
+
+  results_.clear();
+  const bool profiling = ProfilerEnabled();
+  for (auto it = frame->scopes.begin(); it != frame->scopes.end(); ++it) {
+    if (it->end_query < 0) continue;
+    const uint64_t begin = backend_->Result(frame->queries[it->begin_query]);
+    const uint64_t end = backend_->Result(frame->queries[it->end_query]);
+    ScopeTiming timing;
+    timing.name = it->name;
+    timing.depth = it->depth;
+    timing.seconds = end > begin ? (end - begin) * 1e-9 : 0.0;
+    results_.push_back(timing);
+    if (profiling) {
+      ProfileCounter(ProfileInternName(std::string("gpu:") + it->name),
+                     static_cast<int64_t>(timing.seconds * 1e6));
+    }
+  }
+  results_frame_ = frame->frame;
+  return true;
+}
+
+void GpuTimer::Reset() {
+  for (int i = 0; i < kFramesInFlight; ++i) {
+    Frame &frame = frames_[i];
+    if (!frame.queries.empty()) {
+      backend_->DeleteQueries(frame.queries.size(), frame.queries.data());
+    }
+    frame = Frame();
+  }
+  open_scopes_.clear();
+  pass_open_ = false;
+}
+
+}  // namespace fplbase
@@ -14,12 +14,9 @@
 
 #include "precompiled.h"
 #include "fplbase/input.h"
+#include "fplbase/input_recording.h"
 #include "fplbase/utilities.h"
 
-//#if defined(_DEBUG) || DEBUG==1
-//#define LOG_FRAMERATE
-//#endif
-
 using mathfu::mat4;
 using mathfu::vec2;
 using mathfu::vec2i;
@@ -40,6 +37,9 @@ InputSystem::InputSystem()
       minimized_frame_(0),
       mousewheel_delta_(mathfu::kZeros2i),
       record_text_input_(false),
+      input_reset_(false),
+      input_recorder_(nullptr),
+      input_player_(nullptr),
       touch_device_(true) {
   pointers_.assign(kMaxSimultanuousPointers, InputPointer());
 #if ANDROID_HMD
@@ -55,7 +55,8 @@ InputSystem::~InputSystem() {
 
 
 void InputSystem::ResetInputState() {
-  button_map_.clear();
+  button_table_.Clear();
+  input_reset_ = true;
 #if ANDROID_GAMEPAD
   gamepad_map_.clear();
 #endif
@@ -66,10 +67,22 @@ void InputSystem::AddAppEventCallback(AppEventCallback callback) {
 }
 
 void InputSystem::AdvanceFrame(vec2i *window_size) {
+  // When replaying, the recording replaces both the clock and the events.
+  InputFrame replay_frame;
+  const bool replaying =
+      input_player_ != nullptr && input_player_->NextFrame(&replay_frame);
+
   // Update timing.
-  auto current = RealTime();
-  frame_time_ = current - elapsed_time_;
-  elapsed_time_ = current;
+  if (replaying) {
+    frame_time_ = input_player_->fixed_timestep() > 0.0
+                      ? input_player_->fixed_timestep()
+                      : replay_frame.delta_time;
+    elapsed_time_ += frame_time_;
+  } else {
+    auto current = RealTime();
+    frame_time_ = current - elapsed_time_;
+    elapsed_time_ = current;
+  }
   frames_++;
 
 #ifdef __ANDROID__
@@ -87,44 +100,9 @@ void InputSystem::AdvanceFrame(vec2i *window_size) {
   }
 #endif
 
-#ifdef LOG_FRAMERATE
-  // Framerate statistics over the last N frames.
-  const int kNumDeltaTimes = 64;
-  static int cur_delta_idx = 0;
-  static double delta_times[kNumDeltaTimes];
-  delta_times[cur_delta_idx++] = DeltaTime();
-  if (cur_delta_idx == kNumDeltaTimes) {
-    cur_delta_idx = 0;
-    double sum_delta = 0, min_delta = 99999, max_delta = 0;
-    const int kMaxBins = 8;
-    int bins[kMaxBins] = {0};
-    for (int i = 0; i < kNumDeltaTimes; i++) {
-      sum_delta += delta_times[i];
-      min_delta = std::min(min_delta, delta_times[i]);
-      max_delta = std::max(max_delta, delta_times[i]);
-      // Frame-count "bin".
-      // Bin 0: 0 ~ 16.6ms (=1/60s)
-      // Bin 1: 16.6 ~ 32.3ms (=2/60s)
-      // Bin 2: 32.3 ~ 50ms (=3/60s)
-      auto bin = static_cast<int>(delta_times[i] * 60.0);
-      bins[std::max(1, std::min(bin, kMaxBins - 1))]++;
-    }
-    std::ostringstream os;
-    for (int i = 1; i < kMaxBins; i++) {
-      os << bins[i] << ";";
-    }
-    LogInfo(kApplication,
-            "DeltaTime (ms) avg: %.1f, max: %.1f, min: %.1f, bins: %s",
-            (sum_delta / kNumDeltaTimes * 1000), max_delta * 1000,
-            min_delta * 1000, os.str().c_str());
-  }
-#endif
-
   // Reset our per-frame input state.
   mousewheel_delta_ = mathfu::kZeros2i;
-  for (auto it = button_map_.begin(); it != button_map_.end(); ++it) {
-    it->second.AdvanceFrame();
-  }
+  button_table_.AdvanceFrame();
   for (auto it = pointers_.begin(); it != pointers_.end(); ++it) {
     it->mousedelta = mathfu::kZeros2i;
     if (touch_device_ && !it->used) {
@@ -145,7 +123,16 @@ void InputSystem::AdvanceFrame(vec2i *window_size) {
     text_input_events_.clear();
   }
 
-  UpdateEvents(window_size);
+  if (replaying) {
+    ApplyInputFrame(replay_frame, window_size);
+  } else {
+    UpdateEvents(window_size);
+  }
+  if (input_recorder_) {
+    InputFrame frame;
+    CaptureInputFrame(*window_size, &frame);
+    input_recorder_->AddFrame(frame);
+  }
 
   // Update the head mounted display input. Note this is after the mouse
   // input, as that can be treated as a trigger.
@@ -159,9 +146,48 @@ double InputSystem::Time() const { return elapsed_time_; }
 double InputSystem::DeltaTime() const { return frame_time_; }
 
 Button &InputSystem::GetButton(int button) {
-  auto it = button_map_.find(button);
-  return it != button_map_.end() ? it->second
-                                 : (button_map_[button] = Button());
+  return button_table_.GetButton(button);
+}
+
+void InputSystem::CaptureInputFrame(const vec2i &window_size,
+                                    InputFrame *frame) {
+  frame->delta_time = frame_time_;
+  frame->buttons.clear();
+  button_table_.ForEachChangedButton([frame](int id, const Button &button) {
+    InputFrame::ButtonState state;
+    state.id = id;
+    state.is_down = button.is_down();
+    state.went_down = button.went_down();
+    state.went_up = button.went_up();
+    frame->buttons.push_back(state);
+  });
+  frame->pointers = pointers_;
+  frame->mousewheel_delta = mousewheel_delta_;
+  frame->window_size = window_size;
+  frame->exit_requested = exit_requested_;
+  frame->minimized = minimized_;
+  frame->touch_device = touch_device_;
+  frame->input_reset = input_reset_;
+  input_reset_ = false;
+}
+
+void InputSystem::ApplyInputFrame(const InputFrame &frame,
+                                  vec2i *window_size) {
+  if (frame.input_reset) button_table_.Clear();
+  for (auto it = frame.buttons.begin(); it != frame.buttons.end(); ++it) {
+    GetButton(it->id).state_ = static_cast<uint8_t>(
+        (it->is_down ? Button::kIsDown : 0) |
+        (it->went_down ? Button::kWentDown : 0) |
+        (it->went_up ? Button::kWentUp : 0));
+  }
+  for (size_t i = 0; i < pointers_.size() && i < frame.pointers.size(); ++i) {
+    pointers_[i] = frame.pointers[i];
+  }
+  mousewheel_delta_ = frame.mousewheel_delta;
+  if (frame.window_size != mathfu::kZeros2i) *window_size = frame.window_size;
+  exit_requested_ = frame.exit_requested;
+  minimized_ = frame.minimized;
+  touch_device_ = frame.touch_device;
 }
 
 Joystick &InputSystem::GetJoystick(JoystickId joystick_id) {
@@ -203,12 +229,47 @@ const std::vector<TextInputEvent> *InputSystem::GetTextInputEvents() {
 }
 
 void Button::Update(bool down) {
-  if (!is_down_ && down) {
-    went_down_ = true;
-  } else if (is_down_ && !down) {
-    went_up_ = true;
+  if (!is_down() && down) {
+    state_ |= kWentDown;
+  } else if (is_down() && !down) {
+    state_ |= kWentUp;
+  }
+  state_ = down ? (state_ | kIsDown) : (state_ & ~kIsDown);
+}
+
+const int ButtonTable::kNumNegativeButtons;
+const int ButtonTable::kNumCharacterKeys;
+const int ButtonTable::kNumScancodeKeys;
+const int ButtonTable::kNumDenseButtons;
+
+void ButtonTable::AdvanceFrame() {
+  for (int i = 0; i < kNumDenseButtons; ++i) {
+    dense_[i].state_ &= Button::kIsDown;
+  }
+  for (auto it = sparse_.begin(); it != sparse_.end(); ++it) {
+    it->second.AdvanceFrame();
   }
-  is_down_ = down;
+}
+
+void ButtonTable::ForEachChangedButton(
+    const std::function<void(int, const Button &)> &function) const {
+  const uint8_t kChanged = Button::kWentDown | Button::kWentUp;
+  for (int i = 0; i < kNumDenseButtons; ++i) {
+    if (!(dense_[i].state_ & kChanged)) continue;
+    int id = i - kNumNegativeButtons;
+    if (id >= kNumCharacterKeys) {
+      id = (id - kNumCharacterKeys) | FPLK_SCANCODE_MASK;
+    }
+    function(id, dense_[i]);
+  }
+  for (auto it = sparse_.begin(); it != sparse_.end(); ++it) {
+    if (it->second.state_ & kChanged) function(it->first, it->second);
+  }
+}
+
+void ButtonTable::Clear() {
+  std::fill(dense_, dense_ + kNumDenseButtons, Button());
+  sparse_.clear();
 }
 
 Button &Joystick::GetButton(size_t button_index) {
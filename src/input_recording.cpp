@@ -0,0 +1,261 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/input_recording.h"
+#include "fplbase/utilities.h"
+
+using mathfu::vec2i;
+
+namespace fplbase {
+
+// The stream starts with a header, followed by the frames back to back:
+//   float64 delta_time
+//   uint8   flags (kFrameFlag*)
+//   int32   mousewheel_delta x, y
+//   int32   window_size x, y
+//   uint16  number of buttons, then for each:
+//             int32 id, uint8 state (kButtonState*)
+//   uint8   number of changed pointers, then for each:
+//             uint8 index, uint64 id, uint8 used,
+//             int32 mousepos x, y, int32 mousedelta x, y
+// All values are little endian, whatever the host byte order. float64 is an
+// IEEE 754 double.
+static const char kInputStreamMagic[4] = {'F', 'P', 'L', 'I'};
+static const uint32_t kInputStreamVersion = 1;
+
+enum {
+  kFrameFlagExitRequested = 1 << 0,
+  kFrameFlagMinimized = 1 << 1,
+  kFrameFlagTouchDevice = 1 << 2,
+  kFrameFlagInputReset = 1 << 3,
+};
+
+enum {
+  kButtonStateIsDown = 1 << 0,
+  kButtonStateWentDown = 1 << 1,
+  kButtonStateWentUp = 1 << 2,
+};
+
+static void WriteBytes(const void *bytes, size_t size, std::string *dest) {
+  dest->append(static_cast<const char *>(bytes), size);
+}
+
+static bool HostIsLittleEndian() {
+  const uint16_t one = 1;
+  return *reinterpret_cast<const uint8_t *>(&one) == 1;
+}
+
+// Convert between host order and the little endian order of the stream. The
+// conversion is its own inverse, so it serves both reading and writing.
+static void SwapToLittleEndian(uint8_t *bytes, size_t size) {
+  if (!HostIsLittleEndian()) std::reverse(bytes, bytes + size);
+}
+
+template <typename T>
+static void Write(T value, std::string *dest) {
+  uint8_t bytes[sizeof(value)];
+  memcpy(bytes, &value, sizeof(value));
+  SwapToLittleEndian(bytes, sizeof(bytes));
+  WriteBytes(bytes, sizeof(bytes), dest);
+}
+
+static void Write(const vec2i &value, std::string *dest) {
+  Write<int32_t>(value.x(), dest);
+  Write<int32_t>(value.y(), dest);
+}
+
+// Reads values from a stream, remembering if it ever ran off the end.
+class StreamReader {
+ public:
+  StreamReader(const std::string &data, size_t position)
+      : data_(data), position_(position), ok_(true) {}
+
+  template <typename T>
+  T Read() {
+    T value = T();
+    if (position_ + sizeof(value) > data_.size()) {
+      ok_ = false;
+      return value;
+    }
+    uint8_t bytes[sizeof(value)];
+    memcpy(bytes, &data_[position_], sizeof(bytes));
+    SwapToLittleEndian(bytes, sizeof(bytes));
+    memcpy(&value, bytes, sizeof(value));
+    position_ += sizeof(value);
+    return value;
+  }
+
+  vec2i ReadVec2i() {
+    const int32_t x = Read<int32_t>();
+    return vec2i(x, Read<int32_t>());
+  }
+
+  void Fail() { ok_ = false; }
+  size_t position() const { return position_; }
+  bool ok() const { return ok_; }
+
+ private:
+  const std::string &data_;
+  size_t position_;
+  bool ok_;
+};
+
+static bool PointersEqual(const InputPointer &a, const InputPointer &b) {
+  return a.id == b.id && a.used == b.used && a.mousepos == b.mousepos &&
+         a.mousedelta == b.mousedelta;
+}
+
+InputRecorder::InputRecorder() : num_frames_(0) { Clear(); }
+
+void InputRecorder::Clear() {
+  data_.clear();
+  WriteBytes(kInputStreamMagic, sizeof(kInputStreamMagic), &data_);
+  Write(kInputStreamVersion, &data_);
+  num_frames_ = 0;
+  pointers_.assign(InputSystem::kMaxSimultanuousPointers, InputPointer());
+}
+
+void InputRecorder::AddFrame(const InputFrame &frame) {
+  Write(frame.delta_time, &data_);
+  Write(static_cast<uint8_t>(
+            (frame.exit_requested ? kFrameFlagExitRequested : 0) |
+            (frame.minimized ? kFrameFlagMinimized : 0) |
+            (frame.touch_device ? kFrameFlagTouchDevice : 0) |
+            (frame.input_reset ? kFrameFlagInputReset : 0)),
+        &data_);
+  Write(frame.mousewheel_delta, &data_);
+  Write(frame.window_size, &data_);
+
+  assert(frame.buttons.size() <= 0xFFFF);
+  Write(static_cast<uint16_t>(frame.buttons.size()), &data_);
+  for (auto it = frame.buttons.begin(); it != frame.buttons.end(); ++it) {
+    Write<int32_t>(it->id, &data_);
+    Write(static_cast<uint8_t>((it->is_down ? kButtonStateIsDown : 0) |
+                               (it->went_down ? kButtonStateWentDown : 0) |
+                               (it->went_up ? kButtonStateWentUp : 0)),
+          &data_);
+  }
+
+  // Only write the pointers that differ from the previous frame.
+  const size_t num_pointers = std::min(frame.pointers.size(), pointers_.size());
+  uint8_t num_changed = 0;
+  for (size_t i = 0; i < num_pointers; ++i) {
+    num_changed += !PointersEqual(frame.pointers[i], pointers_[i]);
+  }
+  Write(num_changed, &data_);
+  for (size_t i = 0; i < num_pointers; ++i) {
+    const InputPointer &pointer = frame.pointers[i];
+    if (PointersEqual(pointer, pointers_[i])) continue;
+    Write(static_cast<uint8_t>(i), &data_);
+    Write<uint64_t>(pointer.id, &data_);
+    Write<uint8_t>(pointer.used, &data_);
+    Write(pointer.mousepos, &data_);
+    Write(pointer.mousedelta, &data_);
+    pointers_[i] = pointer;
+  }
+  num_frames_++;
+}
+
+bool InputRecorder::Save(const char *filename) const {
+  return SaveFile(filename, data_);
+}
+
+InputPlayer::InputPlayer() : position_(0), fixed_timestep_(0.0) {}
+
+bool InputPlayer::Load(const char *filename) {
+  std::string data;
+  if (!LoadFile(filename, &data)) {
+    LogError(kApplication, "Couldn't load input recording %s", filename);
+    return false;
+  }
+  return Set(data);
+}
+
+bool InputPlayer::Set(const std::string &data) {
+  data_.clear();
+  position_ = 0;
+  const size_t header_size =
+      sizeof(kInputStreamMagic) + sizeof(kInputStreamVersion);
+  if (data.size() < header_size ||
+      memcmp(data.data(), kInputStreamMagic, sizeof(kInputStreamMagic))) {
+    LogError(kApplication, "Not an input recording");
+    return false;
+  }
+  uint32_t version;
+  memcpy(&version, &data[sizeof(kInputStreamMagic)], sizeof(version));
+  if (version != kInputStreamVersion) {
+    LogError(kApplication, "Input recording version %d, expected %d",
+             static_cast<int>(version), static_cast<int>(kInputStreamVersion));
+    return false;
+  }
+  data_ = data;
+  Rewind();
+  return true;
+}
+
+void InputPlayer::Rewind() {
+  position_ = std::min(data_.size(),
+                       sizeof(kInputStreamMagic) + sizeof(kInputStreamVersion));
+  pointers_.assign(InputSystem::kMaxSimultanuousPointers, InputPointer());
+}
+
+bool InputPlayer::NextFrame(InputFrame *frame) {
+  if (finished()) return false;
+
+  StreamReader in(data_, position_);
+  frame->delta_time = in.Read<double>();
+  const uint8_t flags = in.Read<uint8_t>();
+  frame->exit_requested = (flags & kFrameFlagExitRequested) != 0;
+  frame->minimized = (flags & kFrameFlagMinimized) != 0;
+  frame->touch_device = (flags & kFrameFlagTouchDevice) != 0;
+  frame->input_reset = (flags & kFrameFlagInputReset) != 0;
+  frame->mousewheel_delta = in.ReadVec2i();
+  frame->window_size = in.ReadVec2i();
+
+  frame->buttons.resize(in.Read<uint16_t>());
+  for (auto it = frame->buttons.begin(); it != frame->buttons.end(); ++it) {
+    it->id = in.Read<int32_t>();
+    const uint8_t state = in.Read<uint8_t>();
+    it->is_down = (state & kButtonStateIsDown) != 0;
+    it->went_down = (state & kButtonStateWentDown) != 0;
+    it->went_up = (state & kButtonStateWentUp) != 0;
+  }
+
+  const uint8_t num_changed = in.Read<uint8_t>();
+  for (uint8_t i = 0; i < num_changed && in.ok(); ++i) {
+    const uint8_t index = in.Read<uint8_t>();
+    InputPointer pointer;
+    pointer.id = in.Read<uint64_t>();
+    pointer.used = in.Read<uint8_t>() != 0;
+    pointer.mousepos = in.ReadVec2i();
+    pointer.mousedelta = in.ReadVec2i();
+    if (index >= pointers_.size()) {
+      in.Fail();
+      break;
+    }
+    pointers_[index] = pointer;
+  }
+  frame->pointers = pointers_;
+
+  if (!in.ok()) {
+    LogError(kApplication, "Input recording is corrupt");
+    position_ = data_.size();
+    return false;
+  }
+  position_ = in.position();
+  return true;
+}
+
+}  // namespace fplbase
@@ -0,0 +1,46 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_JSON_UTILITIES_H
+#define FPLBASE_JSON_UTILITIES_H
+
+#include <stdio.h>
+#include <string>
+
+namespace fplbase {
+
+// Internal helpers for the JSON that fplbase writes out (profiles, asset
+// load telemetry). Not part of the public API.
+
+// Append `str` to `json` as a quoted JSON string.
+inline void AppendJsonString(const std::string &str, std::string *json) {
+  json->push_back('"');
+  for (auto c = str.begin(); c != str.end(); ++c) {
+    if (*c == '"' || *c == '\\') {
+      json->push_back('\\');
+      json->push_back(*c);
+    } else if (static_cast<unsigned char>(*c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      json->append(escaped);
+    } else {
+      json->push_back(*c);
+    }
+  }
+  json->push_back('"');
+}
+
+}  // namespace fplbase
+
+#endif  // FPLBASE_JSON_UTILITIES_H
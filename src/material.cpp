@@ -19,8 +19,15 @@
 namespace fplbase {
 
 void Material::Set(Renderer &renderer) {
-  renderer.SetBlendMode(blend_mode_);
-  for (size_t i = 0; i < textures_.size(); i++) textures_[i]->Set(i);
+  Set(renderer, renderer.default_render_context());
+}
+
+void Material::Set(Renderer &renderer, RenderContext *render_context) {
+  renderer.SetBlendMode(blend_mode_, render_context);
+  renderer.SetTextureLayer(texture_layer_);
+  for (size_t i = 0; i < textures_.size(); i++) {
+    textures_[i]->Set(i, render_context);
+  }
 }
 
 void Material::DeleteTextures() {
@@ -14,6 +14,7 @@
 
 #include "precompiled.h"
 #include "fplbase/mesh.h"
+#include "fplbase/parallel_for.h"
 #include "fplbase/renderer.h"
 
 using mathfu::mat4;
@@ -26,6 +27,28 @@ using mathfu::vec4i;
 namespace fplbase {
 namespace {
 
+// Batches of skinned instances smaller than this are not worth splitting
+// across threads.
+const size_t kMinSkinnedInstancesPerThread = 64;
+
+// Calculate a * b, treating both as 4x4 matrices with an implied last row of
+// (0, 0, 0, 1). AffineTransform stores the three rows of the matrix as vec4
+// columns, so each output row is a linear combination of the rows of b, which
+// maps directly onto mathfu's SIMD vec4 operations without going through a
+// full mat4 multiply.
+inline void MultiplyAffine(const mathfu::AffineTransform &a,
+                           const mathfu::AffineTransform &b,
+                           mathfu::AffineTransform *result) {
+  const vec4 b0 = b.GetColumn(0);
+  const vec4 b1 = b.GetColumn(1);
+  const vec4 b2 = b.GetColumn(2);
+  for (int row = 0; row < 3; ++row) {
+    const vec4 a_row = a.GetColumn(row);
+    result->GetColumn(row) = a_row.x() * b0 + a_row.y() * b1 +
+                             a_row.z() * b2 + vec4(0.0f, 0.0f, 0.0f, a_row.w());
+  }
+}
+
 GLenum GetGlPrimitiveType(Mesh::Primitive primitive) {
   switch (primitive) {
     case Mesh::kLines:
@@ -163,17 +186,25 @@ Mesh::Mesh(const void *vertex_data, int count, int vertex_size,
            const Attribute *format, vec3 *max_position, vec3 *min_position)
     : vertex_size_(vertex_size),
       num_vertices_(static_cast<size_t>(count)),
+      vbo_(0),
       default_bone_transform_inverses_(nullptr) {
   set_format(format);
-  GL_CALL(glGenBuffers(1, &vbo_));
-  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
-  GL_CALL(glBufferData(GL_ARRAY_BUFFER, count * vertex_size, vertex_data,
-                       GL_STATIC_DRAW));
+  // Without vertices, e.g. for a mesh only used for its bones, there is no
+  // buffer to create.
+  if (count > 0) {
+    GL_CALL(glGenBuffers(1, &vbo_));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER, count * vertex_size, vertex_data,
+                         GL_STATIC_DRAW));
+  }
 
   // Determine the min and max position
   if (max_position && min_position) {
     max_position_ = *max_position;
     min_position_ = *min_position;
+  } else if (count <= 0) {
+    min_position_ = mathfu::kZeros3f;
+    max_position_ = mathfu::kZeros3f;
   } else {
     auto data = static_cast<const float *>(vertex_data);
     const Attribute *attribute = format;
@@ -190,7 +221,7 @@ Mesh::Mesh(const void *vertex_data, int count, int vertex_size,
 }
 
 Mesh::~Mesh() {
-  GL_CALL(glDeleteBuffers(1, &vbo_));
+  if (vbo_) GL_CALL(glDeleteBuffers(1, &vbo_));
   for (auto it = indices_.begin(); it != indices_.end(); ++it) {
     GL_CALL(glDeleteBuffers(1, &it->ibo));
   }
@@ -258,9 +289,15 @@ void Mesh::DrawElement(Renderer &renderer, int32_t count, int32_t instances) {
 }
 
 void Mesh::Render(Renderer &renderer, bool ignore_material, size_t instances) {
+  Render(renderer, ignore_material, instances,
+         renderer.default_render_context());
+}
+
+void Mesh::Render(Renderer &renderer, bool ignore_material, size_t instances,
+                  RenderContext *render_context) {
   SetAttributes(vbo_, format_, static_cast<int>(vertex_size_), nullptr);
   for (auto it = indices_.begin(); it != indices_.end(); ++it) {
-    if (!ignore_material) it->mat->Set(renderer);
+    if (!ignore_material) it->mat->Set(renderer, render_context);
     GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, it->ibo));
     DrawElement(renderer, it->count, static_cast<int32_t>(instances));
   }
@@ -270,13 +307,22 @@ void Mesh::Render(Renderer &renderer, bool ignore_material, size_t instances) {
 void Mesh::RenderStereo(Renderer &renderer, const Shader *shader,
                         const vec4i *viewport, const mat4 *mvp,
                         const vec3 *camera_position, bool ignore_material,
-                        size_t instances) {
+                        size_t instances, uint8_t visible_eyes) {
+  if (!(visible_eyes & kFrustumVisibleBothEyes)) return;
+  if ((visible_eyes & kFrustumVisibleBothEyes) == kFrustumVisibleBothEyes &&
+      renderer.feature_level() == Renderer::kFeatureLevel30 &&
+      shader->SupportsInstancedStereo()) {
+    RenderInstancedStereo(renderer, shader, viewport, mvp, camera_position,
+                          ignore_material, instances);
+    return;
+  }
   SetAttributes(vbo_, format_, static_cast<int>(vertex_size_), nullptr);
   for (auto it = indices_.begin(); it != indices_.end(); ++it) {
     if (!ignore_material) it->mat->Set(renderer);
     GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, it->ibo));
 
     for (auto i = 0; i < 2; ++i) {
+      if (!(visible_eyes & (1 << i))) continue;
       renderer.set_camera_pos(camera_position[i]);
       renderer.set_model_view_projection(mvp[i]);
       shader->Set(renderer);
@@ -289,13 +335,90 @@ void Mesh::RenderStereo(Renderer &renderer, const Shader *shader,
   UnSetAttributes(format_);
 }
 
+void Mesh::RenderInstancedStereo(Renderer &renderer, const Shader *shader,
+                                 const vec4i *viewport, const mat4 *mvp,
+                                 const vec3 *camera_position,
+                                 bool ignore_material, size_t instances) {
+  vec4i span;
+  vec4 viewport_transform[2];
+  vec4 viewport_bounds[2];
+  ComputeStereoViewports(viewport, &span, viewport_transform,
+                         viewport_bounds);
+
+  // Keep the standard uniforms meaningful for shaders that also use them,
+  // e.g. for effects that don't depend on the eye.
+  renderer.set_camera_pos(camera_position[0]);
+  renderer.set_model_view_projection(mvp[0]);
+  shader->Set(renderer);
+  shader->SetStereoUniforms(mvp, camera_position, viewport_transform,
+                            viewport_bounds);
+  GL_CALL(glViewport(span.x(), span.y(), span.z(), span.w()));
+
+  SetAttributes(vbo_, format_, static_cast<int>(vertex_size_), nullptr);
+  for (auto it = indices_.begin(); it != indices_.end(); ++it) {
+    if (!ignore_material) it->mat->Set(renderer);
+    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, it->ibo));
+    DrawElement(renderer, it->count, static_cast<int32_t>(instances * 2));
+  }
+  UnSetAttributes(format_);
+}
+
+void Mesh::ComputeStereoViewports(const vec4i *viewport, vec4i *span,
+                                  vec4 *viewport_transform,
+                                  vec4 *viewport_bounds) {
+  // Draw into a viewport that spans both eyes. The shader moves each eye's
+  // clip space coordinates into the eye's part of it, using
+  //     clip.xy = clip.xy * transform.xy + transform.zw * clip.w
+  // and discards pixels outside of the eye's bounds, which GL doesn't clip.
+  const vec2i span_min = vec2i::Min(viewport[0].xy(), viewport[1].xy());
+  const vec2i span_max = vec2i::Max(viewport[0].xy() + viewport[0].zw(),
+                                    viewport[1].xy() + viewport[1].zw());
+  const vec2 span_size(span_max - span_min);
+  *span = vec4i(span_min, span_max - span_min);
+  for (int i = 0; i < 2; ++i) {
+    const vec2 eye_size(viewport[i].zw());
+    const vec2 eye_offset(viewport[i].xy() - span_min);
+    viewport_transform[i] =
+        vec4(eye_size / span_size,
+             (2.0f * eye_offset + eye_size) / span_size - mathfu::kOnes2f);
+    viewport_bounds[i] = vec4(vec2(viewport[i].xy()),
+                              vec2(viewport[i].xy() + viewport[i].zw()));
+  }
+}
+
 void Mesh::RenderArray(Primitive primitive, int index_count,
                        const Attribute *format, int vertex_size,
                        const void *vertices, const unsigned short *indices) {
+  auto gl_primitive = GetGlPrimitiveType(primitive);
+
+  // Copy the vertices and indices into this frame's streaming buffers, so the
+  // draw doesn't have to read client memory. Only the vertices up to the
+  // highest index are referenced, so that's all that needs uploading.
+  Renderer *renderer = Renderer::Get();
+  if (renderer && index_count > 0) {
+    const unsigned short max_index =
+        *std::max_element(indices, indices + index_count);
+    size_t vertex_offset = 0;
+    size_t index_offset = 0;
+    if (renderer->streaming_vertices().Write(
+            vertices, (max_index + 1) * static_cast<size_t>(vertex_size),
+            &vertex_offset) &&
+        renderer->streaming_indices().Write(
+            indices, index_count * sizeof(unsigned short), &index_offset)) {
+      SetAttributes(renderer->streaming_vertices().handle(), format,
+                    vertex_size, reinterpret_cast<const char *>(vertex_offset));
+      GL_CALL(glDrawElements(gl_primitive, index_count, GL_UNSIGNED_SHORT,
+                             reinterpret_cast<const void *>(index_offset)));
+      UnSetAttributes(format);
+      GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+      GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+      return;
+    }
+  }
+
   SetAttributes(0, format, vertex_size,
                 reinterpret_cast<const char *>(vertices));
   GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-  auto gl_primitive = GetGlPrimitiveType(primitive);
   GL_CALL(
       glDrawElements(gl_primitive, index_count, GL_UNSIGNED_SHORT, indices));
   UnSetAttributes(format);
@@ -304,12 +427,23 @@ void Mesh::RenderArray(Primitive primitive, int index_count,
 void Mesh::RenderArray(Primitive primitive, int vertex_count,
                        const Attribute *format, int vertex_size,
                        const void *vertices) {
-  SetAttributes(0, format, vertex_size,
-                reinterpret_cast<const char *>(vertices));
-  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
   auto gl_primitive = GetGlPrimitiveType(primitive);
+  Renderer *renderer = Renderer::Get();
+  size_t vertex_offset = 0;
+  if (renderer &&
+      renderer->streaming_vertices().Write(
+          vertices, vertex_count * static_cast<size_t>(vertex_size),
+          &vertex_offset)) {
+    SetAttributes(renderer->streaming_vertices().handle(), format, vertex_size,
+                  reinterpret_cast<const char *>(vertex_offset));
+  } else {
+    SetAttributes(0, format, vertex_size,
+                  reinterpret_cast<const char *>(vertices));
+  }
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
   GL_CALL(glDrawArrays(gl_primitive, 0, vertex_count));
   UnSetAttributes(format);
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
 }
 
 void Mesh::RenderAAQuadAlongX(const vec3 &bottom_left, const vec3 &top_right,
@@ -389,10 +523,34 @@ void Mesh::GatherShaderTransforms(
     mathfu::AffineTransform *shader_transforms) const {
   for (size_t i = 0; i < shader_bone_indices_.size(); ++i) {
     const int bone_idx = shader_bone_indices_[i];
-    shader_transforms[i] = mat4::ToAffineTransform(
-        mat4::FromAffineTransform(bone_transforms[bone_idx]) *
-        mat4::FromAffineTransform(default_bone_transform_inverses_[bone_idx]));
+    MultiplyAffine(bone_transforms[bone_idx],
+                   default_bone_transform_inverses_[bone_idx],
+                   &shader_transforms[i]);
+  }
+}
+
+void Mesh::GatherShaderTransforms(const SkinnedInstance *instances,
+                                  size_t num_instances) {
+  ParallelFor(num_instances, kMinSkinnedInstancesPerThread,
+              [instances](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                  const SkinnedInstance &instance = instances[i];
+                  instance.mesh->GatherShaderTransforms(
+                      instance.bone_transforms, instance.shader_transforms);
+                }
+              });
+}
+
+AssetMemoryUsage Mesh::MemoryUsage() const {
+  AssetMemoryUsage usage;
+  usage.gpu_bytes = num_vertices_ * vertex_size_ +
+                    CalculateTotalNumberOfIndices() * sizeof(unsigned short);
+  usage.cpu_bytes = num_bones() * sizeof(mathfu::AffineTransform) +
+                    bone_parents_.size() + shader_bone_indices_.size();
+  for (auto it = bone_names_.begin(); it != bone_names_.end(); ++it) {
+    usage.cpu_bytes += it->size();
   }
+  return usage;
 }
 
 size_t Mesh::CalculateTotalNumberOfIndices() const {
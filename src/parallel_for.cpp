@@ -0,0 +1,226 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/parallel_for.h"
+
+#include <deque>
+
+#if defined(FPL_BASE_BACKEND_STDLIB)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace fplbase {
+
+static size_t g_thread_count_override = 0;
+
+namespace {
+
+struct ParallelForJob {
+  size_t begin;
+  size_t end;
+};
+
+// One ParallelFor() call: its sub-ranges, and how many haven't finished.
+struct ParallelForBatch {
+  const ParallelForBody *body;
+  std::vector<ParallelForJob> jobs;
+  size_t unfinished;
+};
+
+struct ParallelForTask {
+  ParallelForBatch *batch;
+  size_t job;
+};
+
+#if defined(FPL_BASE_BACKEND_SDL) || defined(FPL_BASE_BACKEND_STDLIB)
+// Threads that run the sub-ranges of every ParallelFor() call. They are
+// started the first time they're needed, and then wait for more work for
+// the lifetime of the program, since starting threads on every call can
+// cost more than the per-frame work itself.
+//
+// Callers run tasks from the queue while their own are pending, so calls
+// from several threads, and calls nested in a body, always make progress.
+class WorkerPool {
+ public:
+  WorkerPool() : num_workers_(0) {
+#if defined(FPL_BASE_BACKEND_SDL)
+    mutex_ = SDL_CreateMutex();
+    work_condition_ = SDL_CreateCond();
+    done_condition_ = SDL_CreateCond();
+#endif  // defined(FPL_BASE_BACKEND_SDL)
+  }
+
+  // Never destroyed, as the workers outlive static destruction.
+  static WorkerPool &Get() {
+    static WorkerPool *pool = new WorkerPool();
+    return *pool;
+  }
+
+  void Run(ParallelForBatch *batch) {
+    Lock();
+    StartWorkersLocked(batch->jobs.size() - 1);
+    for (size_t i = 1; i < batch->jobs.size(); ++i) {
+      ParallelForTask task = {batch, i};
+      tasks_.push_back(task);
+    }
+    WakeWorkersLocked();
+    Unlock();
+
+    (*batch->body)(batch->jobs[0].begin, batch->jobs[0].end);
+
+    Lock();
+    batch->unfinished--;
+    while (batch->unfinished) {
+      if (!tasks_.empty()) {
+        RunTaskLocked();
+      } else {
+        WaitLocked(kDoneCondition);
+      }
+    }
+    Unlock();
+  }
+
+ private:
+  enum Condition { kWorkCondition, kDoneCondition };
+
+  // Pops the first task and runs it with the lock released.
+  void RunTaskLocked() {
+    const ParallelForTask task = tasks_.front();
+    tasks_.pop_front();
+    Unlock();
+    const ParallelForJob &job = task.batch->jobs[task.job];
+    (*task.batch->body)(job.begin, job.end);
+    Lock();
+    if (--task.batch->unfinished == 0) WakeCallersLocked();
+  }
+
+  void Work() {
+    Lock();
+    for (;;) {
+      while (tasks_.empty()) WaitLocked(kWorkCondition);
+      RunTaskLocked();
+    }
+  }
+
+  // A thread that fails to start only means callers do more themselves.
+  void StartWorkersLocked(size_t count) {
+    while (num_workers_ < count) {
+#if defined(FPL_BASE_BACKEND_SDL)
+      SDL_Thread *thread =
+          SDL_CreateThread(WorkerThread, "FPL ParallelFor", this);
+      if (!thread) return;
+      SDL_DetachThread(thread);
+#else
+      std::thread(&WorkerPool::Work, this).detach();
+#endif  // defined(FPL_BASE_BACKEND_SDL)
+      num_workers_++;
+    }
+  }
+
+#if defined(FPL_BASE_BACKEND_SDL)
+  static int WorkerThread(void *user_data) {
+    static_cast<WorkerPool *>(user_data)->Work();
+    return 0;
+  }
+
+  void Lock() { SDL_LockMutex(mutex_); }
+  void Unlock() { SDL_UnlockMutex(mutex_); }
+  void WaitLocked(Condition condition) {
+    SDL_CondWait(condition == kWorkCondition ? work_condition_
+                                             : done_condition_,
+                 mutex_);
+  }
+  void WakeWorkersLocked() { SDL_CondBroadcast(work_condition_); }
+  void WakeCallersLocked() { SDL_CondBroadcast(done_condition_); }
+
+  SDL_mutex *mutex_;
+  SDL_cond *work_condition_;
+  SDL_cond *done_condition_;
+#else
+  void Lock() { mutex_.lock(); }
+  void Unlock() { mutex_.unlock(); }
+  void WaitLocked(Condition condition) {
+    (condition == kWorkCondition ? work_condition_ : done_condition_)
+        .wait(mutex_);
+  }
+  void WakeWorkersLocked() { work_condition_.notify_all(); }
+  void WakeCallersLocked() { done_condition_.notify_all(); }
+
+  std::mutex mutex_;
+  std::condition_variable_any work_condition_;
+  std::condition_variable_any done_condition_;
+#endif  // defined(FPL_BASE_BACKEND_SDL)
+
+  std::deque<ParallelForTask> tasks_;
+  size_t num_workers_;
+};
+#endif  // defined(FPL_BASE_BACKEND_SDL) || defined(FPL_BASE_BACKEND_STDLIB)
+
+}  // namespace
+
+size_t ParallelForThreadCount() {
+  if (g_thread_count_override) return g_thread_count_override;
+#if defined(FPL_BASE_BACKEND_SDL)
+  const int cpus = SDL_GetCPUCount();
+  return cpus > 0 ? static_cast<size_t>(cpus) : 1;
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  const unsigned int cpus = std::thread::hardware_concurrency();
+  return cpus > 0 ? static_cast<size_t>(cpus) : 1;
+#else
+  return 1;
+#endif
+}
+
+void SetParallelForThreadCount(size_t count) {
+  g_thread_count_override = count;
+}
+
+void ParallelFor(size_t count, size_t min_range, const ParallelForBody &body) {
+  if (count == 0) return;
+  if (min_range == 0) min_range = 1;
+
+  // Never create more sub-ranges than there are threads, nor sub-ranges that
+  // are too small to amortize the cost of handing them to a thread.
+  size_t num_jobs = std::min(ParallelForThreadCount(),
+                             (count + min_range - 1) / min_range);
+  if (num_jobs <= 1) {
+    body(0, count);
+    return;
+  }
+
+  ParallelForBatch batch;
+  batch.body = &body;
+  batch.jobs.resize(num_jobs);
+  batch.unfinished = num_jobs;
+  const size_t range = (count + num_jobs - 1) / num_jobs;
+  size_t begin = 0;
+  for (size_t i = 0; i < num_jobs; ++i) {
+    batch.jobs[i].begin = begin;
+    batch.jobs[i].end = std::min(begin + range, count);
+    begin = batch.jobs[i].end;
+  }
+
+#if defined(FPL_BASE_BACKEND_SDL) || defined(FPL_BASE_BACKEND_STDLIB)
+  WorkerPool::Get().Run(&batch);
+#else
+  for (size_t i = 0; i < num_jobs; ++i) {
+    body(batch.jobs[i].begin, batch.jobs[i].end);
+  }
+#endif
+}
+
+}  // namespace fplbase
@@ -0,0 +1,341 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "fplbase/pixel_buffer_pool.h"
+#include "fplbase/utilities.h"
+
+#ifdef FPL_BASE_BACKEND_STDLIB
+#include <mutex>
+#endif
+
+namespace fplbase {
+
+// Holds the pool's mutex for as long as it lives.
+class PixelBufferPoolLock {
+ public:
+  explicit PixelBufferPoolLock(const PixelBufferPool *pool)
+      : mutex_(pool->mutex_) {
+#ifdef FPL_BASE_BACKEND_SDL
+    auto err = SDL_LockMutex(static_cast<SDL_mutex *>(mutex_));
+    (void)err;
+    assert(err == 0);
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    static_cast<std::mutex *>(mutex_)->lock();
+#else
+#error Need to define FPL_BASE_BACKEND_XXX
+#endif
+  }
+  ~PixelBufferPoolLock() {
+#ifdef FPL_BASE_BACKEND_SDL
+    SDL_UnlockMutex(static_cast<SDL_mutex *>(mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    static_cast<std::mutex *>(mutex_)->unlock();
+#endif
+  }
+
+ private:
+  void *mutex_;
+};
+
+const int PixelBufferPool::kFramesInFlight;
+const uint32_t PixelBufferPool::kIdleFrames;
+const size_t PixelBufferPool::kMinBufferSize;
+
+// Pixel buffer enums, which GL 2 headers lack.
+static const GLenum kGlPixelUnpackBuffer = 0x88EC;
+static const GLbitfield kGlMapWriteBit = 0x0002;
+static const GLbitfield kGlMapInvalidateBufferBit = 0x0008;
+
+#if defined(_WIN32)
+#define FPLBASE_GL_APIENTRY __stdcall
+#else
+#define FPLBASE_GL_APIENTRY
+#endif
+typedef void *(FPLBASE_GL_APIENTRY *MapBufferRangeFunc)(GLenum, GLintptr,
+                                                        GLsizeiptr,
+                                                        GLbitfield);
+typedef GLboolean(FPLBASE_GL_APIENTRY *UnmapBufferFunc)(GLenum);
+
+static void *GetGlFunction(const char *name) {
+#ifdef FPL_BASE_BACKEND_SDL
+  return SDL_GL_GetProcAddress(name);
+#else
+  (void)name;
+  return nullptr;
+#endif
+}
+
+GlPixelBufferBackend::GlPixelBufferBackend()
+    : supported_(false), map_buffer_range_(nullptr), unmap_buffer_(nullptr) {}
+
+void GlPixelBufferBackend::Initialize(bool gl3) {
+  if (!gl3) return;
+  map_buffer_range_ = GetGlFunction("glMapBufferRange");
+  unmap_buffer_ = GetGlFunction("glUnmapBuffer");
+  supported_ = map_buffer_range_ && unmap_buffer_;
+}
+
+unsigned int GlPixelBufferBackend::CreateBuffer(size_t size) {
+  GLuint buffer = 0;
+  GL_CALL(glGenBuffers(1, &buffer));
+  GL_CALL(glBindBuffer(kGlPixelUnpackBuffer, buffer));
+  GL_CALL(glBufferData(kGlPixelUnpackBuffer, static_cast<GLsizeiptr>(size),
+                       nullptr, GL_STREAM_DRAW));
+  GL_CALL(glBindBuffer(kGlPixelUnpackBuffer, 0));
+  return buffer;
+}
+
+void GlPixelBufferBackend::DeleteBuffer(unsigned int buffer) {
+  GL_CALL(glDeleteBuffers(1, &buffer));
+}
+
+void *GlPixelBufferBackend::Map(unsigned int buffer, size_t size) {
+  GL_CALL(glBindBuffer(kGlPixelUnpackBuffer, buffer));
+  void *data = reinterpret_cast<MapBufferRangeFunc>(map_buffer_range_)(
+      kGlPixelUnpackBuffer, 0, static_cast<GLsizeiptr>(size),
+      kGlMapWriteBit | kGlMapInvalidateBufferBit);
+  GL_CALL(glBindBuffer(kGlPixelUnpackBuffer, 0));
+  return data;
+}
+
+bool GlPixelBufferBackend::Unmap(unsigned int buffer) {
+  GL_CALL(glBindBuffer(kGlPixelUnpackBuffer, buffer));
+  const GLboolean ok =
+      reinterpret_cast<UnmapBufferFunc>(unmap_buffer_)(kGlPixelUnpackBuffer);
+  GL_CALL(glBindBuffer(kGlPixelUnpackBuffer, 0));
+  return ok != GL_FALSE;
+}
+
+void GlPixelBufferBackend::Bind(unsigned int buffer) {
+  GL_CALL(glBindBuffer(kGlPixelUnpackBuffer, buffer));
+}
+
+PixelBufferPool::PixelBufferPool(PixelBufferBackend *backend,
+                                 size_t max_bytes)
+    : backend_(backend),
+      max_bytes_(max_bytes),
+      total_bytes_(0),
+      frame_(0),
+      mutex_(nullptr) {
+#ifdef FPL_BASE_BACKEND_SDL
+  mutex_ = SDL_CreateMutex();
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  mutex_ = new std::mutex();
+#endif
+}
+
+PixelBufferPool::~PixelBufferPool() {
+  Reset();
+#ifdef FPL_BASE_BACKEND_SDL
+  SDL_DestroyMutex(static_cast<SDL_mutex *>(mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  delete static_cast<std::mutex *>(mutex_);
+#endif
+}
+
+size_t PixelBufferPool::BufferSize(size_t size) {
+  size_t buffer_size = kMinBufferSize;
+  while (buffer_size < size) buffer_size *= 2;
+  return buffer_size;
+}
+
+int PixelBufferPool::Find(unsigned int id) const {
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    if (buffers_[i].id == id) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+void PixelBufferPool::Delete(size_t index) {
+  const Buffer &buffer = buffers_[index];
+  assert(buffer.state != kAcquired);
+  if (buffer.state != kInFlight) backend_->Unmap(buffer.id);
+  backend_->DeleteBuffer(buffer.id);
+  total_bytes_ -= buffer.size;
+  buffers_.erase(buffers_.begin() + index);
+}
+
+bool PixelBufferPool::MakeRoom(size_t size) {
+  if (size > max_bytes_) return false;
+  while (total_bytes_ + size > max_bytes_) {
+    // Buffers created this frame were wanted just now, so keep those.
+    int oldest = -1;
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+      const Buffer &buffer = buffers_[i];
+      if (buffer.state != kIdle || buffer.last_use == frame_) continue;
+      if (oldest < 0 || buffer.last_use < buffers_[oldest].last_use) {
+        oldest = static_cast<int>(i);
+      }
+    }
+    if (oldest < 0) return false;
+    Delete(oldest);
+  }
+  return true;
+}
+
+bool PixelBufferPool::Acquire(size_t size, Staging *staging) {
+  *staging = Staging();
+  if (!size || !backend_->Supported()) return false;
+  PixelBufferPoolLock lock(this);
+  // Take the smallest idle buffer that fits.
+  int best = -1;
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    const Buffer &buffer = buffers_[i];
+    if (buffer.state != kIdle || buffer.size < size) continue;
+    if (best < 0 || buffer.size < buffers_[best].size) {
+      best = static_cast<int>(i);
+    }
+  }
+  if (best < 0) {
+    const size_t wanted = BufferSize(size);
+    if (wanted <= max_bytes_) wanted_.push_back(wanted);
+    return false;
+  }
+  Buffer &buffer = buffers_[best];
+  buffer.state = kAcquired;
+  buffer.last_use = frame_;
+  staging->buffer = buffer.id;
+  staging->data = buffer.data;
+  staging->size = buffer.size;
+  return true;
+}
+
+void PixelBufferPool::Release(Staging *staging) {
+  if (!staging->buffer) return;
+  PixelBufferPoolLock lock(this);
+  const int index = Find(staging->buffer);
+  if (index >= 0 && buffers_[index].state == kAcquired) {
+    buffers_[index].state = kIdle;
+  } else if (index >= 0 && buffers_[index].state == kOrphaned) {
+    Delete(index);
+  }
+  *staging = Staging();
+}
+
+bool PixelBufferPool::BeginTransfer(const Staging &staging) {
+  PixelBufferPoolLock lock(this);
+  const int index = Find(staging.buffer);
+  if (index < 0 || buffers_[index].state != kAcquired) return false;
+  Buffer &buffer = buffers_[index];
+  buffer.state = kInFlight;
+  buffer.data = nullptr;
+  if (!backend_->Unmap(buffer.id)) {
+    LogError(kError, "PixelBufferPool: staged pixels were lost");
+    return false;
+  }
+  backend_->Bind(buffer.id);
+  return true;
+}
+
+void PixelBufferPool::EndTransfer(Staging *staging) {
+  if (!staging->buffer) return;
+  PixelBufferPoolLock lock(this);
+  const int index = Find(staging->buffer);
+  if (index >= 0 && buffers_[index].state == kOrphaned) {
+    // BeginTransfer() refused it, so it is still mapped and not bound.
+    Delete(index);
+  } else if (index >= 0) {
+    backend_->Bind(0);
+    buffers_[index].last_use = frame_;
+  }
+  *staging = Staging();
+}
+
+void PixelBufferPool::AdvanceFrame() {
+  PixelBufferPoolLock lock(this);
+  frame_++;
+  for (size_t i = 0; i < buffers_.size();) {
+    Buffer &buffer = buffers_[i];
+    const uint32_t age = frame_ - buffer.last_use;
+    if (buffer.state == kInFlight &&
+        age >= static_cast<uint32_t>(kFramesInFlight)) {
+      buffer.data = static_cast<uint8_t *>(
+          backend_->Map(buffer.id, buffer.size));
+      if (buffer.data) {
+        buffer.state = kIdle;
+      } else {
+        Delete(i);
+        continue;
+      }
+    } else if (buffer.state == kIdle && age >= kIdleFrames) {
+      Delete(i);
+      continue;
+    }
+    ++i;
+  }
+  // Shrink to a lowered limit, and make room for what was wanted.
+  MakeRoom(0);
+  for (auto it = wanted_.begin(); it != wanted_.end(); ++it) {
+    if (!MakeRoom(*it)) continue;
+    const unsigned int id = backend_->CreateBuffer(*it);
+    if (!id) continue;
+    auto data = static_cast<uint8_t *>(backend_->Map(id, *it));
+    if (!data) {
+      backend_->DeleteBuffer(id);
+      continue;
+    }
+    Buffer buffer;
+    buffer.id = id;
+    buffer.size = *it;
+    buffer.data = data;
+    buffer.state = kIdle;
+    buffer.last_use = frame_;
+    buffers_.push_back(buffer);
+    total_bytes_ += *it;
+  }
+  wanted_.clear();
+}
+
+void PixelBufferPool::Reset() {
+  PixelBufferPoolLock lock(this);
+  for (size_t i = buffers_.size(); i-- > 0;) {
+    Buffer &buffer = buffers_[i];
+    if (buffer.state == kAcquired) {
+      // Its owner may still be writing to it, so it can't be unmapped yet.
+      LogError(kError, "PixelBufferPool: reset with a buffer still acquired");
+      buffer.state = kOrphaned;
+    } else if (buffer.state != kOrphaned) {
+      Delete(i);
+    }
+  }
+  wanted_.clear();
+}
+
+void PixelBufferPool::set_max_bytes(size_t max_bytes) {
+  PixelBufferPoolLock lock(this);
+  max_bytes_ = max_bytes;
+}
+
+size_t PixelBufferPool::total_bytes() const {
+  PixelBufferPoolLock lock(this);
+  return total_bytes_;
+}
+
+size_t PixelBufferPool::num_buffers() const {
+  PixelBufferPoolLock lock(this);
+  return buffers_.size();
+}
+
+size_t PixelBufferPool::num_idle() const {
+  PixelBufferPoolLock lock(this);
+  size_t idle = 0;
+  for (auto it = buffers_.begin(); it != buffers_.end(); ++it) {
+    if (it->state == kIdle) idle++;
+  }
+  return idle;
+}
+
+}  // namespace fplbase
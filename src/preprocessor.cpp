@@ -12,89 +12,478 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+
 #include "fplbase/preprocessor.h"
-#include <stack>
 #include <unordered_set>
 #include "fplbase/fpl_common.h"
 #include "precompiled.h"
 
+#ifdef FPL_BASE_BACKEND_STDLIB
+#include <mutex>
+#endif
+
 namespace fplbase {
 
-bool LoadFileWithDirectivesHelper(
-    const char *filename, std::string *dest, std::string *error_message,
-    std::set<std::string> *all_includes,
-    const char *const *defines) {
-  if (!LoadFile(filename, dest)) {
-    *error_message = std::string("cannot load ") + filename;
-    return false;
+static const char kDefineMissingIdError[] =
+    "#define must be followed by an identifier.";
+static const char kIfDefMissingIdError[] =
+    "#ifdef and #ifndef must be followed by an identifier.";
+static const char kElifError[] = "#elif can't follow #ifdef or #ifndef.";
+static const char kMissingEndIfError[] =
+    "All #if (#ifdef, #ifndef) statements must have a corresponding #endif "
+    "statement.";
+static const char kUnmatchedError[] =
+    "#elif, #else and #endif must follow an #if (#ifdef, #ifndef) in the same "
+    "file.";
+
+enum ChunkType {
+  kChunkText,
+  kChunkInclude,
+  kChunkDefine,
+  kChunkIfDef,
+  kChunkIfNDef,
+  kChunkIf,
+  kChunkElif,
+  kChunkElse,
+  kChunkEndIf,
+  // Directives passed through to the GLSL compiler, e.g. #version.
+  kChunkOtherDirective,
+};
+
+// A directive line, or a run of other lines.
+struct PreprocessorChunk {
+  ChunkType type;
+  // Range in the file, including the last newline.
+  size_t begin;
+  size_t end;
+  // First line of the chunk, counting from 1.
+  int line;
+  int num_lines;
+  // The identifier or included file, if any.
+  std::string argument;
+  // For #defines: whether there is anything after the identifier.
+  bool has_value;
+};
+
+// A file split into chunks.
+struct Preprocessor::ParsedFile {
+  std::string text;
+  std::vector<PreprocessorChunk> chunks;
+};
+
+// Holds a Preprocessor's cache mutex for as long as it exists.
+class PreprocessorCacheLock {
+ public:
+  explicit PreprocessorCacheLock(const Preprocessor *preprocessor)
+      : mutex_(preprocessor->cache_mutex_) {
+#ifdef FPL_BASE_BACKEND_SDL
+    auto err = SDL_LockMutex(static_cast<SDL_mutex *>(mutex_));
+    (void)err;
+    assert(err == 0);
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    static_cast<std::mutex *>(mutex_)->lock();
+#else
+#error Need to define FPL_BASE_BACKEND_XXX
+#endif
   }
-  all_includes->insert(filename);
-  std::vector<std::string> includes;
-  auto cursor = dest->c_str();
-  static auto kIncludeStatement = "#include";
-  auto include_len = strlen(kIncludeStatement);
-  size_t insertion_point = 0;
-  // Parse only lines that are include statements, skipping everything else.
-  while (*cursor) {
-    cursor += strspn(cursor, " \t");  // Skip whitespace.
-    auto start = cursor;
-    if (strncmp(cursor, kIncludeStatement, include_len) == 0) {
-      cursor += include_len;
-      cursor += strspn(cursor, " \t");  // Skip whitespace.
-      if (*cursor == '\"') {            // Must find quote.
-        cursor++;
-        auto len = strcspn(cursor, "\"\n\r");  // Filename part.
-        if (cursor[len] == '\"') {             // Ending quote.
-          includes.push_back(std::string(cursor, len));
-          cursor += len + 1;
-          insertion_point = start - dest->c_str();
-          dest->erase(insertion_point, cursor - start);
-          cursor = start;
-          cursor += strspn(cursor, "\n\r \t");  // Skip whitespace and newline.
-          continue;
-        }
+  ~PreprocessorCacheLock() {
+#ifdef FPL_BASE_BACKEND_SDL
+    SDL_UnlockMutex(static_cast<SDL_mutex *>(mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    static_cast<std::mutex *>(mutex_)->unlock();
+#endif
+  }
+
+ private:
+  void *mutex_;
+};
+
+// State of a single Process() call.
+struct Preprocessor::State {
+  struct If {
+    // Whether lines in this branch are emitted.
+    bool active;
+    bool parent_active;
+    // Left for the GLSL compiler to evaluate, so all branches are emitted,
+    // along with the directives themselves.
+    bool passthrough;
+  };
+
+  bool active() const { return if_stack.empty() || if_stack.back().active; }
+
+  std::unordered_set<std::string> defines;
+  std::vector<If> if_stack;
+  std::vector<std::string> sources;
+  std::unordered_set<std::string> included;
+  std::string *dest;
+  std::string *error_message;
+};
+
+static bool IsIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static const char *SkipSpaces(const char *p) { return p + strspn(p, " \t"); }
+
+// Identifiers the GLSL compiler defines itself, which only it can evaluate.
+static bool IsPredefined(const std::string &identifier) {
+  return identifier.compare(0, 3, "GL_") == 0 ||
+         identifier.compare(0, 2, "__") == 0;
+}
+
+// Returns the position just past a leading #version line, or 0 if none.
+static size_t VersionLineEnd(const std::string &source) {
+  static auto kVersionStatement = "#version";
+  auto start = strspn(source.c_str(), " \t\n\r");
+  if (source.compare(start, strlen(kVersionStatement), kVersionStatement)) {
+    return 0;
+  }
+  auto end = source.find('\n', start);
+  return end == std::string::npos ? source.length() : end + 1;
+}
+
+// Appends an #if or #elif line to `dest`, with `defined(X)` and `defined X`
+// replaced by 1 for identifiers in `defines`. Those without a value aren't
+// passed on to the GLSL compiler, so it can't evaluate them itself.
+static void AppendIfLine(const char *p, const char *end,
+                         const std::unordered_set<std::string> &defines,
+                         std::string *dest) {
+  while (p < end) {
+    if (!IsIdentifierChar(*p)) {
+      dest->push_back(*p++);
+      continue;
+    }
+    auto word = p;
+    while (p < end && IsIdentifierChar(*p)) p++;
+    if (p - word != 7 || strncmp(word, "defined", 7) != 0) {
+      dest->append(word, p);
+      continue;
+    }
+    auto q = SkipSpaces(p);
+    const bool parenthesized = *q == '(';
+    if (parenthesized) q = SkipSpaces(q + 1);
+    auto identifier = q;
+    while (q < end && IsIdentifierChar(*q)) q++;
+    const std::string name(identifier, q);
+    if (parenthesized) {
+      q = SkipSpaces(q);
+      if (*q != ')') {
+        dest->append(word, p);
+        continue;
       }
+      q++;
     }
-    // Something else, skip it.
-    cursor += strcspn(cursor, "\n\r");  // Skip all except newline;
-    cursor += strspn(cursor, "\n\r");   // Skip newline;
+    if (!name.empty() && !IsPredefined(name) &&
+        defines.find(name) != defines.end()) {
+      dest->push_back('1');
+    } else {
+      dest->append(word, q);
+    }
+    p = q;
+  }
+}
+
+// Classify a line as a directive, or text.
+static ChunkType ParseLine(const char *line, const char *line_end,
+                           std::string *argument, bool *has_value) {
+  auto p = SkipSpaces(line);
+  if (*p != '#') return kChunkText;
+  p = SkipSpaces(p + 1);
+  auto keyword = p;
+  while (IsIdentifierChar(*p)) p++;
+  const std::string directive(keyword, p);
+  p = SkipSpaces(p);
+  if (directive == "include") {
+    // Anything but a quoted file name is left for the GLSL compiler.
+    if (*p != '\"') return kChunkOtherDirective;
+    p++;
+    auto len = strcspn(p, "\"\n\r");
+    if (p[len] != '\"') return kChunkOtherDirective;
+    argument->assign(p, len);
+    return kChunkInclude;
+  }
+  ChunkType type;
+  if (directive == "define") {
+    type = kChunkDefine;
+  } else if (directive == "ifdef") {
+    type = kChunkIfDef;
+  } else if (directive == "ifndef") {
+    type = kChunkIfNDef;
+  } else if (directive == "if") {
+    return kChunkIf;
+  } else if (directive == "elif") {
+    return kChunkElif;
+  } else if (directive == "else") {
+    return kChunkElse;
+  } else if (directive == "endif") {
+    return kChunkEndIf;
+  } else {
+    return kChunkOtherDirective;
   }
-  // Early out for files with no includes.
-  if (!includes.size()) return true;
-
-  // Add the #defines.
-  if (defines) {
-    for (auto defs = defines; *defs; defs++) {
-      auto def = std::string("#define ") + *defs + "\n";
-      dest->insert(insertion_point, def);
-      insertion_point += def.length();
+  auto identifier = p;
+  while (IsIdentifierChar(*p)) p++;
+  argument->assign(identifier, p);
+  p = SkipSpaces(p);
+  *has_value = p < line_end && *p != '\n' && *p != '\r';
+  return type;
+}
+
+static void ParseFile(const std::string &text,
+                      std::vector<PreprocessorChunk> *chunks) {
+  const char *start = text.c_str();
+  size_t pos = 0;
+  for (int line = 1; pos < text.length(); ++line) {
+    auto newline = text.find('\n', pos);
+    const size_t end = newline == std::string::npos ? text.length()
+                                                    : newline + 1;
+    PreprocessorChunk chunk;
+    chunk.has_value = false;
+    chunk.type =
+        ParseLine(start + pos, start + end, &chunk.argument, &chunk.has_value);
+    if (chunk.type == kChunkText && !chunks->empty() &&
+        chunks->back().type == kChunkText) {
+      // Extend the previous run of text.
+      chunks->back().end = end;
+      chunks->back().num_lines++;
+    } else {
+      chunk.begin = pos;
+      chunk.end = end;
+      chunk.line = line;
+      chunk.num_lines = 1;
+      chunks->push_back(chunk);
     }
+    pos = end;
+  }
+}
+
+Preprocessor::Preprocessor() : line_directives_(false) {
+#ifdef FPL_BASE_BACKEND_SDL
+  cache_mutex_ = SDL_CreateMutex();
+  assert(cache_mutex_);
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  cache_mutex_ = new std::mutex();
+#endif
+}
+
+Preprocessor::~Preprocessor() {
+#ifdef FPL_BASE_BACKEND_SDL
+  SDL_DestroyMutex(static_cast<SDL_mutex *>(cache_mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  delete static_cast<std::mutex *>(cache_mutex_);
+#endif
+}
+
+Preprocessor &Preprocessor::Shared() {
+  static Preprocessor preprocessor;
+  return preprocessor;
+}
+
+void Preprocessor::ClearCache() {
+  PreprocessorCacheLock lock(this);
+  cache_.clear();
+}
+
+size_t Preprocessor::cache_size() const {
+  PreprocessorCacheLock lock(this);
+  return cache_.size();
+}
+
+std::shared_ptr<const Preprocessor::ParsedFile> Preprocessor::LoadParsed(
+    const std::string &filename, std::string *error_message) {
+  std::string text;
+  if (!LoadFile(filename.c_str(), &text)) {
+    *error_message = "cannot load " + filename;
+    return nullptr;
   }
-  // Now insert the includes.
-  std::string include;
-  for (auto it = includes.begin(); it != includes.end(); ++it) {
-    if (all_includes->find(*it) == all_includes->end()) {
-      if (!LoadFileWithDirectivesHelper(it->c_str(), &include, error_message,
-                                        all_includes, nullptr)) {
-        return false;
+  {
+    PreprocessorCacheLock lock(this);
+    auto it = cache_.find(filename);
+    if (it != cache_.end() && it->second->text == text) return it->second;
+  }
+  std::shared_ptr<ParsedFile> file(new ParsedFile());
+  file->text.swap(text);
+  ParseFile(file->text, &file->chunks);
+  PreprocessorCacheLock lock(this);
+  cache_[filename] = file;
+  return file;
+}
+
+bool Preprocessor::ProcessFile(const std::string &filename, State *state) {
+  auto file = LoadParsed(filename, state->error_message);
+  if (!file) return false;
+  const std::string source_number = flatbuffers::NumToString(
+      static_cast<int>(state->sources.size()));
+  state->sources.push_back(filename);
+  state->included.insert(filename);
+
+  std::string &dest = *state->dest;
+  std::vector<State::If> &if_stack = state->if_stack;
+  const size_t if_depth = if_stack.size();
+  const char *text = file->text.c_str();
+  for (auto chunk = file->chunks.begin(); chunk != file->chunks.end();
+       ++chunk) {
+    const bool active = state->active();
+    bool emit = false;
+    bool resolve_defined = false;
+    switch (chunk->type) {
+      case kChunkText:
+      case kChunkOtherDirective:
+        emit = active;
+        break;
+      case kChunkInclude:
+        if (active &&
+            state->included.find(chunk->argument) == state->included.end()) {
+          if (line_directives_) {
+            dest += "#line 1 ";
+            dest += flatbuffers::NumToString(
+                static_cast<int>(state->sources.size()));
+            dest += "\n";
+          }
+          if (!ProcessFile(chunk->argument, state)) return false;
+          // Ensure there's a linefeed at eof.
+          if (!dest.empty() && dest.back() != '\n') dest += '\n';
+          if (line_directives_) {
+            dest += "#line ";
+            dest += flatbuffers::NumToString(chunk->line + 1);
+            dest += " " + source_number + "\n";
+          }
+          continue;
+        }
+        break;
+      case kChunkDefine:
+        if (active) {
+          if (chunk->argument.empty()) {
+            *state->error_message = kDefineMissingIdError;
+            return false;
+          }
+          state->defines.insert(chunk->argument);
+          // Only the GLSL compiler can substitute values and arguments.
+          emit = chunk->has_value;
+        }
+        break;
+      case kChunkIfDef:
+      case kChunkIfNDef: {
+        if (chunk->argument.empty()) {
+          *state->error_message = kIfDefMissingIdError;
+          return false;
+        }
+        State::If branch = {active, active, true};
+        if (IsPredefined(chunk->argument)) {
+          emit = active;
+        } else {
+          const bool defined = state->defines.find(chunk->argument) !=
+                               state->defines.end();
+          branch.active = active && defined == (chunk->type == kChunkIfDef);
+          branch.passthrough = false;
+        }
+        if_stack.push_back(branch);
+        break;
       }
-      dest->insert(insertion_point, include);
-      insertion_point += include.length();
-      // Ensure there's a linefeed at eof.
-      if (include.size() && include.back() != '\n') {
-        dest->insert(insertion_point++, "\n");
+      case kChunkIf: {
+        State::If branch = {active, active, true};
+        if_stack.push_back(branch);
+        emit = active;
+        resolve_defined = true;
+        break;
       }
+      case kChunkElif:
+        if (if_stack.size() == if_depth) {
+          *state->error_message = kUnmatchedError;
+          return false;
+        }
+        if (!if_stack.back().passthrough) {
+          *state->error_message = kElifError;
+          return false;
+        }
+        emit = if_stack.back().parent_active;
+        resolve_defined = true;
+        break;
+      case kChunkElse:
+        if (if_stack.size() == if_depth) {
+          *state->error_message = kUnmatchedError;
+          return false;
+        }
+        if (if_stack.back().passthrough) {
+          emit = if_stack.back().parent_active;
+        } else {
+          if_stack.back().active =
+              if_stack.back().parent_active && !if_stack.back().active;
+        }
+        break;
+      case kChunkEndIf:
+        if (if_stack.size() == if_depth) {
+          *state->error_message = kUnmatchedError;
+          return false;
+        }
+        emit = if_stack.back().passthrough && if_stack.back().parent_active;
+        if_stack.pop_back();
+        break;
     }
+    if (emit && resolve_defined) {
+      AppendIfLine(text + chunk->begin, text + chunk->end, state->defines,
+                   &dest);
+    } else if (emit) {
+      dest.append(text + chunk->begin, chunk->end - chunk->begin);
+    } else if (line_directives_) {
+      // Keep the lines that follow at the same line number.
+      dest.append(static_cast<size_t>(chunk->num_lines), '\n');
+    }
+  }
+  if (if_stack.size() > if_depth) {
+    *state->error_message = kMissingEndIfError;
+    return false;
   }
   return true;
 }
 
+bool Preprocessor::Process(const char *filename, const char *const *defines,
+                           std::string *dest, std::string *error_message,
+                           std::vector<std::string> *sources) {
+  State state;
+  state.dest = dest;
+  state.error_message = error_message;
+  // Defines with a value, e.g. "NUM_LIGHTS 4", are also needed by the GLSL
+  // compiler, so are written out after any #version line.
+  std::string value_defines;
+  for (auto def = defines; def && *def; ++def) {
+    auto p = *def;
+    while (IsIdentifierChar(*p)) p++;
+    state.defines.insert(std::string(*def, p));
+    if (*SkipSpaces(p)) value_defines += std::string("#define ") + *def + "\n";
+  }
+  dest->clear();
+  const bool ok = ProcessFile(filename, &state);
+  if (ok && !value_defines.empty()) {
+    const size_t version_end = VersionLineEnd(*dest);
+    if (line_directives_) {
+      // Continue numbering where the inserted lines interrupted it.
+      const int next_line = version_end ? 2 : 1;
+      value_defines +=
+          "#line " + flatbuffers::NumToString(next_line) + " 0\n";
+    }
+    dest->insert(version_end, value_defines);
+  }
+  if (sources) sources->swap(state.sources);
+  return ok;
+}
+
+bool LoadFileWithDirectives(const char *filename, std::string *dest,
+                            const char *const *defines,
+                            std::set<std::string> *files,
+                            std::string *error_message) {
+  std::vector<std::string> sources;
+  const bool ok = Preprocessor::Shared().Process(filename, defines, dest,
+                                                 error_message, &sources);
+  files->clear();
+  files->insert(sources.begin(), sources.end());
+  return ok;
+}
+
 bool LoadFileWithDirectives(const char *filename, std::string *dest,
                             const char *const *defines,
                             std::string *error_message) {
-  std::set<std::string> all_includes;
-  return LoadFileWithDirectivesHelper(filename, dest, error_message,
-                                      &all_includes, defines);
+  return Preprocessor::Shared().Process(filename, defines, dest,
+                                        error_message);
 }
 
 bool LoadFileWithDirectives(const char *filename, std::string *dest,
@@ -0,0 +1,340 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/profiler.h"
+#include "fplbase/utilities.h"
+#include "json_utilities.h"
+
+#include <atomic>
+#include <chrono>
+
+#ifdef FPL_BASE_BACKEND_STDLIB
+#include <mutex>
+#endif
+
+namespace fplbase {
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Each thread records into chunks of events that it allocates as needed, so
+// recording never takes a lock and never moves events a reader may be
+// copying.
+const size_t kEventsPerChunk = 4096;
+const size_t kMaxChunks = 256;
+
+struct ThreadBuffer {
+  explicit ThreadBuffer(int index)
+      : thread_index(index), generation(0), count(0) {
+    for (size_t i = 0; i < kMaxChunks; ++i) chunks[i].store(nullptr);
+  }
+
+  int thread_index;
+  // Guarded by Registry::mutex.
+  std::string thread_name;
+  // The value of Registry::generation when this buffer was last reset.
+  std::atomic<uint32_t> generation;
+  // Number of events recorded. Only the owning thread writes this.
+  std::atomic<size_t> count;
+  std::atomic<ProfileEvent *> chunks[kMaxChunks];
+};
+
+struct Registry {
+  Registry() : enabled(false), generation(0), dropped(0) {
+    epoch = Clock::now();
+#ifdef FPL_BASE_BACKEND_SDL
+    mutex = SDL_CreateMutex();
+    thread_buffer = SDL_TLSCreate();
+    assert(mutex && thread_buffer);
+#endif
+  }
+
+  void Lock(const std::function<void()> &body) {
+#ifdef FPL_BASE_BACKEND_SDL
+    auto err = SDL_LockMutex(mutex);
+    (void)err;
+    assert(err == 0);
+    body();
+    SDL_UnlockMutex(mutex);
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    std::lock_guard<std::mutex> lock(mutex);
+    body();
+#endif
+  }
+
+  std::atomic<bool> enabled;
+  // Incremented by ProfilerClear(). Each thread empties its own buffer when
+  // it notices.
+  std::atomic<uint32_t> generation;
+  std::atomic<uint64_t> dropped;
+  Clock::time_point epoch;
+
+  // Guards the members below. Only taken when a thread first records, when
+  // naming, and when collecting.
+#ifdef FPL_BASE_BACKEND_SDL
+  SDL_mutex *mutex;
+  // The calling thread's ThreadBuffer.
+  SDL_TLSID thread_buffer;
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  std::mutex mutex;
+#else
+#error Need to define FPL_BASE_BACKEND_XXX
+#endif
+  std::vector<ThreadBuffer *> threads;
+  // Buffers of threads that have exited, for reuse by new threads.
+  std::vector<ThreadBuffer *> free_threads;
+  std::set<std::string> names;
+};
+
+// Threads may still record while static objects are destroyed, so the
+// registry and the buffers are never freed. Instead, the buffer of a thread
+// that exits is handed to the next new thread.
+Registry &GetRegistry() {
+  static Registry *registry = new Registry();
+  return *registry;
+}
+
+// Called as a thread exits. Its events stay collectable until its buffer is
+// reused.
+void ReleaseThreadBuffer(void *data) {
+  ThreadBuffer *buffer = static_cast<ThreadBuffer *>(data);
+  Registry &registry = GetRegistry();
+  registry.Lock([&registry, buffer]() {
+    registry.free_threads.push_back(buffer);
+  });
+}
+
+#ifdef FPL_BASE_BACKEND_STDLIB
+// Releases the calling thread's buffer when the thread exits.
+struct ThreadBufferOwner {
+  ThreadBufferOwner() : buffer(nullptr) {}
+  ~ThreadBufferOwner() {
+    if (buffer) ReleaseThreadBuffer(buffer);
+  }
+  ThreadBuffer *buffer;
+};
+thread_local ThreadBufferOwner current_thread_buffer;
+#endif
+
+// Take a buffer from a thread that has exited, or make a new one.
+// Buffers still holding events since the last ProfilerClear() are passed
+// over, so no recorded events are lost. Call with the registry locked.
+ThreadBuffer *AcquireThreadBufferLocked(Registry *registry) {
+  const uint32_t generation = registry->generation.load();
+  for (auto it = registry->free_threads.begin();
+       it != registry->free_threads.end(); ++it) {
+    ThreadBuffer *buffer = *it;
+    if (buffer->generation.load() == generation && buffer->count.load()) {
+      continue;
+    }
+    registry->free_threads.erase(it);
+    buffer->thread_name.clear();
+    buffer->count.store(0);
+    buffer->generation.store(generation);
+    return buffer;
+  }
+  ThreadBuffer *buffer =
+      new ThreadBuffer(static_cast<int>(registry->threads.size()));
+  buffer->generation.store(generation);
+  registry->threads.push_back(buffer);
+  return buffer;
+}
+
+ThreadBuffer *CurrentThreadBuffer() {
+  Registry &registry = GetRegistry();
+#ifdef FPL_BASE_BACKEND_SDL
+  ThreadBuffer *buffer =
+      static_cast<ThreadBuffer *>(SDL_TLSGet(registry.thread_buffer));
+#else
+  ThreadBuffer *buffer = current_thread_buffer.buffer;
+#endif
+  if (!buffer) {
+    registry.Lock([&registry, &buffer]() {
+      buffer = AcquireThreadBufferLocked(&registry);
+    });
+#ifdef FPL_BASE_BACKEND_SDL
+    SDL_TLSSet(registry.thread_buffer, buffer, ReleaseThreadBuffer);
+#else
+    current_thread_buffer.buffer = buffer;
+#endif
+  }
+  return buffer;
+}
+
+void Record(ProfileEventType type, const char *name, int64_t value) {
+  Registry &registry = GetRegistry();
+  if (!registry.enabled.load(std::memory_order_relaxed)) return;
+  const Clock::time_point now = Clock::now();
+
+  ThreadBuffer *buffer = CurrentThreadBuffer();
+  const uint32_t generation =
+      registry.generation.load(std::memory_order_acquire);
+  if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+    buffer->count.store(0, std::memory_order_release);
+    buffer->generation.store(generation, std::memory_order_release);
+  }
+
+  const size_t index = buffer->count.load(std::memory_order_relaxed);
+  const size_t chunk = index / kEventsPerChunk;
+  if (chunk >= kMaxChunks) {
+    registry.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ProfileEvent *events = buffer->chunks[chunk].load(std::memory_order_relaxed);
+  if (!events) {
+    events = new ProfileEvent[kEventsPerChunk];
+    buffer->chunks[chunk].store(events, std::memory_order_release);
+  }
+  ProfileEvent &event = events[index % kEventsPerChunk];
+  event.time = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now -
+                                                           registry.epoch)
+          .count());
+  event.name = name;
+  event.value = value;
+  event.type = type;
+  buffer->count.store(index + 1, std::memory_order_release);
+}
+
+}  // namespace
+
+void ProfilerEnable(bool enable) { GetRegistry().enabled.store(enable); }
+
+bool ProfilerEnabled() { return GetRegistry().enabled.load(); }
+
+void ProfileBegin(const char *name) { Record(kProfileZoneBegin, name, 0); }
+
+void ProfileEnd() { Record(kProfileZoneEnd, "", 0); }
+
+void ProfileCounter(const char *name, int64_t value) {
+  Record(kProfileCounter, name, value);
+}
+
+void ProfileAsyncBegin(const char *name, int32_t cookie) {
+  Record(kProfileAsyncBegin, name, cookie);
+}
+
+void ProfileAsyncEnd(const char *name, int32_t cookie) {
+  Record(kProfileAsyncEnd, name, cookie);
+}
+
+void ProfileSetThreadName(const char *name) {
+  ThreadBuffer *buffer = CurrentThreadBuffer();
+  GetRegistry().Lock([buffer, name]() { buffer->thread_name = name; });
+}
+
+const char *ProfileInternName(const std::string &name) {
+  Registry &registry = GetRegistry();
+  const char *interned = nullptr;
+  registry.Lock([&registry, &name, &interned]() {
+    interned = registry.names.insert(name).first->c_str();
+  });
+  return interned;
+}
+
+void ProfilerCollect(std::vector<ProfileThreadEvents> *threads) {
+  Registry &registry = GetRegistry();
+  registry.Lock([&registry, threads]() {
+    const uint32_t generation = registry.generation.load();
+    threads->clear();
+    for (auto it = registry.threads.begin(); it != registry.threads.end();
+         ++it) {
+      const ThreadBuffer &buffer = **it;
+      threads->push_back(ProfileThreadEvents());
+      ProfileThreadEvents &thread = threads->back();
+      thread.thread_index = buffer.thread_index;
+      thread.thread_name = buffer.thread_name;
+      // A buffer from before the last ProfilerClear() counts as empty.
+      if (buffer.generation.load(std::memory_order_acquire) != generation) {
+        continue;
+      }
+      const size_t count = buffer.count.load(std::memory_order_acquire);
+      thread.events.reserve(count);
+      for (size_t i = 0; i < count; i += kEventsPerChunk) {
+        const size_t chunk = i / kEventsPerChunk;
+        const ProfileEvent *events =
+            buffer.chunks[chunk].load(std::memory_order_acquire);
+        thread.events.insert(thread.events.end(), events,
+                             events + std::min(kEventsPerChunk, count - i));
+      }
+    }
+  });
+}
+
+void ProfilerClear() {
+  Registry &registry = GetRegistry();
+  registry.generation.fetch_add(1);
+  registry.dropped.store(0);
+}
+
+uint64_t ProfilerDroppedEvents() { return GetRegistry().dropped.load(); }
+
+std::string ProfilerChromeTraceJson(
+    const std::vector<ProfileThreadEvents> &threads) {
+  std::string json = "{\"traceEvents\":[";
+  bool first = true;
+  char buf[128];
+  for (auto thread = threads.begin(); thread != threads.end(); ++thread) {
+    if (!thread->thread_name.empty()) {
+      snprintf(buf, sizeof(buf),
+               "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\","
+               "\"args\":{\"name\":",
+               first ? "" : ",", thread->thread_index);
+      json += buf;
+      AppendJsonString(thread->thread_name, &json);
+      json += "}}";
+      first = false;
+    }
+    for (auto event = thread->events.begin(); event != thread->events.end();
+         ++event) {
+      static const char *kPhases[] = {"B", "E", "C", "b", "e"};
+      snprintf(buf, sizeof(buf),
+               "%s\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+               first ? "" : ",", kPhases[event->type], thread->thread_index,
+               event->time / 1000.0);
+      json += buf;
+      first = false;
+      if (event->type != kProfileZoneEnd) {
+        json += ",\"name\":";
+        AppendJsonString(event->name, &json);
+      }
+      if (event->type == kProfileCounter) {
+        snprintf(buf, sizeof(buf), ",\"args\":{\"value\":%lld}",
+                 static_cast<long long>(event->value));
+        json += buf;
+      } else if (event->type == kProfileAsyncBegin ||
+                 event->type == kProfileAsyncEnd) {
+        snprintf(buf, sizeof(buf), ",\"cat\":\"fplbase\",\"id\":%lld",
+                 static_cast<long long>(event->value));
+        json += buf;
+      }
+      json += "}";
+    }
+  }
+  json += "\n]}\n";
+  return json;
+}
+
+bool ProfilerSaveChromeTrace(const char *filename) {
+  std::vector<ProfileThreadEvents> threads;
+  ProfilerCollect(&threads);
+  if (!SaveFile(filename, ProfilerChromeTraceJson(threads))) {
+    LogError(kApplication, "Couldn't save profile to %s", filename);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace fplbase
@@ -88,6 +88,7 @@ void RenderTarget::Initialize(mathfu::vec2i dimensions, GLenum format,
   GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
   GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
   GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+  Renderer::Get()->InvalidateTextureBindings();
 
   initialized_ = true;
 }
@@ -97,6 +98,7 @@ void RenderTarget::Delete() {
     GL_CALL(glDeleteFramebuffers(1, &framebuffer_id_));
     GL_CALL(glDeleteRenderbuffers(1, &depth_buffer_id_));
     GL_CALL(glDeleteTextures(1, &rendered_texture_id_));
+    Renderer::Get()->InvalidateTextureBindings();
     initialized_ = false;
   }
 }
@@ -106,14 +108,16 @@ void RenderTarget::Delete() {
 void RenderTarget::SetAsRenderTarget() const {
   // Calling SetAsRenderTarget on uninitialized rendertargets is bad.
   assert(initialized_);
+  Renderer::Get()->gpu_timer().BeginPass(framebuffer_id_ ? "RenderTarget"
+                                                         : "Screen");
   GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id_));
   GL_CALL(glViewport(0, 0, dimensions_.x(), dimensions_.y()));
 }
 
 void RenderTarget::BindAsTexture(int texture_number) const {
   assert(initialized_);
-  GL_CALL(glActiveTexture(GL_TEXTURE0 + texture_number));
-  GL_CALL(glBindTexture(GL_TEXTURE_2D, rendered_texture_id_));
+  Renderer::Get()->BindTexture(static_cast<size_t>(texture_number),
+                               GL_TEXTURE_2D, rendered_texture_id_);
 }
 
 // Generates a render target that represents the screen.
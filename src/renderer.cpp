@@ -29,6 +29,14 @@ namespace fplbase {
 
 Renderer *Renderer::the_renderer_ = nullptr;
 
+// Sizes of the transient geometry buffers. Each holds this many bytes before
+// it has to orphan and start over.
+static const size_t kStreamingVertexBufferSize = 1024 * 1024;
+static const size_t kStreamingIndexBufferSize = 256 * 1024;
+
+// Most memory the pixel buffers textures are staged in may take together.
+static const size_t kPixelBufferPoolSize = 16 * 1024 * 1024;
+
 #define LOOKUP_GL_FUNCTION(type, name, lookup_fn)                  \
   union {                                                          \
     void *data;                                                    \
@@ -55,9 +63,18 @@ Renderer::Renderer()
       force_shader_(nullptr),
       force_blend_mode_(kBlendModeCount),
       max_vertex_uniform_components_(0),
+      texture_layer_(-1),
+      streaming_vertex_backend_(StreamingBuffer::kVertexBuffer),
+      streaming_index_backend_(StreamingBuffer::kIndexBuffer),
+      streaming_vertices_(&streaming_vertex_backend_,
+                          kStreamingVertexBufferSize),
+      streaming_indices_(&streaming_index_backend_, kStreamingIndexBufferSize),
+      gpu_timer_(&gpu_timer_backend_),
+      pixel_buffer_pool_(&pixel_buffer_backend_, kPixelBufferPoolSize),
       version_(&Version()) {
   assert(!the_renderer_);
   the_renderer_ = this;
+  InvalidateTextureBindings();
 }
 
 #ifndef FPL_BASE_RENDERER_BACKEND_SDL
@@ -205,12 +222,22 @@ void Renderer::EndRendering(RenderContext *) {}
 
 void Renderer::AdvanceFrame(bool minimized, double time) {
   time_ = time;
+  frame_stats_.EndPhase(kFramePhaseCpu);
   if (minimized) {
     // Save some cpu / battery:
     SDL_Delay(10);
   } else {
+    frame_stats_.BeginPhase(kFramePhaseSwap);
     SDL_GL_SwapWindow(static_cast<SDL_Window *>(window_));
+    frame_stats_.EndPhase(kFramePhaseSwap);
+    AdvanceStreamingBuffers();
+    gpu_timer_.AdvanceFrame();
   }
+  // Other code may have bound textures during the frame.
+  InvalidateTextureBindings();
+  texture_layer_ = -1;
+  frame_stats_.EndFrame();
+  frame_stats_.BeginPhase(kFramePhaseCpu);
   // Get window size again, just in case it has changed.
   SDL_GetWindowSize(static_cast<SDL_Window *>(window_), &window_size_.x(),
                     &window_size_.y());
@@ -221,6 +248,14 @@ void Renderer::AdvanceFrame(bool minimized, double time) {
 }
 
 void Renderer::ShutDown() {
+  // The streaming buffers, pixel buffers and timer queries belong to the
+  // context, so free them first.
+  streaming_vertices_.Reset();
+  streaming_indices_.Reset();
+  pixel_buffer_pool_.Reset();
+  gpu_timer_.Reset();
+  InvalidateTextureBindings();
+  texture_layer_ = -1;
   if (context_) {
     SDL_GL_DeleteContext(context_);
     context_ = nullptr;
@@ -240,6 +275,12 @@ bool Renderer::SupportsTextureFormat(TextureFormat texture_format) const {
 
 bool Renderer::SupportsTextureNpot() const { return supports_texture_npot_; }
 
+void Renderer::AdvanceStreamingBuffers() {
+  streaming_vertices_.AdvanceFrame();
+  streaming_indices_.AdvanceFrame();
+  pixel_buffer_pool_.AdvanceFrame();
+}
+
 bool Renderer::InitializeRenderingState() {
   auto exts = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
 
@@ -291,6 +332,8 @@ bool Renderer::InitializeRenderingState() {
   }
 #endif  // defined(GL_MAX_VERTEX_UNIFORM_VECTORS)
 
+  gpu_timer_backend_.Initialize();
+  pixel_buffer_backend_.Initialize(feature_level_ >= kFeatureLevel30);
   return true;
 }
 
@@ -362,6 +405,12 @@ Shader *Renderer::CompileAndLinkShaderHelper(const char *vs_source,
                                    "aBoneIndices"));
       GL_CALL(glBindAttribLocation(program, Mesh::kAttributeBoneWeights,
                                    "aBoneWeights"));
+      // OpenGL ES 2.0 only guarantees 8 attributes, one less than this
+      // needs, and has no texture arrays to use it with.
+      if (feature_level_ >= kFeatureLevel30) {
+        GL_CALL(glBindAttribLocation(program, Mesh::kAttributeTextureLayer,
+                                     "aTextureLayer"));
+      }
       GL_CALL(glLinkProgram(program));
       GLint status;
       GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
@@ -395,9 +444,9 @@ Shader *Renderer::CompileAndLinkShader(const char *vs_source,
   return CompileAndLinkShaderHelper(vs_source, ps_source, nullptr);
 }
 
-void Renderer::RecompileShader(const char *vs_source, const char *ps_source,
+bool Renderer::RecompileShader(const char *vs_source, const char *ps_source,
                                Shader *shader) {
-  shader = CompileAndLinkShaderHelper(vs_source, ps_source, shader);
+  return CompileAndLinkShaderHelper(vs_source, ps_source, shader) != nullptr;
 }
 
 void Renderer::DepthTest(bool on, RenderContext *render_context) {
@@ -528,6 +577,32 @@ void Renderer::ScissorOn(const vec2i &pos, const vec2i &size, RenderContext *) {
 
 void Renderer::ScissorOff(RenderContext *) { glDisable(GL_SCISSOR_TEST); }
 
+void Renderer::BindTexture(size_t unit, TextureTarget target,
+                           TextureHandle texture) {
+  assert(unit < static_cast<size_t>(kMaxTexturesPerShader));
+  // Callers may go on to update the texture, which needs its unit active
+  // even when it was bound already.
+  if (unit != active_texture_unit_) {
+    GL_CALL(glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit)));
+    active_texture_unit_ = unit;
+  }
+  if (texture && bound_textures_[unit] == texture) return;
+  GL_CALL(glBindTexture(target, texture));
+  bound_textures_[unit] = texture;
+}
+
+void Renderer::InvalidateTextureBindings() {
+  active_texture_unit_ = kMaxTexturesPerShader;
+  for (int i = 0; i < kMaxTexturesPerShader; i++) bound_textures_[i] = 0;
+}
+
+void Renderer::SetTextureLayer(int layer) {
+  if (feature_level_ < kFeatureLevel30 || layer == texture_layer_) return;
+  GL_CALL(glVertexAttrib1f(Mesh::kAttributeTextureLayer,
+                           static_cast<float>(layer)));
+  texture_layer_ = layer;
+}
+
 }  // namespace fplbase
 
 #ifndef GL_INVALID_FRAMEBUFFER_OPERATION
@@ -58,6 +58,7 @@ void InitializeUndistortFramebuffer(int width, int height) {
                                     g_undistort_renderbuffer_id));
 
   GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+  Renderer::Get()->InvalidateTextureBindings();
 }
 
 void BeginUndistortFramebuffer() {
@@ -93,6 +94,7 @@ void HeadMountedDisplayRenderStart(
     const HeadMountedDisplayInput& head_mounted_display_input,
     Renderer* renderer, const mathfu::vec4& clear_color, bool use_undistortion,
     HeadMountedDisplayViewSettings* view_settings) {
+  renderer->gpu_timer().BeginPass("HMD eyes");
   if (use_undistortion) BeginUndistortFramebuffer();
   renderer->ClearFrameBuffer(clear_color);
   renderer->set_color(mathfu::kOnes4f);
@@ -118,9 +120,11 @@ void HeadMountedDisplayRenderEnd(Renderer* renderer, bool use_undistortion) {
   // Reset the screen, and finish
   GL_CALL(glViewport(0, 0, viewport_size.x(), viewport_size.y()));
   if (use_undistortion) {
+    renderer->gpu_timer().BeginPass("HMD undistortion");
     FinishUndistortFramebuffer();
     renderer->SetBlendMode(kBlendModeOff);
   }
+  renderer->gpu_timer().EndPass();
 }
 
 #endif  // ANDROID_HMD
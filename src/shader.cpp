@@ -69,6 +69,15 @@ void Shader::InitializeUniforms() {
   // orientation of the i'th bone.
   uniform_bone_transforms_ = glGetUniformLocation(program_, "bone_transforms");
 
+  // Per-eye arrays, for drawing both eyes of a stereo view in one call.
+  uniform_stereo_model_view_projection_ =
+      glGetUniformLocation(program_, "stereo_model_view_projection");
+  uniform_stereo_camera_pos_ =
+      glGetUniformLocation(program_, "stereo_camera_pos");
+  uniform_stereo_viewport_transform_ =
+      glGetUniformLocation(program_, "stereo_viewport_transform");
+  uniform_stereo_viewport_ = glGetUniformLocation(program_, "stereo_viewport");
+
   // Set up the uniforms the shader uses for texture access.
   char texture_unit_name[] = "texture_unit_#####";
   for (int i = 0; i < kMaxTexturesPerShader; i++) {
@@ -80,33 +89,64 @@ void Shader::InitializeUniforms() {
 }
 
 void Shader::Set(const Renderer &renderer) const {
+  Set(renderer, renderer.default_render_context());
+}
+
+void Shader::Set(const Renderer &renderer,
+                 RenderContext *render_context) const {
   const int kNumVec4InBoneTransform = 3;
 
   GL_CALL(glUseProgram(program_));
 
   if (uniform_model_view_projection_ >= 0)
-    GL_CALL(glUniformMatrix4fv(uniform_model_view_projection_, 1, false,
-                               &renderer.model_view_projection()[0]));
+    GL_CALL(glUniformMatrix4fv(
+        uniform_model_view_projection_, 1, false,
+        &renderer.model_view_projection(render_context)[0]));
   if (uniform_model_ >= 0)
-    GL_CALL(glUniformMatrix4fv(uniform_model_, 1, false, &renderer.model()[0]));
+    GL_CALL(glUniformMatrix4fv(uniform_model_, 1, false,
+                               &renderer.model(render_context)[0]));
   if (uniform_color_ >= 0)
-    GL_CALL(glUniform4fv(uniform_color_, 1, &renderer.color()[0]));
+    GL_CALL(glUniform4fv(uniform_color_, 1,
+                         &renderer.color(render_context)[0]));
   if (uniform_light_pos_ >= 0)
-    GL_CALL(glUniform3fv(uniform_light_pos_, 1, &renderer.light_pos()[0]));
+    GL_CALL(glUniform3fv(uniform_light_pos_, 1,
+                         &renderer.light_pos(render_context)[0]));
   if (uniform_camera_pos_ >= 0)
-    GL_CALL(glUniform3fv(uniform_camera_pos_, 1, &renderer.camera_pos()[0]));
+    GL_CALL(glUniform3fv(uniform_camera_pos_, 1,
+                         &renderer.camera_pos(render_context)[0]));
   if (uniform_time_ >= 0)
     GL_CALL(glUniform1f(uniform_time_, static_cast<float>(renderer.time())));
-  if (uniform_bone_transforms_ >= 0 && renderer.num_bones() > 0) {
-    assert(renderer.bone_transforms() != nullptr);
-
-    const mathfu::AffineTransform *bone_transforms = renderer.bone_transforms();
+  const int num_bones = renderer.num_bones(render_context);
+  if (uniform_bone_transforms_ >= 0 && num_bones > 0) {
+    const mathfu::AffineTransform *bone_transforms =
+        renderer.bone_transforms(render_context);
+    assert(bone_transforms != nullptr);
 
     GL_CALL(glUniform4fv(uniform_bone_transforms_,
-                         renderer.num_bones() * kNumVec4InBoneTransform,
+                         num_bones * kNumVec4InBoneTransform,
                          &bone_transforms[0][0]));
   }
 }
 
+void Shader::SetStereoUniforms(const mathfu::mat4 *mvp,
+                               const mathfu::vec3 *camera_position,
+                               const mathfu::vec4 *viewport_transform,
+                               const mathfu::vec4 *viewport) const {
+  if (!SupportsInstancedStereo()) return;
+
+  GL_CALL(glUniformMatrix4fv(uniform_stereo_model_view_projection_, 2, false,
+                             &mvp[0][0]));
+  GL_CALL(glUniform4fv(uniform_stereo_viewport_transform_, 2,
+                       &viewport_transform[0][0]));
+  GL_CALL(glUniform4fv(uniform_stereo_viewport_, 2, &viewport[0][0]));
+  if (uniform_stereo_camera_pos_ >= 0) {
+    // vec3 may be padded to 16 bytes, so pack the array tightly.
+    const float camera_pos[] = {
+        camera_position[0].x(), camera_position[0].y(), camera_position[0].z(),
+        camera_position[1].x(), camera_position[1].y(), camera_position[1].z()};
+    GL_CALL(glUniform3fv(uniform_stereo_camera_pos_, 2, camera_pos));
+  }
+}
+
 }  // namespace fplbase
 
@@ -0,0 +1,186 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "fplbase/shader_permutations.h"
+
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "shader_generated.h"
+
+namespace fplbase {
+
+static bool IsIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+void FindShaderFeatures(const char *source,
+                        std::vector<std::string> *features) {
+  static const char kPragma[] = "#pragma";
+  static const char kFeatures[] = "fpl_features";
+  for (auto cursor = source; *cursor;) {
+    cursor += strspn(cursor, " \t");
+    if (strncmp(cursor, kPragma, sizeof(kPragma) - 1) == 0) {
+      auto p = cursor + sizeof(kPragma) - 1;
+      p += strspn(p, " \t");
+      if (strncmp(p, kFeatures, sizeof(kFeatures) - 1) == 0 &&
+          !IsIdentifierChar(p[sizeof(kFeatures) - 1])) {
+        p += sizeof(kFeatures) - 1;
+        for (;;) {
+          p += strspn(p, " \t");
+          auto start = p;
+          while (IsIdentifierChar(*p)) p++;
+          if (p == start) break;
+          const std::string feature(start, p);
+          if (std::find(features->begin(), features->end(), feature) ==
+              features->end()) {
+            features->push_back(feature);
+          }
+        }
+      }
+    }
+    cursor += strcspn(cursor, "\n\r");  // Skip the rest of the line.
+    cursor += strspn(cursor, "\n\r");   // Skip newline.
+  }
+}
+
+ShaderPermutations::ShaderPermutations(Renderer &renderer)
+    : renderer_(renderer), num_compiled_(0) {}
+
+ShaderPermutations::~ShaderPermutations() {
+  for (auto it = variants_.begin(); it != variants_.end(); ++it) {
+    delete *it;
+  }
+}
+
+bool ShaderPermutations::Init(std::string *shader_file) {
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t *>(shader_file->c_str()),
+      shader_file->length());
+  if (!shaderdef::VerifyShaderBuffer(verifier)) {
+    LogError(kError, "Not a shader file.");
+    return false;
+  }
+  auto shaderdef = shaderdef::GetShader(shader_file->c_str());
+  const int num_features =
+      shaderdef->features() ? static_cast<int>(shaderdef->features()->size())
+                            : 0;
+  if (num_features > kMaxShaderFeatures) {
+    LogError(kError, "Shader has %d features, the most allowed is %d.",
+             num_features, kMaxShaderFeatures);
+    return false;
+  }
+  const size_t num_variants = static_cast<size_t>(1) << num_features;
+  const size_t num_stored =
+      shaderdef->variants() ? shaderdef->variants()->size() : 0;
+  if (num_stored != (num_features ? num_variants : 0)) {
+    LogError(kError, "Shader has %d variants, but %d features.",
+             static_cast<int>(num_stored), num_features);
+    return false;
+  }
+  features_.clear();
+  for (int i = 0; i < num_features; ++i) {
+    features_.push_back(shaderdef->features()
+                            ->Get(static_cast<flatbuffers::uoffset_t>(i))
+                            ->str());
+  }
+  variants_.assign(num_variants, nullptr);
+  states_.assign(num_variants, kVariantNotCompiled);
+  shader_file_.swap(*shader_file);
+  return true;
+}
+
+uint32_t ShaderPermutations::FeatureBit(const char *feature) const {
+  for (size_t i = 0; i < features_.size(); ++i) {
+    if (features_[i] == feature) return 1u << i;
+  }
+  return 0;
+}
+
+uint32_t ShaderPermutations::FeatureMask(const char *const *features) const {
+  uint32_t mask = 0;
+  for (auto feature = features; feature && *feature; ++feature) {
+    mask |= FeatureBit(*feature);
+  }
+  return mask;
+}
+
+Shader *ShaderPermutations::Variant(uint32_t feature_mask) {
+  assert(feature_mask < num_variants());
+  switch (states_[feature_mask]) {
+    case kVariantCompiled:
+      return variants_[feature_mask];
+    case kVariantFailed:
+      return nullptr;
+    case kVariantNotCompiled:
+      break;
+  }
+  auto shaderdef = shaderdef::GetShader(shader_file_.c_str());
+  auto vertex_shader = shaderdef->vertex_shader();
+  auto fragment_shader = shaderdef->fragment_shader();
+  if (shaderdef->variants()) {
+    auto variant = shaderdef->variants()->Get(feature_mask);
+    assert(variant->feature_mask() == feature_mask);
+    vertex_shader = variant->vertex_shader();
+    fragment_shader = variant->fragment_shader();
+  }
+  Shader *shader = nullptr;
+  if (vertex_shader && fragment_shader) {
+    shader = renderer_.CompileAndLinkShader(vertex_shader->c_str(),
+                                            fragment_shader->c_str());
+  } else {
+    renderer_.set_last_error("Shader variant has no source.");
+  }
+  if (!shader) {
+    std::string features;
+    for (size_t i = 0; i < features_.size(); ++i) {
+      if (feature_mask & (1u << i)) features += " " + features_[i];
+    }
+    LogError(kError, "Shader variant with features:%s failed: %s",
+             features.c_str(), renderer_.last_error().c_str());
+    states_[feature_mask] = kVariantFailed;
+    return nullptr;
+  }
+  variants_[feature_mask] = shader;
+  states_[feature_mask] = kVariantCompiled;
+  num_compiled_++;
+  return shader;
+}
+
+void ShaderPermutations::Prewarm(uint32_t feature_mask) {
+  assert(feature_mask < num_variants());
+  if (states_[feature_mask] == kVariantNotCompiled) {
+    prewarm_queue_.push_back(feature_mask);
+  }
+}
+
+void ShaderPermutations::PrewarmAll() {
+  for (uint32_t mask = 0; mask < num_variants(); ++mask) Prewarm(mask);
+}
+
+bool ShaderPermutations::CompileNextPrewarm() {
+  // Skip variants that were used, and so compiled, since being queued.
+  while (!prewarm_queue_.empty()) {
+    const uint32_t mask = prewarm_queue_.front();
+    prewarm_queue_.pop_front();
+    if (states_[mask] == kVariantNotCompiled) {
+      Variant(mask);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace fplbase
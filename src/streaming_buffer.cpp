@@ -0,0 +1,109 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/streaming_buffer.h"
+
+namespace fplbase {
+
+const size_t StreamingBuffer::kAlignment;
+
+StreamingBuffer::StreamingBuffer(StreamingBufferBackend *backend,
+                                 size_t capacity)
+    : backend_(backend),
+      capacity_(std::max(capacity, kAlignment)),
+      buffer_(0),
+      offset_(0),
+      bytes_this_frame_(0) {}
+
+StreamingBuffer::~StreamingBuffer() { Reset(); }
+
+void StreamingBuffer::Reset() {
+  if (buffer_) {
+    backend_->DeleteBuffer(buffer_);
+    buffer_ = 0;
+  }
+  offset_ = 0;
+  bytes_this_frame_ = 0;
+}
+
+bool StreamingBuffer::Write(const void *data, size_t size, size_t *offset) {
+  if (size == 0) return false;
+  if (!buffer_) {
+    buffer_ = backend_->CreateBuffer();
+    if (!buffer_) return false;
+    backend_->Bind(buffer_);
+    backend_->Allocate(capacity_);
+    offset_ = 0;
+  } else {
+    backend_->Bind(buffer_);
+  }
+
+  size_t aligned = (offset_ + kAlignment - 1) & ~(kAlignment - 1);
+  if (aligned + size > capacity_) {
+    // Out of room: start over in fresh storage, big enough for this write.
+    while (capacity_ < size) capacity_ *= 2;
+    backend_->Allocate(capacity_);
+    aligned = 0;
+  }
+  backend_->Upload(aligned, data, size);
+  offset_ = aligned + size;
+  bytes_this_frame_ += size;
+  *offset = aligned;
+  return true;
+}
+
+void StreamingBuffer::AdvanceFrame() {
+  bytes_this_frame_ = 0;
+  // Untouched storage can be written again without orphaning.
+  if (!buffer_ || !offset_) return;
+  backend_->Bind(buffer_);
+  backend_->Allocate(capacity_);
+  backend_->Bind(0);
+  offset_ = 0;
+}
+
+static GLenum GetGlBufferTarget(StreamingBuffer::Type type) {
+  return type == StreamingBuffer::kIndexBuffer ? GL_ELEMENT_ARRAY_BUFFER
+                                                : GL_ARRAY_BUFFER;
+}
+
+unsigned int GlStreamingBufferBackend::CreateBuffer() {
+  GLuint buffer = 0;
+  GL_CALL(glGenBuffers(1, &buffer));
+  return buffer;
+}
+
+void GlStreamingBufferBackend::DeleteBuffer(unsigned int buffer) {
+  GL_CALL(glDeleteBuffers(1, &buffer));
+}
+
+void GlStreamingBufferBackend::Bind(unsigned int buffer) {
+  GL_CALL(glBindBuffer(GetGlBufferTarget(type_), buffer));
+}
+
+void GlStreamingBufferBackend::Allocate(size_t size) {
+  GL_CALL(glBufferData(GetGlBufferTarget(type_),
+                       static_cast<GLsizeiptr>(size), nullptr,
+                       GL_STREAM_DRAW));
+}
+
+void GlStreamingBufferBackend::Upload(size_t offset, const void *data,
+                                      size_t size) {
+  GL_CALL(glBufferSubData(GetGlBufferTarget(type_),
+                          static_cast<GLintptr>(offset),
+                          static_cast<GLsizeiptr>(size), data));
+}
+
+}  // namespace fplbase
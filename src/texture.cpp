@@ -19,7 +19,12 @@
 #endif  // FPL_BASE_BACKEND_STDLIB
 
 #include "fplbase/texture.h"
+#include "fplbase/asset_telemetry.h"
+#include "fplbase/parallel_for.h"
+#include "fplbase/profiler.h"
 #include "fplbase/renderer.h"
+#include "fplbase/texture_cache.h"
+#include "fplbase/texture_transcoder.h"
 #include "fplbase/utilities.h"
 #include "mathfu/glsl_mappings.h"
 #include "precompiled.h"
@@ -95,6 +100,12 @@ struct KTXHeader {
   uint32_t keyvalue_data;
 };
 
+// The id every KTX file starts with.
+static const char kKTXIdentifier[] = "\xABKTX 11\xBB\r\n\x1A\n";
+
+// Texture array target, which GL 2 headers lack.
+static const GLenum kGlTexture2DArray = 0x8C1A;
+
 Texture::Texture(const char *filename, TextureFormat format, TextureFlags flags)
 : AsyncAsset(filename ? filename : ""),
   id_(0),
@@ -102,36 +113,202 @@ Texture::Texture(const char *filename, TextureFormat format, TextureFlags flags)
   original_size_(mathfu::kZeros2i),
   scale_(mathfu::kOnes2f),
   texture_format_(kFormat888),
-  target_(flags & kTextureFlagsIsCubeMap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D),
+  target_(flags & kTextureFlagsIsCubeMap
+              ? GL_TEXTURE_CUBE_MAP
+              : flags & kTextureFlagsIsArray ? kGlTexture2DArray
+                                             : GL_TEXTURE_2D),
   desired_(format),
-  flags_(flags) {}
+  flags_(flags),
+  ktx_data_bytes_(0),
+  ktx_gpu_bytes_(0) {}
+
+Texture::~Texture() {
+  auto renderer = Renderer::Get();
+  if (renderer) renderer->pixel_buffer_pool().Release(&staging_);
+  Delete();
+}
+
+// Walks the mip levels of a KTX file like CreateTexture() does. Returns the
+// bytes of image data in at most `max_levels` of them, and sets `levels` to
+// how many levels that is.
+static size_t KTXImageSize(const uint8_t *buffer, uint32_t max_levels,
+                           uint32_t *levels) {
+  auto &header = *reinterpret_cast<const KTXHeader *>(buffer);
+  const uint8_t *data = buffer + sizeof(KTXHeader);
+  size_t image_size = 0;
+  auto cur_size = vec2i(header.width, header.height);
+  *levels = 0;
+  while (*levels < std::min(header.mip_levels, max_levels)) {
+    auto data_size = *reinterpret_cast<const int32_t *>(data);
+    data += sizeof(int32_t);
+    // Cubemap files give the size of one face, others of the whole level.
+    const size_t level_size = static_cast<size_t>(data_size) * header.faces;
+    data += level_size;
+    image_size += level_size;
+    ++*levels;
+    if (cur_size.x() == 1 && cur_size.y() == 1) break;
+    cur_size = vec2i(std::max(cur_size.x() / 2, 1),
+                     std::max(cur_size.y() / 2, 1));
+  }
+  return image_size;
+}
+
+// Returns how many bytes of `buffer` CreateTexture() uploads as they are, or
+// 0 if it converts them first, in which case they can't be staged in a pixel
+// buffer.
+static size_t StagedSize(const uint8_t *buffer, const vec2i &size,
+                         TextureFormat texture_format, TextureFormat desired) {
+  // Pick the format the same way CreateTexture() does.
+  if (desired == kFormatAuto) {
+    desired = IsCompressed(texture_format)
+                  ? texture_format
+                  : HasAlpha(texture_format) ? kFormat5551 : kFormat565;
+  } else if (desired == kFormatNative || texture_format == kFormatKTX) {
+    desired = texture_format;
+  }
+  if (desired != texture_format) return 0;
+
+  switch (texture_format) {
+    case kFormatASTC: {
+      auto &header = *reinterpret_cast<const ASTCHeader *>(buffer);
+      auto xblocks = (size.x() + header.blockdim_x - 1) / header.blockdim_x;
+      auto yblocks = (size.y() + header.blockdim_y - 1) / header.blockdim_y;
+      return sizeof(ASTCHeader) + (static_cast<size_t>(xblocks) * yblocks << 4);
+    }
+    case kFormatPKM: {
+      auto &header = *reinterpret_cast<const PKMHeader *>(buffer);
+      auto ext_xsize = (header.ext_width[0] << 8) | header.ext_width[1];
+      auto ext_ysize = (header.ext_height[0] << 8) | header.ext_height[1];
+      return sizeof(PKMHeader) +
+             static_cast<size_t>(ext_xsize / 4) * (ext_ysize / 4) * 8;
+    }
+    case kFormatKTX: {
+      uint32_t levels;
+      const size_t image_size = KTXImageSize(buffer, UINT32_MAX, &levels);
+      return sizeof(KTXHeader) + levels * sizeof(int32_t) + image_size;
+    }
+    default: {
+      // GL reads rows padded to 4 bytes, which would run past the end of
+      // the pixels otherwise.
+      const size_t row = static_cast<size_t>(size.x()) *
+                         BitsPerPixel(texture_format) / 8;
+      if (row % 4) return 0;
+      return row * size.y();
+    }
+  }
+}
+
+void Texture::StageData() {
+  auto renderer = Renderer::Get();
+  if (!data_ || !renderer) return;
+  auto &pool = renderer->pixel_buffer_pool();
+  pool.Release(&staging_);
+  const size_t staged_size = StagedSize(data_, size_, texture_format_,
+                                        desired_);
+  if (!staged_size || !pool.Acquire(staged_size, &staging_)) return;
+  // `data_` itself is kept, for the headers CreateTexture() reads, and in
+  // case the copy is lost before Finalize().
+  FPLBASE_PROFILE_ZONE("Texture::StageData");
+  memcpy(staging_.data, data_, staged_size);
+}
 
 void Texture::Load() {
+  AssetLoadScope telemetry(load_telemetry_, load_record_);
+  // Reading the file is timed separately, by LoadFile().
+  AssetLoadPhaseTimer decode(kAssetLoadPhaseDecode);
   data_ =
-      LoadAndUnpackTexture(filename_.c_str(), scale_, &size_, &texture_format_);
+      LoadAndUnpackTexture(filename_.c_str(), scale_, &size_, &texture_format_,
+                           flags_, desired_);
+  decode.Stop();
   SetOriginalSizeIfNotYetSet(size_);
+  if (data_ && texture_format_ == kFormatKTX) CountKTXBytes(data_);
+  StageData();
+}
+
+void Texture::CountKTXBytes(const uint8_t *ktx) {
+  uint32_t levels;
+  ktx_data_bytes_ = KTXImageSize(ktx, UINT32_MAX, &levels);
+  // Without mipmaps, only the first level is uploaded. With them, compressed
+  // files upload the levels they have, and uncompressed ones have the full
+  // chain generated from the first.
+  const bool mips = (flags_ & kTextureFlagsUseMipMaps) != 0;
+  const bool compressed =
+      reinterpret_cast<const KTXHeader *>(ktx)->type == 0;
+  ktx_gpu_bytes_ =
+      KTXImageSize(ktx, mips && compressed ? UINT32_MAX : 1, &levels);
+  if (mips && !compressed) ktx_gpu_bytes_ += ktx_gpu_bytes_ / 3;
 }
 
 void Texture::LoadFromMemory(const uint8_t *data, const vec2i &size,
                              TextureFormat texture_format) {
+  // Create the new texture before deleting the current one, which is kept if
+  // that fails.
+  const GLuint id = CreateTexture(data, size, texture_format, desired_, flags_);
+  if (!id) return;
+  Delete();
+  id_ = id;
   size_ = size;
   SetOriginalSizeIfNotYetSet(size_);
   texture_format_ = texture_format;
-  id_ = CreateTexture(data, size_, texture_format_, desired_, flags_);
+  if (texture_format_ == kFormatKTX) CountKTXBytes(data);
 }
 
 void Texture::Finalize() {
+  FPLBASE_PROFILE_ZONE("Texture::Finalize");
+  AssetLoadScope telemetry(load_telemetry_, load_record_);
   if (data_) {
-    id_ = CreateTexture(data_, size_, texture_format_, desired_, flags_);
+    AssetLoadPhaseTimer upload(kAssetLoadPhaseUpload);
+    if (staging_.buffer) {
+      auto &pool = Renderer::Get()->pixel_buffer_pool();
+      const bool staged = pool.BeginTransfer(staging_);
+      id_ = CreateTexture(data_, size_, texture_format_, desired_, flags_,
+                          staged);
+      pool.EndTransfer(&staging_);
+    } else {
+      id_ = CreateTexture(data_, size_, texture_format_, desired_, flags_);
+    }
+    upload.Stop();
     free(const_cast<uint8_t *>(data_));
     data_ = nullptr;
     CallFinalizeCallback();
   }
+  if (load_telemetry_) load_telemetry_->EndAsset(load_record_, id_ != 0);
+}
+
+AssetMemoryUsage Texture::MemoryUsage() const {
+  AssetMemoryUsage usage;
+  if (texture_format_ == kFormatKTX) {
+    if (data_) usage.cpu_bytes = ktx_data_bytes_;
+    if (id_) usage.gpu_bytes = ktx_gpu_bytes_;
+    return usage;
+  }
+  const size_t pixels = static_cast<size_t>(size_.x()) * size_.y();
+  if (data_) usage.cpu_bytes = pixels * BitsPerPixel(texture_format_) / 8;
+  if (id_) {
+    // CreateTexture() converts uncompressed data to 16 bits per pixel when
+    // asked to, or when picking the format itself.
+    auto stored = texture_format_;
+    if (!IsCompressed(texture_format_) &&
+        (desired_ == kFormatAuto || desired_ == kFormat5551 ||
+         desired_ == kFormat565)) {
+      stored = kFormat565;
+    }
+    usage.gpu_bytes = pixels * BitsPerPixel(stored) / 8;
+    if (flags_ & kTextureFlagsUseMipMaps) {
+      usage.gpu_bytes += usage.gpu_bytes / 3;
+    }
+  }
+  return usage;
 }
 
 void Texture::Set(size_t unit, RenderContext *) {
-  GL_CALL(glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit)));
-  GL_CALL(glBindTexture(target_, id_));
+  auto renderer = Renderer::Get();
+  if (renderer) {
+    renderer->BindTexture(unit, target_, id_);
+  } else {
+    GL_CALL(glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit)));
+    GL_CALL(glBindTexture(target_, id_));
+  }
 }
 
 void Texture::Set(size_t unit) { Set(unit, nullptr); }
@@ -146,6 +323,9 @@ void Texture::Delete() {
   if (id_) {
     GL_CALL(glDeleteTextures(1, &id_));
     id_ = 0;
+    // A new texture may reuse the id.
+    auto renderer = Renderer::Get();
+    if (renderer) renderer->InvalidateTextureBindings();
   }
 }
 
@@ -168,6 +348,210 @@ uint16_t *Texture::Convert888To565(const uint8_t *buffer, const vec2i &size) {
   return buffer16;
 }
 
+// KTX rows and mip levels are padded to a multiple of this many bytes.
+static const size_t kKTXAlignment = 4;
+
+// Rows per sub-range when a mip level is split over threads.
+static const size_t kMinMipRows = 64;
+
+static const int kCubeMapFaces = 6;
+
+// Returns the number of levels in a full mip chain, down to 1x1.
+static int NumMipLevels(const vec2i &size) {
+  int levels = 1;
+  for (int side = std::max(size.x(), size.y()); side > 1; side /= 2) {
+    ++levels;
+  }
+  return levels;
+}
+
+// Halves an image into the rows [begin, end) of `dest`, averaging 2x2 blocks
+// of pixels. Odd rows and columns are averaged with themselves, so the last
+// pixels keep their weight.
+static void HalveImage(const uint8_t *image, const vec2i &size, int channels,
+                       uint8_t *dest, const vec2i &dest_size, size_t begin,
+                       size_t end) {
+  for (size_t y = begin; y < end; ++y) {
+    const int y0 = static_cast<int>(y) * 2;
+    const int y1 = std::min(y0 + 1, size.y() - 1);
+    for (int x = 0; x < dest_size.x(); ++x) {
+      const int x0 = x * 2;
+      const int x1 = std::min(x0 + 1, size.x() - 1);
+      const uint8_t *p00 = image + (y0 * size.x() + x0) * channels;
+      const uint8_t *p01 = image + (y0 * size.x() + x1) * channels;
+      const uint8_t *p10 = image + (y1 * size.x() + x0) * channels;
+      const uint8_t *p11 = image + (y1 * size.x() + x1) * channels;
+      uint8_t *out = dest + (y * dest_size.x() + x) * channels;
+      for (int c = 0; c < channels; ++c) {
+        const int sum = p00[c] + p01[c] + p10[c] + p11[c];
+        out[c] = static_cast<uint8_t>((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+// Sets `level` to the rows of `image` in `format`, each padded to
+// kKTXAlignment bytes.
+static void PackMipLevel(const uint8_t *image, const vec2i &size,
+                         TextureFormat format, std::string *level) {
+  const size_t row_size =
+      static_cast<size_t>(size.x()) * BitsPerPixel(format) / 8;
+  const size_t stride =
+      (row_size + kKTXAlignment - 1) / kKTXAlignment * kKTXAlignment;
+  const uint8_t *pixels = image;
+  uint16_t *pixels16 = nullptr;
+  if (format == kFormat565) {
+    pixels16 = Texture::Convert888To565(image, size);
+  } else if (format == kFormat5551) {
+    pixels16 = Texture::Convert8888To5551(image, size);
+  }
+  if (pixels16) pixels = reinterpret_cast<const uint8_t *>(pixels16);
+  level->assign(stride * size.y(), '\0');
+  uint8_t *dest = reinterpret_cast<uint8_t *>(&(*level)[0]);
+  for (int y = 0; y < size.y(); ++y) {
+    memcpy(dest + y * stride, pixels + y * row_size, row_size);
+  }
+  delete[] pixels16;
+}
+
+// Builds the mip chain of `image`, with `channels` bytes per pixel, and packs
+// each level in `format`. Each level is made from the one before it, like
+// glGenerateMipmap() does. With `parallel`, the rows of each level are split
+// over threads.
+static void BuildMipChain(const uint8_t *image, const vec2i &size,
+                          int channels, TextureFormat format, int num_levels,
+                          bool parallel, std::vector<std::string> *levels) {
+  levels->resize(num_levels);
+  std::vector<uint8_t> level(
+      image, image + static_cast<size_t>(size.x()) * size.y() * channels);
+  vec2i level_size = size;
+  std::vector<uint8_t> next;
+  for (int i = 0; i < num_levels; ++i) {
+    PackMipLevel(level.data(), level_size, format, &(*levels)[i]);
+    if (i == num_levels - 1) break;
+    const vec2i next_size(std::max(level_size.x() / 2, 1),
+                          std::max(level_size.y() / 2, 1));
+    next.resize(static_cast<size_t>(next_size.x()) * next_size.y() *
+                channels);
+    const size_t rows = static_cast<size_t>(next_size.y());
+    ParallelFor(rows, parallel ? kMinMipRows : rows,
+                [&](size_t begin, size_t end) {
+                  HalveImage(level.data(), level_size, channels, next.data(),
+                             next_size, begin, end);
+                });
+    level.swap(next);
+    level_size = next_size;
+  }
+}
+
+bool Texture::PackKTX(const uint8_t *buffer, const vec2i &size,
+                      TextureFormat texture_format, TextureFormat desired,
+                      TextureFlags flags, std::string *ktx) {
+  if (texture_format != kFormat888 && texture_format != kFormat8888) {
+    return false;
+  }
+  if (desired == kFormatAuto) {
+    desired = HasAlpha(texture_format) ? kFormat5551 : kFormat565;
+  } else if (desired == kFormatNative) {
+    desired = texture_format;
+  }
+
+  KTXHeader header;
+  memcpy(header.id, kKTXIdentifier, sizeof(header.id));
+  header.endian = 0x04030201;
+  switch (desired) {
+    case kFormat565:
+      header.type = GL_UNSIGNED_SHORT_5_6_5;
+      header.format = GL_RGB;
+      break;
+    case kFormat5551:
+      header.type = GL_UNSIGNED_SHORT_5_5_5_1;
+      header.format = GL_RGBA;
+      break;
+    case kFormat888:
+      header.type = GL_UNSIGNED_BYTE;
+      header.format = GL_RGB;
+      break;
+    case kFormat8888:
+      header.type = GL_UNSIGNED_BYTE;
+      header.format = GL_RGBA;
+      break;
+    default:
+      return false;
+  }
+  header.type_size = header.type == GL_UNSIGNED_BYTE ? 1 : 2;
+  // Unsized formats, so ES2 accepts them too.
+  header.internal_format = header.format;
+  header.base_internal_format = header.format;
+
+  // The faces of a 1x6 strip, or the square layers of an array, are
+  // consecutive rows, so each is an image of its own without copying.
+  const bool is_array = !(flags & kTextureFlagsIsCubeMap) &&
+                        (flags & kTextureFlagsIsArray) && size.x() > 0;
+  const int num_faces = flags & kTextureFlagsIsCubeMap
+                            ? kCubeMapFaces
+                            : is_array ? size.y() / size.x() : 1;
+  if (num_faces < 1) return false;
+  const vec2i face_size = size / vec2i(1, num_faces);
+  if (face_size.y() * num_faces != size.y()) return false;
+  if (is_array && face_size.x() != face_size.y()) return false;
+  const int levels = flags & kTextureFlagsUseMipMaps ? NumMipLevels(face_size)
+                                                     : 1;
+  header.width = static_cast<uint32_t>(face_size.x());
+  header.height = static_cast<uint32_t>(face_size.y());
+  header.depth = 0;
+  header.array_elements = is_array ? static_cast<uint32_t>(num_faces) : 0;
+  header.faces = is_array ? 1 : static_cast<uint32_t>(num_faces);
+  header.mip_levels = static_cast<uint32_t>(levels);
+  header.keyvalue_data = 0;
+
+  // Add or drop alpha to match the channels of `desired`.
+  const int channels = header.format == GL_RGBA ? 4 : 3;
+  const int buffer_channels = texture_format == kFormat8888 ? 4 : 3;
+  const size_t num_pixels = static_cast<size_t>(size.x()) * size.y();
+  std::vector<uint8_t> converted;
+  const uint8_t *pixels = buffer;
+  if (channels != buffer_channels) {
+    converted.resize(num_pixels * channels);
+    for (size_t i = 0; i < num_pixels; ++i) {
+      for (int c = 0; c < channels; ++c) {
+        converted[i * channels + c] =
+            c < buffer_channels ? buffer[i * buffer_channels + c] : 255;
+      }
+    }
+    pixels = converted.data();
+  }
+
+  // Every face is its own job. A single face splits its rows instead.
+  const bool parallel = (flags & kTextureFlagsParallelDecode) != 0;
+  const bool parallel_faces = parallel && num_faces > 1;
+  const size_t face_bytes =
+      static_cast<size_t>(face_size.x()) * face_size.y() * channels;
+  std::vector<std::vector<std::string>> face_levels(num_faces);
+  ParallelFor(static_cast<size_t>(num_faces), parallel_faces ? 1 : num_faces,
+              [&](size_t begin, size_t end) {
+                for (size_t face = begin; face < end; ++face) {
+                  BuildMipChain(pixels + face * face_bytes, face_size,
+                                channels, desired, levels,
+                                parallel && !parallel_faces,
+                                &face_levels[face]);
+                }
+              });
+
+  // Each level starts with its size, which for cubemaps is that of one
+  // face, and for arrays that of all layers, followed by the faces or layers
+  // in order.
+  ktx->assign(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (int i = 0; i < levels; ++i) {
+    const uint32_t image_size = static_cast<uint32_t>(
+        face_levels[0][i].size() * (is_array ? num_faces : 1));
+    ktx->append(reinterpret_cast<const char *>(&image_size),
+                sizeof(image_size));
+    for (int face = 0; face < num_faces; ++face) *ktx += face_levels[face][i];
+  }
+  return true;
+}
+
 void Texture::SetTextureId(TextureTarget target, TextureHandle id) {
   target_ = target;
   id_ = id;
@@ -175,10 +559,12 @@ void Texture::SetTextureId(TextureTarget target, TextureHandle id) {
 
 GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
                               TextureFormat texture_format,
-                              TextureFormat desired, TextureFlags flags) {
+                              TextureFormat desired, TextureFlags flags,
+                              bool staged) {
   GLenum tex_type = GL_TEXTURE_2D;
   GLenum tex_imagetype = GL_TEXTURE_2D;
   int tex_num_faces = 1;
+  int tex_num_layers = 1;
   auto tex_size = size;
 
   if (flags & kTextureFlagsIsCubeMap) {
@@ -190,6 +576,28 @@ GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
       LogError(kError, "CreateTexture: cubemap not in 1x6 format: (%d,%d)",
                size.x(), size.y());
     }
+  } else if (flags & kTextureFlagsIsArray) {
+    if (Renderer::Get()->feature_level() < Renderer::kFeatureLevel30) {
+      LogError(kError, "CreateTexture: texture arrays need OpenGL (ES) 3.0");
+      return 0;
+    }
+    tex_type = kGlTexture2DArray;
+    tex_imagetype = kGlTexture2DArray;
+    // KTX arrays say how many layers they have, strips have square layers.
+    if (texture_format == kFormatKTX) {
+      tex_num_layers = std::max(
+          1, static_cast<int>(
+                 reinterpret_cast<const KTXHeader *>(buffer)->array_elements));
+    } else if (size.x() > 0) {
+      tex_num_layers = std::max(1, size.y() / size.x());
+    }
+    tex_size = size / vec2i(1, tex_num_layers);
+    if (tex_size.y() * tex_num_layers != size.y() ||
+        (texture_format != kFormatKTX && tex_size.x() != tex_size.y())) {
+      LogError(kError, "CreateTexture: array not in square layers: (%d,%d)",
+               size.x(), size.y());
+      return 0;
+    }
   }
 
   if (!Renderer::Get()->SupportsTextureNpot()) {
@@ -207,6 +615,17 @@ GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
     }
   }
 
+  if (texture_format == kFormatKTX && !(flags & kTextureFlagsIsCubeMap) &&
+      reinterpret_cast<const KTXHeader *>(buffer)->faces != 1) {
+    LogError(kError, "CreateTexture: KTX cubemap needs kTextureFlagsIsCubeMap");
+    return 0;
+  }
+  if (texture_format == kFormatKTX && !(flags & kTextureFlagsIsArray) &&
+      reinterpret_cast<const KTXHeader *>(buffer)->array_elements != 0) {
+    LogError(kError, "CreateTexture: KTX array needs kTextureFlagsIsArray");
+    return 0;
+  }
+
   bool generate_mips = (flags & kTextureFlagsUseMipMaps) != 0;
   bool have_mips = generate_mips;
 
@@ -234,8 +653,7 @@ GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
   // TODO(wvo): support default args for mipmap/wrap/trilinear
   GLuint texture_id;
   GL_CALL(glGenTextures(1, &texture_id));
-  GL_CALL(glActiveTexture(GL_TEXTURE0));
-  GL_CALL(glBindTexture(tex_type, texture_id));
+  Renderer::Get()->BindTexture(0, tex_type, texture_id);
   GL_CALL(glTexParameteri(tex_type, GL_TEXTURE_WRAP_S, wrap_mode));
   GL_CALL(glTexParameteri(tex_type, GL_TEXTURE_WRAP_T, wrap_mode));
   if (flags & kTextureFlagsIsCubeMap) {
@@ -251,20 +669,43 @@ GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
     desired = IsCompressed(texture_format)
                   ? texture_format
                   : HasAlpha(texture_format) ? kFormat5551 : kFormat565;
-  } else if (desired == kFormatNative) {
+  } else if (desired == kFormatNative || texture_format == kFormatKTX) {
+    // KTX files hold pixels in their final format, ready to upload.
     desired = texture_format;
   }
 
+  // `buf_size` is the size of one face or layer. The layers of an array
+  // follow each other in `buf`, and are uploaded at once.
   auto gl_tex_image = [&](const uint8_t *buf, const vec2i &mip_size,
                           int mip_level, int buf_size, bool compressed) {
+    if (tex_type == kGlTexture2DArray) {
+      auto pixels = staged && buf
+                        ? reinterpret_cast<const uint8_t *>(buf - buffer)
+                        : buf;
+      if (compressed) {
+        GL_CALL(glCompressedTexImage3D(tex_type, mip_level, format,
+                                       mip_size.x(), mip_size.y(),
+                                       tex_num_layers, 0,
+                                       buf_size * tex_num_layers, pixels));
+      } else {
+        GL_CALL(glTexImage3D(tex_type, mip_level, format, mip_size.x(),
+                             mip_size.y(), tex_num_layers, 0, format, type,
+                             pixels));
+      }
+      return;
+    }
     for (int i = 0; i < tex_num_faces; i++) {
+      // Staged pixels are read from the pixel buffer, at the same offset.
+      auto pixels = staged && buf
+                        ? reinterpret_cast<const uint8_t *>(buf - buffer)
+                        : buf;
       if (compressed) {
         GL_CALL(glCompressedTexImage2D(tex_imagetype + i, mip_level, format,
                                        mip_size.x(), mip_size.y(), 0, buf_size,
-                                       buf));
+                                       pixels));
       } else {
         GL_CALL(glTexImage2D(tex_imagetype + i, mip_level, format, mip_size.x(),
-                             mip_size.y(), 0, format, type, buf));
+                             mip_size.y(), 0, format, type, pixels));
       }
       if (buf) buf += buf_size;
     }
@@ -288,7 +729,8 @@ GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
           }
           break;
         case kFormat5551:
-          // Nothing coversion.
+          // No conversion.
+          type = GL_UNSIGNED_SHORT_5_5_5_1;
           gl_tex_image(buffer, tex_size, 0, num_pixels * 2, false);
           break;
         default:
@@ -315,6 +757,8 @@ GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
           break;
         case kFormat565:
           // No conversion.
+          format = GL_RGB;
+          type = GL_UNSIGNED_SHORT_5_6_5;
           gl_tex_image(buffer, tex_size, 0, num_pixels * 2, false);
           break;
         default:
@@ -406,7 +850,7 @@ GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
       // TODO(wvo): cubemaps in ASTC may not work for block sizes that straddle
       // the face boundaries.
       gl_tex_image(buffer + sizeof(ASTCHeader), tex_size, 0,
-                   data_size / tex_num_faces, true);
+                   data_size / (tex_num_faces * tex_num_layers), true);
       break;
     }
     case kFormatPKM: {
@@ -417,24 +861,35 @@ GLuint Texture::CreateTexture(const uint8_t *buffer, const vec2i &size,
       auto data_size = (ext_xsize / 4) * (ext_ysize / 4) * 8;
       format = GL_COMPRESSED_RGB8_ETC2;
       gl_tex_image(buffer + sizeof(PKMHeader), tex_size, 0,
-                   data_size / tex_num_faces, true);
+                   data_size / (tex_num_faces * tex_num_layers), true);
       break;
     }
     case kFormatKTX: {
       assert(texture_format == kFormatKTX);
       auto &header = *reinterpret_cast<const KTXHeader *>(buffer);
-      format = header.internal_format;
+      // A type of 0 means the internal format is a compressed one.
+      const bool compressed = header.type == 0;
+      format = compressed ? header.internal_format : header.format;
+      if (!compressed) type = header.type;
       auto data = buffer + sizeof(KTXHeader);
       auto cur_size = tex_size;
       for (uint32_t i = 0; i < header.mip_levels; i++) {
         auto data_size = *(reinterpret_cast<const int32_t *>(data));
         data += sizeof(int32_t);
-        gl_tex_image(data, cur_size, i, data_size / tex_num_faces, true);
-        cur_size /= 2;
-        data += data_size;
-        // For some reason header.mip_levels can be big enough such that a
-        // coordinate goes to 0.
-        if (!cur_size.x() || !cur_size.y()) break;
+        // In cubemap files each level's size is that of a single face, with
+        // the faces following each other. In 1x6 strips and arrays it covers
+        // all faces or layers.
+        const int num_images = tex_num_faces * tex_num_layers;
+        auto face_size =
+            header.faces == 1 ? data_size / num_images : data_size;
+        gl_tex_image(data, cur_size, i, face_size, compressed);
+        data += face_size * num_images;
+        // For some reason header.mip_levels can be bigger than the chain
+        // down to 1x1.
+        if (cur_size.x() == 1 && cur_size.y() == 1) break;
+        // Non-square chains keep going after one side reaches 1.
+        cur_size = vec2i(std::max(cur_size.x() / 2, 1),
+                         std::max(cur_size.y() / 2, 1));
         // If the file has mips but the caller doesn't want them, stop here.
         if (!have_mips) break;
       }
@@ -486,6 +941,7 @@ void Texture::UpdateTexture(TextureFormat format, int xoffset, int yoffset,
       pixel_format = GL_UNSIGNED_SHORT_5_5_5_1;
       break;
     case kFormat565:
+      texture_format = GL_RGB;
       pixel_format = GL_UNSIGNED_SHORT_5_6_5;
       break;
     case kFormat8888:
@@ -493,6 +949,28 @@ void Texture::UpdateTexture(TextureFormat format, int xoffset, int yoffset,
     default:
       assert(false);  // TODO(wvo): not implemented.
   }
+  // Go through a pixel buffer if one is free, so the upload doesn't have to
+  // wait for the GPU to finish drawing with the texture.
+  // Rows are read padded to 4 bytes, as GL_UNPACK_ALIGNMENT is left at 4.
+  auto renderer = Renderer::Get();
+  if (renderer && width > 0 && height > 0) {
+    auto &pool = renderer->pixel_buffer_pool();
+    const size_t row = static_cast<size_t>(width) * BitsPerPixel(format) / 8;
+    const size_t stride = (row + 3) & ~static_cast<size_t>(3);
+    const size_t bytes = stride * (height - 1) + row;
+    PixelBufferPool::Staging staging;
+    if (pool.Acquire(bytes, &staging)) {
+      memcpy(staging.data, data, bytes);
+      const bool staged = pool.BeginTransfer(staging);
+      if (staged) {
+        GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, xoffset, yoffset, width,
+                                height, texture_format, pixel_format,
+                                nullptr));
+      }
+      pool.EndTransfer(&staging);
+      if (staged) return;
+    }
+  }
   GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, xoffset, yoffset, width, height,
                           texture_format, pixel_format, data));
 }
@@ -514,7 +992,8 @@ uint8_t *Texture::UnpackTGA(const void *tga_buf, vec2i *dimensions,
 
 uint8_t *Texture::UnpackWebP(const void *webp_buf, size_t size,
                              const vec2 &scale, vec2i *dimensions,
-                             TextureFormat *texture_format) {
+                             TextureFormat *texture_format,
+                             TextureFlags flags) {
   WebPDecoderConfig config;
   memset(&config, 0, sizeof(WebPDecoderConfig));
   auto status = WebPGetFeatures(static_cast<const uint8_t *>(webp_buf), size,
@@ -533,6 +1012,10 @@ uint8_t *Texture::UnpackWebP(const void *webp_buf, size_t size,
   if (config.input.has_alpha) {
     config.output.colorspace = MODE_RGBA;
   }
+
+  // VP8 data can only be decoded in order, but libwebp can filter and
+  // output the rows on a second thread while the next ones are decoded.
+  if (flags & kTextureFlagsParallelDecode) config.options.use_threads = 1;
   status = WebPDecode(static_cast<const uint8_t *>(webp_buf), size, &config);
   if (status != VP8_STATUS_OK) return nullptr;
 
@@ -592,13 +1075,16 @@ uint8_t *Texture::UnpackPKM(const void *file_buf, size_t size,
 uint8_t *Texture::UnpackKTX(const void *file_buf, size_t size,
                             vec2i *dimensions, TextureFormat *texture_format) {
   auto &header = *reinterpret_cast<const KTXHeader *>(file_buf);
-  auto magic = "\xABKTX 11\xBB\r\n\x1A\n";
-  auto v = memcmp(header.id, magic, sizeof(header.id));
+  auto v = memcmp(header.id, kKTXIdentifier, sizeof(header.id));
   if (v != 0 || header.endian != 0x04030201 || header.depth != 0 ||
-      header.faces != 1 || header.keyvalue_data != 0)
+      (header.faces != 1 && header.faces != 6) ||
+      (header.faces != 1 && header.array_elements != 0) ||
+      header.keyvalue_data != 0)
     return nullptr;
 
-  *dimensions = vec2i(header.width, header.height);
+  // Cubemaps and arrays report the size of the strip they would otherwise be.
+  const uint32_t images = std::max(header.array_elements, 1u) * header.faces;
+  *dimensions = vec2i(header.width, header.height * images);
   *texture_format = kFormatKTX;
 
   // TODO(wvo): This in theory doesn't need to be copied, but it keeps the API
@@ -610,9 +1096,83 @@ uint8_t *Texture::UnpackKTX(const void *file_buf, size_t size,
   return buf;
 }
 
+// Output rows per stripe below which resizing isn't worth another thread.
+static const size_t kMinResizeStripeRows = 64;
+
+// Resizes an image with STB. With `parallel`, the output is split into
+// stripes of rows that are resized on separate threads. Each stripe is given
+// the scale STB computes for the whole image, and is offset by its first
+// row, so every output pixel is sampled at the same position with the same
+// weights, and the result is identical.
+static void ResizeImage(const uint8_t *image, int width, int height,
+                        int channels, uint8_t *new_image, int new_width,
+                        int new_height, bool parallel) {
+  FPLBASE_PROFILE_ZONE("ResizeImage");
+  if (!parallel) {
+    stbir_resize_uint8(image, width, height, 0, new_image, new_width,
+                       new_height, 0, channels);
+    return;
+  }
+  const size_t stride = static_cast<size_t>(new_width) * channels;
+  // stbir_resize_region() would derive the scale from the stripe height
+  // instead, which rounds differently.
+  const float x_scale = static_cast<float>(new_width) / width;
+  const float y_scale = static_cast<float>(new_height) / height;
+  ParallelFor(static_cast<size_t>(new_height), kMinResizeStripeRows,
+              [&](size_t begin, size_t end) {
+                stbir_resize_subpixel(
+                    image, width, height, 0, new_image + begin * stride,
+                    new_width, static_cast<int>(end - begin), 0,
+                    STBIR_TYPE_UINT8, channels, STBIR_ALPHA_CHANNEL_NONE, 0,
+                    STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_FILTER_DEFAULT,
+                    STBIR_FILTER_DEFAULT, STBIR_COLORSPACE_LINEAR, nullptr,
+                    x_scale, y_scale, 0.0f, static_cast<float>(begin));
+              });
+}
+
+// Returns n if `scale` is 1 / n for a power of two n, or 0 otherwise.
+static int PowerOfTwoDivisor(float scale) {
+  for (int divisor = 1; divisor <= 1024; divisor *= 2) {
+    if (scale * divisor == 1.0f) return divisor;
+  }
+  return 0;
+}
+
+// Averages blocks of `fx` by `fy` pixels of `image` into the rows [begin,
+// end) of `dest`. Blocks that would run past the edge of the image repeat
+// its last row or column. Every pixel is written after all the pixels it
+// reads, and before any pixel that later ones read, so with all rows in
+// order `dest` may be `image` itself.
+static void BoxDownscale(const uint8_t *image, int width, int height,
+                         int channels, int fx, int fy, uint8_t *dest,
+                         int new_width, size_t begin, size_t end) {
+  const int area = fx * fy;
+  int sum[4];
+  for (size_t y = begin; y < end; ++y) {
+    uint8_t *out = dest + y * new_width * channels;
+    for (int x = 0; x < new_width; ++x) {
+      for (int c = 0; c < channels; ++c) sum[c] = 0;
+      for (int by = 0; by < fy; ++by) {
+        const int src_y = std::min(static_cast<int>(y) * fy + by, height - 1);
+        const uint8_t *row = image + static_cast<size_t>(src_y) * width *
+                                         channels;
+        for (int bx = 0; bx < fx; ++bx) {
+          const uint8_t *src =
+              row + std::min(x * fx + bx, width - 1) * channels;
+          for (int c = 0; c < channels; ++c) sum[c] += src[c];
+        }
+      }
+      for (int c = 0; c < channels; ++c) {
+        *out++ = static_cast<uint8_t>((sum[c] + area / 2) / area);
+      }
+    }
+  }
+}
+
 uint8_t *Texture::UnpackImage(const void *img_buf, size_t size,
                               const vec2 &scale, vec2i *dimensions,
-                              TextureFormat *texture_format) {
+                              TextureFormat *texture_format,
+                              TextureFlags flags) {
   uint8_t *image = nullptr;
   int width = 0;
   int height = 0;
@@ -625,14 +1185,40 @@ uint8_t *Texture::UnpackImage(const void *img_buf, size_t size,
 
   if (image && (scale.x() != 1.0f || scale.y() != 1.0f)) {
     // Scale the image.
-    int32_t new_width = static_cast<int32_t>(width * scale.x());
-    int32_t new_height = static_cast<int32_t>(height * scale.y());
-    uint8_t *new_image =
-        static_cast<uint8_t *>(malloc(new_width * new_height * channels));
-    stbir_resize_uint8(image, width, height, 0, new_image, new_width,
-                       new_height, 0, channels);
-    stbi_image_free(image);
-    image = new_image;
+    int32_t new_width = std::max(static_cast<int32_t>(width * scale.x()), 1);
+    int32_t new_height =
+        std::max(static_cast<int32_t>(height * scale.y()), 1);
+    const size_t new_size =
+        static_cast<size_t>(new_width) * new_height * channels;
+    const bool parallel = (flags & kTextureFlagsParallelDecode) != 0;
+    // With kTextureFlagsBoxDownscale, power of two downscales are averaged
+    // straight into the decoded image. That is much cheaper than STB's
+    // resampling filter, but a little less sharp. It also saves the output
+    // buffer, though that is only 1/n^2 the size of the decoded image, which
+    // is allocated either way.
+    const bool box = (flags & kTextureFlagsBoxDownscale) != 0;
+    const int fx = box ? PowerOfTwoDivisor(scale.x()) : 0;
+    const int fy = box ? PowerOfTwoDivisor(scale.y()) : 0;
+    if (fx && fy && !parallel) {
+      BoxDownscale(image, width, height, channels, fx, fy, image, new_width,
+                   0, new_height);
+      auto shrunk = static_cast<uint8_t *>(realloc(image, new_size));
+      if (shrunk) image = shrunk;
+    } else {
+      uint8_t *new_image = static_cast<uint8_t *>(malloc(new_size));
+      if (fx && fy) {
+        ParallelFor(static_cast<size_t>(new_height), kMinResizeStripeRows,
+                    [&](size_t begin, size_t end) {
+                      BoxDownscale(image, width, height, channels, fx, fy,
+                                   new_image, new_width, begin, end);
+                    });
+      } else {
+        ResizeImage(image, width, height, channels, new_image, new_width,
+                    new_height, parallel);
+      }
+      stbi_image_free(image);
+      image = new_image;
+    }
     width = new_width;
     height = new_height;
   }
@@ -650,9 +1236,48 @@ uint8_t *Texture::UnpackImage(const void *img_buf, size_t size,
   return image;
 }
 
+// Records the size of the data returned by an Unpack*() function in the
+// telemetry of the asset being loaded.
+static void AddDecodedBytes(const vec2i &size, TextureFormat format,
+                            size_t file_size) {
+  const size_t pixels = static_cast<size_t>(size.x()) * size.y();
+  switch (format) {
+    case kFormat8888:
+      AssetLoadAddBytes(0, pixels * 4);
+      break;
+    case kFormat888:
+      AssetLoadAddBytes(0, pixels * 3);
+      break;
+    case kFormatLuminance:
+      AssetLoadAddBytes(0, pixels);
+      break;
+    default:
+      // Compressed formats are copied from the file as is.
+      AssetLoadAddBytes(0, file_size);
+      break;
+  }
+}
+
+// Picks what to transcode ETC1S into for a texture in the `desired` format.
+// Compressed formats are used if asked for, or with kFormatAuto, if the GPU
+// supports them. Otherwise the pixels are decoded to 565, which is what
+// kFormatAuto uploads RGB as, unless 888 is asked for.
+static TextureFormat ETC1STranscodeTarget(TextureFormat desired) {
+  const Renderer *renderer = Renderer::Get();
+  if (desired == kFormat565 || desired == kFormat888) return desired;
+  if (desired == kFormatPKM || desired == kFormatASTC) {
+    if (renderer->SupportsTextureFormat(desired)) return desired;
+  }
+  if (renderer->SupportsTextureFormat(kFormatPKM)) return kFormatPKM;
+  if (renderer->SupportsTextureFormat(kFormatASTC)) return kFormatASTC;
+  return kFormat565;
+}
+
 uint8_t *Texture::LoadAndUnpackTexture(const char *filename, const vec2 &scale,
                                        vec2i *dimensions,
-                                       TextureFormat *texture_format) {
+                                       TextureFormat *texture_format,
+                                       TextureFlags flags,
+                                       TextureFormat desired) {
   std::string ext;
   std::string basename = filename;
   size_t ext_pos = basename.find_last_of(".");
@@ -663,6 +1288,28 @@ uint8_t *Texture::LoadAndUnpackTexture(const char *filename, const vec2 &scale,
 
   std::string file;
 
+  // Transcode ETC1S into the best format the GPU supports. Its blocks are
+  // valid ETC2 blocks, so PKM needs no work, and ASTC is a per block
+  // conversion. Other GPUs get uncompressed pixels.
+  if (ext == "etc1s") {
+    if (!LoadFile(filename, &file)) {
+      LogError(kApplication, "Couldn\'t load: %s", filename);
+      return nullptr;
+    }
+    // Like the other block compressed formats, ETC1S is loaded at the size
+    // it was encoded at.
+    if (scale.x() != 1.0f || scale.y() != 1.0f) {
+      LogError(kApplication, "ETC1S textures can't be scaled, loading %s at "
+               "full size", filename);
+    }
+    *texture_format = ETC1STranscodeTarget(desired);
+    auto buf = TranscodeETC1S(file.c_str(), file.length(), *texture_format,
+                              dimensions);
+    if (!buf) LogError(kApplication, "ETC1S format problem: %s", filename);
+    if (buf) AddDecodedBytes(*dimensions, *texture_format, file.length());
+    return buf;
+  }
+
   // Try to load ASTC, but default to WebP if not available or not supported.
   if (ext == "astc") {
     if (Renderer::Get()->SupportsTextureFormat(kFormatASTC) &&
@@ -670,6 +1317,7 @@ uint8_t *Texture::LoadAndUnpackTexture(const char *filename, const vec2 &scale,
       auto buf =
           UnpackASTC(file.c_str(), file.length(), dimensions, texture_format);
       if (!buf) LogError(kApplication, "ASTC format problem: %s", filename);
+      if (buf) AddDecodedBytes(*dimensions, *texture_format, file.length());
       return buf;
     } else {
       ext = "webp";
@@ -683,6 +1331,7 @@ uint8_t *Texture::LoadAndUnpackTexture(const char *filename, const vec2 &scale,
       auto buf =
           UnpackPKM(file.c_str(), file.length(), dimensions, texture_format);
       if (!buf) LogError(kApplication, "PKM format problem: %s", filename);
+      if (buf) AddDecodedBytes(*dimensions, *texture_format, file.length());
       return buf;
     } else {
       ext = "webp";
@@ -690,12 +1339,17 @@ uint8_t *Texture::LoadAndUnpackTexture(const char *filename, const vec2 &scale,
   }
 
   // Try to load KTX, but default to WebP if not available or not supported.
+  // KTX files of uncompressed pixels, as written by texture_pipeline, work
+  // everywhere.
   if (ext == "ktx") {
-    if (Renderer::Get()->SupportsTextureFormat(kFormatKTX) &&
-        LoadFile(filename, &file)) {
+    if (LoadFile(filename, &file) &&
+        (Renderer::Get()->SupportsTextureFormat(kFormatKTX) ||
+         (file.length() >= sizeof(KTXHeader) &&
+          reinterpret_cast<const KTXHeader *>(file.c_str())->type != 0))) {
       auto buf =
           UnpackKTX(file.c_str(), file.length(), dimensions, texture_format);
       if (!buf) LogError(kApplication, "KTX format problem: %s", filename);
+      if (buf) AddDecodedBytes(*dimensions, *texture_format, file.length());
       return buf;
     } else {
       ext = "webp";
@@ -710,21 +1364,71 @@ uint8_t *Texture::LoadAndUnpackTexture(const char *filename, const vec2 &scale,
     return nullptr;
   }
 
+  // Decoded and converted textures may be cached on disk, keyed by the
+  // contents of the file.
+  TextureCache &cache = TextureCache::Shared();
+  const bool cacheable = (ext == "tga" || ext == "png" || ext == "jpg" ||
+                          ext == "webp") &&
+                         cache.is_open();
+  TextureCache::Key key = 0;
+  if (cacheable) {
+    key = TextureCache::MakeKey(file.c_str(), file.length(), desired, flags,
+                                scale);
+    size_t size = 0;
+    auto buf = cache.Load(key, &size);
+    // An entry that isn't a KTX file, e.g. one damaged outside the cache, is
+    // dropped, and the texture decoded again.
+    if (buf && (size < sizeof(KTXHeader) ||
+                memcmp(reinterpret_cast<const KTXHeader *>(buf)->id,
+                       kKTXIdentifier, sizeof(KTXHeader::id)) != 0)) {
+      LogError(kApplication, "Bad texture cache entry for %s", filename);
+      free(buf);
+      buf = nullptr;
+      cache.Remove(key);
+    }
+    if (buf) {
+      // Cubemaps and arrays are loaded as strips of their faces or layers.
+      const auto &header = *reinterpret_cast<const KTXHeader *>(buf);
+      const uint32_t layers = std::max(header.array_elements, 1u);
+      *dimensions =
+          vec2i(header.width, header.height * header.faces * layers);
+      *texture_format = kFormatKTX;
+      AddDecodedBytes(*dimensions, *texture_format, size);
+      return buf;
+    }
+  }
+
+  uint8_t *buf = nullptr;
   if (ext == "tga" || ext == "png" || ext == "jpg") {
-    auto buf = UnpackImage(file.c_str(), file.length(), scale, dimensions,
-                           texture_format);
+    buf = UnpackImage(file.c_str(), file.length(), scale, dimensions,
+                      texture_format, flags);
     if (!buf) LogError(kApplication, "Image format problem: %s", filename);
-    return buf;
   } else if (ext == "webp") {
-    auto buf = UnpackWebP(file.c_str(), file.length(), scale, dimensions,
-                          texture_format);
+    buf = UnpackWebP(file.c_str(), file.length(), scale, dimensions,
+                     texture_format, flags);
     if (!buf) LogError(kApplication, "WebP format problem: %s", filename);
-    return buf;
   } else {
     LogError(kApplication, "Can\'t figure out file type from extension: %s",
              filename);
     return nullptr;
   }
+
+  // Convert here, on the loader thread, what CreateTexture() would otherwise
+  // convert, and keep the result for the next run.
+  std::string ktx;
+  if (buf && cacheable &&
+      PackKTX(buf, *dimensions, *texture_format, desired, flags, &ktx)) {
+    cache.Store(key, ktx);
+    free(buf);
+    buf = static_cast<uint8_t *>(malloc(ktx.size()));
+    memcpy(buf, ktx.data(), ktx.size());
+    *texture_format = kFormatKTX;
+  }
+  if (buf) {
+    AddDecodedBytes(*dimensions, *texture_format,
+                    ktx.empty() ? file.length() : ktx.size());
+  }
+  return buf;
 }
 
 }  // namespace fplbase
@@ -0,0 +1,421 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "fplbase/texture_cache.h"
+#include "fplbase/utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif  // defined(_WIN32)
+
+#ifdef FPL_BASE_BACKEND_STDLIB
+#include <mutex>
+#endif
+
+namespace fplbase {
+
+// Holds a TextureCache's mutex for as long as it exists.
+class TextureCacheLock {
+ public:
+  explicit TextureCacheLock(const TextureCache *cache)
+      : mutex_(cache->mutex_) {
+#ifdef FPL_BASE_BACKEND_SDL
+    auto err = SDL_LockMutex(static_cast<SDL_mutex *>(mutex_));
+    (void)err;
+    assert(err == 0);
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    static_cast<std::mutex *>(mutex_)->lock();
+#else
+#error Need to define FPL_BASE_BACKEND_XXX
+#endif
+  }
+  ~TextureCacheLock() {
+#ifdef FPL_BASE_BACKEND_SDL
+    SDL_UnlockMutex(static_cast<SDL_mutex *>(mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+    static_cast<std::mutex *>(mutex_)->unlock();
+#endif
+  }
+
+ private:
+  void *mutex_;
+};
+
+static const char kIndexFile[] = "texture_cache_index";
+static const char kIndexMagic[] = "fplbase_texture_cache";
+
+// Change this when the contents of entries change, e.g. how PackKTX() builds
+// mips, so old entries are no longer found.
+static const uint64_t kTextureCacheVersion = 2;
+
+static const uint64_t kFNVOffsetBasis = 0xcbf29ce484222325ULL;
+static const uint64_t kFNVPrime = 0x100000001b3ULL;
+
+// Store() writes the index after this many stores. Close() always writes
+// it, and entries left out of it by a crash are deleted by the next Open().
+static const size_t kStoresPerIndexSave = 16;
+
+// Flags that change what PackKTX() makes of a texture.
+static const int kContentFlags =
+    kTextureFlagsUseMipMaps | kTextureFlagsIsCubeMap | kTextureFlagsIsArray |
+    kTextureFlagsBoxDownscale;
+
+// FNV-1a, on 64 bit words instead of bytes so large files hash quickly. The
+// shift lets the high bits of each word affect the low bits of the hash.
+static uint64_t HashBytes(const void *data, size_t size, uint64_t hash) {
+  auto bytes = static_cast<const uint8_t *>(data);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * kFNVPrime;
+    hash ^= hash >> 32;
+  }
+  for (; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * kFNVPrime;
+  }
+  return hash;
+}
+
+// Returns the names of the files in `directory`.
+static std::vector<std::string> ListFiles(const std::string &directory) {
+  std::vector<std::string> names;
+#if defined(_WIN32)
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE) return names;
+  do {
+    names.push_back(data.cFileName);
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) return names;
+  while (struct dirent *entry = readdir(dir)) names.push_back(entry->d_name);
+  closedir(dir);
+#endif  // defined(_WIN32)
+  return names;
+}
+
+// Moves the file `from` to `to`, replacing it. POSIX rename() does that
+// atomically, Windows' fails if `to` exists, so it is removed first.
+static bool MoveOver(const std::string &from, const std::string &to) {
+#if defined(_WIN32)
+  remove(to.c_str());
+#endif  // defined(_WIN32)
+  return rename(from.c_str(), to.c_str()) == 0;
+}
+
+// If `name` is an entry file, or a temporary file Store() writes one to,
+// sets `key` to the entry's key and `temporary` to which it is.
+static bool ParseEntryName(const std::string &name, TextureCache::Key *key,
+                           bool *temporary) {
+  static const size_t kKeyLength = 16;
+  static const char kExtension[] = ".ktx";
+  static const char kTemporaryExtension[] = ".tmp";
+  if (name.size() < kKeyLength + strlen(kExtension) ||
+      name.compare(kKeyLength, strlen(kExtension), kExtension) != 0 ||
+      name.find_first_not_of("0123456789abcdef") != kKeyLength) {
+    return false;
+  }
+  *temporary = name.size() != kKeyLength + strlen(kExtension);
+  if (*temporary &&
+      name.compare(name.size() - strlen(kTemporaryExtension),
+                   strlen(kTemporaryExtension), kTemporaryExtension) != 0) {
+    return false;
+  }
+  *key = static_cast<TextureCache::Key>(
+      strtoull(name.substr(0, kKeyLength).c_str(), nullptr, 16));
+  return true;
+}
+
+TextureCache::TextureCache()
+    : max_bytes_(0),
+      total_bytes_(0),
+      use_counter_(0),
+      temp_counter_(0),
+      stores_since_save_(0),
+      open_(false),
+      index_dirty_(false) {
+#ifdef FPL_BASE_BACKEND_SDL
+  mutex_ = SDL_CreateMutex();
+  assert(mutex_);
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  mutex_ = new std::mutex();
+#endif
+}
+
+TextureCache::~TextureCache() {
+  Close();
+#ifdef FPL_BASE_BACKEND_SDL
+  SDL_DestroyMutex(static_cast<SDL_mutex *>(mutex_));
+#elif defined(FPL_BASE_BACKEND_STDLIB)
+  delete static_cast<std::mutex *>(mutex_);
+#endif
+}
+
+TextureCache &TextureCache::Shared() {
+  static TextureCache cache;
+  return cache;
+}
+
+bool TextureCache::Open(const std::string &directory, size_t max_bytes) {
+  Close();
+  TextureCacheLock lock(this);
+  directory_ = directory;
+  max_bytes_ = max_bytes;
+  total_bytes_ = 0;
+  use_counter_ = 0;
+  entries_.clear();
+
+  // Read the index. Each line after the first is an entry: its key, its size
+  // and when it was last used. A missing or unknown index starts out empty.
+  FILE *file = fopen((directory_ + "/" + kIndexFile).c_str(), "r");
+  if (file) {
+    char magic[64];
+    unsigned long long version = 0;
+    if (fscanf(file, "%63s %llu", magic, &version) == 2 &&
+        strcmp(magic, kIndexMagic) == 0 && version == kTextureCacheVersion) {
+      unsigned long long key, size, last_use;
+      while (fscanf(file, "%llx %llu %llu", &key, &size, &last_use) == 3) {
+        Entry &entry = entries_[static_cast<Key>(key)];
+        entry.size = static_cast<size_t>(size);
+        entry.last_use = last_use;
+        total_bytes_ += entry.size;
+        use_counter_ = std::max(use_counter_, entry.last_use + 1);
+      }
+    }
+    fclose(file);
+  }
+  RemoveOrphansLocked();
+
+  // Writing the index now checks that the directory can be used.
+  open_ = true;
+  index_dirty_ = true;
+  SaveIndexLocked();
+  if (index_dirty_) {
+    LogError(kError, "TextureCache: can't write to %s", directory.c_str());
+    open_ = false;
+    entries_.clear();
+    total_bytes_ = 0;
+    return false;
+  }
+  return true;
+}
+
+void TextureCache::Close() {
+  TextureCacheLock lock(this);
+  if (!open_) return;
+  SaveIndexLocked();
+  open_ = false;
+  entries_.clear();
+  total_bytes_ = 0;
+}
+
+void TextureCache::Clear() {
+  TextureCacheLock lock(this);
+  while (!entries_.empty()) RemoveLocked(entries_.begin()->first);
+  SaveIndexLocked();
+}
+
+TextureCache::Key TextureCache::MakeKey(const void *file, size_t size,
+                                        TextureFormat desired,
+                                        TextureFlags flags,
+                                        const mathfu::vec2 &scale) {
+  const int content_flags = flags & kContentFlags;
+  const float scale_xy[2] = {scale.x(), scale.y()};
+  const int format = desired;
+  uint64_t hash = HashBytes(&kTextureCacheVersion,
+                            sizeof(kTextureCacheVersion), kFNVOffsetBasis);
+  hash = HashBytes(&format, sizeof(format), hash);
+  hash = HashBytes(&content_flags, sizeof(content_flags), hash);
+  hash = HashBytes(scale_xy, sizeof(scale_xy), hash);
+  return HashBytes(file, size, hash);
+}
+
+uint8_t *TextureCache::Load(Key key, size_t *size) {
+  std::string path;
+  size_t expected_size = 0;
+  {
+    TextureCacheLock lock(this);
+    if (!open_) return nullptr;
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return nullptr;
+    it->second.last_use = use_counter_++;
+    index_dirty_ = true;
+    expected_size = it->second.size;
+    path = EntryPath(key);
+  }
+
+  // Read without holding the lock, so other threads can use the cache.
+  uint8_t *buf = nullptr;
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file) {
+    buf = static_cast<uint8_t *>(malloc(expected_size));
+    const bool read = fread(buf, 1, expected_size, file) == expected_size &&
+                      fgetc(file) == EOF;
+    fclose(file);
+    if (!read) {
+      free(buf);
+      buf = nullptr;
+    }
+  }
+  if (!buf) {
+    // The entry was deleted or changed outside the cache.
+    TextureCacheLock lock(this);
+    RemoveLocked(key);
+    return nullptr;
+  }
+  *size = expected_size;
+  return buf;
+}
+
+bool TextureCache::Store(Key key, const std::string &data) {
+  std::string path;
+  std::string temp_path;
+  {
+    TextureCacheLock lock(this);
+    if (!open_ || data.size() > max_bytes_) return false;
+    path = EntryPath(key);
+    // Each store writes its own temporary file, so threads storing the same
+    // key don't write into each other's.
+    temp_path =
+        path + "." + flatbuffers::NumToString(temp_counter_++) + ".tmp";
+  }
+
+  // Entries appear complete or not at all, even if the app is killed while
+  // writing one.
+  FILE *file = fopen(temp_path.c_str(), "wb");
+  if (!file) return false;
+  const bool written =
+      fwrite(data.data(), 1, data.size(), file) == data.size();
+  fclose(file);
+  if (!written || !MoveOver(temp_path, path)) {
+    remove(temp_path.c_str());
+    return false;
+  }
+
+  TextureCacheLock lock(this);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) total_bytes_ -= it->second.size;
+  Entry &entry = entries_[key];
+  entry.size = data.size();
+  entry.last_use = use_counter_++;
+  total_bytes_ += entry.size;
+
+  // Delete the least recently used entries until everything fits. The new
+  // entry is the most recently used, so it goes last.
+  if (total_bytes_ > max_bytes_) {
+    std::vector<std::pair<uint64_t, Key>> by_use;
+    by_use.reserve(entries_.size());
+    for (auto e = entries_.begin(); e != entries_.end(); ++e) {
+      by_use.push_back(std::make_pair(e->second.last_use, e->first));
+    }
+    std::sort(by_use.begin(), by_use.end());
+    for (auto e = by_use.begin();
+         e != by_use.end() && total_bytes_ > max_bytes_; ++e) {
+      RemoveLocked(e->second);
+    }
+  }
+  index_dirty_ = true;
+  if (++stores_since_save_ >= kStoresPerIndexSave) SaveIndexLocked();
+  return true;
+}
+
+bool TextureCache::is_open() const {
+  TextureCacheLock lock(this);
+  return open_;
+}
+
+size_t TextureCache::total_bytes() const {
+  TextureCacheLock lock(this);
+  return total_bytes_;
+}
+
+size_t TextureCache::num_entries() const {
+  TextureCacheLock lock(this);
+  return entries_.size();
+}
+
+std::string TextureCache::EntryPath(Key key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.ktx",
+           static_cast<unsigned long long>(key));
+  return directory_ + "/" + name;
+}
+
+void TextureCache::Remove(Key key) {
+  TextureCacheLock lock(this);
+  RemoveLocked(key);
+}
+
+void TextureCache::RemoveLocked(Key key) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return;
+  remove(EntryPath(key).c_str());
+  total_bytes_ -= it->second.size;
+  entries_.erase(it);
+  index_dirty_ = true;
+}
+
+void TextureCache::RemoveOrphansLocked() {
+  const std::vector<std::string> names = ListFiles(directory_);
+  for (auto it = names.begin(); it != names.end(); ++it) {
+    Key key;
+    bool temporary;
+    if (!ParseEntryName(*it, &key, &temporary)) continue;
+    if (temporary || entries_.find(key) == entries_.end()) {
+      remove((directory_ + "/" + *it).c_str());
+    }
+  }
+}
+
+void TextureCache::SaveIndexLocked() {
+  if (!open_ || !index_dirty_) return;
+  std::string index = std::string(kIndexMagic) + " " +
+                      flatbuffers::NumToString(kTextureCacheVersion) + "\n";
+  char line[64];
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    snprintf(line, sizeof(line), "%016llx %llu %llu\n",
+             static_cast<unsigned long long>(it->first),
+             static_cast<unsigned long long>(it->second.size),
+             static_cast<unsigned long long>(it->second.last_use));
+    index += line;
+  }
+  // Like entries, the index is replaced whole or not at all.
+  const std::string path = directory_ + "/" + kIndexFile;
+  const std::string temp_path = path + ".tmp";
+  FILE *file = fopen(temp_path.c_str(), "w");
+  if (!file) return;
+  const bool written =
+      fwrite(index.data(), 1, index.size(), file) == index.size();
+  fclose(file);
+  if (!written || !MoveOver(temp_path, path)) {
+    remove(temp_path.c_str());
+    return;
+  }
+  index_dirty_ = false;
+  stores_since_save_ = 0;
+}
+
+}  // namespace fplbase
@@ -0,0 +1,387 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "fplbase/texture_transcoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using mathfu::vec2i;
+
+namespace fplbase {
+
+static const char kETC1SMagic[4] = {'E', '1', 'S', '1'};
+
+// Intensity modifiers of ETC1: pixel index 0 and 1 add the small and large
+// modifier of the block's table, 2 and 3 subtract them.
+static const int kETC1Modifiers[8][2] = {
+    {2, 8},   {5, 17},  {9, 29},   {13, 42},
+    {18, 60}, {24, 80}, {33, 106}, {47, 183},
+};
+
+// Pixel indices of ETC1 in order of increasing intensity.
+static const int kETC1IndexByRank[4] = {3, 2, 0, 1};
+
+static const size_t kASTCBlockSize = 16;
+static const size_t kASTCHeaderSize = 16;
+static const size_t kPKMHeaderSize = 16;
+
+// ASTC block mode for a 4x4 grid of 2 bit weights, with one plane.
+static const uint32_t kASTCBlockMode4x4Weights2Bits = 0x42;
+// ASTC color endpoint mode for direct LDR RGB endpoints.
+static const uint32_t kASTCEndpointModeLDRRGB = 8;
+
+static inline int Clamp255(int value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static inline int Expand5(int value) { return (value << 3) | (value >> 2); }
+static inline int Expand4(int value) { return (value << 4) | value; }
+
+static inline void WriteLE32(uint32_t value, uint8_t *dest) {
+  for (int i = 0; i < 4; ++i) dest[i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+static inline uint32_t ReadLE32(const uint8_t *src) {
+  return src[0] | (src[1] << 8) | (src[2] << 16) |
+         (static_cast<uint32_t>(src[3]) << 24);
+}
+
+// The fields of an ETC1S block: one base color, one table, 16 selectors.
+struct ETC1SBlock {
+  int base[3];  // Expanded to 8 bits.
+  int table;
+  uint32_t indices;  // ETC1 layout: MSBs in the high 16 bits.
+};
+
+static inline void UnpackETC1SBlock(const uint8_t *block, ETC1SBlock *out) {
+  for (int c = 0; c < 3; ++c) out->base[c] = Expand5(block[c] >> 3);
+  out->table = block[3] >> 5;
+  out->indices = (static_cast<uint32_t>(block[4]) << 24) | (block[5] << 16) |
+                 (block[6] << 8) | block[7];
+}
+
+// Returns the ETC1 pixel index (0..3) of pixel (x, y) in a block.
+static inline int PixelIndex(uint32_t indices, int x, int y) {
+  const int bit = x * 4 + y;
+  return static_cast<int>(((indices >> (bit + 16)) & 1) << 1 |
+                          ((indices >> bit) & 1));
+}
+
+static inline int Modifier(int table, int index) {
+  const int magnitude = kETC1Modifiers[table][index & 1];
+  return index & 2 ? -magnitude : magnitude;
+}
+
+void DecodeETC1Block(const uint8_t *block, uint8_t *rgb) {
+  int base[2][3];
+  const bool diff = (block[3] & 2) != 0;
+  const bool flip = (block[3] & 1) != 0;
+  for (int c = 0; c < 3; ++c) {
+    if (diff) {
+      const int first = block[c] >> 3;
+      int delta = block[c] & 7;
+      if (delta >= 4) delta -= 8;
+      base[0][c] = Expand5(first);
+      base[1][c] = Expand5((first + delta) & 31);
+    } else {
+      base[0][c] = Expand4(block[c] >> 4);
+      base[1][c] = Expand4(block[c] & 15);
+    }
+  }
+  const int tables[2] = {block[3] >> 5, (block[3] >> 2) & 7};
+  const uint32_t indices = (static_cast<uint32_t>(block[4]) << 24) |
+                           (block[5] << 16) | (block[6] << 8) | block[7];
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      const int sub = flip ? (y >= 2) : (x >= 2);
+      const int modifier = Modifier(tables[sub], PixelIndex(indices, x, y));
+      uint8_t *out = rgb + (y * 4 + x) * 3;
+      for (int c = 0; c < 3; ++c) {
+        out[c] = static_cast<uint8_t>(Clamp255(base[sub][c] + modifier));
+      }
+    }
+  }
+}
+
+// Picks the table and pixel indices that best fit `pixels` (16 RGB values
+// in rows) around `base`, and returns the squared error.
+static int FitETC1SIndices(const int *pixels, const int *base, int *table,
+                           uint32_t *indices) {
+  int best_error = -1;
+  for (int t = 0; t < 8; ++t) {
+    int error = 0;
+    uint32_t bits = 0;
+    for (int p = 0; p < 16; ++p) {
+      int best_pixel_error = -1;
+      int best_index = 0;
+      for (int index = 0; index < 4; ++index) {
+        const int modifier = Modifier(t, index);
+        int pixel_error = 0;
+        for (int c = 0; c < 3; ++c) {
+          const int d = Clamp255(base[c] + modifier) - pixels[p * 3 + c];
+          pixel_error += d * d;
+        }
+        if (best_pixel_error < 0 || pixel_error < best_pixel_error) {
+          best_pixel_error = pixel_error;
+          best_index = index;
+        }
+      }
+      error += best_pixel_error;
+      const int bit = (p % 4) * 4 + p / 4;
+      bits |= static_cast<uint32_t>(best_index >> 1) << (bit + 16);
+      bits |= static_cast<uint32_t>(best_index & 1) << bit;
+    }
+    if (best_error < 0 || error < best_error) {
+      best_error = error;
+      *table = t;
+      *indices = bits;
+    }
+  }
+  return best_error;
+}
+
+// Encodes 16 RGB pixels (in rows) into an ETC1S block.
+static void EncodeETC1SBlock(const int *pixels, uint8_t *block) {
+  int average[3] = {0, 0, 0};
+  for (int p = 0; p < 16; ++p) {
+    for (int c = 0; c < 3; ++c) average[c] += pixels[p * 3 + c];
+  }
+  int quantized[3];
+  for (int c = 0; c < 3; ++c) {
+    quantized[c] = (average[c] * 31 + 255 * 8) / (255 * 16);
+  }
+  // Try the rounded average color, and its neighbours along the gray axis,
+  // which the modifiers can't reach symmetrically once they clamp.
+  int best_error = -1;
+  int best_base[3] = {0, 0, 0};
+  int best_table = 0;
+  uint32_t best_indices = 0;
+  for (int offset = -1; offset <= 1; ++offset) {
+    int q[3];
+    int base[3];
+    for (int c = 0; c < 3; ++c) {
+      q[c] = std::min(std::max(quantized[c] + offset, 0), 31);
+      base[c] = Expand5(q[c]);
+    }
+    int table = 0;
+    uint32_t indices = 0;
+    const int error = FitETC1SIndices(pixels, base, &table, &indices);
+    if (best_error < 0 || error < best_error) {
+      best_error = error;
+      std::copy(q, q + 3, best_base);
+      best_table = table;
+      best_indices = indices;
+    }
+  }
+  // Differential mode with no difference, and the same table for both halves.
+  for (int c = 0; c < 3; ++c) {
+    block[c] = static_cast<uint8_t>(best_base[c] << 3);
+  }
+  block[3] = static_cast<uint8_t>(best_table << 5 | best_table << 2 | 2);
+  for (int i = 0; i < 4; ++i) {
+    block[4 + i] = static_cast<uint8_t>(best_indices >> (24 - i * 8));
+  }
+}
+
+void EncodeETC1S(const uint8_t *pixels, const vec2i &size, int channels,
+                 std::string *file) {
+  assert(channels == 3 || channels == 4);
+  const int blocks_x = (size.x() + 3) / 4;
+  const int blocks_y = (size.y() + 3) / 4;
+  file->assign(kETC1SHeaderSize +
+                   static_cast<size_t>(blocks_x) * blocks_y * kETC1SBlockSize,
+               '\0');
+  uint8_t *out = reinterpret_cast<uint8_t *>(&(*file)[0]);
+  memcpy(out, kETC1SMagic, sizeof(kETC1SMagic));
+  WriteLE32(static_cast<uint32_t>(size.x()), out + 4);
+  WriteLE32(static_cast<uint32_t>(size.y()), out + 8);
+  out += kETC1SHeaderSize;
+
+  int block_pixels[16 * 3];
+  for (int by = 0; by < blocks_y; ++by) {
+    for (int bx = 0; bx < blocks_x; ++bx) {
+      // Blocks past the edge of the image repeat its last row and column.
+      for (int p = 0; p < 16; ++p) {
+        const int x = std::min(bx * 4 + p % 4, size.x() - 1);
+        const int y = std::min(by * 4 + p / 4, size.y() - 1);
+        const uint8_t *src =
+            pixels + (static_cast<size_t>(y) * size.x() + x) * channels;
+        for (int c = 0; c < 3; ++c) block_pixels[p * 3 + c] = src[c];
+      }
+      EncodeETC1SBlock(block_pixels, out);
+      out += kETC1SBlockSize;
+    }
+  }
+}
+
+// Writes `count` bits of `value` into a little endian 128 bit block.
+static inline void WriteBits(uint32_t value, int count, int position,
+                             uint8_t *block) {
+  for (int i = 0; i < count; ++i, ++position) {
+    if (value & (1u << i)) block[position >> 3] |= 1 << (position & 7);
+  }
+}
+
+// Transcodes an ETC1S block into an ASTC 4x4 block with one partition,
+// direct RGB endpoints and 2 bit weights.
+static void TranscodeBlockToASTC(const ETC1SBlock &etc, uint8_t *block) {
+  // Fit a line through the block's four colors, weighted by how many pixels
+  // use each, placing them at the ASTC weights 0, 1/3, 2/3 and 1. The
+  // colors lie on the gray axis through the base color, so a single offset
+  // describes all channels.
+  int counts[4] = {0, 0, 0, 0};
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) ++counts[PixelIndex(etc.indices, x, y)];
+  }
+  float sum_n = 0.0f, sum_t = 0.0f, sum_m = 0.0f, sum_tt = 0.0f,
+        sum_tm = 0.0f;
+  for (int rank = 0; rank < 4; ++rank) {
+    const float n = static_cast<float>(counts[kETC1IndexByRank[rank]]);
+    const float t = rank / 3.0f;
+    const float m =
+        static_cast<float>(Modifier(etc.table, kETC1IndexByRank[rank]));
+    sum_n += n;
+    sum_t += n * t;
+    sum_m += n * m;
+    sum_tt += n * t * t;
+    sum_tm += n * t * m;
+  }
+  const float denominator = sum_n * sum_tt - sum_t * sum_t;
+  float slope = 0.0f;
+  float intercept = sum_m / sum_n;
+  if (denominator > 1e-6f) {
+    slope = (sum_n * sum_tm - sum_t * sum_m) / denominator;
+    intercept = (sum_m - slope * sum_t) / sum_n;
+  }
+  const int low = static_cast<int>(floorf(intercept + 0.5f));
+  const int high = static_cast<int>(floorf(intercept + slope + 0.5f));
+
+  memset(block, 0, kASTCBlockSize);
+  WriteBits(kASTCBlockMode4x4Weights2Bits, 11, 0, block);
+  // Bits 11 and 12 hold the partition count minus one, which is 0.
+  WriteBits(kASTCEndpointModeLDRRGB, 4, 13, block);
+  // With 79 bits left for 6 endpoint values, they are stored as plain bytes:
+  // r0, r1, g0, g1, b0, b1.
+  for (int c = 0; c < 3; ++c) {
+    WriteBits(static_cast<uint32_t>(Clamp255(etc.base[c] + low)), 8,
+              17 + c * 16, block);
+    WriteBits(static_cast<uint32_t>(Clamp255(etc.base[c] + high)), 8,
+              25 + c * 16, block);
+  }
+  // Weights are stored from the top bit of the block down, in rows.
+  int rank_of_index[4];
+  for (int rank = 0; rank < 4; ++rank) {
+    rank_of_index[kETC1IndexByRank[rank]] = rank;
+  }
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      const int weight = rank_of_index[PixelIndex(etc.indices, x, y)];
+      const int position = 127 - (y * 4 + x) * 2;
+      if (weight & 1) block[position >> 3] |= 1 << (position & 7);
+      if (weight & 2) block[(position - 1) >> 3] |= 1 << ((position - 1) & 7);
+    }
+  }
+}
+
+uint8_t *TranscodeETC1S(const void *file, size_t size, TextureFormat target,
+                        vec2i *dimensions) {
+  auto src = static_cast<const uint8_t *>(file);
+  if (size < kETC1SHeaderSize ||
+      memcmp(src, kETC1SMagic, sizeof(kETC1SMagic)) != 0) {
+    return nullptr;
+  }
+  const int width = static_cast<int>(ReadLE32(src + 4));
+  const int height = static_cast<int>(ReadLE32(src + 8));
+  const int blocks_x = (width + 3) / 4;
+  const int blocks_y = (height + 3) / 4;
+  const size_t num_blocks = static_cast<size_t>(blocks_x) * blocks_y;
+  if (width <= 0 || height <= 0 ||
+      size < kETC1SHeaderSize + num_blocks * kETC1SBlockSize) {
+    return nullptr;
+  }
+  const uint8_t *blocks = src + kETC1SHeaderSize;
+  *dimensions = vec2i(width, height);
+
+  switch (target) {
+    case kFormatPKM: {
+      // ETC2 decoders read ETC1 blocks unchanged.
+      const size_t data_size = num_blocks * kETC1SBlockSize;
+      auto buf = static_cast<uint8_t *>(malloc(kPKMHeaderSize + data_size));
+      memcpy(buf, "PKM 20", 6);
+      const int sizes[6] = {0, 1, blocks_x * 4, blocks_y * 4, width, height};
+      for (int i = 0; i < 5; ++i) {
+        buf[6 + i * 2] = static_cast<uint8_t>(sizes[i + 1] >> 8);
+        buf[7 + i * 2] = static_cast<uint8_t>(sizes[i + 1]);
+      }
+      memcpy(buf + kPKMHeaderSize, blocks, data_size);
+      return buf;
+    }
+    case kFormatASTC: {
+      auto buf = static_cast<uint8_t *>(
+          malloc(kASTCHeaderSize + num_blocks * kASTCBlockSize));
+      static const uint8_t magic[] = {0x13, 0xab, 0xa1, 0x5c, 4, 4, 1};
+      memcpy(buf, magic, sizeof(magic));
+      for (int i = 0; i < 3; ++i) {
+        buf[7 + i] = static_cast<uint8_t>(width >> (i * 8));
+        buf[10 + i] = static_cast<uint8_t>(height >> (i * 8));
+        buf[13 + i] = static_cast<uint8_t>(i == 0 ? 1 : 0);
+      }
+      uint8_t *out = buf + kASTCHeaderSize;
+      ETC1SBlock etc;
+      for (size_t i = 0; i < num_blocks; ++i) {
+        UnpackETC1SBlock(blocks + i * kETC1SBlockSize, &etc);
+        TranscodeBlockToASTC(etc, out + i * kASTCBlockSize);
+      }
+      return buf;
+    }
+    case kFormat565:
+    case kFormat888: {
+      const int bytes_per_pixel = target == kFormat565 ? 2 : 3;
+      auto buf = static_cast<uint8_t *>(
+          malloc(static_cast<size_t>(width) * height * bytes_per_pixel));
+      uint8_t rgb[16 * 3];
+      for (int by = 0; by < blocks_y; ++by) {
+        for (int bx = 0; bx < blocks_x; ++bx) {
+          DecodeETC1Block(blocks + (by * blocks_x + bx) * kETC1SBlockSize,
+                          rgb);
+          const int rows = std::min(4, height - by * 4);
+          const int columns = std::min(4, width - bx * 4);
+          for (int y = 0; y < rows; ++y) {
+            const size_t row = static_cast<size_t>(by * 4 + y) * width;
+            for (int x = 0; x < columns; ++x) {
+              const uint8_t *c = rgb + (y * 4 + x) * 3;
+              const size_t pixel = row + bx * 4 + x;
+              if (target == kFormat565) {
+                reinterpret_cast<uint16_t *>(buf)[pixel] =
+                    static_cast<uint16_t>((c[0] >> 3) << 11 |
+                                          (c[1] >> 2) << 5 | c[2] >> 3);
+              } else {
+                memcpy(buf + pixel * 3, c, 3);
+              }
+            }
+          }
+        }
+      }
+      return buf;
+    }
+    default:
+      return nullptr;
+  }
+}
+
+}  // namespace fplbase
@@ -17,6 +17,8 @@
 #include "fplbase/utilities.h"
 // clang-format on
 
+#include "fplbase/asset_telemetry.h"
+
 #if defined(__ANDROID__)
 #include <string>
 #endif  // defined(__ANDROID__)
@@ -81,7 +83,10 @@ LoadFileFunction SetLoadFileFunction(LoadFileFunction load_file_function) {
 
 bool LoadFile(const char *filename, std::string *dest) {
   assert(g_load_file_function);
-  return g_load_file_function(filename, dest);
+  AssetLoadPhaseTimer timer(kAssetLoadPhaseRead);
+  const bool loaded = g_load_file_function(filename, dest);
+  if (loaded) AssetLoadAddBytes(dest->size(), 0);
+  return loaded;
 }
 
 #ifdef FPL_BASE_BACKEND_SDL
@@ -0,0 +1,196 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fplbase/asset_manager.h"
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "gtest/gtest.h"
+#include "fake_load_file.h"
+#include "materials_generated.h"
+
+using fplbase::AssetManager;
+using fplbase::AssetMemoryStats;
+using fplbase::FileAsset;
+using fplbase::kAssetTypeFile;
+using fplbase::kAssetTypeTexture;
+using fplbase::Material;
+using fplbase::Texture;
+
+class AssetManagerTests : public ::testing::Test {
+ protected:
+  // Every file is 1000 bytes.
+  AssetManagerTests() : files_(1000) {}
+
+  FakeLoadFile files_;
+  fplbase::Renderer renderer_;
+};
+
+TEST_F(AssetManagerTests, UnloadDeletesWithoutBudget) {
+  AssetManager assets(renderer_);
+  assets.LoadFileAsset("a");
+  FileAsset *b = assets.LoadFileAsset("b");
+  b->IncreaseRefCount();
+  EXPECT_EQ(2000u, assets.MemoryStats(kAssetTypeFile).usage.cpu_bytes);
+
+  assets.UnloadFileAsset("a");
+  assets.UnloadFileAsset("b");
+  EXPECT_EQ(nullptr, assets.FindFileAsset("a"));
+  EXPECT_EQ(b, assets.FindFileAsset("b"));
+  assets.UnloadFileAsset("b");
+  EXPECT_EQ(nullptr, assets.FindFileAsset("b"));
+  EXPECT_EQ(0u, assets.MemoryStats(kAssetTypeFile).count);
+}
+
+TEST_F(AssetManagerTests, UnusedAssetsAreReused) {
+  AssetManager assets(renderer_);
+  assets.set_memory_budget(10000);
+  FileAsset *a = assets.LoadFileAsset("a");
+  assets.UnloadFileAsset("a");
+  AssetMemoryStats stats = assets.MemoryStats(kAssetTypeFile);
+  EXPECT_EQ(1u, stats.count);
+  EXPECT_EQ(1u, stats.unused_count);
+  EXPECT_EQ(1000u, stats.unused_bytes);
+  // Unloading an unused asset again does nothing.
+  assets.UnloadFileAsset("a");
+
+  EXPECT_EQ(a, assets.LoadFileAsset("a"));
+  EXPECT_EQ(0u, assets.MemoryStats(kAssetTypeFile).unused_count);
+  EXPECT_EQ(1u, assets.load_telemetry().CacheCounts("file").hits);
+}
+
+TEST_F(AssetManagerTests, EvictsLeastRecentlyUnloaded) {
+  AssetManager assets(renderer_);
+  assets.set_memory_budget(3500);
+  const char *names[] = {"a", "b", "c", "d", "e"};
+  for (int i = 0; i < 5; ++i) assets.LoadFileAsset(names[i]);
+  // Over budget, but nothing is unused yet.
+  EXPECT_EQ(5000u, assets.TotalMemoryStats().usage.total());
+
+  assets.UnloadFileAsset("c");
+  assets.UnloadFileAsset("a");
+  assets.UnloadFileAsset("b");
+  // c and a go, leaving 3000 bytes.
+  EXPECT_EQ(nullptr, assets.FindFileAsset("c"));
+  EXPECT_EQ(nullptr, assets.FindFileAsset("a"));
+  EXPECT_NE(nullptr, assets.FindFileAsset("b"));
+  AssetMemoryStats stats = assets.MemoryStats(kAssetTypeFile);
+  EXPECT_EQ(3u, stats.count);
+  EXPECT_EQ(1u, stats.unused_count);
+  EXPECT_EQ(3000u, stats.usage.cpu_bytes);
+  EXPECT_EQ(0u, stats.usage.gpu_bytes);
+  EXPECT_EQ(0u, assets.MemoryStats(kAssetTypeTexture).count);
+  EXPECT_EQ(3000u, assets.TotalMemoryStats().usage.total());
+
+  // Reused assets are no longer candidates for eviction.
+  assets.LoadFileAsset("b");
+  assets.set_memory_budget(1000);
+  EXPECT_NE(nullptr, assets.FindFileAsset("b"));
+
+  assets.UnloadFileAsset("d");
+  assets.UnloadFileAsset("e");
+  assets.set_memory_budget(100000);
+  EXPECT_EQ(nullptr, assets.FindFileAsset("d"));
+  EXPECT_EQ(nullptr, assets.FindFileAsset("e"));
+}
+
+TEST_F(AssetManagerTests, PurgeUnusedAssets) {
+  AssetManager assets(renderer_);
+  assets.set_memory_budget(100000);
+  assets.LoadFileAsset("a");
+  assets.LoadFileAsset("b");
+  assets.UnloadFileAsset("a");
+  assets.LoadFileAsset("c");
+  assets.EnforceMemoryBudget();
+  EXPECT_EQ(1u, assets.TotalMemoryStats().unused_count);
+  assets.PurgeUnusedAssets();
+  EXPECT_EQ(nullptr, assets.FindFileAsset("a"));
+  EXPECT_EQ(2u, assets.MemoryStats(kAssetTypeFile).count);
+  EXPECT_EQ(0u, assets.TotalMemoryStats().unused_count);
+}
+
+TEST_F(AssetManagerTests, HotReloadsFileAssets) {
+  static const char kFilename[] = "asset_manager_test_hot_reload.txt";
+  fplbase::SetLoadFileFunction(nullptr);
+  ASSERT_TRUE(fplbase::SaveFile(kFilename, "old"));
+  AssetManager assets(renderer_);
+  assets.EnableHotReload(true);
+  FileAsset *file = assets.LoadFileAsset(kFilename);
+  ASSERT_NE(nullptr, file);
+  EXPECT_EQ("old", file->contents);
+  EXPECT_EQ(0, assets.ReloadChangedAssets());
+
+  ASSERT_TRUE(fplbase::SaveFile(kFilename, "new"));
+  EXPECT_EQ(1, assets.ReloadChangedAssets());
+  // The new contents are swapped into the same FileAsset.
+  for (int i = 0; i < 1000 && !assets.TryFinalize(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_EQ(file, assets.FindFileAsset(kFilename));
+  EXPECT_EQ("new", file->contents);
+  remove(kFilename);
+}
+
+// Every file loaded is a material with the single texture "shared.webp".
+static bool LoadSharedTextureMaterial(const char *, std::string *dest) {
+  flatbuffers::FlatBufferBuilder fbb;
+  std::vector<flatbuffers::Offset<flatbuffers::String>> textures;
+  textures.push_back(fbb.CreateString("shared.webp"));
+  auto textures_fb = fbb.CreateVector(textures);
+  matdef::FinishMaterialBuffer(fbb, matdef::CreateMaterial(fbb, textures_fb));
+  dest->assign(reinterpret_cast<const char *>(fbb.GetBufferPointer()),
+               fbb.GetSize());
+  return true;
+}
+
+TEST_F(AssetManagerTests, MaterialsKeepSharedTexturesAlive) {
+  fplbase::SetLoadFileFunction(LoadSharedTextureMaterial);
+  AssetManager assets(renderer_);
+  assets.set_memory_budget(100000);
+  // Queued, but never loaded, so no GL context is needed. The materials
+  // below find it already loaded.
+  Texture *tex = assets.LoadTexture("shared.webp", fplbase::kFormatAuto,
+                                    fplbase::kTextureFlagsLoadAsync);
+  ASSERT_NE(nullptr, tex);
+  Material *a = assets.LoadMaterial("a.fplmat");
+  Material *b = assets.LoadMaterial("b.fplmat");
+  ASSERT_NE(nullptr, a);
+  ASSERT_NE(nullptr, b);
+  EXPECT_EQ(tex, a->textures()[0]);
+  EXPECT_EQ(tex, b->textures()[0]);
+
+  // Each material holds its own reference, so evicting one of them, or
+  // unloading the texture, leaves it to the other.
+  assets.UnloadMaterial("a.fplmat");
+  assets.PurgeUnusedAssets();
+  EXPECT_EQ(nullptr, assets.FindMaterial("a.fplmat"));
+  EXPECT_EQ(tex, assets.FindTexture("shared.webp"));
+  assets.UnloadTexture("shared.webp");
+  assets.PurgeUnusedAssets();
+  EXPECT_EQ(tex, assets.FindTexture("shared.webp"));
+
+  assets.UnloadMaterial("b.fplmat");
+  assets.PurgeUnusedAssets();
+  EXPECT_EQ(nullptr, assets.FindTexture("shared.webp"));
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
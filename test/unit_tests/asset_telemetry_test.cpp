@@ -0,0 +1,226 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fplbase/asset_telemetry.h"
+#include "fplbase/utilities.h"
+#include "gtest/gtest.h"
+#include "fake_load_file.h"
+
+using fplbase::AssetLoadPhaseTimer;
+using fplbase::AssetLoadRecord;
+using fplbase::AssetLoadScope;
+using fplbase::AssetLoadTelemetry;
+using fplbase::kAssetLoadPhaseDecode;
+using fplbase::kAssetLoadPhaseRead;
+using fplbase::kAssetLoadPhaseUpload;
+
+class AssetTelemetryTests : public ::testing::Test {
+ protected:
+  // Every file is 100 bytes, and takes 20ms.
+  AssetTelemetryTests() : files_(100, std::chrono::milliseconds(20)) {}
+
+  FakeLoadFile files_;
+};
+
+TEST_F(AssetTelemetryTests, RecordsPhasesAndBytes) {
+  AssetLoadTelemetry telemetry;
+  const int id = telemetry.BeginAsset("texture", "a.webp", false);
+  {
+    AssetLoadScope scope(&telemetry, id);
+    AssetLoadPhaseTimer decode(kAssetLoadPhaseDecode);
+    std::string file;
+    EXPECT_TRUE(fplbase::LoadFile("a.webp", &file));
+    fplbase::AssetLoadAddBytes(0, 4096);
+  }
+  EXPECT_EQ(4096u, telemetry.staging_bytes());
+  telemetry.EndAsset(id, true);
+  EXPECT_EQ(0u, telemetry.staging_bytes());
+  EXPECT_EQ(4096u, telemetry.peak_staging_bytes());
+
+  const auto records = telemetry.Records();
+  ASSERT_EQ(1u, records.size());
+  const AssetLoadRecord &record = records[0];
+  EXPECT_STREQ("texture", record.kind);
+  EXPECT_EQ("a.webp", record.name);
+  EXPECT_EQ(100u, record.bytes_read);
+  EXPECT_EQ(4096u, record.bytes_decoded);
+  EXPECT_FALSE(record.failed);
+  EXPECT_FALSE(record.async);
+  // The read is nested in the decode timer, but only counted as a read.
+  EXPECT_GE(record.phase_seconds[kAssetLoadPhaseRead], 0.015);
+  EXPECT_LT(record.phase_seconds[kAssetLoadPhaseDecode],
+            record.phase_seconds[kAssetLoadPhaseRead]);
+  EXPECT_EQ(0.0, record.phase_seconds[kAssetLoadPhaseUpload]);
+  EXPECT_GE(record.end, record.start);
+}
+
+TEST_F(AssetTelemetryTests, NestedLoadsAreRecordedSeparately) {
+  AssetLoadTelemetry telemetry;
+  const int mesh = telemetry.BeginAsset("mesh", "m.fplmesh", false);
+  {
+    AssetLoadScope mesh_scope(&telemetry, mesh);
+    AssetLoadPhaseTimer mesh_decode(kAssetLoadPhaseDecode);
+    std::string file;
+    fplbase::LoadFile("m.fplmesh", &file);
+    const int material = telemetry.BeginAsset("material", "m.fplmat", false);
+    {
+      AssetLoadScope material_scope(&telemetry, material);
+      AssetLoadPhaseTimer material_decode(kAssetLoadPhaseDecode);
+      fplbase::LoadFile("m.fplmat", &file);
+      fplbase::LoadFile("m.fplmat", &file);
+    }
+    telemetry.EndAsset(material, true);
+    fplbase::AssetLoadAddBytes(0, 10);
+  }
+  telemetry.EndAsset(mesh, false);
+
+  const auto records = telemetry.Records();
+  ASSERT_EQ(2u, records.size());
+  EXPECT_EQ(100u, records[0].bytes_read);
+  EXPECT_EQ(10u, records[0].bytes_decoded);
+  EXPECT_TRUE(records[0].failed);
+  EXPECT_EQ(200u, records[1].bytes_read);
+  EXPECT_EQ(0u, records[1].bytes_decoded);
+  EXPECT_GT(records[1].phase_seconds[kAssetLoadPhaseRead],
+            records[0].phase_seconds[kAssetLoadPhaseRead]);
+  // The material's reads don't count towards the mesh's decode time.
+  EXPECT_LT(records[0].phase_seconds[kAssetLoadPhaseDecode], 0.015);
+}
+
+TEST_F(AssetTelemetryTests, NothingRecordedOutsideAScope) {
+  AssetLoadTelemetry telemetry;
+  const int id = telemetry.BeginAsset("file", "f.txt", false);
+  std::string file;
+  fplbase::LoadFile("f.txt", &file);
+  fplbase::AssetLoadAddBytes(1, 1);
+  {
+    AssetLoadScope scope(nullptr, -1);
+    fplbase::LoadFile("f.txt", &file);
+  }
+  telemetry.EndAsset(id, true);
+  EXPECT_EQ(0u, telemetry.Records()[0].bytes_read);
+  EXPECT_EQ(0.0, telemetry.Records()[0].TotalSeconds());
+
+  telemetry.set_enabled(false);
+  EXPECT_EQ(-1, telemetry.BeginAsset("file", "g.txt", false));
+  telemetry.CountLookup("file", true);
+  EXPECT_EQ(1u, telemetry.Records().size());
+  EXPECT_EQ(0u, telemetry.CacheCounts(nullptr).hits);
+}
+
+TEST_F(AssetTelemetryTests, ClearForgetsLoadsInProgress) {
+  AssetLoadTelemetry telemetry;
+  const int stale = telemetry.BeginAsset("texture", "old.webp", true);
+  telemetry.AddBytes(stale, 0, 1000);
+  telemetry.Clear();
+  EXPECT_EQ(0u, telemetry.staging_bytes());
+  const int id = telemetry.BeginAsset("texture", "new.webp", true);
+  EXPECT_NE(stale, id);
+  telemetry.AddBytes(stale, 5, 5);
+  telemetry.EndAsset(stale, true);
+  const auto records = telemetry.Records();
+  ASSERT_EQ(1u, records.size());
+  EXPECT_EQ("new.webp", records[0].name);
+  EXPECT_EQ(0u, records[0].bytes_read);
+  EXPECT_LT(records[0].end, 0.0);
+  EXPECT_EQ(0u, telemetry.staging_bytes());
+}
+
+TEST_F(AssetTelemetryTests, PeakStagingAcrossThreads) {
+  AssetLoadTelemetry telemetry;
+  std::vector<int> ids;
+  for (int i = 0; i < 8; ++i) {
+    ids.push_back(telemetry.BeginAsset("texture", "t.webp", true));
+  }
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.push_back(std::thread([&telemetry, &ids, i]() {
+      AssetLoadScope scope(&telemetry, ids[i]);
+      fplbase::AssetLoadAddBytes(0, 1000);
+    }));
+  }
+  for (auto it = threads.begin(); it != threads.end(); ++it) it->join();
+  EXPECT_EQ(8000u, telemetry.peak_staging_bytes());
+  for (int i = 0; i < 4; ++i) telemetry.EndAsset(ids[i], true);
+  EXPECT_EQ(4000u, telemetry.staging_bytes());
+  EXPECT_EQ(8000u, telemetry.peak_staging_bytes());
+}
+
+TEST_F(AssetTelemetryTests, CacheCounts) {
+  AssetLoadTelemetry telemetry;
+  telemetry.CountLookup("texture", false);
+  telemetry.CountLookup("texture", true);
+  telemetry.CountLookup("texture", true);
+  telemetry.CountLookup("mesh", false);
+  EXPECT_EQ(2u, telemetry.CacheCounts("texture").hits);
+  EXPECT_EQ(1u, telemetry.CacheCounts("texture").misses);
+  EXPECT_EQ(0u, telemetry.CacheCounts("mesh").hits);
+  EXPECT_EQ(2u, telemetry.CacheCounts(nullptr).misses);
+  EXPECT_EQ(0u, telemetry.CacheCounts("shader").misses);
+}
+
+TEST_F(AssetTelemetryTests, SlowestRecords) {
+  AssetLoadTelemetry telemetry;
+  EXPECT_TRUE(telemetry.SlowestRecords(0.01).empty());
+  for (int i = 0; i < 200; ++i) {
+    const int id = telemetry.BeginAsset("texture", std::to_string(i), false);
+    telemetry.AddPhaseTime(id, kAssetLoadPhaseDecode, (i * 37 % 200) * 1e-3);
+    telemetry.EndAsset(id, true);
+  }
+  const auto slowest = telemetry.SlowestRecords(0.01);
+  ASSERT_EQ(2u, slowest.size());
+  EXPECT_DOUBLE_EQ(0.199, slowest[0].TotalSeconds());
+  EXPECT_DOUBLE_EQ(0.198, slowest[1].TotalSeconds());
+  EXPECT_EQ(1u, telemetry.SlowestRecords(0.0).size());
+  EXPECT_EQ(200u, telemetry.SlowestRecords(1.0).size());
+}
+
+TEST_F(AssetTelemetryTests, Export) {
+  AssetLoadTelemetry telemetry;
+  const int id = telemetry.BeginAsset("texture", "a,\"b\".png", true);
+  telemetry.AddPhaseTime(id, kAssetLoadPhaseRead, 0.0015);
+  telemetry.AddPhaseTime(id, kAssetLoadPhaseUpload, 0.0025);
+  telemetry.AddBytes(id, 10, 20);
+  telemetry.EndAsset(id, true);
+  telemetry.CountLookup("texture", true);
+
+  const std::string csv = telemetry.ToCsv();
+  EXPECT_EQ(0u, csv.find("kind,name,async,failed,start_ms,end_ms,read_ms,"
+                         "decode_ms,upload_ms,total_ms,bytes_read,"
+                         "bytes_decoded\n"));
+  EXPECT_NE(std::string::npos,
+            csv.find("texture,\"a,\"\"b\"\".png\",1,0,"));
+  EXPECT_NE(std::string::npos, csv.find(",1.500,0.000,2.500,4.000,10,20\n"));
+
+  const std::string json = telemetry.ToJson();
+  EXPECT_EQ(0u, json.find("{\"peak_staging_bytes\":20,\"cache\":{\"texture\":"
+                          "{\"hits\":1,\"misses\":0}},\"assets\":["));
+  EXPECT_NE(std::string::npos,
+            json.find("{\"kind\":\"texture\",\"name\":\"a,\\\"b\\\".png\","
+                      "\"async\":true,\"failed\":false,"));
+  EXPECT_NE(std::string::npos,
+            json.find("\"read_ms\":1.500,\"decode_ms\":0.000,"
+                      "\"upload_ms\":2.500,\"total_ms\":4.000,"
+                      "\"bytes_read\":10,\"bytes_decoded\":20}"));
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,101 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdlib.h>
+#include <vector>
+
+#include "fplbase/atlas_packer.h"
+#include "gtest/gtest.h"
+#include "mathfu/glsl_mappings.h"
+
+using fplbase::AtlasPacker;
+using mathfu::vec2i;
+
+class AtlasPackerTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() { srand(1234); }
+  virtual void TearDown() {}
+};
+
+// True if the two rectangles, grown by `padding` on every side, overlap.
+static bool Overlaps(const vec2i &pos_a, const vec2i &size_a,
+                     const vec2i &pos_b, const vec2i &size_b, int padding) {
+  return pos_a.x() - padding < pos_b.x() + size_b.x() + padding &&
+         pos_b.x() - padding < pos_a.x() + size_a.x() + padding &&
+         pos_a.y() - padding < pos_b.y() + size_b.y() + padding &&
+         pos_b.y() - padding < pos_a.y() + size_a.y() + padding;
+}
+
+TEST_F(AtlasPackerTests, FillsPageExactly) {
+  AtlasPacker packer(vec2i(64, 64), 0);
+  for (int i = 0; i < 16; ++i) {
+    vec2i position;
+    EXPECT_TRUE(packer.Insert(vec2i(16, 16), &position));
+  }
+  vec2i position;
+  EXPECT_FALSE(packer.Fits(vec2i(1, 1)));
+  EXPECT_FALSE(packer.Insert(vec2i(1, 1), &position));
+  EXPECT_FLOAT_EQ(1.0f, packer.Occupancy());
+
+  packer.Reset();
+  EXPECT_FLOAT_EQ(0.0f, packer.Occupancy());
+  EXPECT_TRUE(packer.Insert(vec2i(64, 64), &position));
+  EXPECT_EQ(vec2i(0, 0), position);
+}
+
+TEST_F(AtlasPackerTests, RejectsTooBig) {
+  AtlasPacker packer(vec2i(64, 32), 1);
+  vec2i position;
+  EXPECT_FALSE(packer.Insert(vec2i(64, 8), &position));
+  EXPECT_FALSE(packer.Insert(vec2i(8, 31), &position));
+  EXPECT_FALSE(packer.Insert(vec2i(0, 8), &position));
+  EXPECT_TRUE(packer.Insert(vec2i(62, 30), &position));
+  EXPECT_EQ(vec2i(1, 1), position);
+}
+
+// Pack random sizes until the page is full, and check that no two
+// rectangles or their padding overlap, and that all are on the page.
+TEST_F(AtlasPackerTests, RandomNoOverlap) {
+  const int kPadding = 2;
+  const vec2i kPageSize(512, 256);
+  AtlasPacker packer(kPageSize, kPadding);
+  std::vector<vec2i> positions;
+  std::vector<vec2i> sizes;
+  int failures = 0;
+  while (failures < 20) {
+    const vec2i size(1 + rand() % 48, 1 + rand() % 48);
+    vec2i position;
+    if (!packer.Insert(size, &position)) {
+      ++failures;
+      continue;
+    }
+    EXPECT_GE(position.x(), kPadding);
+    EXPECT_GE(position.y(), kPadding);
+    EXPECT_LE(position.x() + size.x() + kPadding, kPageSize.x());
+    EXPECT_LE(position.y() + size.y() + kPadding, kPageSize.y());
+    for (size_t i = 0; i < positions.size(); ++i) {
+      EXPECT_FALSE(Overlaps(position, size, positions[i], sizes[i], kPadding));
+    }
+    positions.push_back(position);
+    sizes.push_back(size);
+  }
+  // MaxRects should do far better than this on random rectangles.
+  EXPECT_GT(packer.Occupancy(), 0.75f);
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,203 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fplbase/command_buffer.h"
+#include "gtest/gtest.h"
+#include "mathfu/glsl_mappings.h"
+
+using fplbase::CommandBuffer;
+using fplbase::CommandQueue;
+using fplbase::RecordingCommandBackend;
+
+class CommandBufferTests : public ::testing::Test {
+ protected:
+  // Assets are only ever compared by address, so any distinct addresses do.
+  fplbase::Mesh *mesh(int i) {
+    return reinterpret_cast<fplbase::Mesh *>(&assets_[i]);
+  }
+  fplbase::Shader *shader(int i) {
+    return reinterpret_cast<fplbase::Shader *>(&assets_[i]);
+  }
+  fplbase::Texture *texture(int i) {
+    return reinterpret_cast<fplbase::Texture *>(&assets_[i]);
+  }
+
+  int assets_[4];
+};
+
+TEST_F(CommandBufferTests, ExecutesInRecordedOrder) {
+  CommandBuffer commands;
+  commands.ClearFrameBuffer(mathfu::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+  commands.ClearDepthBuffer();
+  commands.SetViewport(mathfu::vec4i(0, 0, 640, 480));
+  commands.SetShader(shader(0));
+  const float kTint[] = {0.5f, 0.25f, 1.0f, 1.0f};
+  commands.SetUniform(shader(0), 3, kTint, 4);
+  commands.SetTexture(texture(1), 2);
+  commands.SetBlendMode(fplbase::kBlendModeAlpha);
+  commands.SetCulling(fplbase::kCullingModeBack);
+  commands.DepthTest(true);
+  commands.SetColor(mathfu::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+  commands.SetCameraPos(mathfu::vec3(1.0f, 2.0f, 3.0f));
+  commands.RenderMesh(mesh(2));
+  commands.RenderMesh(mesh(3), true, 4);
+  commands.RenderMesh(mesh(2));
+  EXPECT_EQ(14u, commands.num_commands());
+
+  RecordingCommandBackend backend;
+  commands.Execute(&backend);
+  const char *kExpected[] = {
+      "ClearFrameBuffer 0 0 0 1",
+      "ClearDepthBuffer",
+      "SetViewport 0 0 640 480",
+      "SetShader shader0",
+      "SetUniform shader0 3 0.5 0.25 1 1",
+      "SetTexture texture1 2",
+      "SetBlendMode 2 0.5",
+      "SetCulling 2",
+      "DepthTest 1",
+      "SetColor 1 0 0 1",
+      "SetCameraPos 1 2 3",
+      "RenderMesh mesh2 0 1",
+      "RenderMesh mesh3 1 4",
+      "RenderMesh mesh2 0 1",
+  };
+  ASSERT_EQ(sizeof(kExpected) / sizeof(kExpected[0]), backend.log().size());
+  for (size_t i = 0; i < backend.log().size(); ++i) {
+    EXPECT_EQ(kExpected[i], backend.log()[i]);
+  }
+}
+
+TEST_F(CommandBufferTests, CopiesTransforms) {
+  mathfu::mat4 mvp = mathfu::mat4::Identity();
+  mvp(0, 3) = 7.0f;
+  mathfu::AffineTransform bones[2];
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 12; ++j) bones[i][j] = static_cast<float>(i * 12 + j);
+  }
+
+  CommandBuffer commands;
+  commands.SetModelViewProjection(mvp);
+  commands.SetBoneTransforms(bones, 2);
+  // Changes after recording must not show up when executing.
+  mvp(0, 3) = 0.0f;
+  bones[1][0] = -1.0f;
+
+  RecordingCommandBackend backend;
+  commands.Execute(&backend);
+  ASSERT_EQ(2u, backend.log().size());
+  EXPECT_EQ("SetModelViewProjection 1 0 0 0 0 1 0 0 0 0 1 0 7 0 0 1",
+            backend.log()[0]);
+  std::string expected_bones = "SetBoneTransforms";
+  for (int i = 0; i < 24; ++i) expected_bones += " " + std::to_string(i);
+  EXPECT_EQ(expected_bones, backend.log()[1]);
+}
+
+// Checks that bone transforms are handed out 16 byte aligned.
+class AlignmentCheckingBackend : public RecordingCommandBackend {
+ public:
+  virtual void SetBoneTransforms(const mathfu::AffineTransform *bone_transforms,
+                                 int num_bones) {
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(bone_transforms) % 16);
+    RecordingCommandBackend::SetBoneTransforms(bone_transforms, num_bones);
+  }
+};
+
+TEST_F(CommandBufferTests, AlignsBoneTransforms) {
+  mathfu::AffineTransform bones[3];
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 12; ++j) bones[i][j] = static_cast<float>(i * 12 + j);
+  }
+
+  // Interleave other commands, and record enough bones to grow their storage
+  // after the first transforms were recorded.
+  CommandBuffer commands;
+  for (int i = 1; i <= 3; ++i) {
+    commands.SetLightPos(mathfu::vec3(1.0f, 2.0f, 3.0f));
+    commands.SetBoneTransforms(bones + 3 - i, i);
+  }
+
+  AlignmentCheckingBackend backend;
+  commands.Execute(&backend);
+  ASSERT_EQ(6u, backend.log().size());
+  std::string expected_bones = "SetBoneTransforms";
+  for (int i = 24; i < 36; ++i) expected_bones += " " + std::to_string(i);
+  EXPECT_EQ(expected_bones, backend.log()[1]);
+  expected_bones = "SetBoneTransforms";
+  for (int i = 0; i < 36; ++i) expected_bones += " " + std::to_string(i);
+  EXPECT_EQ(expected_bones, backend.log()[5]);
+}
+
+TEST_F(CommandBufferTests, ClearReusesBuffer) {
+  CommandBuffer commands;
+  for (int i = 0; i < 100; ++i) commands.RenderMesh(mesh(0));
+  const size_t size = commands.size_in_bytes();
+  commands.Clear();
+  EXPECT_EQ(0u, commands.num_commands());
+  EXPECT_EQ(0u, commands.size_in_bytes());
+
+  RecordingCommandBackend backend;
+  commands.Execute(&backend);
+  EXPECT_TRUE(backend.log().empty());
+
+  for (int i = 0; i < 100; ++i) commands.RenderMesh(mesh(0));
+  EXPECT_EQ(size, commands.size_in_bytes());
+}
+
+TEST_F(CommandBufferTests, QueueFromThreads) {
+  const int kThreads = 4;
+  const int kBuffersPerThread = 50;
+  CommandQueue queue;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.push_back(std::thread([this, t, &queue]() {
+      for (int i = 0; i < kBuffersPerThread; ++i) {
+        CommandBuffer *commands = queue.AcquireCommandBuffer();
+        commands->SetColor(mathfu::vec4(static_cast<float>(t),
+                                        static_cast<float>(i), 0.0f, 1.0f));
+        commands->RenderMesh(mesh(t));
+        queue.Submit(commands);
+      }
+    }));
+  }
+
+  // Each buffer must execute whole, and each thread's buffers in order.
+  RecordingCommandBackend backend;
+  size_t executed = 0;
+  while (executed < kThreads * kBuffersPerThread) {
+    executed += queue.ExecutePending(&backend, true);
+  }
+  for (auto it = threads.begin(); it != threads.end(); ++it) it->join();
+  EXPECT_EQ(0u, queue.ExecutePending(&backend, false));
+
+  ASSERT_EQ(2u * kThreads * kBuffersPerThread, backend.log().size());
+  int next[kThreads] = {0};
+  for (size_t i = 0; i < backend.log().size(); i += 2) {
+    int t = 0, n = 0;
+    ASSERT_EQ(2, sscanf(backend.log()[i].c_str(), "SetColor %d %d", &t, &n));
+    ASSERT_LT(t, kThreads);
+    EXPECT_EQ(next[t]++, n);
+    EXPECT_EQ(0u, backend.log()[i + 1].find("RenderMesh mesh"));
+  }
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,168 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <vector>
+
+#include "fplbase/dynamic_atlas.h"
+#include "gtest/gtest.h"
+#include "mathfu/glsl_mappings.h"
+
+using fplbase::DynamicAtlas;
+using mathfu::vec2i;
+using mathfu::vec4;
+
+class DynamicAtlasTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() {}
+  virtual void TearDown() {}
+};
+
+// Returns a luminance image of the given size filled with `value`.
+static std::vector<uint8_t> Image(const vec2i &size, uint8_t value) {
+  return std::vector<uint8_t>(size.x() * size.y(), value);
+}
+
+// Reads a pixel of the atlas at normalized coordinates plus a pixel offset.
+static uint8_t Pixel(const DynamicAtlas &atlas, const vec4 &bounds, int dx,
+                     int dy) {
+  const int x = static_cast<int>(bounds.x() * atlas.size().x() + 0.5f) + dx;
+  const int y = static_cast<int>(bounds.y() * atlas.size().y() + 0.5f) + dy;
+  return atlas.pixels()[y * atlas.size().x() + x];
+}
+
+TEST_F(DynamicAtlasTests, InsertAndFind) {
+  DynamicAtlas atlas(vec2i(64, 64), fplbase::kFormatLuminance, 1);
+  const vec2i size(6, 10);
+  const vec4 *bounds = atlas.Insert(1, size, Image(size, 200).data());
+  ASSERT_NE(nullptr, bounds);
+  EXPECT_EQ(bounds, atlas.Find(1));
+  EXPECT_EQ(nullptr, atlas.Find(2));
+  EXPECT_FLOAT_EQ(6.0f / 64.0f, bounds->z());
+  EXPECT_FLOAT_EQ(10.0f / 64.0f, bounds->w());
+  EXPECT_TRUE(atlas.has_pending_upload());
+
+  // The image is copied in, with empty padding around it.
+  EXPECT_EQ(200, Pixel(atlas, *bounds, 0, 0));
+  EXPECT_EQ(200, Pixel(atlas, *bounds, 5, 9));
+  EXPECT_EQ(0, Pixel(atlas, *bounds, -1, 0));
+  EXPECT_EQ(0, Pixel(atlas, *bounds, 6, 0));
+  EXPECT_EQ(0, Pixel(atlas, *bounds, 0, 10));
+
+  atlas.Remove(1);
+  EXPECT_EQ(nullptr, atlas.Find(1));
+  EXPECT_EQ(0u, atlas.num_entries());
+}
+
+TEST_F(DynamicAtlasTests, ImagesDontOverlap) {
+  DynamicAtlas atlas(vec2i(128, 128), fplbase::kFormatLuminance, 1);
+  for (int i = 0; i < 100; ++i) {
+    const vec2i size(3 + i % 9, 4 + i % 7);
+    ASSERT_NE(nullptr, atlas.Insert(i, size, Image(size, i + 1).data()));
+  }
+  // Every image still holds its own pixels.
+  for (int i = 0; i < 100; ++i) {
+    const vec2i size(3 + i % 9, 4 + i % 7);
+    const vec4 *bounds = atlas.Find(i);
+    ASSERT_NE(nullptr, bounds);
+    for (int y = 0; y < size.y(); ++y) {
+      for (int x = 0; x < size.x(); ++x) {
+        ASSERT_EQ(i + 1, Pixel(atlas, *bounds, x, y));
+      }
+    }
+  }
+}
+
+TEST_F(DynamicAtlasTests, EvictsLeastRecentlyUsed) {
+  // Room for exactly four 14x14 images (16x16 with padding).
+  DynamicAtlas atlas(vec2i(32, 32), fplbase::kFormatLuminance, 1);
+  const vec2i size(14, 14);
+  const std::vector<uint8_t> image = Image(size, 1);
+  for (DynamicAtlas::Key key = 0; key < 4; ++key) {
+    ASSERT_NE(nullptr, atlas.Insert(key, size, image.data()));
+  }
+
+  // Everything was used this frame, so nothing can be evicted.
+  EXPECT_EQ(nullptr, atlas.Insert(4, size, image.data()));
+  EXPECT_EQ(0u, atlas.num_evictions());
+
+  atlas.AdvanceFrame();
+  atlas.Find(0);
+  atlas.Find(2);
+  ASSERT_NE(nullptr, atlas.Insert(4, size, image.data()));
+  ASSERT_NE(nullptr, atlas.Insert(5, size, image.data()));
+  EXPECT_EQ(2u, atlas.num_evictions());
+  EXPECT_EQ(nullptr, atlas.Find(1));
+  EXPECT_EQ(nullptr, atlas.Find(3));
+  EXPECT_NE(nullptr, atlas.Find(0));
+  EXPECT_NE(nullptr, atlas.Find(2));
+  EXPECT_EQ(4u, atlas.num_entries());
+}
+
+TEST_F(DynamicAtlasTests, ReusesFreedSpace) {
+  DynamicAtlas atlas(vec2i(64, 16), fplbase::kFormatLuminance, 0);
+  const vec2i small(8, 8);
+  const vec2i tall(8, 16);
+  // Fill the first shelf, then free a slot in the middle.
+  for (DynamicAtlas::Key key = 0; key < 8; ++key) {
+    ASSERT_NE(nullptr, atlas.Insert(key, small, Image(small, 1).data()));
+  }
+  const vec4 freed = *atlas.Find(3);
+  atlas.Remove(3);
+  const vec4 *bounds = atlas.Insert(8, small, Image(small, 2).data());
+  ASSERT_NE(nullptr, bounds);
+  EXPECT_EQ(freed, *bounds);
+
+  // A full height image only fits once everything else is gone.
+  EXPECT_EQ(nullptr, atlas.Insert(9, tall, Image(tall, 3).data()));
+  atlas.Clear();
+  EXPECT_NE(nullptr, atlas.Insert(9, tall, Image(tall, 3).data()));
+}
+
+TEST_F(DynamicAtlasTests, RejectsTooBig) {
+  DynamicAtlas atlas(vec2i(16, 16), fplbase::kFormat8888, 1);
+  const std::vector<uint8_t> image(16 * 16 * 4, 0);
+  EXPECT_EQ(nullptr, atlas.Insert(0, vec2i(15, 4), image.data()));
+  EXPECT_NE(nullptr, atlas.Insert(0, vec2i(14, 4), image.data()));
+}
+
+// 16 bit pixels are copied whole, with padding around them.
+TEST_F(DynamicAtlasTests, SixteenBitFormats) {
+  const fplbase::TextureFormat formats[] = {fplbase::kFormat565,
+                                            fplbase::kFormat5551};
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+    DynamicAtlas atlas(vec2i(32, 32), formats[i], 1);
+    const vec2i size(3, 2);
+    const uint16_t image[] = {0xF800, 0x07E0, 0x001F, 0xFFFF, 0x1234, 0x8001};
+    const vec4 *bounds = atlas.Insert(1, size, image);
+    ASSERT_NE(nullptr, bounds);
+    const int left = static_cast<int>(bounds->x() * 32 + 0.5f);
+    const int top = static_cast<int>(bounds->y() * 32 + 0.5f);
+    const uint16_t *pixels =
+        reinterpret_cast<const uint16_t *>(atlas.pixels().data());
+    for (int y = -1; y <= size.y(); ++y) {
+      for (int x = -1; x <= size.x(); ++x) {
+        const bool inside = x >= 0 && x < size.x() && y >= 0 && y < size.y();
+        EXPECT_EQ(inside ? image[y * size.x() + x] : 0,
+                  pixels[(top + y) * 32 + left + x]);
+      }
+    }
+  }
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
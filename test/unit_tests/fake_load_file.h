@@ -0,0 +1,58 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPLBASE_TEST_FAKE_LOAD_FILE_H
+#define FPLBASE_TEST_FAKE_LOAD_FILE_H
+
+#include <stddef.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "fplbase/utilities.h"
+
+// Stands in for the file system while it exists: every file is `size` bytes,
+// and takes `delay` to load. Only one may exist at a time.
+class FakeLoadFile {
+ public:
+  explicit FakeLoadFile(size_t size, std::chrono::milliseconds delay =
+                                         std::chrono::milliseconds(0)) {
+    Size() = size;
+    Delay() = delay;
+    previous_ = fplbase::SetLoadFileFunction(Load);
+  }
+  ~FakeLoadFile() { fplbase::SetLoadFileFunction(previous_); }
+
+ private:
+  static bool Load(const char *, std::string *dest) {
+    if (Delay().count() > 0) std::this_thread::sleep_for(Delay());
+    dest->assign(Size(), 'x');
+    return true;
+  }
+
+  // LoadFileFunction is a plain function pointer, so its settings are kept
+  // in statics.
+  static size_t &Size() {
+    static size_t size = 0;
+    return size;
+  }
+  static std::chrono::milliseconds &Delay() {
+    static std::chrono::milliseconds delay;
+    return delay;
+  }
+
+  fplbase::LoadFileFunction previous_;
+};
+
+#endif  // FPLBASE_TEST_FAKE_LOAD_FILE_H
@@ -0,0 +1,88 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "fplbase/file_watcher.h"
+#include "fplbase/utilities.h"
+#include "gtest/gtest.h"
+
+using fplbase::FileWatcher;
+
+static const char kWatched[] = "file_watcher_test_watched.txt";
+static const char kOther[] = "file_watcher_test_other.txt";
+static const char kTemp[] = "file_watcher_test_temp.txt";
+
+class FileWatcherTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() { ASSERT_TRUE(fplbase::SaveFile(kWatched, "old")); }
+  virtual void TearDown() {
+    remove(kWatched);
+    remove(kOther);
+    remove(kTemp);
+  }
+};
+
+TEST_F(FileWatcherTests, ReportsWrittenFiles) {
+  FileWatcher watcher;
+  ASSERT_TRUE(watcher.Watch(kWatched));
+  EXPECT_TRUE(watcher.IsWatching(kWatched));
+  std::vector<std::string> changed;
+  watcher.Poll(&changed);
+  EXPECT_TRUE(changed.empty());
+
+  // Several writes are reported once.
+  ASSERT_TRUE(fplbase::SaveFile(kWatched, "new"));
+  ASSERT_TRUE(fplbase::SaveFile(kWatched, "newer"));
+  watcher.Poll(&changed);
+  ASSERT_EQ(1u, changed.size());
+  EXPECT_EQ(kWatched, changed[0]);
+  watcher.Poll(&changed);
+  EXPECT_TRUE(changed.empty());
+}
+
+TEST_F(FileWatcherTests, ReportsReplacedFiles) {
+  FileWatcher watcher;
+  ASSERT_TRUE(watcher.Watch(kWatched));
+  // Like editors that save to a new file and rename it over the old one.
+  ASSERT_TRUE(fplbase::SaveFile(kTemp, "new"));
+  ASSERT_EQ(0, rename(kTemp, kWatched));
+  std::vector<std::string> changed;
+  watcher.Poll(&changed);
+  ASSERT_EQ(1u, changed.size());
+  EXPECT_EQ(kWatched, changed[0]);
+}
+
+TEST_F(FileWatcherTests, IgnoresUnwatchedFiles) {
+  FileWatcher watcher;
+  ASSERT_TRUE(watcher.Watch(kWatched));
+  ASSERT_TRUE(fplbase::SaveFile(kOther, "new"));
+  std::vector<std::string> changed;
+  watcher.Poll(&changed);
+  EXPECT_TRUE(changed.empty());
+
+  watcher.Unwatch(kWatched);
+  EXPECT_FALSE(watcher.IsWatching(kWatched));
+  ASSERT_TRUE(fplbase::SaveFile(kWatched, "new"));
+  watcher.Poll(&changed);
+  EXPECT_TRUE(changed.empty());
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "fplbase/frame_stats.h"
+#include "gtest/gtest.h"
+
+using fplbase::FrameStats;
+using fplbase::FrameTimeHistogram;
+
+class FrameStatsTests : public ::testing::Test {};
+
+TEST_F(FrameStatsTests, BucketsCoverEveryValue) {
+  int previous = -1;
+  for (uint64_t us = 0; us < (1u << 20); us += 1 + us / 64) {
+    const int index = FrameTimeHistogram::BucketIndex(us);
+    EXPECT_GE(index, previous);
+    EXPECT_LE(FrameTimeHistogram::BucketStart(index), us);
+    if (index + 1 < FrameTimeHistogram::kNumBuckets) {
+      EXPECT_GT(FrameTimeHistogram::BucketStart(index + 1), us);
+    }
+    previous = index;
+  }
+  EXPECT_EQ(FrameTimeHistogram::kNumBuckets - 1,
+            FrameTimeHistogram::BucketIndex(~0ull));
+}
+
+TEST_F(FrameStatsTests, Percentiles) {
+  FrameTimeHistogram histogram;
+  EXPECT_EQ(0.0, histogram.Percentile(50));
+
+  // 1ms to 1000ms, once each.
+  for (int ms = 1; ms <= 1000; ++ms) histogram.Record(ms / 1000.0);
+  EXPECT_EQ(1000u, histogram.count());
+  EXPECT_DOUBLE_EQ(0.001, histogram.min());
+  EXPECT_DOUBLE_EQ(1.0, histogram.max());
+  EXPECT_NEAR(0.5005, histogram.mean(), 1e-9);
+  const double kPercentiles[] = {1, 50, 95, 99, 100};
+  for (size_t i = 0; i < sizeof(kPercentiles) / sizeof(kPercentiles[0]);
+       ++i) {
+    const double expected = kPercentiles[i] * 0.01;
+    EXPECT_NEAR(expected, histogram.Percentile(kPercentiles[i]),
+                expected * 0.07);
+  }
+
+  histogram.Clear();
+  EXPECT_EQ(0u, histogram.count());
+  EXPECT_EQ(0.0, histogram.max());
+}
+
+TEST_F(FrameStatsTests, RecentFrames) {
+  FrameStats stats;
+  stats.EndFrame();  // Starts the clock.
+  for (int i = 0; i < FrameStats::kRingSize + 10; ++i) {
+    stats.AddPhaseTime(fplbase::kFramePhaseCpu, i * 0.001);
+    stats.AddPhaseTime(fplbase::kFramePhaseSwap, 0.002);
+    stats.AddPhaseTime(fplbase::kFramePhaseSwap, 0.003);
+    stats.EndFrame();
+  }
+  EXPECT_EQ(static_cast<uint32_t>(FrameStats::kRingSize + 10),
+            stats.num_frames());
+
+  std::vector<FrameStats::Frame> frames(FrameStats::kRingSize * 2);
+  const int copied =
+      stats.CopyRecentFrames(frames.data(), static_cast<int>(frames.size()));
+  ASSERT_EQ(FrameStats::kRingSize, copied);
+  for (int i = 0; i < copied; ++i) {
+    EXPECT_EQ(static_cast<uint32_t>(10 + i), frames[i].index);
+    EXPECT_FLOAT_EQ((10 + i) * 0.001f,
+                    frames[i].seconds[fplbase::kFramePhaseCpu]);
+    EXPECT_FLOAT_EQ(0.005f, frames[i].seconds[fplbase::kFramePhaseSwap]);
+    EXPECT_EQ(0.0f, frames[i].seconds[fplbase::kFramePhaseFinalize]);
+  }
+  EXPECT_EQ(2, stats.CopyRecentFrames(frames.data(), 2));
+  EXPECT_EQ(static_cast<uint32_t>(FrameStats::kRingSize + 9),
+            frames[1].index);
+
+  EXPECT_NEAR(0.005, stats.histogram(fplbase::kFramePhaseSwap).Percentile(99),
+              0.0005);
+  EXPECT_NE(std::string::npos, stats.Summary().find("swap"));
+
+  stats.Reset();
+  EXPECT_EQ(0, stats.CopyRecentFrames(frames.data(), 2));
+}
+
+TEST_F(FrameStatsTests, ReadWhileRecording) {
+  FrameStats stats;
+  stats.EndFrame();
+  std::atomic<bool> done(false);
+  std::thread reader([&stats, &done]() {
+    std::vector<FrameStats::Frame> frames(FrameStats::kRingSize);
+    while (!done.load()) {
+      const int copied = stats.CopyRecentFrames(
+          frames.data(), static_cast<int>(frames.size()));
+      for (int i = 0; i < copied; ++i) {
+        // Every phase of a frame was written together.
+        const float cpu = frames[i].seconds[fplbase::kFramePhaseCpu];
+        EXPECT_EQ(cpu, frames[i].seconds[fplbase::kFramePhaseSwap]);
+        EXPECT_EQ(static_cast<float>(frames[i].index), cpu);
+        if (i > 0) {
+          EXPECT_LT(frames[i - 1].index, frames[i].index);
+        }
+      }
+    }
+  });
+  for (int i = 0; i < 100000; ++i) {
+    stats.AddPhaseTime(fplbase::kFramePhaseCpu, i);
+    stats.AddPhaseTime(fplbase::kFramePhaseSwap, i);
+    stats.EndFrame();
+  }
+  done.store(true);
+  reader.join();
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
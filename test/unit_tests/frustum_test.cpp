@@ -0,0 +1,216 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#include "fplbase/frustum.h"
+#include "fplbase/parallel_for.h"
+#include "gtest/gtest.h"
+#include "mathfu/glsl_mappings.h"
+
+using fplbase::AabbBatch;
+using fplbase::CullBoundingBoxes;
+using fplbase::Frustum;
+using fplbase::ObbBatch;
+using mathfu::mat4;
+using mathfu::vec3;
+
+class FrustumTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() { srand(1234); }
+  virtual void TearDown() { fplbase::SetParallelForThreadCount(0); }
+};
+
+// Right handed OpenGL projection looking down -z, built by hand so the tests
+// don't depend on the conventions of any particular math library helper.
+static mat4 Perspective(float fovy, float aspect, float znear, float zfar) {
+  const float f = 1.0f / tanf(fovy * 0.5f);
+  mat4 m(0.0f);
+  m(0, 0) = f / aspect;
+  m(1, 1) = f;
+  m(2, 2) = (zfar + znear) / (znear - zfar);
+  m(2, 3) = 2.0f * zfar * znear / (znear - zfar);
+  m(3, 2) = -1.0f;
+  return m;
+}
+
+static mat4 Translation(const vec3 &v) {
+  mat4 m = mat4::Identity();
+  m(0, 3) = v.x();
+  m(1, 3) = v.y();
+  m(2, 3) = v.z();
+  return m;
+}
+
+static float RandomFloat(float lo, float hi) {
+  return lo + (hi - lo) * (static_cast<float>(rand()) / RAND_MAX);
+}
+
+static void AddRandomBoxes(size_t count, AabbBatch *batch) {
+  batch->Reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const vec3 center(RandomFloat(-200, 200), RandomFloat(-200, 200),
+                      RandomFloat(-200, 200));
+    const vec3 extent(RandomFloat(0.1f, 5), RandomFloat(0.1f, 5),
+                      RandomFloat(0.1f, 5));
+    batch->Add(center - extent, center + extent);
+  }
+}
+
+static const Frustum kCamera(Perspective(1.0f, 1.5f, 1.0f, 100.0f));
+
+// Boxes clearly inside, behind, beside and straddling the frustum.
+TEST_F(FrustumTests, SingleBoxes) {
+  EXPECT_TRUE(kCamera.IntersectsAabb(vec3(-1, -1, -11), vec3(1, 1, -9)));
+  EXPECT_FALSE(kCamera.IntersectsAabb(vec3(-1, -1, 9), vec3(1, 1, 11)));
+  EXPECT_FALSE(kCamera.IntersectsAabb(vec3(-61, -1, -11), vec3(-59, 1, -9)));
+  EXPECT_FALSE(kCamera.IntersectsAabb(vec3(-1, -1, -111), vec3(1, 1, -109)));
+  EXPECT_TRUE(kCamera.IntersectsAabb(vec3(-1, -1, -101), vec3(1, 1, -99)));
+  EXPECT_TRUE(kCamera.IntersectsAabb(vec3(-1, -1, -1), vec3(1, 1, 1)));
+}
+
+// The batched SIMD path must agree with the scalar test, including for the
+// boxes in a partial group of four at the end of the batch.
+TEST_F(FrustumTests, BatchMatchesScalar) {
+  AabbBatch batch;
+  std::vector<vec3> mins, maxs;
+  for (size_t i = 0; i < 1003; ++i) {
+    const vec3 center(RandomFloat(-120, 120), RandomFloat(-120, 120),
+                      RandomFloat(-120, 20));
+    const vec3 extent(RandomFloat(0.1f, 5), RandomFloat(0.1f, 5),
+                      RandomFloat(0.1f, 5));
+    mins.push_back(center - extent);
+    maxs.push_back(center + extent);
+    batch.Add(mins.back(), maxs.back());
+  }
+  std::vector<uint8_t> visibility(batch.size(), 0xFF);
+  CullBoundingBoxes(&kCamera, 1, batch, visibility.data());
+  size_t num_visible = 0;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    EXPECT_EQ(kCamera.IntersectsAabb(mins[i], maxs[i]), visibility[i] == 1);
+    num_visible += visibility[i];
+  }
+  EXPECT_GT(num_visible, 0u);
+  EXPECT_LT(num_visible, batch.size());
+
+  // Clearing keeps the padding consistent for the next frame.
+  batch.Clear();
+  EXPECT_EQ(0u, batch.size());
+  batch.Add(mins[0], maxs[0]);
+  CullBoundingBoxes(&kCamera, 1, batch, visibility.data());
+  EXPECT_EQ(kCamera.IntersectsAabb(mins[0], maxs[0]), visibility[0] == 1);
+}
+
+// An oriented box must be culled using its actual extents, not the AABB
+// around it. A long thin box rotated 45 degrees just outside the left plane
+// has an enclosing AABB that intersects the frustum, while the box itself does
+// not.
+TEST_F(FrustumTests, OrientedBoxes) {
+  const float c = cosf(0.785398f);
+  mat4 world = Translation(vec3(-11.83f, 0.0f, -12.83f));
+  world(0, 0) = -c;
+  world(2, 0) = -c;
+  world(0, 2) = -c;
+  world(2, 2) = c;
+  const vec3 local_min(-8.0f, -1.0f, -0.1f);
+  const vec3 local_max(8.0f, 1.0f, 0.1f);
+
+  ObbBatch obbs;
+  obbs.Add(local_min, local_max, world);
+  AabbBatch aabbs;
+  aabbs.Add(local_min, local_max, world);
+  uint8_t obb_visibility = 0xFF;
+  uint8_t aabb_visibility = 0xFF;
+  CullBoundingBoxes(&kCamera, 1, obbs, &obb_visibility);
+  CullBoundingBoxes(&kCamera, 1, aabbs, &aabb_visibility);
+  EXPECT_EQ(0, obb_visibility);
+  EXPECT_EQ(1, aabb_visibility);
+
+  // With an identity transform both representations must agree.
+  ObbBatch identity_obbs;
+  AabbBatch identity_aabbs;
+  identity_obbs.Add(vec3(-1, -1, -11), vec3(1, 1, -9), mat4::Identity());
+  identity_aabbs.Add(vec3(-1, -1, -11), vec3(1, 1, -9));
+  CullBoundingBoxes(&kCamera, 1, identity_obbs, &obb_visibility);
+  CullBoundingBoxes(&kCamera, 1, identity_aabbs, &aabb_visibility);
+  EXPECT_EQ(1, obb_visibility);
+  EXPECT_EQ(1, aabb_visibility);
+}
+
+// One pass computes the visibility for both eyes of a stereo camera.
+TEST_F(FrustumTests, StereoMasks) {
+  const mat4 projection = Perspective(1.0f, 1.0f, 1.0f, 100.0f);
+  const Frustum eyes[] = {Frustum(projection * Translation(vec3(5, 0, 0))),
+                          Frustum(projection * Translation(vec3(-5, 0, 0)))};
+  AabbBatch batch;
+  batch.Add(vec3(-1, -1, -11), vec3(1, 1, -9));    // Both eyes.
+  batch.Add(vec3(-9, -1, -11), vec3(-8, 1, -9));    // Left eye only.
+  batch.Add(vec3(8, -1, -11), vec3(9, 1, -9));      // Right eye only.
+  batch.Add(vec3(-1, -1, 9), vec3(1, 1, 11));       // Behind the camera.
+  uint8_t visibility[4];
+  CullBoundingBoxes(eyes, 2, batch, visibility);
+  EXPECT_EQ(fplbase::kFrustumVisibleBothEyes, visibility[0]);
+  EXPECT_EQ(fplbase::kFrustumVisibleLeftEye, visibility[1]);
+  EXPECT_EQ(fplbase::kFrustumVisibleRightEye, visibility[2]);
+  EXPECT_EQ(0, visibility[3]);
+}
+
+// Splitting a batch across threads must not change the results.
+TEST_F(FrustumTests, ThreadedMatchesSerial) {
+  AabbBatch batch;
+  AddRandomBoxes(200003, &batch);
+  std::vector<uint8_t> serial(batch.size());
+  std::vector<uint8_t> threaded(batch.size());
+  fplbase::SetParallelForThreadCount(1);
+  CullBoundingBoxes(&kCamera, 1, batch, serial.data());
+  // Force several threads, even on single core machines.
+  fplbase::SetParallelForThreadCount(4);
+  CullBoundingBoxes(&kCamera, 1, batch, threaded.data());
+  EXPECT_TRUE(serial == threaded);
+}
+
+static void Benchmark(size_t count) {
+  AabbBatch batch;
+  AddRandomBoxes(count, &batch);
+  std::vector<uint8_t> visibility(batch.size());
+  const size_t thread_counts[] = {1, 0};
+  for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]);
+       ++t) {
+    fplbase::SetParallelForThreadCount(thread_counts[t]);
+    const int kIterations = 10;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      CullBoundingBoxes(&kCamera, 1, batch, visibility.data());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const double ms =
+        std::chrono::duration<double, std::milli>(end - start).count() /
+        kIterations;
+    printf("Culled %d boxes on %d thread(s) in %.3f ms\n",
+           static_cast<int>(count),
+           static_cast<int>(fplbase::ParallelForThreadCount()), ms);
+  }
+}
+
+TEST_F(FrustumTests, Benchmark10k) { Benchmark(10000); }
+TEST_F(FrustumTests, Benchmark100k) { Benchmark(100000); }
+TEST_F(FrustumTests, Benchmark1M) { Benchmark(1000000); }
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,202 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "fplbase/gpu_timer.h"
+#include "gtest/gtest.h"
+
+using fplbase::GpuTimer;
+using fplbase::GpuTimerBackend;
+using fplbase::GpuTimerScope;
+
+// Backend where the GPU clock advances 1ms per timestamp and results only
+// become available once the test says the GPU has caught up.
+class MockGpuTimerBackend : public GpuTimerBackend {
+ public:
+  MockGpuTimerBackend()
+      : supported(true),
+        disjoint(false),
+        next_query(1),
+        clock(0),
+        issued(0),
+        completed(0) {}
+
+  virtual bool Supported() const { return supported; }
+  virtual void CreateQueries(size_t count, unsigned int *queries) {
+    for (size_t i = 0; i < count; ++i) {
+      queries[i] = next_query++;
+      live.insert(queries[i]);
+    }
+  }
+  virtual void DeleteQueries(size_t count, const unsigned int *queries) {
+    for (size_t i = 0; i < count; ++i) live.erase(queries[i]);
+  }
+  virtual void QueryTimestamp(unsigned int query) {
+    EXPECT_EQ(1u, live.count(query));
+    clock += 1000000;
+    timestamps[query] = clock;
+    order[query] = ++issued;
+  }
+  virtual bool ResultAvailable(unsigned int query) {
+    return order[query] <= completed;
+  }
+  virtual uint64_t Result(unsigned int query) {
+    EXPECT_TRUE(ResultAvailable(query));
+    return timestamps[query];
+  }
+  virtual bool Disjoint() { return disjoint; }
+
+  // Let the GPU finish everything issued so far.
+  void Finish() { completed = issued; }
+
+  bool supported;
+  bool disjoint;
+  unsigned int next_query;
+  uint64_t clock;
+  uint64_t issued;
+  uint64_t completed;
+  std::set<unsigned int> live;
+  std::map<unsigned int, uint64_t> timestamps;
+  std::map<unsigned int, uint64_t> order;
+};
+
+class GpuTimerTests : public ::testing::Test {};
+
+TEST_F(GpuTimerTests, NestedScopes) {
+  MockGpuTimerBackend backend;
+  GpuTimer timer(&backend);
+  timer.BeginPass("Shadows");
+  timer.BeginPass("Main");
+  {
+    GpuTimerScope scope(&timer, "Opaque");
+  }
+  timer.EndPass();
+  backend.Finish();
+  timer.AdvanceFrame();
+
+  // Shadows: 1ms. Main: begin, Opaque begin/end, end = 3ms. Opaque: 1ms.
+  const auto &results = timer.results();
+  ASSERT_EQ(3u, results.size());
+  EXPECT_EQ(std::string("Shadows"), results[0].name);
+  EXPECT_EQ(0, results[0].depth);
+  EXPECT_DOUBLE_EQ(0.001, results[0].seconds);
+  EXPECT_EQ(std::string("Main"), results[1].name);
+  EXPECT_EQ(0, results[1].depth);
+  EXPECT_DOUBLE_EQ(0.003, results[1].seconds);
+  EXPECT_EQ(std::string("Opaque"), results[2].name);
+  EXPECT_EQ(1, results[2].depth);
+  EXPECT_DOUBLE_EQ(0.001, results[2].seconds);
+  EXPECT_EQ(0u, timer.results_frame());
+  EXPECT_EQ(1u, timer.frame());
+}
+
+TEST_F(GpuTimerTests, ResultsArriveLate) {
+  MockGpuTimerBackend backend;
+  GpuTimer timer(&backend);
+  timer.BeginPass("Frame0");
+  timer.AdvanceFrame();
+  EXPECT_TRUE(timer.results().empty());
+
+  timer.BeginPass("Frame1");
+  backend.Finish();
+  timer.BeginPass("Frame1b");  // Issued after the GPU caught up.
+  timer.AdvanceFrame();
+  // Frame 0 is done, but frame 1 isn't yet.
+  ASSERT_EQ(1u, timer.results().size());
+  EXPECT_EQ(std::string("Frame0"), timer.results()[0].name);
+  EXPECT_EQ(0u, timer.results_frame());
+
+  backend.Finish();
+  timer.AdvanceFrame();
+  ASSERT_EQ(2u, timer.results().size());
+  EXPECT_EQ(std::string("Frame1b"), timer.results()[1].name);
+  EXPECT_EQ(1u, timer.results_frame());
+  EXPECT_EQ(0u, timer.dropped_frames());
+}
+
+TEST_F(GpuTimerTests, DropsFramesTheGpuFallsBehindOn) {
+  MockGpuTimerBackend backend;
+  GpuTimer timer(&backend);
+  for (int i = 0; i < GpuTimer::kFramesInFlight + 2; ++i) {
+    timer.BeginPass("Pass");
+    timer.AdvanceFrame();
+  }
+  EXPECT_EQ(3u, timer.dropped_frames());
+  EXPECT_TRUE(timer.results().empty());
+
+  // Queries are reused rather than leaked.
+  const size_t live_queries = backend.live.size();
+  for (int i = 0; i < 10; ++i) {
+    timer.BeginPass("Pass");
+    backend.Finish();
+    timer.AdvanceFrame();
+  }
+  EXPECT_EQ(live_queries, backend.live.size());
+  EXPECT_EQ(1u, timer.results().size());
+
+  timer.Reset();
+  EXPECT_TRUE(backend.live.empty());
+}
+
+TEST_F(GpuTimerTests, DisjointFramesAreDropped) {
+  MockGpuTimerBackend backend;
+  GpuTimer timer(&backend);
+  timer.BeginPass("Pass");
+  timer.EndPass();
+  backend.Finish();
+  backend.disjoint = true;
+  timer.AdvanceFrame();
+  EXPECT_TRUE(timer.results().empty());
+  EXPECT_EQ(1u, timer.dropped_frames());
+}
+
+TEST_F(GpuTimerTests, ScopesPerFrameAreCapped) {
+  MockGpuTimerBackend backend;
+  GpuTimer timer(&backend);
+  for (int i = 0; i < GpuTimer::kMaxScopesPerFrame + 10; ++i) {
+    GpuTimerScope outer(&timer, "Outer");
+    GpuTimerScope inner(&timer, "Inner");
+  }
+  backend.Finish();
+  timer.AdvanceFrame();
+  EXPECT_EQ(static_cast<size_t>(GpuTimer::kMaxScopesPerFrame),
+            timer.results().size());
+}
+
+TEST_F(GpuTimerTests, UnsupportedIsANoOp) {
+  MockGpuTimerBackend backend;
+  backend.supported = false;
+  GpuTimer timer(&backend);
+  timer.BeginPass("Pass");
+  {
+    GpuTimerScope scope(&timer, "Scope");
+  }
+  timer.AdvanceFrame();
+  EXPECT_EQ(0u, backend.issued);
+  EXPECT_TRUE(backend.live.empty());
+
+  backend.supported = true;
+  timer.set_enabled(false);
+  timer.BeginPass("Pass");
+  timer.AdvanceFrame();
+  EXPECT_EQ(0u, backend.issued);
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
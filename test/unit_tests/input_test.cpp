@@ -0,0 +1,305 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "fplbase/input.h"
+#include "fplbase/input_recording.h"
+#include "gtest/gtest.h"
+
+using fplbase::Button;
+using fplbase::ButtonTable;
+using fplbase::InputFrame;
+using fplbase::InputPlayer;
+using fplbase::InputRecorder;
+using fplbase::InputSystem;
+
+class InputTests : public ::testing::Test {};
+
+static int ScancodeKey(int scancode) {
+  return FPL_SCANCODE_TO_KEYCODE(scancode);
+}
+
+// One of each kind of button ID: pointer, pad, character key, scancode key,
+// and keys that fall outside the dense ranges.
+static const int kButtonIds[] = {
+    fplbase::K_POINTER1,
+    fplbase::K_POINTER10,
+    fplbase::K_PAD_UP,
+    fplbase::K_PAD_B,
+    fplbase::FPLK_a,
+    fplbase::FPLK_DELETE,
+    fplbase::FPLK_F1,
+    fplbase::FPLK_LEFT,
+    ScancodeKey(ButtonTable::kNumScancodeKeys - 1),
+    ScancodeKey(ButtonTable::kNumScancodeKeys),
+    -1000,
+    1000,
+};
+static const size_t kNumButtonIds = sizeof(kButtonIds) / sizeof(kButtonIds[0]);
+
+TEST_F(InputTests, DistinctButtons) {
+  ButtonTable table;
+  std::vector<Button *> buttons;
+  for (size_t i = 0; i < kNumButtonIds; ++i) {
+    buttons.push_back(&table.GetButton(kButtonIds[i]));
+    for (size_t j = 0; j < i; ++j) EXPECT_NE(buttons[j], buttons[i]);
+  }
+  // Adding buttons must not move existing ones.
+  for (int i = 2000; i < 3000; ++i) table.GetButton(i);
+  for (size_t i = 0; i < kNumButtonIds; ++i) {
+    EXPECT_EQ(buttons[i], &table.GetButton(kButtonIds[i]));
+  }
+}
+
+TEST_F(InputTests, DenseIndices) {
+  EXPECT_EQ(0, ButtonTable::DenseIndex(fplbase::K_PAD_UP));
+  EXPECT_EQ(-1, ButtonTable::DenseIndex(fplbase::K_PAD_UP - 1));
+  EXPECT_EQ(ButtonTable::kNumNegativeButtons, ButtonTable::DenseIndex(0));
+  EXPECT_EQ(ButtonTable::kNumDenseButtons - 1,
+            ButtonTable::DenseIndex(
+                ScancodeKey(ButtonTable::kNumScancodeKeys - 1)));
+  EXPECT_EQ(-1, ButtonTable::DenseIndex(ButtonTable::kNumCharacterKeys));
+}
+
+TEST_F(InputTests, FrameTransitions) {
+  ButtonTable table;
+  for (size_t i = 0; i < kNumButtonIds; ++i) {
+    Button &button = table.GetButton(kButtonIds[i]);
+    EXPECT_FALSE(button.is_down());
+
+    button.Update(true);
+    EXPECT_TRUE(button.is_down());
+    EXPECT_TRUE(button.went_down());
+    EXPECT_FALSE(button.went_up());
+
+    table.AdvanceFrame();
+    EXPECT_TRUE(button.is_down());
+    EXPECT_FALSE(button.went_down());
+
+    button.Update(false);
+    button.Update(true);
+    EXPECT_TRUE(button.is_down());
+    EXPECT_TRUE(button.went_down());
+    EXPECT_TRUE(button.went_up());
+
+    table.AdvanceFrame();
+    EXPECT_FALSE(button.went_down());
+    EXPECT_FALSE(button.went_up());
+  }
+
+  table.Clear();
+  for (size_t i = 0; i < kNumButtonIds; ++i) {
+    EXPECT_FALSE(table.GetButton(kButtonIds[i]).is_down());
+  }
+}
+
+// Time a UI style workload: 500 button queries, then a frame reset.
+template <typename GetButtonFn, typename AdvanceFrameFn>
+static double TimeFrames(const std::vector<int> &queries,
+                         GetButtonFn get_button, AdvanceFrameFn advance_frame) {
+  const int kFrames = 1000;
+  int down = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int frame = 0; frame < kFrames; ++frame) {
+    for (auto it = queries.begin(); it != queries.end(); ++it) {
+      Button &button = get_button(*it);
+      down += button.went_down();
+      if ((*it + frame) % 7 == 0) button.Update(!button.is_down());
+    }
+    advance_frame();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  EXPECT_GT(down, 0);
+  return std::chrono::duration<double, std::micro>(end - start).count() /
+         kFrames;
+}
+
+TEST_F(InputTests, Benchmark500QueriesPerFrame) {
+  srand(1234);
+  std::vector<int> queries;
+  for (int i = 0; i < 500; ++i) {
+    switch (rand() % 4) {
+      case 0: queries.push_back(fplbase::K_POINTER1 + rand() % 10); break;
+      case 1: queries.push_back(fplbase::FPLK_a + rand() % 26); break;
+      default:
+        queries.push_back(ScancodeKey(fplbase::FPL_SCANCODE_F1 + rand() % 12));
+        break;
+    }
+  }
+
+  ButtonTable table;
+  const double table_us =
+      TimeFrames(queries, [&table](int id) -> Button & {
+        return table.GetButton(id);
+      }, [&table]() { table.AdvanceFrame(); });
+
+  std::map<int, Button> map;
+  const double map_us =
+      TimeFrames(queries, [&map](int id) -> Button & { return map[id]; },
+                 [&map]() {
+                   for (auto it = map.begin(); it != map.end(); ++it) {
+                     it->second.AdvanceFrame();
+                   }
+                 });
+
+  printf("500 button queries per frame: %.2f us with ButtonTable, "
+         "%.2f us with std::map\n", table_us, map_us);
+}
+
+// A short session: a click, a drag, some typing and a resize.
+static std::vector<InputFrame> MakeSession() {
+  std::vector<InputFrame> frames(6);
+  for (size_t i = 0; i < frames.size(); ++i) {
+    frames[i].delta_time = 0.015 + 0.001 * i;
+    frames[i].window_size = mathfu::vec2i(640, 480);
+    frames[i].pointers.assign(InputSystem::kMaxSimultanuousPointers,
+                              fplbase::InputPointer());
+  }
+  InputFrame::ButtonState click;
+  click.id = fplbase::K_POINTER1;
+  click.is_down = click.went_down = true;
+  frames[1].buttons.push_back(click);
+  frames[1].pointers[0].used = true;
+  frames[1].pointers[0].mousepos = mathfu::vec2i(10, 20);
+  for (size_t i = 2; i < 4; ++i) {
+    frames[i].pointers[0] = frames[i - 1].pointers[0];
+    frames[i].pointers[0].mousedelta = mathfu::vec2i(5, 0);
+    frames[i].pointers[0].mousepos += frames[i].pointers[0].mousedelta;
+  }
+  click.is_down = click.went_down = false;
+  click.went_up = true;
+  frames[4].buttons.push_back(click);
+  frames[4].pointers[0] = frames[3].pointers[0];
+  InputFrame::ButtonState key;
+  key.id = fplbase::FPLK_a;
+  key.went_down = key.went_up = true;
+  frames[4].buttons.push_back(key);
+  key.id = ScancodeKey(fplbase::FPL_SCANCODE_F1);
+  key.is_down = key.went_down = true;
+  key.went_up = false;
+  frames[4].buttons.push_back(key);
+  frames[5].window_size = mathfu::vec2i(800, 600);
+  frames[5].mousewheel_delta = mathfu::vec2i(0, -3);
+  frames[5].exit_requested = true;
+  return frames;
+}
+
+static void ExpectFramesEqual(const InputFrame &a, const InputFrame &b) {
+  EXPECT_EQ(a.delta_time, b.delta_time);
+  ASSERT_EQ(a.buttons.size(), b.buttons.size());
+  for (size_t i = 0; i < a.buttons.size(); ++i) {
+    EXPECT_EQ(a.buttons[i].id, b.buttons[i].id);
+    EXPECT_EQ(a.buttons[i].is_down, b.buttons[i].is_down);
+    EXPECT_EQ(a.buttons[i].went_down, b.buttons[i].went_down);
+    EXPECT_EQ(a.buttons[i].went_up, b.buttons[i].went_up);
+  }
+  ASSERT_EQ(a.pointers.size(), b.pointers.size());
+  for (size_t i = 0; i < a.pointers.size(); ++i) {
+    EXPECT_EQ(a.pointers[i].used, b.pointers[i].used);
+    EXPECT_EQ(a.pointers[i].mousepos, b.pointers[i].mousepos);
+    EXPECT_EQ(a.pointers[i].mousedelta, b.pointers[i].mousedelta);
+  }
+  EXPECT_EQ(a.mousewheel_delta, b.mousewheel_delta);
+  EXPECT_EQ(a.window_size, b.window_size);
+  EXPECT_EQ(a.exit_requested, b.exit_requested);
+}
+
+TEST_F(InputTests, RecordingRoundTrip) {
+  const std::vector<InputFrame> session = MakeSession();
+  InputRecorder recorder;
+  for (auto it = session.begin(); it != session.end(); ++it) {
+    recorder.AddFrame(*it);
+  }
+  EXPECT_EQ(static_cast<int>(session.size()), recorder.num_frames());
+
+  InputPlayer player;
+  ASSERT_TRUE(player.Set(recorder.data()));
+  for (int pass = 0; pass < 2; ++pass) {
+    InputFrame frame;
+    for (auto it = session.begin(); it != session.end(); ++it) {
+      ASSERT_TRUE(player.NextFrame(&frame));
+      ExpectFramesEqual(*it, frame);
+    }
+    EXPECT_TRUE(player.finished());
+    EXPECT_FALSE(player.NextFrame(&frame));
+    player.Rewind();
+  }
+
+  // A truncated stream plays the whole frames, then stops.
+  std::string truncated = recorder.data();
+  truncated.resize(truncated.size() - 3);
+  ASSERT_TRUE(player.Set(truncated));
+  InputFrame frame;
+  for (size_t i = 0; i + 1 < session.size(); ++i) {
+    EXPECT_TRUE(player.NextFrame(&frame));
+  }
+  EXPECT_FALSE(player.NextFrame(&frame));
+  EXPECT_FALSE(player.Set("not a recording"));
+}
+
+TEST_F(InputTests, ReplayDrivesInputSystem) {
+  const std::vector<InputFrame> session = MakeSession();
+  InputRecorder original;
+  for (auto it = session.begin(); it != session.end(); ++it) {
+    original.AddFrame(*it);
+  }
+
+  // Replaying while recording must reproduce the stream bit for bit.
+  InputPlayer player;
+  ASSERT_TRUE(player.Set(original.data()));
+  InputRecorder rerecorded;
+  InputSystem input;
+  input.set_input_player(&player);
+  input.set_input_recorder(&rerecorded);
+  mathfu::vec2i window_size(640, 480);
+  double time = input.Time();
+  for (size_t i = 0; i < session.size(); ++i) {
+    input.AdvanceFrame(&window_size);
+    time += session[i].delta_time;
+    EXPECT_DOUBLE_EQ(time, input.Time());
+    EXPECT_EQ(session[i].delta_time, input.DeltaTime());
+    if (i == 1) {
+      EXPECT_TRUE(input.GetPointerButton(0).went_down());
+      EXPECT_EQ(mathfu::vec2i(10, 20), input.get_pointers()[0].mousepos);
+    } else if (i == 4) {
+      EXPECT_TRUE(input.GetPointerButton(0).went_up());
+      EXPECT_FALSE(input.GetButton(fplbase::FPLK_a).is_down());
+      EXPECT_TRUE(input.GetButton(fplbase::FPLK_a).went_down());
+    }
+  }
+  EXPECT_EQ(mathfu::vec2i(800, 600), window_size);
+  EXPECT_TRUE(input.exit_requested());
+  EXPECT_EQ(original.data(), rerecorded.data());
+
+  // With a fixed timestep, time ignores the recorded deltas.
+  InputSystem fixed_input;
+  player.Rewind();
+  player.set_fixed_timestep(1.0 / 60.0);
+  fixed_input.set_input_player(&player);
+  for (size_t i = 0; i < session.size(); ++i) {
+    fixed_input.AdvanceFrame(&window_size);
+    EXPECT_DOUBLE_EQ(1.0 / 60.0, fixed_input.DeltaTime());
+  }
+  EXPECT_TRUE(player.finished());
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
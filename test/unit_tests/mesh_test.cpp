@@ -0,0 +1,177 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+
+#include "fplbase/mesh.h"
+#include "fplbase/parallel_for.h"
+#include "gtest/gtest.h"
+#include "mathfu/glsl_mappings.h"
+
+using fplbase::Mesh;
+using mathfu::AffineTransform;
+using mathfu::mat4;
+using mathfu::vec2;
+using mathfu::vec4;
+using mathfu::vec4i;
+
+class MeshTests : public ::testing::Test {};
+
+// Maps a point in an eye's clip space to window coordinates, the way the
+// stereo vertex shader and the shared viewport do.
+static vec2 EyeToWindow(const vec2 &clip, const vec4 &transform,
+                        const vec4i &span) {
+  const vec2 ndc = clip * transform.xy() + transform.zw();
+  return vec2(span.xy()) + (ndc * 0.5f + 0.5f) * vec2(span.zw());
+}
+
+// The corners of each eye's clip space land on the corners of its viewport,
+// which are also the bounds its pixels are clipped to.
+TEST_F(MeshTests, StereoViewportsMapEachEye) {
+  const vec4i kViewports[][2] = {
+      {vec4i(0, 0, 400, 300), vec4i(400, 0, 400, 300)},
+      {vec4i(10, 20, 300, 200), vec4i(330, 40, 200, 180)},
+  };
+  for (size_t c = 0; c < sizeof(kViewports) / sizeof(kViewports[0]); ++c) {
+    const vec4i *viewport = kViewports[c];
+    vec4i span;
+    vec4 transform[2];
+    vec4 bounds[2];
+    Mesh::ComputeStereoViewports(viewport, &span, transform, bounds);
+    for (int eye = 0; eye < 2; ++eye) {
+      const vec2 lo = EyeToWindow(vec2(-1, -1), transform[eye], span);
+      const vec2 hi = EyeToWindow(vec2(1, 1), transform[eye], span);
+      EXPECT_NEAR(static_cast<float>(viewport[eye].x()), lo.x(), 1e-3f);
+      EXPECT_NEAR(static_cast<float>(viewport[eye].y()), lo.y(), 1e-3f);
+      EXPECT_NEAR(static_cast<float>(viewport[eye].x() + viewport[eye].z()),
+                  hi.x(), 1e-3f);
+      EXPECT_NEAR(static_cast<float>(viewport[eye].y() + viewport[eye].w()),
+                  hi.y(), 1e-3f);
+      EXPECT_NEAR(lo.x(), bounds[eye].x(), 1e-3f);
+      EXPECT_NEAR(lo.y(), bounds[eye].y(), 1e-3f);
+      EXPECT_NEAR(hi.x(), bounds[eye].z(), 1e-3f);
+      EXPECT_NEAR(hi.y(), bounds[eye].w(), 1e-3f);
+    }
+  }
+}
+
+// Geometry past the right edge of the left eye is still inside the shared
+// viewport, so only the bounds keep it out of the right eye.
+TEST_F(MeshTests, StereoBoundsClipSpillIntoOtherEye) {
+  const vec4i viewport[2] = {vec4i(0, 0, 400, 300), vec4i(400, 0, 400, 300)};
+  vec4i span;
+  vec4 transform[2];
+  vec4 bounds[2];
+  Mesh::ComputeStereoViewports(viewport, &span, transform, bounds);
+  EXPECT_EQ(vec4i(0, 0, 800, 300), span);
+  const vec2 spill = EyeToWindow(vec2(1.5f, 0), transform[0], span);
+  EXPECT_LT(spill.x(), static_cast<float>(span.x() + span.z()));
+  EXPECT_GE(spill.x(), bounds[0].z());
+  EXPECT_GE(spill.x(), bounds[1].x());
+}
+
+// Returns a transform with every element in [-2, 2], so it rotates, scales,
+// shears and translates.
+static AffineTransform RandomAffine() {
+  float elements[12];
+  for (int i = 0; i < 12; ++i) {
+    elements[i] = static_cast<float>(rand() % 4001 - 2000) / 1000.0f;
+  }
+  return AffineTransform(elements);
+}
+
+static const int kNumBones = 4;
+static const uint8_t kBoneParents[kNumBones] = {0, 0, 1, 2};
+// Bone 1 has no vertices weighted to it, so it has no shader transform.
+static const uint8_t kShaderBones[] = {3, 0, 2};
+static const int kNumShaderBones =
+    sizeof(kShaderBones) / sizeof(kShaderBones[0]);
+
+// A skinned mesh without vertices, so no GL context is needed, and random
+// default bone transforms, which SetBones() takes as the inverses.
+static Mesh *SkinnedMesh(AffineTransform *inverses) {
+  static const fplbase::Attribute kFormat[] = {fplbase::kPosition3f,
+                                              fplbase::kEND};
+  Mesh *mesh = new Mesh(nullptr, 0, 3 * sizeof(float), kFormat);
+  for (int i = 0; i < kNumBones; ++i) inverses[i] = RandomAffine();
+  mesh->SetBones(inverses, kBoneParents, nullptr, kNumBones, kShaderBones,
+                 kNumShaderBones);
+  return mesh;
+}
+
+// The affine shader transforms equal the full 4x4 matrix products.
+TEST_F(MeshTests, ShaderTransformsMatchMatrixProduct) {
+  srand(1234);
+  AffineTransform inverses[kNumBones];
+  std::unique_ptr<Mesh> mesh(SkinnedMesh(inverses));
+  AffineTransform bones[kNumBones];
+  for (int i = 0; i < kNumBones; ++i) bones[i] = RandomAffine();
+  AffineTransform shader[kNumShaderBones];
+  mesh->GatherShaderTransforms(bones, shader);
+
+  for (int i = 0; i < kNumShaderBones; ++i) {
+    const int bone = kShaderBones[i];
+    const mat4 expected = mat4::FromAffineTransform(bones[bone]) *
+                          mat4::FromAffineTransform(inverses[bone]);
+    const mat4 actual = mat4::FromAffineTransform(shader[i]);
+    for (int row = 0; row < 4; ++row) {
+      for (int column = 0; column < 4; ++column) {
+        EXPECT_NEAR(expected(row, column), actual(row, column), 1e-4f);
+      }
+    }
+  }
+}
+
+// Batches big enough to be split over threads give the same results as
+// converting each instance on its own.
+TEST_F(MeshTests, BatchedShaderTransformsMatchSingle) {
+  srand(5678);
+  fplbase::SetParallelForThreadCount(4);
+  AffineTransform inverses[kNumBones];
+  std::unique_ptr<Mesh> mesh(SkinnedMesh(inverses));
+  // More than the 64 instances per thread that are worth splitting off.
+  const size_t kNumInstances = 300;
+  // Arrays from new[], as mathfu aligns those for SIMD.
+  std::unique_ptr<AffineTransform[]> bones(
+      new AffineTransform[kNumInstances * kNumBones]);
+  for (size_t i = 0; i < kNumInstances * kNumBones; ++i) {
+    bones[i] = RandomAffine();
+  }
+  std::unique_ptr<AffineTransform[]> batched(
+      new AffineTransform[kNumInstances * kNumShaderBones]);
+  std::vector<Mesh::SkinnedInstance> instances(kNumInstances);
+  for (size_t i = 0; i < kNumInstances; ++i) {
+    instances[i].mesh = mesh.get();
+    instances[i].bone_transforms = &bones[i * kNumBones];
+    instances[i].shader_transforms = &batched[i * kNumShaderBones];
+  }
+  Mesh::GatherShaderTransforms(instances.data(), kNumInstances);
+
+  AffineTransform single[kNumShaderBones];
+  for (size_t i = 0; i < kNumInstances; ++i) {
+    mesh->GatherShaderTransforms(&bones[i * kNumBones], single);
+    ASSERT_EQ(0, memcmp(single, &batched[i * kNumShaderBones],
+                        sizeof(single)));
+  }
+  fplbase::SetParallelForThreadCount(0);
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,69 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "fplbase/parallel_for.h"
+#include "gtest/gtest.h"
+
+class ParallelForTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() { fplbase::SetParallelForThreadCount(4); }
+  virtual void TearDown() { fplbase::SetParallelForThreadCount(0); }
+};
+
+// Counts how often each index of [0, count) is visited.
+static std::vector<int> Visit(size_t count, size_t min_range) {
+  std::vector<std::atomic<int>> visits(count);
+  for (size_t i = 0; i < count; ++i) visits[i] = 0;
+  fplbase::ParallelFor(count, min_range, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) visits[i]++;
+  });
+  return std::vector<int>(visits.begin(), visits.end());
+}
+
+// Every index is visited exactly once, over many calls on the same workers.
+TEST_F(ParallelForTests, VisitsEachIndexOnce) {
+  for (int call = 0; call < 100; ++call) {
+    const size_t count = 1 + call * 37;
+    const std::vector<int> visits = Visit(count, 16);
+    for (size_t i = 0; i < count; ++i) ASSERT_EQ(1, visits[i]);
+  }
+}
+
+// Calls from several threads at once, and calls inside a body, finish.
+TEST_F(ParallelForTests, ConcurrentAndNestedCalls) {
+  std::atomic<int> total(0);
+  auto nested = [&]() {
+    fplbase::ParallelFor(8, 1, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        fplbase::ParallelFor(100, 10, [&](size_t b, size_t e) {
+          total += static_cast<int>(e - b);
+        });
+      }
+    });
+  };
+  std::thread other(nested);
+  nested();
+  other.join();
+  EXPECT_EQ(2 * 8 * 100, total.load());
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
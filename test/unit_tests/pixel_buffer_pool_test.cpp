@@ -0,0 +1,286 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+#include <map>
+#include <vector>
+
+#include "fplbase/pixel_buffer_pool.h"
+#include "gtest/gtest.h"
+
+using fplbase::PixelBufferBackend;
+using fplbase::PixelBufferPool;
+
+static const size_t kMin = PixelBufferPool::kMinBufferSize;
+
+// Backend whose buffers are plain memory, and which checks they're only
+// mapped, unmapped and bound when they may be.
+class MockPixelBufferBackend : public PixelBufferBackend {
+ public:
+  MockPixelBufferBackend()
+      : supported(true),
+        lose_contents(false),
+        next_buffer(1),
+        bound(0),
+        created(0),
+        maps(0) {}
+
+  virtual bool Supported() const { return supported; }
+  virtual unsigned int CreateBuffer(size_t size) {
+    created++;
+    storage[next_buffer].resize(size);
+    return next_buffer++;
+  }
+  virtual void DeleteBuffer(unsigned int buffer) {
+    EXPECT_EQ(0u, mapped.count(buffer));
+    EXPECT_NE(buffer, bound);
+    storage.erase(buffer);
+  }
+  virtual void *Map(unsigned int buffer, size_t size) {
+    EXPECT_EQ(0u, mapped.count(buffer));
+    EXPECT_EQ(storage[buffer].size(), size);
+    mapped[buffer] = true;
+    maps++;
+    return storage[buffer].data();
+  }
+  virtual bool Unmap(unsigned int buffer) {
+    EXPECT_EQ(1u, mapped.count(buffer));
+    mapped.erase(buffer);
+    return !lose_contents;
+  }
+  virtual void Bind(unsigned int buffer) {
+    EXPECT_EQ(0u, mapped.count(buffer));
+    bound = buffer;
+  }
+
+  bool supported;
+  bool lose_contents;
+  unsigned int next_buffer;
+  unsigned int bound;
+  int created;
+  int maps;
+  std::map<unsigned int, std::vector<uint8_t>> storage;
+  std::map<unsigned int, bool> mapped;
+};
+
+// Stage `size` bytes and issue an upload from them, like Texture::Finalize().
+static bool Upload(PixelBufferPool *pool, MockPixelBufferBackend *backend,
+                   size_t size) {
+  PixelBufferPool::Staging staging;
+  if (!pool->Acquire(size, &staging)) return false;
+  memset(staging.data, 0xAB, size);
+  const unsigned int buffer = staging.buffer;
+  EXPECT_TRUE(pool->BeginTransfer(staging));
+  EXPECT_EQ(buffer, backend->bound);
+  EXPECT_EQ(0xAB, backend->storage[buffer][size - 1]);
+  pool->EndTransfer(&staging);
+  EXPECT_EQ(0u, backend->bound);
+  EXPECT_EQ(0u, staging.buffer);
+  return true;
+}
+
+class PixelBufferPoolTests : public ::testing::Test {};
+
+TEST_F(PixelBufferPoolTests, BuffersAreCreatedForFailedRequests) {
+  MockPixelBufferBackend backend;
+  PixelBufferPool pool(&backend, 16 * kMin);
+  PixelBufferPool::Staging staging;
+  EXPECT_FALSE(pool.Acquire(kMin + 1, &staging));
+  EXPECT_EQ(nullptr, staging.data);
+  EXPECT_EQ(0, backend.created);
+
+  pool.AdvanceFrame();
+  EXPECT_EQ(1u, pool.num_buffers());
+  EXPECT_EQ(1u, pool.num_idle());
+  EXPECT_EQ(2 * kMin, pool.total_bytes());
+  ASSERT_TRUE(pool.Acquire(kMin + 1, &staging));
+  EXPECT_NE(nullptr, staging.data);
+  EXPECT_EQ(2 * kMin, staging.size);
+  EXPECT_EQ(0u, pool.num_idle());
+
+  // A request that was never used goes back to being idle.
+  pool.Release(&staging);
+  EXPECT_EQ(0u, staging.buffer);
+  EXPECT_EQ(1u, pool.num_idle());
+}
+
+TEST_F(PixelBufferPoolTests, BuffersAreReusedOnceTheGpuIsDone) {
+  MockPixelBufferBackend backend;
+  PixelBufferPool pool(&backend, 16 * kMin);
+  EXPECT_FALSE(Upload(&pool, &backend, 100));
+  pool.AdvanceFrame();
+  EXPECT_TRUE(Upload(&pool, &backend, 100));
+
+  // The buffer stays unmapped while uploads may still read it.
+  for (int i = 1; i < PixelBufferPool::kFramesInFlight; ++i) {
+    pool.AdvanceFrame();
+    EXPECT_EQ(0u, pool.num_idle());
+  }
+  pool.AdvanceFrame();
+  EXPECT_EQ(1u, pool.num_idle());
+
+  // Streaming a texture every frame settles on one buffer per frame in
+  // flight, and then stops creating any.
+  for (int i = 0; i < 20; ++i) {
+    Upload(&pool, &backend, 100);
+    pool.AdvanceFrame();
+  }
+  const int created = backend.created;
+  EXPECT_EQ(PixelBufferPool::kFramesInFlight, created);
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_TRUE(Upload(&pool, &backend, 100));
+    pool.AdvanceFrame();
+  }
+  EXPECT_EQ(created, backend.created);
+}
+
+TEST_F(PixelBufferPoolTests, SmallestFittingBufferIsTaken) {
+  MockPixelBufferBackend backend;
+  PixelBufferPool pool(&backend, 16 * kMin);
+  PixelBufferPool::Staging staging;
+  pool.Acquire(4 * kMin, &staging);
+  pool.Acquire(kMin, &staging);
+  pool.AdvanceFrame();
+  EXPECT_EQ(2u, pool.num_idle());
+  ASSERT_TRUE(pool.Acquire(10, &staging));
+  EXPECT_EQ(kMin, staging.size);
+  PixelBufferPool::Staging large;
+  ASSERT_TRUE(pool.Acquire(10, &large));
+  EXPECT_EQ(4 * kMin, large.size);
+  EXPECT_FALSE(pool.Acquire(10, &large));
+}
+
+TEST_F(PixelBufferPoolTests, PoolStaysWithinItsLimit) {
+  MockPixelBufferBackend backend;
+  PixelBufferPool pool(&backend, 3 * kMin);
+  PixelBufferPool::Staging staging;
+
+  // Too big to ever fit.
+  EXPECT_FALSE(pool.Acquire(3 * kMin, &staging));
+  pool.AdvanceFrame();
+  EXPECT_EQ(0, backend.created);
+
+  // Only the first three of these fit.
+  for (int i = 0; i < 4; ++i) pool.Acquire(kMin, &staging);
+  pool.AdvanceFrame();
+  EXPECT_EQ(3u, pool.num_buffers());
+  EXPECT_EQ(3 * kMin, pool.total_bytes());
+
+  // Idle buffers make way for new requests, least recently used first.
+  pool.AdvanceFrame();
+  PixelBufferPool::Staging used;
+  ASSERT_TRUE(pool.Acquire(kMin, &used));
+  const unsigned int used_buffer = used.buffer;
+  pool.Release(&used);
+  EXPECT_FALSE(pool.Acquire(2 * kMin, &staging));
+  pool.AdvanceFrame();
+  EXPECT_EQ(2u, pool.num_buffers());
+  EXPECT_EQ(3 * kMin, pool.total_bytes());
+  EXPECT_EQ(1u, backend.storage.count(used_buffer));
+  ASSERT_TRUE(pool.Acquire(2 * kMin, &staging));
+
+  // Lowering the limit frees idle buffers, but not ones in use.
+  pool.set_max_bytes(kMin);
+  pool.AdvanceFrame();
+  EXPECT_EQ(1u, pool.num_buffers());
+  EXPECT_EQ(2 * kMin, pool.total_bytes());
+  pool.Release(&staging);
+  pool.AdvanceFrame();
+  EXPECT_EQ(0u, pool.num_buffers());
+  EXPECT_EQ(0u, pool.total_bytes());
+}
+
+TEST_F(PixelBufferPoolTests, IdleBuffersAreFreed) {
+  MockPixelBufferBackend backend;
+  PixelBufferPool pool(&backend, 16 * kMin);
+  PixelBufferPool::Staging staging;
+  pool.Acquire(10, &staging);
+  pool.AdvanceFrame();
+  for (uint32_t i = 1; i < PixelBufferPool::kIdleFrames; ++i) {
+    pool.AdvanceFrame();
+  }
+  EXPECT_EQ(1u, pool.num_buffers());
+  pool.AdvanceFrame();
+  EXPECT_EQ(0u, pool.num_buffers());
+  EXPECT_TRUE(backend.storage.empty());
+}
+
+TEST_F(PixelBufferPoolTests, LostContentsAreNotUploaded) {
+  MockPixelBufferBackend backend;
+  PixelBufferPool pool(&backend, 16 * kMin);
+  PixelBufferPool::Staging staging;
+  pool.Acquire(10, &staging);
+  pool.AdvanceFrame();
+  ASSERT_TRUE(pool.Acquire(10, &staging));
+  backend.lose_contents = true;
+  EXPECT_FALSE(pool.BeginTransfer(staging));
+  EXPECT_EQ(0u, backend.bound);
+  pool.EndTransfer(&staging);
+
+  // The buffer is mapped again all the same.
+  backend.lose_contents = false;
+  for (int i = 0; i < PixelBufferPool::kFramesInFlight; ++i) {
+    pool.AdvanceFrame();
+  }
+  EXPECT_EQ(1u, pool.num_idle());
+}
+
+TEST_F(PixelBufferPoolTests, UnsupportedAndReset) {
+  MockPixelBufferBackend backend;
+  backend.supported = false;
+  PixelBufferPool pool(&backend, 16 * kMin);
+  PixelBufferPool::Staging staging;
+  EXPECT_FALSE(pool.Acquire(10, &staging));
+  pool.AdvanceFrame();
+  EXPECT_EQ(0, backend.created);
+
+  backend.supported = true;
+  pool.Acquire(10, &staging);
+  pool.Acquire(10, &staging);
+  pool.AdvanceFrame();
+  ASSERT_TRUE(pool.Acquire(10, &staging));
+  EXPECT_TRUE(Upload(&pool, &backend, 10));
+  pool.Reset();
+  // Buffers acquired before the reset stay mapped, as they may still be
+  // written to, until they are given back.
+  EXPECT_EQ(1u, pool.num_buffers());
+  EXPECT_EQ(0u, pool.num_idle());
+  ASSERT_EQ(1u, backend.storage.size());
+  EXPECT_EQ(1u, backend.mapped.count(staging.buffer));
+  memset(staging.data, 0xCD, 10);
+  pool.Reset();
+  EXPECT_EQ(1u, backend.storage.size());
+  pool.Release(&staging);
+  EXPECT_EQ(0u, staging.buffer);
+  EXPECT_EQ(0u, pool.num_buffers());
+  EXPECT_EQ(0u, pool.total_bytes());
+  EXPECT_EQ(0u, backend.storage.size());
+  EXPECT_EQ(0u, backend.mapped.size());
+
+  // One whose upload is refused after the reset goes away with EndTransfer().
+  pool.Acquire(10, &staging);
+  pool.AdvanceFrame();
+  ASSERT_TRUE(pool.Acquire(10, &staging));
+  pool.Reset();
+  EXPECT_FALSE(pool.BeginTransfer(staging));
+  pool.EndTransfer(&staging);
+  EXPECT_EQ(0u, pool.num_buffers());
+  EXPECT_EQ(0u, backend.storage.size());
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -14,6 +14,10 @@
 
 #include "gtest/gtest.h"
 #include "fplbase/preprocessor.h"
+#include "flatbuffers/util.h"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <unordered_set>
 
@@ -36,8 +40,9 @@ static const std::string kDefineMissingIdError =
 static const std::string kMissingEndIfError = "All #if (#ifdef, #ifndef) "
                                               "statements must have a "
                                               "corresponding #endif statement.";
-static const std::string kIfStackEmptyRegex =
-    "[Assertion failed: (!if_stack.empty())].*";
+static const std::string kUnmatchedError =
+    "#elif, #else and #endif must follow an #if (#ifdef, #ifndef) in the same "
+    "file.";
 
 static const char *empty_defines[] = {nullptr};
 
@@ -250,9 +255,24 @@ TEST_F(PreprocessorTests, TooManyEndif) {
                      "foo is defined.\n"
                      "#endif\n"
                      "#endif";
-  EXPECT_DEATH_IF_SUPPORTED(
-      fplbase::LoadFileWithDirectives(file.c_str(), &file_, empty_defines,
-                                      &error_message_), kIfStackEmptyRegex);
+  bool result = fplbase::LoadFileWithDirectives(file.c_str(), &file_,
+                                                empty_defines, &error_message_);
+  EXPECT_FALSE(result);
+  EXPECT_EQ(error_message_, kUnmatchedError);
+}
+
+// Should fail on an #else without an #if, or closing one in another file.
+TEST_F(PreprocessorTests, UnmatchedElse) {
+  std::string file = "#else\n";
+  EXPECT_FALSE(fplbase::LoadFileWithDirectives(file.c_str(), &file_,
+                                               empty_defines, &error_message_));
+  EXPECT_EQ(error_message_, kUnmatchedError);
+
+  file = "#ifndef foo\n"
+         "#include \"#endif\"\n";
+  EXPECT_FALSE(fplbase::LoadFileWithDirectives(file.c_str(), &file_,
+                                               empty_defines, &error_message_));
+  EXPECT_EQ(error_message_, kUnmatchedError);
 }
 
 // Unknown directives should be passed through.
@@ -316,6 +336,36 @@ TEST_F(PreprocessorTests, ManualDefineTest) {
   EXPECT_EQ(file_, "foo is defined.\n");
 }
 
+// Defines that aren't in the output are resolved in #if and #elif.
+TEST_F(PreprocessorTests, DefinedInIfTest) {
+  static const char *my_defines[] = {"foo", nullptr};
+  std::string file = "#define bar\n"
+                     "#if defined(foo) && X\n"
+                     "#elif defined bar || defined(baz) || defined(GL_ES)\n"
+                     "#endif\n";
+  bool result = fplbase::LoadFileWithDirectives(file.c_str(), &file_,
+                                                my_defines, &error_message_);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(file_, "#if 1 && X\n"
+                   "#elif 1 || defined(baz) || defined(GL_ES)\n"
+                   "#endif\n");
+}
+
+// Passed in defines with a value are written out after #version.
+TEST_F(PreprocessorTests, ManualDefineValueTest) {
+  static const char *my_defines[] = {"foo", "NUM_LIGHTS 4", nullptr};
+  std::string file = "#version 100\n"
+                     "#ifdef NUM_LIGHTS\n"
+                     "uniform vec3 lights[NUM_LIGHTS];\n"
+                     "#endif\n";
+  bool result = fplbase::LoadFileWithDirectives(file.c_str(), &file_,
+                                                my_defines, &error_message_);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(file_, "#version 100\n"
+                   "#define NUM_LIGHTS 4\n"
+                   "uniform vec3 lights[NUM_LIGHTS];\n");
+}
+
 // Comments inside a #ifdef that evaluates to false should be skipped.
 TEST_F(PreprocessorTests, NotCompilingComments) {
   static const char *my_defines[] = {"foo", nullptr};
@@ -332,6 +382,130 @@ TEST_F(PreprocessorTests, NotCompilingComments) {
   EXPECT_EQ(file_, "// first comment\nfoo is defined.\n");
 }
 
+// Each file is included once, where its first #include is.
+TEST_F(PreprocessorTests, IncludeInPlace) {
+  std::string file = "a\n"
+                     "#include \"b\"\n"
+                     "c\n"
+                     "#include \"b\"\n"
+                     "#ifdef foo\n"
+                     "#include \"d\"\n"
+                     "#endif\n";
+  std::set<std::string> files;
+  bool result = fplbase::LoadFileWithDirectives(file.c_str(), &file_,
+                                                empty_defines, &files,
+                                                &error_message_);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(file_, "a\nb\nc\n");
+  EXPECT_EQ(2u, files.size());
+  EXPECT_EQ(1u, files.count("b"));
+}
+
+// With #line directives, errors in the output map back to the sources.
+TEST_F(PreprocessorTests, LineDirectives) {
+  fplbase::Preprocessor preprocessor;
+  preprocessor.set_line_directives(true);
+  std::string file = "#version 100\n"
+                     "#include \"b\"\n"
+                     "#ifdef foo\n"
+                     "foo is defined.\n"
+                     "#endif\n"
+                     "c\n";
+  std::vector<std::string> sources;
+  bool result = preprocessor.Process(file.c_str(), empty_defines, &file_,
+                                     &error_message_, &sources);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(file_, "#version 100\n"
+                   "#line 1 1\n"
+                   "b\n"
+                   "#line 3 0\n"
+                   "\n\n\n"
+                   "c\n");
+  ASSERT_EQ(2u, sources.size());
+  EXPECT_EQ(file, sources[0]);
+  EXPECT_EQ("b", sources[1]);
+}
+
+// Contents returned by LoadChangingFile().
+static std::string &ChangingFileContents() {
+  static std::string contents;
+  return contents;
+}
+
+static bool LoadChangingFile(const char *, std::string *dest) {
+  *dest = ChangingFileContents();
+  return true;
+}
+
+// The cache is checked against what LoadFile() returns, so it follows
+// changes made through a custom LoadFileFunction.
+TEST_F(PreprocessorTests, CacheFollowsLoadFileFunction) {
+  fplbase::SetLoadFileFunction(LoadChangingFile);
+  fplbase::Preprocessor preprocessor;
+  ChangingFileContents() = "#ifdef foo\nold\n#endif\n";
+  static const char *defines[] = {"foo", nullptr};
+  EXPECT_TRUE(preprocessor.Process("file", defines, &file_, &error_message_));
+  EXPECT_EQ("old\n", file_);
+  ChangingFileContents() = "#ifdef foo\nnew\n#endif\n";
+  EXPECT_TRUE(preprocessor.Process("file", defines, &file_, &error_message_));
+  EXPECT_EQ("new\n", file_);
+  EXPECT_EQ(1u, preprocessor.cache_size());
+}
+
+// Expands a deep tree of real files, with and without the cache.
+TEST_F(PreprocessorTests, DeepIncludeTreeBenchmark) {
+  static const int kDepth = 32;
+  static const int kLinesPerFile = 200;
+  static const int kIterations = 20;
+  fplbase::SetLoadFileFunction(nullptr);
+  std::vector<std::string> names;
+  for (int i = 0; i < kDepth; ++i) {
+    names.push_back("preprocessor_test_" + flatbuffers::NumToString(i) + ".glsl");
+  }
+  names.push_back("preprocessor_test_common.glsl");
+  ASSERT_TRUE(fplbase::SaveFile(names[kDepth].c_str(), "common\n"));
+  for (int i = 0; i < kDepth; ++i) {
+    std::string contents = "#include \"" + names[kDepth] + "\"\n";
+    if (i + 1 < kDepth) contents += "#include \"" + names[i + 1] + "\"\n";
+    contents += "#ifdef SKINNED\nskinned\n#endif\n";
+    for (int line = 0; line < kLinesPerFile; ++line) {
+      contents += "vec4 value" + flatbuffers::NumToString(line) + " = vec4(1.0);\n";
+    }
+    ASSERT_TRUE(fplbase::SaveFile(names[i].c_str(), contents));
+  }
+
+  static const char *defines[] = {"SKINNED", nullptr};
+  fplbase::Preprocessor preprocessor;
+  std::string cold_output;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    preprocessor.ClearCache();
+    ASSERT_TRUE(preprocessor.Process(names[0].c_str(), defines, &cold_output,
+                                     &error_message_));
+  }
+  auto cold = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    ASSERT_TRUE(preprocessor.Process(names[0].c_str(), defines, &file_,
+                                     &error_message_));
+  }
+  auto warm = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(static_cast<size_t>(kDepth + 1), preprocessor.cache_size());
+  EXPECT_EQ(cold_output, file_);
+  // Every file appears once, and the common one only once in all.
+  EXPECT_EQ(0u, file_.find("common\n"));
+  EXPECT_EQ(std::string::npos, file_.find("common\n", 1));
+  EXPECT_EQ(static_cast<size_t>(kDepth * (kLinesPerFile + 1) + 1),
+            static_cast<size_t>(
+                std::count(file_.begin(), file_.end(), '\n')));
+  printf("%d files, %d lines: %.3f ms uncached, %.3f ms cached\n", kDepth,
+         kDepth * kLinesPerFile,
+         std::chrono::duration<double, std::milli>(cold).count() / kIterations,
+         std::chrono::duration<double, std::milli>(warm).count() /
+             kIterations);
+  for (size_t i = 0; i < names.size(); ++i) remove(names[i].c_str());
+}
+
 extern "C" int FPL_main(int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
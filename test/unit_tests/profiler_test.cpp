@@ -0,0 +1,162 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fplbase/profiler.h"
+#include "fplbase/systrace.h"
+#include "gtest/gtest.h"
+
+using fplbase::ProfileEvent;
+using fplbase::ProfileThreadEvents;
+
+class ProfilerTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    fplbase::ProfilerClear();
+    fplbase::ProfilerEnable(true);
+  }
+  virtual void TearDown() { fplbase::ProfilerEnable(false); }
+
+  // All events recorded by threads with the given name.
+  static std::vector<ProfileEvent> EventsOf(const char *thread_name) {
+    std::vector<ProfileThreadEvents> threads;
+    fplbase::ProfilerCollect(&threads);
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      if (it->thread_name == thread_name) return it->events;
+    }
+    return std::vector<ProfileEvent>();
+  }
+};
+
+TEST_F(ProfilerTests, NestedZones) {
+  fplbase::ProfileSetThreadName("main");
+  {
+    FPLBASE_PROFILE_ZONE("outer");
+    FPLBASE_PROFILE_COUNTER("count", 42);
+    { FPLBASE_PROFILE_ZONE("inner"); }
+  }
+  const std::vector<ProfileEvent> events = EventsOf("main");
+  ASSERT_EQ(5u, events.size());
+  EXPECT_EQ(fplbase::kProfileZoneBegin, events[0].type);
+  EXPECT_STREQ("outer", events[0].name);
+  EXPECT_EQ(fplbase::kProfileCounter, events[1].type);
+  EXPECT_EQ(42, events[1].value);
+  EXPECT_STREQ("inner", events[2].name);
+  EXPECT_EQ(fplbase::kProfileZoneEnd, events[3].type);
+  EXPECT_EQ(fplbase::kProfileZoneEnd, events[4].type);
+  for (size_t i = 1; i < events.size(); ++i) {
+    EXPECT_LE(events[i - 1].time, events[i].time);
+  }
+}
+
+TEST_F(ProfilerTests, DisabledRecordsNothing) {
+  fplbase::ProfileSetThreadName("main");
+  fplbase::ProfilerEnable(false);
+  { FPLBASE_PROFILE_ZONE("ignored"); }
+  EXPECT_TRUE(EventsOf("main").empty());
+}
+
+TEST_F(ProfilerTests, ThreadsAndAsyncSpans) {
+  const int kThreads = 4;
+  const int kZonesPerThread = 10000;
+  const char *kNames[kThreads] = {"worker0", "worker1", "worker2", "worker3"};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.push_back(std::thread([t, &kNames]() {
+      fplbase::ProfileSetThreadName(kNames[t]);
+      SystraceAsyncBegin("job", t);
+      for (int i = 0; i < kZonesPerThread; ++i) {
+        SystraceBegin("work");
+        SystraceEnd();
+      }
+    }));
+  }
+  for (auto it = threads.begin(); it != threads.end(); ++it) it->join();
+  for (int t = 0; t < kThreads; ++t) SystraceAsyncEnd("job", t);
+
+  for (int t = 0; t < kThreads; ++t) {
+    const std::vector<ProfileEvent> events = EventsOf(kNames[t]);
+    ASSERT_EQ(1u + 2 * kZonesPerThread, events.size());
+    EXPECT_EQ(fplbase::kProfileAsyncBegin, events[0].type);
+    EXPECT_EQ(t, events[0].value);
+  }
+  EXPECT_EQ(0u, fplbase::ProfilerDroppedEvents());
+
+  fplbase::ProfilerClear();
+  EXPECT_TRUE(EventsOf(kNames[0]).empty());
+}
+
+TEST_F(ProfilerTests, ExitedThreadsPassOnTheirBuffers) {
+  std::vector<ProfileThreadEvents> threads;
+  std::thread([]() { FPLBASE_PROFILE_ZONE("first"); }).join();
+  fplbase::ProfilerCollect(&threads);
+  const size_t num_buffers = threads.size();
+
+  // Once cleared, the exited thread's buffer is taken over by the next one,
+  // rather than a new buffer being made for every thread.
+  for (int i = 0; i < 8; ++i) {
+    fplbase::ProfilerClear();
+    std::thread([]() {
+      fplbase::ProfileSetThreadName("short lived");
+      FPLBASE_PROFILE_ZONE("work");
+    }).join();
+  }
+  fplbase::ProfilerCollect(&threads);
+  EXPECT_EQ(num_buffers, threads.size());
+  EXPECT_EQ(2u, EventsOf("short lived").size());
+}
+
+TEST_F(ProfilerTests, ChromeTraceJson) {
+  std::vector<ProfileThreadEvents> threads(1);
+  threads[0].thread_index = 3;
+  threads[0].thread_name = "loader \"1\"";
+  ProfileEvent event;
+  event.time = 1500;
+  event.name = "load";
+  event.value = 0;
+  event.type = fplbase::kProfileZoneBegin;
+  threads[0].events.push_back(event);
+  event.time = 2500;
+  event.type = fplbase::kProfileZoneEnd;
+  threads[0].events.push_back(event);
+  event.name = fplbase::ProfileInternName("textures/a.webp");
+  event.type = fplbase::kProfileAsyncBegin;
+  event.value = 7;
+  threads[0].events.push_back(event);
+  event.name = "memory";
+  event.type = fplbase::kProfileCounter;
+  event.value = 1024;
+  threads[0].events.push_back(event);
+
+  EXPECT_EQ(
+      "{\"traceEvents\":[\n"
+      "{\"ph\":\"M\",\"pid\":1,\"tid\":3,\"name\":\"thread_name\","
+      "\"args\":{\"name\":\"loader \\\"1\\\"\"}},\n"
+      "{\"ph\":\"B\",\"pid\":1,\"tid\":3,\"ts\":1.500,\"name\":\"load\"},\n"
+      "{\"ph\":\"E\",\"pid\":1,\"tid\":3,\"ts\":2.500},\n"
+      "{\"ph\":\"b\",\"pid\":1,\"tid\":3,\"ts\":2.500,"
+      "\"name\":\"textures/a.webp\",\"cat\":\"fplbase\",\"id\":7},\n"
+      "{\"ph\":\"C\",\"pid\":1,\"tid\":3,\"ts\":2.500,\"name\":\"memory\","
+      "\"args\":{\"value\":1024}}\n"
+      "]}\n",
+      fplbase::ProfilerChromeTraceJson(threads));
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
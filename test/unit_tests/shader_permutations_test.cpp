@@ -0,0 +1,116 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string>
+#include <vector>
+
+#include "fplbase/renderer.h"
+#include "fplbase/shader_permutations.h"
+#include "gtest/gtest.h"
+#include "shader_generated.h"
+
+using fplbase::FindShaderFeatures;
+using fplbase::ShaderPermutations;
+
+// Builds a shader file with a variant for every combination of `features`.
+static std::string BuildShaderFile(const std::vector<std::string> &features) {
+  flatbuffers::FlatBufferBuilder fbb;
+  std::vector<flatbuffers::Offset<shaderdef::ShaderVariant>> variants;
+  const uint32_t num_variants = features.empty() ? 0 : 1u << features.size();
+  for (uint32_t mask = 0; mask < num_variants; ++mask) {
+    variants.push_back(shaderdef::CreateShaderVariant(
+        fbb, mask, fbb.CreateString("vs"), fbb.CreateString("fs")));
+  }
+  std::vector<flatbuffers::Offset<flatbuffers::String>> feature_names;
+  for (size_t i = 0; i < features.size(); ++i) {
+    feature_names.push_back(fbb.CreateString(features[i]));
+  }
+  auto vs = fbb.CreateString("vs");
+  auto fs = fbb.CreateString("fs");
+  auto feature_names_fb = fbb.CreateVector(feature_names);
+  auto variants_fb = fbb.CreateVector(variants);
+  shaderdef::FinishShaderBuffer(
+      fbb, shaderdef::CreateShader(fbb, vs, fs, 0, feature_names_fb,
+                                   variants_fb));
+  return std::string(reinterpret_cast<const char *>(fbb.GetBufferPointer()),
+                     fbb.GetSize());
+}
+
+class ShaderPermutationsTests : public ::testing::Test {
+ protected:
+  fplbase::Renderer renderer_;
+};
+
+TEST_F(ShaderPermutationsTests, FindsDeclaredFeatures) {
+  const char *source =
+      "#version 100\n"
+      "#pragma fpl_features FOG SHADOWS\n"
+      "  #pragma   fpl_features\tSKINNED FOG\n"
+      "#pragma fpl_features_other IGNORED\n"
+      "#pragma optimize(on)\n"
+      "// #pragma fpl_features COMMENTED\n"
+      "void main() {}\n";
+  std::vector<std::string> features;
+  FindShaderFeatures(source, &features);
+  ASSERT_EQ(3u, features.size());
+  EXPECT_EQ("FOG", features[0]);
+  EXPECT_EQ("SHADOWS", features[1]);
+  EXPECT_EQ("SKINNED", features[2]);
+
+  // Features already found aren't added again.
+  FindShaderFeatures("#pragma fpl_features SHADOWS NORMALS", &features);
+  ASSERT_EQ(4u, features.size());
+  EXPECT_EQ("NORMALS", features[3]);
+}
+
+TEST_F(ShaderPermutationsTests, MasksSelectFeatures) {
+  std::vector<std::string> features;
+  features.push_back("FOG");
+  features.push_back("SHADOWS");
+  features.push_back("SKINNED");
+  std::string file = BuildShaderFile(features);
+  ShaderPermutations permutations(renderer_);
+  ASSERT_TRUE(permutations.Init(&file));
+  EXPECT_EQ(3, permutations.num_features());
+  EXPECT_EQ(8u, permutations.num_variants());
+  EXPECT_EQ("SHADOWS", permutations.feature(1));
+  EXPECT_EQ(2u, permutations.FeatureBit("SHADOWS"));
+  EXPECT_EQ(0u, permutations.FeatureBit("UNKNOWN"));
+  const char *selected[] = {"SKINNED", "UNKNOWN", "FOG", nullptr};
+  EXPECT_EQ(5u, permutations.FeatureMask(selected));
+  EXPECT_EQ(0, permutations.num_compiled());
+  EXPECT_FALSE(permutations.prewarm_pending());
+  permutations.Prewarm(5u);
+  EXPECT_TRUE(permutations.prewarm_pending());
+}
+
+TEST_F(ShaderPermutationsTests, FilesWithoutFeaturesHaveOneVariant) {
+  std::string file = BuildShaderFile(std::vector<std::string>());
+  ShaderPermutations permutations(renderer_);
+  ASSERT_TRUE(permutations.Init(&file));
+  EXPECT_EQ(0, permutations.num_features());
+  EXPECT_EQ(1u, permutations.num_variants());
+}
+
+TEST_F(ShaderPermutationsTests, RejectsOtherFiles) {
+  std::string file = "not a shader";
+  ShaderPermutations permutations(renderer_);
+  EXPECT_FALSE(permutations.Init(&file));
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,127 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "fplbase/streaming_buffer.h"
+#include "gtest/gtest.h"
+
+using fplbase::StreamingBuffer;
+
+// Keeps the storage of each buffer in memory, and counts how often it is
+// orphaned.
+class MockStreamingBufferBackend : public fplbase::StreamingBufferBackend {
+ public:
+  MockStreamingBufferBackend()
+      : next_buffer_(1), bound_(0), allocations_(0), deleted_(0) {}
+
+  virtual unsigned int CreateBuffer() { return next_buffer_++; }
+  virtual void DeleteBuffer(unsigned int) { ++deleted_; }
+  virtual void Bind(unsigned int buffer) { bound_ = buffer; }
+  virtual void Allocate(size_t size) {
+    EXPECT_NE(0u, bound_);
+    storage_.assign(size, 0);
+    ++allocations_;
+  }
+  virtual void Upload(size_t offset, const void *data, size_t size) {
+    EXPECT_NE(0u, bound_);
+    ASSERT_LE(offset + size, storage_.size());
+    memcpy(&storage_[offset], data, size);
+  }
+
+  unsigned int next_buffer_;
+  unsigned int bound_;
+  int allocations_;
+  int deleted_;
+  std::vector<uint8_t> storage_;
+};
+
+class StreamingBufferTests : public ::testing::Test {
+ protected:
+  MockStreamingBufferBackend backend_;
+};
+
+// Each write starts on an aligned offset after the previous one.
+TEST_F(StreamingBufferTests, AlignsOffsets) {
+  StreamingBuffer buffer(&backend_, 256);
+  const uint8_t data[20] = {1, 2, 3, 4, 5};
+  size_t offset = 1;
+  ASSERT_TRUE(buffer.Write(data, 3, &offset));
+  EXPECT_EQ(0u, offset);
+  ASSERT_TRUE(buffer.Write(data, 20, &offset));
+  EXPECT_EQ(StreamingBuffer::kAlignment, offset);
+  ASSERT_TRUE(buffer.Write(data, 5, &offset));
+  EXPECT_EQ(3 * StreamingBuffer::kAlignment, offset);
+  EXPECT_EQ(0, memcmp(&backend_.storage_[offset], data, 5));
+  EXPECT_EQ(28u, buffer.bytes_this_frame());
+  EXPECT_EQ(1, backend_.allocations_);
+  EXPECT_FALSE(buffer.Write(data, 0, &offset));
+}
+
+// A write that doesn't fit orphans the buffer and starts over at 0.
+TEST_F(StreamingBufferTests, WrapsWhenFull) {
+  StreamingBuffer buffer(&backend_, 64);
+  const uint8_t data[40] = {7};
+  size_t offset = 0;
+  ASSERT_TRUE(buffer.Write(data, 40, &offset));
+  ASSERT_TRUE(buffer.Write(data, 40, &offset));
+  EXPECT_EQ(0u, offset);
+  EXPECT_EQ(2, backend_.allocations_);
+  EXPECT_EQ(64u, buffer.capacity());
+  EXPECT_EQ(7, backend_.storage_[0]);
+}
+
+// A write larger than the buffer grows it to a power of two multiple.
+TEST_F(StreamingBufferTests, GrowsForLargeWrites) {
+  StreamingBuffer buffer(&backend_, 64);
+  std::vector<uint8_t> data(200, 9);
+  size_t offset = 1;
+  ASSERT_TRUE(buffer.Write(data.data(), 10, &offset));
+  ASSERT_TRUE(buffer.Write(data.data(), data.size(), &offset));
+  EXPECT_EQ(0u, offset);
+  EXPECT_EQ(256u, buffer.capacity());
+  EXPECT_EQ(256u, backend_.storage_.size());
+  EXPECT_EQ(9, backend_.storage_[199]);
+}
+
+// Frames that wrote to the buffer orphan it, others leave it alone.
+TEST_F(StreamingBufferTests, OrphansWrittenFrames) {
+  StreamingBuffer buffer(&backend_, 64);
+  buffer.AdvanceFrame();
+  EXPECT_EQ(0, backend_.allocations_);
+  const uint8_t data[4] = {0};
+  size_t offset = 0;
+  ASSERT_TRUE(buffer.Write(data, 4, &offset));
+  buffer.AdvanceFrame();
+  EXPECT_EQ(2, backend_.allocations_);
+  EXPECT_EQ(0u, backend_.bound_);
+  EXPECT_EQ(0u, buffer.bytes_this_frame());
+  buffer.AdvanceFrame();
+  EXPECT_EQ(2, backend_.allocations_);
+  ASSERT_TRUE(buffer.Write(data, 4, &offset));
+  EXPECT_EQ(0u, offset);
+  const unsigned int handle = buffer.handle();
+  buffer.Reset();
+  EXPECT_EQ(1, backend_.deleted_);
+  EXPECT_EQ(0u, buffer.handle());
+  ASSERT_TRUE(buffer.Write(data, 4, &offset));
+  EXPECT_NE(handle, buffer.handle());
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,334 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "fplbase/texture.h"
+#include "fplbase/texture_cache.h"
+#include "fplbase/utilities.h"
+#include "gtest/gtest.h"
+#include "mathfu/glsl_mappings.h"
+
+using fplbase::Texture;
+using fplbase::TextureCache;
+using mathfu::vec2;
+using mathfu::vec2i;
+
+static const char kCacheDirectory[] = ".";
+static const char kIndexFile[] = "./texture_cache_index";
+static const char kTgaFile[] = "texture_cache_test_image.tga";
+static const size_t kMaxBytes = 64 * 1024 * 1024;
+
+class TextureCacheTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    srand(1234);
+    ASSERT_TRUE(cache_.Open(kCacheDirectory, kMaxBytes));
+  }
+  virtual void TearDown() {
+    cache_.Open(kCacheDirectory, kMaxBytes);
+    cache_.Clear();
+    cache_.Close();
+    remove(kIndexFile);
+    remove(kTgaFile);
+  }
+
+  std::string LoadString(TextureCache::Key key) {
+    size_t size = 0;
+    uint8_t *buf = cache_.Load(key, &size);
+    if (!buf) return std::string();
+    std::string data(reinterpret_cast<const char *>(buf), size);
+    free(buf);
+    return data;
+  }
+
+  TextureCache cache_;
+};
+
+// Writes an uncompressed, top-down 32 bit TGA file of noise, and returns the
+// contents of the file.
+static std::string WriteTga(const char *filename, const vec2i &size) {
+  std::string file(18, '\0');
+  file[2] = 2;  // Uncompressed true color.
+  file[12] = static_cast<char>(size.x());
+  file[13] = static_cast<char>(size.x() >> 8);
+  file[14] = static_cast<char>(size.y());
+  file[15] = static_cast<char>(size.y() >> 8);
+  file[16] = 32;
+  file[17] = 0x28;  // Top-down rows, 8 bits of alpha.
+  for (int i = 0; i < size.x() * size.y(); ++i) {
+    file += static_cast<char>(rand());
+    file += static_cast<char>(rand());
+    file += static_cast<char>(rand());
+    file += static_cast<char>(0xff);
+  }
+  FILE *out = fopen(filename, "wb");
+  EXPECT_NE(nullptr, out);
+  if (out) {
+    fwrite(file.data(), 1, file.size(), out);
+    fclose(out);
+  }
+  return file;
+}
+
+TEST_F(TextureCacheTests, StoreAndLoad) {
+  EXPECT_TRUE(cache_.Store(1, "first"));
+  EXPECT_TRUE(cache_.Store(2, "second"));
+  EXPECT_EQ("first", LoadString(1));
+  EXPECT_EQ("second", LoadString(2));
+  EXPECT_EQ("", LoadString(3));
+
+  // Replacing an entry replaces its size too.
+  EXPECT_TRUE(cache_.Store(1, "1st"));
+  EXPECT_EQ("1st", LoadString(1));
+  EXPECT_EQ(2u, cache_.num_entries());
+  EXPECT_EQ(strlen("1st") + strlen("second"), cache_.total_bytes());
+}
+
+// Entries over the size limit evict the least recently used ones.
+TEST_F(TextureCacheTests, EvictsLeastRecentlyUsed) {
+  ASSERT_TRUE(cache_.Open(kCacheDirectory, 100));
+  const std::string data(40, 'x');
+  EXPECT_TRUE(cache_.Store(1, data));
+  EXPECT_TRUE(cache_.Store(2, data));
+  EXPECT_EQ(data, LoadString(1));
+  EXPECT_TRUE(cache_.Store(3, data));
+  EXPECT_EQ(2u, cache_.num_entries());
+  EXPECT_EQ(80u, cache_.total_bytes());
+  EXPECT_EQ(data, LoadString(1));
+  EXPECT_EQ("", LoadString(2));
+  EXPECT_EQ(data, LoadString(3));
+
+  // An entry bigger than the whole cache isn't stored, and evicts nothing.
+  EXPECT_FALSE(cache_.Store(4, std::string(101, 'x')));
+  EXPECT_EQ(2u, cache_.num_entries());
+}
+
+// Returns whether `filename` exists.
+static bool FileExists(const char *filename) {
+  FILE *file = fopen(filename, "rb");
+  if (file) fclose(file);
+  return file != nullptr;
+}
+
+// Entry files the index doesn't list, and leftover temporary files, are
+// deleted by Open(). Other files are left alone.
+TEST_F(TextureCacheTests, OpenDeletesOrphans) {
+  EXPECT_TRUE(cache_.Store(1, "listed"));
+  cache_.Close();
+  const char *kOrphans[] = {"./00000000000000ff.ktx",
+                            "./0000000000000001.ktx.7.tmp"};
+  const char kOther[] = "./texture_cache_test_other.ktx";
+  for (size_t i = 0; i < sizeof(kOrphans) / sizeof(kOrphans[0]); ++i) {
+    ASSERT_TRUE(fplbase::SaveFile(kOrphans[i], std::string("orphan")));
+  }
+  ASSERT_TRUE(fplbase::SaveFile(kOther, std::string("other")));
+
+  ASSERT_TRUE(cache_.Open(kCacheDirectory, kMaxBytes));
+  for (size_t i = 0; i < sizeof(kOrphans) / sizeof(kOrphans[0]); ++i) {
+    EXPECT_FALSE(FileExists(kOrphans[i]));
+  }
+  EXPECT_TRUE(FileExists(kOther));
+  EXPECT_EQ("listed", LoadString(1));
+  remove(kOther);
+}
+
+// Entries and the order they were used in survive closing the cache.
+TEST_F(TextureCacheTests, PersistsAcrossRuns) {
+  ASSERT_TRUE(cache_.Open(kCacheDirectory, 100));
+  const std::string data(40, 'x');
+  EXPECT_TRUE(cache_.Store(1, data));
+  EXPECT_TRUE(cache_.Store(2, data));
+  EXPECT_EQ(data, LoadString(1));
+  cache_.Close();
+  EXPECT_FALSE(cache_.is_open());
+  EXPECT_EQ("", LoadString(1));
+
+  ASSERT_TRUE(cache_.Open(kCacheDirectory, 100));
+  EXPECT_EQ(2u, cache_.num_entries());
+  EXPECT_TRUE(cache_.Store(3, data));
+  EXPECT_EQ(data, LoadString(1));
+  EXPECT_EQ("", LoadString(2));
+}
+
+TEST_F(TextureCacheTests, KeyCoversEverythingThatChangesTheResult) {
+  const std::string file = "not really an image";
+  const auto key = [&file](const std::string &contents,
+                           fplbase::TextureFormat desired, int flags,
+                           const vec2 &scale) {
+    return TextureCache::MakeKey(contents.data(), contents.size(), desired,
+                                 static_cast<fplbase::TextureFlags>(flags),
+                                 scale);
+  };
+  const TextureCache::Key base =
+      key(file, fplbase::kFormatAuto, fplbase::kTextureFlagsUseMipMaps,
+          mathfu::kOnes2f);
+  EXPECT_NE(base, key(file + "!", fplbase::kFormatAuto,
+                      fplbase::kTextureFlagsUseMipMaps, mathfu::kOnes2f));
+  EXPECT_NE(base, key(file, fplbase::kFormat8888,
+                      fplbase::kTextureFlagsUseMipMaps, mathfu::kOnes2f));
+  EXPECT_NE(base, key(file, fplbase::kFormatAuto, fplbase::kTextureFlagsNone,
+                      mathfu::kOnes2f));
+  EXPECT_NE(base, key(file, fplbase::kFormatAuto,
+                      fplbase::kTextureFlagsUseMipMaps, vec2(0.5f)));
+  // Flags that don't change the pixels share entries.
+  EXPECT_EQ(base, key(file, fplbase::kFormatAuto,
+                      fplbase::kTextureFlagsUseMipMaps |
+                          fplbase::kTextureFlagsParallelDecode |
+                          fplbase::kTextureFlagsClampToEdge,
+                      mathfu::kOnes2f));
+}
+
+// With the shared cache open, textures load as KTX, and the second load
+// comes from the cache.
+TEST_F(TextureCacheTests, LoadAndUnpackTextureUsesCache) {
+  cache_.Close();
+  TextureCache &shared = TextureCache::Shared();
+  ASSERT_TRUE(shared.Open(kCacheDirectory, kMaxBytes));
+  const vec2i kSize(64, 32);
+  const std::string tga = WriteTga(kTgaFile, kSize);
+  const auto kFlags = fplbase::kTextureFlagsUseMipMaps;
+
+  vec2i size;
+  fplbase::TextureFormat format;
+  uint8_t *ktx = Texture::LoadAndUnpackTexture(kTgaFile, mathfu::kOnes2f,
+                                               &size, &format, kFlags);
+  ASSERT_NE(nullptr, ktx);
+  EXPECT_EQ(fplbase::kFormatKTX, format);
+  EXPECT_EQ(kSize, size);
+  EXPECT_EQ(1u, shared.num_entries());
+
+  // Swap the entry for a recognizable one, to tell a hit from a decode.
+  const TextureCache::Key key =
+      TextureCache::MakeKey(tga.data(), tga.size(), fplbase::kFormatAuto,
+                            kFlags, mathfu::kOnes2f);
+  std::string marked(reinterpret_cast<const char *>(ktx), shared.total_bytes());
+  marked[marked.size() - 1] ^= 0x5a;
+  ASSERT_TRUE(shared.Store(key, marked));
+  free(ktx);
+
+  ktx = Texture::LoadAndUnpackTexture(kTgaFile, mathfu::kOnes2f, &size,
+                                      &format, kFlags);
+  ASSERT_NE(nullptr, ktx);
+  EXPECT_EQ(fplbase::kFormatKTX, format);
+  EXPECT_EQ(kSize, size);
+  EXPECT_EQ(0, memcmp(marked.data(), ktx, marked.size()));
+  free(ktx);
+
+  shared.Clear();
+  shared.Close();
+}
+
+// An entry that isn't a KTX file is replaced by decoding the source again.
+TEST_F(TextureCacheTests, LoadAndUnpackTextureReplacesBadEntries) {
+  cache_.Close();
+  TextureCache &shared = TextureCache::Shared();
+  ASSERT_TRUE(shared.Open(kCacheDirectory, kMaxBytes));
+  const vec2i kSize(32, 16);
+  const std::string tga = WriteTga(kTgaFile, kSize);
+  const auto kFlags = fplbase::kTextureFlagsUseMipMaps;
+  const TextureCache::Key key =
+      TextureCache::MakeKey(tga.data(), tga.size(), fplbase::kFormatAuto,
+                            kFlags, mathfu::kOnes2f);
+
+  const char *kBadEntries[] = {"short", "not a KTX file, but long enough "
+                                        "to hold a whole KTX header."};
+  for (size_t i = 0; i < sizeof(kBadEntries) / sizeof(kBadEntries[0]); ++i) {
+    ASSERT_TRUE(shared.Store(key, kBadEntries[i]));
+    vec2i size;
+    fplbase::TextureFormat format;
+    uint8_t *ktx = Texture::LoadAndUnpackTexture(kTgaFile, mathfu::kOnes2f,
+                                                 &size, &format, kFlags);
+    ASSERT_NE(nullptr, ktx);
+    EXPECT_EQ(fplbase::kFormatKTX, format);
+    EXPECT_EQ(kSize, size);
+    EXPECT_EQ(0, memcmp(ktx, "\xABKTX 11\xBB\r\n\x1A\n", 12));
+    free(ktx);
+
+    size_t stored = 0;
+    uint8_t *entry = shared.Load(key, &stored);
+    ASSERT_NE(nullptr, entry);
+    EXPECT_LT(strlen(kBadEntries[i]), stored);
+    free(entry);
+  }
+
+  shared.Clear();
+  shared.Close();
+}
+
+// A cache hit on an array gives the size of the whole strip of layers.
+TEST_F(TextureCacheTests, LoadAndUnpackTextureCachesArrays) {
+  cache_.Close();
+  TextureCache &shared = TextureCache::Shared();
+  ASSERT_TRUE(shared.Open(kCacheDirectory, kMaxBytes));
+  const vec2i kSize(16, 64);
+  WriteTga(kTgaFile, kSize);
+  const auto kFlags = fplbase::kTextureFlagsIsArray;
+
+  for (int load = 0; load < 2; ++load) {
+    vec2i size;
+    fplbase::TextureFormat format;
+    uint8_t *ktx = Texture::LoadAndUnpackTexture(kTgaFile, mathfu::kOnes2f,
+                                                 &size, &format, kFlags);
+    ASSERT_NE(nullptr, ktx);
+    EXPECT_EQ(fplbase::kFormatKTX, format);
+    EXPECT_EQ(kSize, size);
+    EXPECT_EQ(1u, shared.num_entries());
+    free(ktx);
+  }
+
+  shared.Clear();
+  shared.Close();
+}
+
+// Prints how long a texture takes to load with and without a cache entry.
+TEST_F(TextureCacheTests, WarmLoadBenchmark) {
+  cache_.Close();
+  TextureCache &shared = TextureCache::Shared();
+  ASSERT_TRUE(shared.Open(kCacheDirectory, kMaxBytes));
+  const vec2i kSize(2048, 2048);
+  WriteTga(kTgaFile, kSize);
+
+  double milliseconds[2];
+  for (int i = 0; i < 2; ++i) {
+    vec2i size;
+    fplbase::TextureFormat format;
+    const auto start = std::chrono::high_resolution_clock::now();
+    uint8_t *ktx = Texture::LoadAndUnpackTexture(
+        kTgaFile, mathfu::kOnes2f, &size, &format,
+        fplbase::kTextureFlagsUseMipMaps);
+    const auto end = std::chrono::high_resolution_clock::now();
+    milliseconds[i] =
+        std::chrono::duration<double, std::milli>(end - start).count();
+    ASSERT_NE(nullptr, ktx);
+    free(ktx);
+  }
+  printf("Load %dx%d with mips: %.1f ms cold, %.1f ms from the cache\n",
+         kSize.x(), kSize.y(), milliseconds[0], milliseconds[1]);
+
+  shared.Clear();
+  shared.Close();
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,297 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "fplbase/parallel_for.h"
+#include "fplbase/renderer.h"
+#include "fplbase/texture.h"
+#include "fplbase/utilities.h"
+#include "gtest/gtest.h"
+#include "mathfu/glsl_mappings.h"
+
+using fplbase::Texture;
+using mathfu::vec2;
+using mathfu::vec2i;
+
+static const char kTgaFile[] = "texture_test_image.tga";
+
+class TextureTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() { srand(1234); }
+  virtual void TearDown() {
+    fplbase::SetParallelForThreadCount(0);
+    remove(kTgaFile);
+  }
+};
+
+// Writes an uncompressed, top-down 32 bit TGA file of smooth noise, and
+// returns its pixels in RGBA order.
+static std::vector<uint8_t> WriteTga(const char *filename, const vec2i &size) {
+  uint8_t header[18] = {0};
+  header[2] = 2;  // Uncompressed true color.
+  header[12] = static_cast<uint8_t>(size.x());
+  header[13] = static_cast<uint8_t>(size.x() >> 8);
+  header[14] = static_cast<uint8_t>(size.y());
+  header[15] = static_cast<uint8_t>(size.y() >> 8);
+  header[16] = 32;
+  header[17] = 0x28;  // Top-down rows, 8 bits of alpha.
+  std::vector<uint8_t> pixels(static_cast<size_t>(size.x()) * size.y() * 4);
+  for (int y = 0; y < size.y(); ++y) {
+    for (int x = 0; x < size.x(); ++x) {
+      uint8_t *p = &pixels[(static_cast<size_t>(y) * size.x() + x) * 4];
+      p[0] = static_cast<uint8_t>(x + y);
+      p[1] = static_cast<uint8_t>(x * 3);
+      p[2] = static_cast<uint8_t>(y * 5 + rand() % 8);
+      p[3] = static_cast<uint8_t>(255 - x);
+    }
+  }
+  FILE *file = fopen(filename, "wb");
+  EXPECT_NE(nullptr, file);
+  if (file) {
+    fwrite(header, 1, sizeof(header), file);
+    fwrite(pixels.data(), 1, pixels.size(), file);
+    fclose(file);
+  }
+  // TGA stores blue, green, red, alpha.
+  for (size_t i = 0; i < pixels.size(); i += 4) {
+    std::swap(pixels[i], pixels[i + 2]);
+  }
+  return pixels;
+}
+
+static uint8_t *Decode(const vec2 &scale, fplbase::TextureFlags flags,
+                       vec2i *size, double *milliseconds) {
+  fplbase::TextureFormat format;
+  const auto start = std::chrono::high_resolution_clock::now();
+  uint8_t *pixels =
+      Texture::LoadAndUnpackTexture(kTgaFile, scale, size, &format, flags);
+  const auto end = std::chrono::high_resolution_clock::now();
+  *milliseconds =
+      std::chrono::duration<double, std::milli>(end - start).count();
+  EXPECT_EQ(fplbase::kFormat8888, format);
+  return pixels;
+}
+
+// Striped parallel resizing must give the same image as resizing in one go.
+// Uses a scale that isn't a power of two, so STB does the resizing.
+TEST_F(TextureTests, ParallelDecodeMatchesSerial) {
+  const vec2i kSize(4096, 2048);
+  WriteTga(kTgaFile, kSize);
+  // Force several stripes, even on machines with few cores.
+  fplbase::SetParallelForThreadCount(8);
+
+  vec2i serial_size;
+  vec2i parallel_size;
+  double serial_ms = 0.0;
+  double parallel_ms = 0.0;
+  const vec2 kScale(0.75f, 0.75f);
+  uint8_t *serial = Decode(kScale, fplbase::kTextureFlagsNone, &serial_size,
+                           &serial_ms);
+  uint8_t *parallel = Decode(kScale, fplbase::kTextureFlagsParallelDecode,
+                             &parallel_size, &parallel_ms);
+  ASSERT_NE(nullptr, serial);
+  ASSERT_NE(nullptr, parallel);
+  EXPECT_EQ(vec2i(3072, 1536), serial_size);
+  EXPECT_EQ(serial_size, parallel_size);
+
+  const size_t bytes =
+      static_cast<size_t>(serial_size.x()) * serial_size.y() * 4;
+  EXPECT_EQ(0, memcmp(serial, parallel, bytes));
+  free(serial);
+  free(parallel);
+
+  printf("Decode and resize %dx%d: %.1f ms serial, %.1f ms parallel\n",
+         kSize.x(), kSize.y(), serial_ms, parallel_ms);
+}
+
+// Box downscales average blocks of pixels, in place or in parallel.
+TEST_F(TextureTests, DownscaleAveragesBlocks) {
+  const vec2i kSize(256, 128);
+  const int kFactor = 4;
+  const std::vector<uint8_t> source = WriteTga(kTgaFile, kSize);
+  const vec2i expected_size = kSize / kFactor;
+  std::vector<uint8_t> expected;
+  for (int y = 0; y < expected_size.y(); ++y) {
+    for (int x = 0; x < expected_size.x(); ++x) {
+      for (int c = 0; c < 4; ++c) {
+        int sum = 0;
+        for (int by = 0; by < kFactor; ++by) {
+          for (int bx = 0; bx < kFactor; ++bx) {
+            sum += source[((y * kFactor + by) * kSize.x() + x * kFactor + bx) *
+                              4 + c];
+          }
+        }
+        const int area = kFactor * kFactor;
+        expected.push_back(static_cast<uint8_t>((sum + area / 2) / area));
+      }
+    }
+  }
+
+  fplbase::SetParallelForThreadCount(4);
+  const fplbase::TextureFlags kFlags[] = {
+      fplbase::kTextureFlagsBoxDownscale,
+      fplbase::kTextureFlagsBoxDownscale |
+          fplbase::kTextureFlagsParallelDecode};
+  for (size_t i = 0; i < sizeof(kFlags) / sizeof(kFlags[0]); ++i) {
+    vec2i size;
+    double ms = 0.0;
+    uint8_t *pixels = Decode(vec2(1.0f / kFactor), kFlags[i], &size, &ms);
+    ASSERT_NE(nullptr, pixels);
+    EXPECT_EQ(expected_size, size);
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), pixels));
+    free(pixels);
+  }
+}
+
+// Downscaling by 4 only keeps a sixteenth of the decoded pixels.
+TEST_F(TextureTests, DownscaleBenchmark) {
+  const vec2i kSize(4096, 2048);
+  WriteTga(kTgaFile, kSize);
+  vec2i size;
+  double ms = 0.0;
+  uint8_t *pixels =
+      Decode(vec2(0.25f), fplbase::kTextureFlagsBoxDownscale, &size, &ms);
+  ASSERT_NE(nullptr, pixels);
+  EXPECT_EQ(kSize / 4, size);
+  free(pixels);
+  printf("Decode and downscale %dx%d by 4: %.1f ms\n", kSize.x(), kSize.y(),
+         ms);
+}
+
+// PackKTX() writes every mip level, and every face of cubemaps, converted to
+// the desired format.
+TEST_F(TextureTests, PackKTXBuildsMipChains) {
+  struct Case {
+    vec2i size;
+    fplbase::TextureFlags flags;
+    uint32_t faces;
+    std::vector<uint32_t> level_sizes;
+  };
+  const auto kCubeMipFlags = static_cast<fplbase::TextureFlags>(
+      fplbase::kTextureFlagsUseMipMaps | fplbase::kTextureFlagsIsCubeMap);
+  // 565 rows are padded to 4 bytes.
+  const Case kCases[] = {
+      {vec2i(6, 3), fplbase::kTextureFlagsNone, 1, {12 * 3}},
+      {vec2i(6, 3), fplbase::kTextureFlagsUseMipMaps, 1, {12 * 3, 8, 4}},
+      {vec2i(4, 24), kCubeMipFlags, 6, {8 * 4, 4 * 2, 4}},
+  };
+  for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); ++i) {
+    const Case &c = kCases[i];
+    // Opaque white, so every 565 pixel is 0xffff.
+    std::vector<uint8_t> pixels(c.size.x() * c.size.y() * 4, 0xff);
+    std::string ktx;
+    ASSERT_TRUE(Texture::PackKTX(pixels.data(), c.size, fplbase::kFormat8888,
+                                 fplbase::kFormat565, c.flags, &ktx));
+    uint32_t header[16];
+    ASSERT_GE(ktx.size(), sizeof(header));
+    memcpy(header, ktx.data(), sizeof(header));
+    EXPECT_EQ(0x04030201u, header[3]);
+    EXPECT_EQ(static_cast<uint32_t>(c.size.x()), header[9]);
+    EXPECT_EQ(static_cast<uint32_t>(c.size.y()) / c.faces, header[10]);
+    EXPECT_EQ(c.faces, header[13]);
+    EXPECT_EQ(c.level_sizes.size(), header[14]);
+    size_t offset = sizeof(header);
+    for (size_t level = 0; level < c.level_sizes.size(); ++level) {
+      uint32_t level_size = 0;
+      memcpy(&level_size, ktx.data() + offset, sizeof(level_size));
+      EXPECT_EQ(c.level_sizes[level], level_size);
+      offset += sizeof(level_size);
+      EXPECT_EQ(0xff, static_cast<uint8_t>(ktx[offset]));
+      offset += level_size * c.faces;
+    }
+    EXPECT_EQ(ktx.size(), offset);
+  }
+  // Only 888 and 8888 pixels can be packed.
+  std::string ktx;
+  uint8_t pixel[4] = {0};
+  EXPECT_FALSE(Texture::PackKTX(pixel, vec2i(1, 1), fplbase::kFormatLuminance,
+                                fplbase::kFormatAuto,
+                                fplbase::kTextureFlagsNone, &ktx));
+}
+
+// Square layers stacked vertically become the layers of a KTX array, each
+// level holding all layers in order.
+TEST_F(TextureTests, PackKTXBuildsArrays) {
+  const int kLayers = 3;
+  const vec2i size(4, 4 * kLayers);
+  std::vector<uint8_t> pixels(size.x() * size.y() * 4);
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    pixels[i] = static_cast<uint8_t>(i / (pixels.size() / kLayers) + 1);
+  }
+  std::string ktx;
+  ASSERT_TRUE(Texture::PackKTX(
+      pixels.data(), size, fplbase::kFormat8888, fplbase::kFormat8888,
+      fplbase::kTextureFlagsUseMipMaps | fplbase::kTextureFlagsIsArray, &ktx));
+  uint32_t header[16];
+  ASSERT_GE(ktx.size(), sizeof(header));
+  memcpy(header, ktx.data(), sizeof(header));
+  EXPECT_EQ(4u, header[9]);
+  EXPECT_EQ(4u, header[10]);
+  EXPECT_EQ(static_cast<uint32_t>(kLayers), header[12]);
+  EXPECT_EQ(1u, header[13]);
+  EXPECT_EQ(3u, header[14]);
+  const uint32_t kLayerSizes[] = {4 * 4 * 4, 2 * 2 * 4, 4};
+  size_t offset = sizeof(header);
+  for (size_t level = 0; level < 3; ++level) {
+    uint32_t level_size = 0;
+    memcpy(&level_size, ktx.data() + offset, sizeof(level_size));
+    EXPECT_EQ(kLayerSizes[level] * kLayers, level_size);
+    offset += sizeof(level_size);
+    for (int layer = 0; layer < kLayers; ++layer) {
+      EXPECT_EQ(layer + 1, ktx[offset + layer * kLayerSizes[level]]);
+    }
+    offset += level_size;
+  }
+  EXPECT_EQ(ktx.size(), offset);
+  // Layers must be square.
+  EXPECT_FALSE(Texture::PackKTX(pixels.data(), vec2i(4, 6),
+                                fplbase::kFormat8888, fplbase::kFormat8888,
+                                fplbase::kTextureFlagsIsArray, &ktx));
+}
+
+// The memory of KTX textures comes from the levels in the file, as their
+// format is only known from its header.
+TEST_F(TextureTests, KTXMemoryUsageCountsLevels) {
+  static const char kKtxFile[] = "texture_test_image.ktx";
+  const vec2i size(8, 8);
+  std::vector<uint8_t> pixels(size.x() * size.y() * 4, 0x80);
+  std::string ktx;
+  ASSERT_TRUE(Texture::PackKTX(pixels.data(), size, fplbase::kFormat8888,
+                               fplbase::kFormat8888,
+                               fplbase::kTextureFlagsUseMipMaps, &ktx));
+  ASSERT_TRUE(fplbase::SaveFile(kKtxFile, ktx));
+
+  fplbase::Renderer renderer;
+  Texture texture(kKtxFile, fplbase::kFormatAuto,
+                  fplbase::kTextureFlagsUseMipMaps);
+  texture.Load();
+  EXPECT_EQ(fplbase::kFormatKTX, texture.format());
+  EXPECT_EQ((8 * 8 + 4 * 4 + 2 * 2 + 1) * 4u,
+            texture.MemoryUsage().cpu_bytes);
+  remove(kKtxFile);
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
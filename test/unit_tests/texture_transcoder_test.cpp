@@ -0,0 +1,309 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "fplbase/renderer.h"
+#include "fplbase/texture.h"
+#include "fplbase/texture_transcoder.h"
+#include "fplbase/utilities.h"
+#include "gtest/gtest.h"
+#include "mathfu/glsl_mappings.h"
+
+using fplbase::TranscodeETC1S;
+using mathfu::vec2i;
+
+class TextureTranscoderTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() { srand(1234); }
+};
+
+// Returns RGB pixels of gradients with a little noise.
+static std::vector<uint8_t> MakeImage(const vec2i &size) {
+  std::vector<uint8_t> pixels(static_cast<size_t>(size.x()) * size.y() * 3);
+  for (int y = 0; y < size.y(); ++y) {
+    for (int x = 0; x < size.x(); ++x) {
+      uint8_t *p = &pixels[(static_cast<size_t>(y) * size.x() + x) * 3];
+      p[0] = static_cast<uint8_t>(x * 2 + y);
+      p[1] = static_cast<uint8_t>(128 + x - y);
+      p[2] = static_cast<uint8_t>(y * 3 + rand() % 8);
+    }
+  }
+  return pixels;
+}
+
+// Returns the average absolute difference between two images.
+static double MeanError(const uint8_t *a, const uint8_t *b, size_t size) {
+  double sum = 0;
+  for (size_t i = 0; i < size; ++i) sum += abs(a[i] - b[i]);
+  return sum / size;
+}
+
+static uint32_t ReadBits(const uint8_t *block, int position, int count) {
+  uint32_t value = 0;
+  for (int i = 0; i < count; ++i, ++position) {
+    value |= ((block[position >> 3] >> (position & 7)) & 1u) << i;
+  }
+  return value;
+}
+
+// Decodes the one kind of ASTC block the transcoder writes: a 4x4 grid of 2
+// bit weights, one partition, direct RGB endpoints stored as bytes.
+static void DecodeASTCBlock(const uint8_t *block, uint8_t *rgb) {
+  ASSERT_EQ(0x42u, ReadBits(block, 0, 11));
+  ASSERT_EQ(0u, ReadBits(block, 11, 2));
+  ASSERT_EQ(8u, ReadBits(block, 13, 4));
+  static const int kWeights[4] = {0, 21, 43, 64};
+  for (int i = 0; i < 16; ++i) {
+    // Weight bits are stored in reverse from the top of the block.
+    const int position = 127 - i * 2;
+    const int weight = kWeights[ReadBits(block, position, 1) |
+                                ReadBits(block, position - 1, 1) << 1];
+    for (int c = 0; c < 3; ++c) {
+      const int e0 = ReadBits(block, 17 + c * 16, 8);
+      const int e1 = ReadBits(block, 25 + c * 16, 8);
+      rgb[i * 3 + c] =
+          static_cast<uint8_t>((e0 * (64 - weight) + e1 * weight + 32) / 64);
+    }
+  }
+}
+
+static void Encode(const vec2i &size, std::vector<uint8_t> *pixels,
+                   std::string *file) {
+  *pixels = MakeImage(size);
+  fplbase::EncodeETC1S(pixels->data(), size, 3, file);
+  const size_t blocks = ((size.x() + 3) / 4) * ((size.y() + 3) / 4);
+  EXPECT_EQ(fplbase::kETC1SHeaderSize + blocks * fplbase::kETC1SBlockSize,
+            file->size());
+}
+
+// Decoding ETC1S should give back an image close to the one encoded.
+TEST_F(TextureTranscoderTests, EncodeDecodeRoundTrip) {
+  const vec2i size(64, 32);
+  std::vector<uint8_t> pixels;
+  std::string file;
+  Encode(size, &pixels, &file);
+
+  vec2i dimensions;
+  uint8_t *rgb = TranscodeETC1S(file.data(), file.size(), fplbase::kFormat888,
+                                &dimensions);
+  ASSERT_NE(nullptr, rgb);
+  EXPECT_EQ(size, dimensions);
+  EXPECT_LT(MeanError(pixels.data(), rgb, pixels.size()), 6.0);
+  free(rgb);
+}
+
+// Sizes that aren't a multiple of the block size are cropped when decoded.
+TEST_F(TextureTranscoderTests, PartialBlocks) {
+  const vec2i size(13, 7);
+  std::vector<uint8_t> pixels;
+  std::string file;
+  Encode(size, &pixels, &file);
+
+  vec2i dimensions;
+  uint8_t *rgb = TranscodeETC1S(file.data(), file.size(), fplbase::kFormat888,
+                                &dimensions);
+  ASSERT_NE(nullptr, rgb);
+  EXPECT_EQ(size, dimensions);
+  EXPECT_LT(MeanError(pixels.data(), rgb, pixels.size()), 6.0);
+  free(rgb);
+}
+
+// The PKM output holds the ETC1S blocks as they are, which any ETC1 decoder
+// turns into the same pixels as the 888 output.
+TEST_F(TextureTranscoderTests, PKMMatchesDecodedPixels) {
+  const vec2i size(32, 16);
+  std::vector<uint8_t> pixels;
+  std::string file;
+  Encode(size, &pixels, &file);
+
+  vec2i dimensions;
+  uint8_t *pkm = TranscodeETC1S(file.data(), file.size(), fplbase::kFormatPKM,
+                                &dimensions);
+  uint8_t *rgb = TranscodeETC1S(file.data(), file.size(), fplbase::kFormat888,
+                                &dimensions);
+  ASSERT_NE(nullptr, pkm);
+  ASSERT_NE(nullptr, rgb);
+  EXPECT_EQ(0, memcmp(pkm, "PKM 20", 6));
+  EXPECT_EQ(size.x(), pkm[12] << 8 | pkm[13]);
+  EXPECT_EQ(size.y(), pkm[14] << 8 | pkm[15]);
+  const size_t data_size = file.size() - fplbase::kETC1SHeaderSize;
+  EXPECT_EQ(0, memcmp(pkm + 16, file.data() + fplbase::kETC1SHeaderSize,
+                      data_size));
+
+  uint8_t block[16 * 3];
+  for (int by = 0; by < size.y() / 4; ++by) {
+    for (int bx = 0; bx < size.x() / 4; ++bx) {
+      fplbase::DecodeETC1Block(pkm + 16 + (by * size.x() / 4 + bx) * 8,
+                               block);
+      for (int y = 0; y < 4; ++y) {
+        const uint8_t *row = rgb + ((by * 4 + y) * size.x() + bx * 4) * 3;
+        EXPECT_EQ(0, memcmp(block + y * 12, row, 12));
+      }
+    }
+  }
+  free(pkm);
+  free(rgb);
+}
+
+// The 565 output is the 888 output with the low bits dropped.
+TEST_F(TextureTranscoderTests, RGB565MatchesRGB888) {
+  const vec2i size(16, 16);
+  std::vector<uint8_t> pixels;
+  std::string file;
+  Encode(size, &pixels, &file);
+
+  vec2i dimensions;
+  uint8_t *rgb565 = TranscodeETC1S(file.data(), file.size(),
+                                   fplbase::kFormat565, &dimensions);
+  uint8_t *rgb888 = TranscodeETC1S(file.data(), file.size(),
+                                   fplbase::kFormat888, &dimensions);
+  ASSERT_NE(nullptr, rgb565);
+  ASSERT_NE(nullptr, rgb888);
+  auto packed = reinterpret_cast<const uint16_t *>(rgb565);
+  for (int i = 0; i < size.x() * size.y(); ++i) {
+    const uint8_t *c = rgb888 + i * 3;
+    EXPECT_EQ((c[0] >> 3) << 11 | (c[1] >> 2) << 5 | c[2] >> 3, packed[i]);
+  }
+  free(rgb565);
+  free(rgb888);
+}
+
+// Loading an .etc1s file transcodes it into the uncompressed format asked
+// for, rather than whatever compressed format the GPU supports.
+TEST_F(TextureTranscoderTests, LoadHonorsDesiredFormat) {
+  static const char kFilename[] = "texture_transcoder_test.etc1s";
+  const vec2i size(16, 8);
+  std::vector<uint8_t> pixels;
+  std::string file;
+  Encode(size, &pixels, &file);
+  ASSERT_TRUE(fplbase::SaveFile(kFilename, file));
+  fplbase::Renderer renderer;
+
+  static const fplbase::TextureFormat kFormats[] = {fplbase::kFormat565,
+                                                    fplbase::kFormat888};
+  for (size_t i = 0; i < sizeof(kFormats) / sizeof(kFormats[0]); ++i) {
+    vec2i dimensions;
+    fplbase::TextureFormat format = fplbase::kFormatAuto;
+    uint8_t *loaded = fplbase::Texture::LoadAndUnpackTexture(
+        kFilename, mathfu::kOnes2f, &dimensions, &format,
+        fplbase::kTextureFlagsNone, kFormats[i]);
+    ASSERT_NE(nullptr, loaded);
+    EXPECT_EQ(kFormats[i], format);
+    EXPECT_EQ(size, dimensions);
+    uint8_t *expected =
+        TranscodeETC1S(file.data(), file.size(), kFormats[i], &dimensions);
+    ASSERT_NE(nullptr, expected);
+    const size_t bytes_per_pixel = kFormats[i] == fplbase::kFormat565 ? 2 : 3;
+    EXPECT_EQ(0, memcmp(expected, loaded,
+                        size.x() * size.y() * bytes_per_pixel));
+    free(expected);
+    free(loaded);
+  }
+  remove(kFilename);
+}
+
+// ASTC weights can't place the four ETC1S colors exactly, but should come
+// close to them.
+TEST_F(TextureTranscoderTests, ASTCApproximatesETC1S) {
+  const vec2i size(64, 64);
+  std::vector<uint8_t> pixels;
+  std::string file;
+  Encode(size, &pixels, &file);
+
+  vec2i dimensions;
+  uint8_t *astc = TranscodeETC1S(file.data(), file.size(),
+                                 fplbase::kFormatASTC, &dimensions);
+  uint8_t *rgb = TranscodeETC1S(file.data(), file.size(), fplbase::kFormat888,
+                                &dimensions);
+  ASSERT_NE(nullptr, astc);
+  ASSERT_NE(nullptr, rgb);
+  static const uint8_t magic[] = {0x13, 0xab, 0xa1, 0x5c, 4, 4, 1};
+  EXPECT_EQ(0, memcmp(astc, magic, sizeof(magic)));
+  EXPECT_EQ(size.x(), astc[7] | astc[8] << 8 | astc[9] << 16);
+  EXPECT_EQ(size.y(), astc[10] | astc[11] << 8 | astc[12] << 16);
+
+  std::vector<uint8_t> decoded(pixels.size());
+  uint8_t block[16 * 3];
+  for (int by = 0; by < size.y() / 4; ++by) {
+    for (int bx = 0; bx < size.x() / 4; ++bx) {
+      DecodeASTCBlock(astc + 16 + (by * size.x() / 4 + bx) * 16, block);
+      for (int y = 0; y < 4; ++y) {
+        memcpy(&decoded[((by * 4 + y) * size.x() + bx * 4) * 3],
+               block + y * 12, 12);
+      }
+    }
+  }
+  EXPECT_LT(MeanError(rgb, decoded.data(), decoded.size()), 4.0);
+  EXPECT_LT(MeanError(pixels.data(), decoded.data(), decoded.size()), 8.0);
+  free(astc);
+  free(rgb);
+}
+
+TEST_F(TextureTranscoderTests, RejectsMalformedFiles) {
+  const vec2i size(8, 8);
+  std::vector<uint8_t> pixels;
+  std::string file;
+  Encode(size, &pixels, &file);
+
+  vec2i dimensions;
+  // Truncated.
+  EXPECT_EQ(nullptr, TranscodeETC1S(file.data(), file.size() - 1,
+                                    fplbase::kFormat888, &dimensions));
+  // Unsupported target.
+  EXPECT_EQ(nullptr, TranscodeETC1S(file.data(), file.size(),
+                                    fplbase::kFormatKTX, &dimensions));
+  // Wrong magic.
+  file[0] = 'X';
+  EXPECT_EQ(nullptr, TranscodeETC1S(file.data(), file.size(),
+                                    fplbase::kFormat888, &dimensions));
+}
+
+// Prints how fast each target is transcoded, to compare against decoding the
+// same image from WebP or PNG.
+TEST_F(TextureTranscoderTests, TranscodeBenchmark) {
+  const vec2i size(1024, 1024);
+  std::vector<uint8_t> pixels;
+  std::string file;
+  Encode(size, &pixels, &file);
+
+  static const fplbase::TextureFormat kTargets[] = {
+      fplbase::kFormatPKM, fplbase::kFormatASTC, fplbase::kFormat565,
+      fplbase::kFormat888};
+  static const char *kTargetNames[] = {"PKM", "ASTC", "565", "888"};
+  for (size_t i = 0; i < sizeof(kTargets) / sizeof(kTargets[0]); ++i) {
+    vec2i dimensions;
+    auto start = std::chrono::steady_clock::now();
+    uint8_t *buf =
+        TranscodeETC1S(file.data(), file.size(), kTargets[i], &dimensions);
+    std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - start;
+    ASSERT_NE(nullptr, buf);
+    free(buf);
+    printf("%s: %.1f megapixels/s\n", kTargetNames[i],
+           size.x() * size.y() / 1e6 / seconds.count());
+  }
+}
+
+extern "C" int FPL_main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,533 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "fplbase/parallel_for.h"
+#include "fplbase/texture.h"
+#include "fplbase/utilities.h"
+
+// The stdlib build of fplbase leaves the STB implementations to the
+// application.
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb_image.h"
+#include "stb_image_resize.h"
+
+using fplbase::Texture;
+using fplbase::TextureFormat;
+using mathfu::vec2i;
+
+// GL enums found in the KTX headers this tool writes. They are spelled out
+// here because this tool doesn't include GL headers.
+static const uint32_t kGLUnsignedByte = 0x1401;
+static const uint32_t kGLRGB = 0x1907;
+static const uint32_t kGLRGBA = 0x1908;
+static const uint32_t kGLUnsignedShort5551 = 0x8034;
+static const uint32_t kGLUnsignedShort565 = 0x8363;
+
+static const int kCubeMapFaces = 6;
+
+// Matches the KTXHeader that Texture::UnpackKTX() reads.
+struct KTXHeader {
+  char id[12];
+  uint32_t endian;
+  uint32_t type;
+  uint32_t type_size;
+  uint32_t format;
+  uint32_t internal_format;
+  uint32_t base_internal_format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t depth;
+  uint32_t array_elements;
+  uint32_t faces;
+  uint32_t mip_levels;
+  uint32_t keyvalue_data;
+};
+
+struct TexturePipelineArgs {
+  TexturePipelineArgs()
+      : format(fplbase::kFormatAuto),
+        mips(true),
+        cube_map(false),
+        force(false),
+        threads(0) {}
+  std::vector<std::string> inputs;  /// The image files to convert.
+  std::string output_dir;           /// Where the KTX files go.
+  TextureFormat format;  /// Pixel format of the output, or kFormatAuto.
+  bool mips;             /// Write the full mip chain.
+  bool cube_map;         /// Inputs are 1x6 strips, written as cubemaps.
+  std::string array;     /// If set, all inputs are layers of this array.
+  bool force;            /// Rebuild outputs that are up to date.
+  size_t threads;        /// Thread count, or 0 for one per core.
+};
+
+// The KTX fields describing each pixel format this tool writes.
+struct KTXPixelFormat {
+  uint32_t type;
+  uint32_t format;
+};
+
+static KTXPixelFormat GetKTXPixelFormat(TextureFormat format) {
+  KTXPixelFormat ktx;
+  switch (format) {
+    case fplbase::kFormat565:
+      ktx.type = kGLUnsignedShort565;
+      ktx.format = kGLRGB;
+      break;
+    case fplbase::kFormat5551:
+      ktx.type = kGLUnsignedShort5551;
+      ktx.format = kGLRGBA;
+      break;
+    case fplbase::kFormat888:
+      ktx.type = kGLUnsignedByte;
+      ktx.format = kGLRGB;
+      break;
+    default:
+      assert(format == fplbase::kFormat8888);
+      ktx.type = kGLUnsignedByte;
+      ktx.format = kGLRGBA;
+      break;
+  }
+  return ktx;
+}
+
+static bool ParseTextureFormat(const std::string &name, TextureFormat *format) {
+  static const struct {
+    const char *name;
+    TextureFormat format;
+  } kFormats[] = {
+      {"auto", fplbase::kFormatAuto}, {"565", fplbase::kFormat565},
+      {"5551", fplbase::kFormat5551}, {"888", fplbase::kFormat888},
+      {"8888", fplbase::kFormat8888},
+  };
+  for (size_t i = 0; i < sizeof(kFormats) / sizeof(kFormats[0]); ++i) {
+    if (name == kFormats[i].name) {
+      *format = kFormats[i].format;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool ParseTexturePipelineArgs(int argc, char **argv,
+                                     TexturePipelineArgs *args) {
+  bool valid_args = true;
+
+  // Parse switches.
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+
+    // -o switch
+    if (arg == "-o" || arg == "--output-dir") {
+      if (i < argc - 1) {
+        ++i;
+        args->output_dir = std::string(argv[i]);
+      } else {
+        valid_args = false;
+      }
+
+      // -f switch
+    } else if (arg == "-f" || arg == "--format") {
+      if (i < argc - 1) {
+        ++i;
+        if (!ParseTextureFormat(argv[i], &args->format)) valid_args = false;
+      } else {
+        valid_args = false;
+      }
+
+      // -n switch
+    } else if (arg == "-n" || arg == "--no-mips") {
+      args->mips = false;
+
+      // -c switch
+    } else if (arg == "-c" || arg == "--cube-map") {
+      args->cube_map = true;
+
+      // -a switch
+    } else if (arg == "-a" || arg == "--array") {
+      if (i < argc - 1) {
+        ++i;
+        args->array = std::string(argv[i]);
+      } else {
+        valid_args = false;
+      }
+
+      // -r switch
+    } else if (arg == "-r" || arg == "--rebuild") {
+      args->force = true;
+
+      // -j switch
+    } else if (arg == "-j" || arg == "--threads") {
+      if (i < argc - 1) {
+        ++i;
+        const int threads = atoi(argv[i]);
+        if (threads < 0) valid_args = false;
+        args->threads = static_cast<size_t>(threads);
+      } else {
+        valid_args = false;
+      }
+
+      // all other (non-empty) arguments are inputs
+    } else if (arg != "" && arg[0] == '-') {
+      printf("Unknown parameter: %s\n", arg.c_str());
+      valid_args = false;
+    } else if (arg != "") {
+      args->inputs.push_back(arg);
+    }
+
+    if (!valid_args) break;
+  }
+
+  if (args->inputs.empty()) valid_args = false;
+  if (args->cube_map && !args->array.empty()) valid_args = false;
+
+  // Print usage.
+  if (!valid_args) {
+    printf(
+        "Usage: texture_pipeline [options] IMAGE...\n"
+        "\n"
+        "Pipeline to convert images (tga, png, jpg, webp) into KTX files\n"
+        "that Texture uploads without any conversion at load time. Each\n"
+        "IMAGE is written next to itself, or into the output directory, with\n"
+        "a .ktx extension. Images whose KTX file is newer and was written\n"
+        "with the same options are skipped.\n"
+        "\n"
+        "Options:\n"
+        "  -o, --output-dir DIR       Directory for the KTX files.\n"
+        "  -f, --format FORMAT        auto, 565, 5551, 888 or 8888. auto\n"
+        "                             (the default) picks 5551 for images\n"
+        "                             with alpha and 565 otherwise, like\n"
+        "                             Texture does at load time.\n"
+        "  -n, --no-mips              Only write the full size image.\n"
+        "  -c, --cube-map             Images are cubemaps in a vertical 1x6\n"
+        "                             strip. They are written as KTX\n"
+        "                             cubemaps with mips for every face.\n"
+        "  -a, --array NAME           Write all images, in order, as the\n"
+        "                             layers of one KTX texture array,\n"
+        "                             NAME.ktx. They must be square, and\n"
+        "                             share their size and channels.\n"
+        "                             Materials that load it share one\n"
+        "                             texture, and pick their layer with\n"
+        "                             texture_layer. The layers are\n"
+        "                             listed in NAME.ktx.layers, so\n"
+        "                             reordering them rebuilds it.\n"
+        "  -r, --rebuild              Rebuild all images.\n"
+        "  -j, --threads COUNT        Threads to use (default: all cores).\n");
+  }
+
+  return valid_args;
+}
+
+// Returns the file name without its directory and extension.
+static std::string BaseName(const std::string &filename) {
+  const size_t slash = filename.find_last_of("/\\");
+  std::string name =
+      slash == std::string::npos ? filename : filename.substr(slash + 1);
+  const size_t dot = name.find_last_of('.');
+  return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// Returns the file name without its extension.
+static std::string RemoveExtension(const std::string &filename) {
+  const size_t dot = filename.find_last_of('.');
+  const size_t slash = filename.find_last_of("/\\");
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return filename;
+  }
+  return filename.substr(0, dot);
+}
+
+static std::string OutputFile(const std::string &input,
+                              const TexturePipelineArgs &args) {
+  if (!args.array.empty()) {
+    return args.output_dir.empty() ? args.array + ".ktx"
+                                   : args.output_dir + "/" + args.array +
+                                         ".ktx";
+  }
+  if (args.output_dir.empty()) return RemoveExtension(input) + ".ktx";
+  return args.output_dir + "/" + BaseName(input) + ".ktx";
+}
+
+// Returns the modification time in `info`, in nanoseconds where the
+// platform records them, so files written within a second of each other are
+// still ordered.
+static long long ModificationTime(const struct stat &info) {
+  long long nanoseconds = 0;
+#if defined(__APPLE__)
+  nanoseconds = info.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+  nanoseconds = info.st_mtim.tv_nsec;
+#endif
+  return static_cast<long long>(info.st_mtime) * 1000000000LL + nanoseconds;
+}
+
+// Returns true if `output` is newer than `input`, and its header says it was
+// written with the options in `args`.
+static bool IsUpToDate(const std::string &input, const std::string &output,
+                       const TexturePipelineArgs &args) {
+  struct stat input_stat;
+  struct stat output_stat;
+  if (stat(input.c_str(), &input_stat) != 0 ||
+      stat(output.c_str(), &output_stat) != 0 ||
+      ModificationTime(output_stat) < ModificationTime(input_stat)) {
+    return false;
+  }
+  FILE *file = fopen(output.c_str(), "rb");
+  if (!file) return false;
+  KTXHeader header;
+  const bool read = fread(&header, sizeof(header), 1, file) == 1;
+  fclose(file);
+  if (!read) return false;
+  const uint32_t layers =
+      args.array.empty() ? 0 : static_cast<uint32_t>(args.inputs.size());
+  if ((header.mip_levels > 1) != args.mips ||
+      header.faces != (args.cube_map ? kCubeMapFaces : 1u) ||
+      header.array_elements != layers) {
+    return false;
+  }
+  if (args.format == fplbase::kFormatAuto) {
+    return header.type == kGLUnsignedShort565 ||
+           header.type == kGLUnsignedShort5551;
+  }
+  const KTXPixelFormat ktx = GetKTXPixelFormat(args.format);
+  return header.type == ktx.type && header.format == ktx.format;
+}
+
+// Returns true if any pixel of an RGBA image isn't opaque.
+static bool HasTransparency(const uint8_t *image, const vec2i &size) {
+  const size_t num_pixels = static_cast<size_t>(size.x()) * size.y();
+  for (size_t i = 0; i < num_pixels; ++i) {
+    if (image[i * 4 + 3] != 255) return true;
+  }
+  return false;
+}
+
+// Writes `ktx` to `output`. Writes to a temporary file first, so an
+// interrupted run never leaves a partial file that looks up to date.
+static bool WriteKTX(const std::string &ktx, const std::string &output) {
+  const std::string temp_file = output + ".tmp";
+  FILE *file = fopen(temp_file.c_str(), "wb");
+  if (!file) {
+    printf("Could not open %s for writing.\n", temp_file.c_str());
+    return false;
+  }
+  const bool written = fwrite(ktx.data(), 1, ktx.size(), file) == ktx.size();
+  fclose(file);
+  remove(output.c_str());
+  if (!written || rename(temp_file.c_str(), output.c_str()) != 0) {
+    printf("Could not write %s.\n", output.c_str());
+    remove(temp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Converts one image into a KTX file. With `parallel_mips`, the faces of a
+// cubemap, or the rows of each mip level otherwise, are split over threads.
+static bool ConvertTexture(const std::string &input, const std::string &output,
+                           const TexturePipelineArgs &args,
+                           bool parallel_mips) {
+  vec2i size;
+  TextureFormat image_format;
+  uint8_t *image = Texture::LoadAndUnpackTexture(
+      input.c_str(), mathfu::kOnes2f, &size, &image_format);
+  if (!image) {
+    printf("Unable to load image: %s\n", input.c_str());
+    return false;
+  }
+  TextureFormat format = args.format;
+  if (format == fplbase::kFormatAuto) {
+    format = image_format == fplbase::kFormat8888 &&
+                     HasTransparency(image, size)
+                 ? fplbase::kFormat5551
+                 : fplbase::kFormat565;
+  }
+  if (args.cube_map && size.x() * kCubeMapFaces != size.y()) {
+    printf("%s: cubemap not in 1x6 format: (%d,%d)\n", input.c_str(),
+           size.x(), size.y());
+    free(image);
+    return false;
+  }
+  const int flags =
+      (args.mips ? fplbase::kTextureFlagsUseMipMaps : 0) |
+      (args.cube_map ? fplbase::kTextureFlagsIsCubeMap : 0) |
+      (parallel_mips ? fplbase::kTextureFlagsParallelDecode : 0);
+  std::string ktx;
+  const bool packed =
+      Texture::PackKTX(image, size, image_format, format,
+                       static_cast<fplbase::TextureFlags>(flags), &ktx);
+  free(image);
+  if (!packed) {
+    printf("%s: can't convert to the requested format.\n", input.c_str());
+    return false;
+  }
+  return WriteKTX(ktx, output);
+}
+
+// The file next to an array's KTX file that lists the inputs it was built
+// from, in layer order. Reordering or renaming layers doesn't change any
+// file's time, so this is how such changes are found.
+static std::string LayersFile(const std::string &output) {
+  return output + ".layers";
+}
+
+static std::string LayerList(const TexturePipelineArgs &args) {
+  std::string list;
+  for (size_t i = 0; i < args.inputs.size(); ++i) {
+    list += args.inputs[i] + "\n";
+  }
+  return list;
+}
+
+// Returns true if the array `output` was last built from the layers in
+// `args`, in the same order.
+static bool LayersMatch(const std::string &output,
+                        const TexturePipelineArgs &args) {
+  std::string list;
+  return fplbase::LoadFile(LayersFile(output).c_str(), &list) &&
+         list == LayerList(args);
+}
+
+// Stacks all inputs into the layers of one KTX texture array.
+static bool ConvertTextureArray(const std::string &output,
+                                const TexturePipelineArgs &args) {
+  std::vector<uint8_t> layers;
+  vec2i layer_size;
+  TextureFormat layer_format = fplbase::kFormatAuto;
+  bool transparent = false;
+  for (size_t i = 0; i < args.inputs.size(); ++i) {
+    const std::string &input = args.inputs[i];
+    vec2i size;
+    TextureFormat image_format;
+    uint8_t *image = Texture::LoadAndUnpackTexture(
+        input.c_str(), mathfu::kOnes2f, &size, &image_format);
+    if (!image) {
+      printf("Unable to load image: %s\n", input.c_str());
+      return false;
+    }
+    if (i == 0) {
+      layer_size = size;
+      layer_format = image_format;
+    }
+    // Texture finds the layers of a strip by their square shape.
+    if (size.x() != size.y() || size != layer_size ||
+        image_format != layer_format) {
+      printf("%s: layers must be square, and match %s\n", input.c_str(),
+             args.inputs[0].c_str());
+      free(image);
+      return false;
+    }
+    transparent = transparent || (image_format == fplbase::kFormat8888 &&
+                                  HasTransparency(image, size));
+    const size_t bytes = static_cast<size_t>(size.x()) * size.y() *
+                         (image_format == fplbase::kFormat8888 ? 4 : 3);
+    layers.insert(layers.end(), image, image + bytes);
+    free(image);
+  }
+  TextureFormat format = args.format;
+  if (format == fplbase::kFormatAuto) {
+    format = transparent ? fplbase::kFormat5551 : fplbase::kFormat565;
+  }
+  // Layers are built in parallel, like the faces of a cubemap.
+  const int flags = (args.mips ? fplbase::kTextureFlagsUseMipMaps : 0) |
+                    fplbase::kTextureFlagsIsArray |
+                    fplbase::kTextureFlagsParallelDecode;
+  const vec2i size(layer_size.x(),
+                   layer_size.y() * static_cast<int>(args.inputs.size()));
+  std::string ktx;
+  if (!Texture::PackKTX(layers.data(), size, layer_format, format,
+                        static_cast<fplbase::TextureFlags>(flags), &ktx)) {
+    printf("%s: can't convert to the requested format.\n", output.c_str());
+    return false;
+  }
+  return WriteKTX(ktx, output);
+}
+
+int main(int argc, char **argv) {
+  // Parse the command line arguments.
+  TexturePipelineArgs args;
+  if (!ParseTexturePipelineArgs(argc, argv, &args)) {
+    return 1;
+  }
+  fplbase::SetParallelForThreadCount(args.threads);
+
+  // An array is one output, stale if any of its layers is, or they changed.
+  if (!args.array.empty()) {
+    const std::string output = OutputFile(args.array, args);
+    bool stale = args.force || !LayersMatch(output, args);
+    for (size_t i = 0; i < args.inputs.size() && !stale; ++i) {
+      stale = !IsUpToDate(args.inputs[i], output, args);
+    }
+    if (!stale) {
+      printf("%s is up to date.\n", output.c_str());
+      return 0;
+    }
+    if (!ConvertTextureArray(output, args)) return 1;
+    if (!fplbase::SaveFile(LayersFile(output).c_str(), LayerList(args))) {
+      printf("Could not write %s.\n", LayersFile(output).c_str());
+      return 1;
+    }
+    for (size_t i = 0; i < args.inputs.size(); ++i) {
+      printf("layer %d: %s\n", static_cast<int>(i), args.inputs[i].c_str());
+    }
+    printf("-> %s\n", output.c_str());
+    return 0;
+  }
+
+  // Find the images that need converting.
+  std::vector<size_t> stale;
+  for (size_t i = 0; i < args.inputs.size(); ++i) {
+    if (args.force ||
+        !IsUpToDate(args.inputs[i], OutputFile(args.inputs[i], args), args)) {
+      stale.push_back(i);
+    }
+  }
+  printf("%d of %d textures to convert.\n", static_cast<int>(stale.size()),
+         static_cast<int>(args.inputs.size()));
+
+  // Each thread takes the next image until none are left, so a few big
+  // images don't hold up the rest. With fewer images than threads, the
+  // spare threads work on the mip levels of each image instead.
+  const size_t threads = fplbase::ParallelForThreadCount();
+  const bool parallel_mips = stale.size() < threads;
+  std::atomic<size_t> next_image(0);
+  std::atomic<int> failures(0);
+  fplbase::ParallelFor(std::min(threads, stale.size()), 1,
+                       [&](size_t, size_t) {
+                         for (size_t i = next_image++; i < stale.size();
+                              i = next_image++) {
+                           const std::string &input = args.inputs[stale[i]];
+                           const std::string output = OutputFile(input, args);
+                           if (ConvertTexture(input, output, args,
+                                              parallel_mips)) {
+                             printf("%s -> %s\n", input.c_str(),
+                                    output.c_str());
+                           } else {
+                             ++failures;
+                           }
+                         }
+                       });
+  return failures ? 1 : 0;
+}